@@ -0,0 +1,448 @@
+#include "MeiMei/MeiMei.h"
+#include "cfg.h"
+#include "config.h"
+#include "iohandler.h"
+#include "json.h"
+#include "json/base64.h"
+#include "listfile.h"
+#include "lmdata.h"
+#include "map16.h"
+#include "metacache.h"
+#include "rats.h"
+#include "registry.h"
+#include "structs.h"
+#include <algorithm>
+#include <array>
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+extern PixiConfig cfg;
+
+// every input is either one of the unit test files or generated from a fixed seed, so runs are comparable
+namespace {
+
+struct lcg {
+    uint32_t state = 0x50495849; // "PIXI"
+    uint32_t next() {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+};
+
+void write_file(const fs::path& path, const std::string& contents) {
+    std::ofstream file{path, std::ios::trunc | std::ios::binary};
+    file << contents;
+}
+
+// the sprite folders with the unit test sprites and the two synthetic lists, created once per process
+void prepare_inputs() {
+    static bool prepared = false;
+    if (prepared)
+        return;
+    prepared = true;
+    // C0-CF are shooters and D0-FF generators
+    for (const char* dir : {"sprites", "shooters", "generators"}) {
+        fs::create_directories(dir);
+        for (const char* name : {"test.json", "test.cfg", "test.asm"}) {
+            fs::copy_file(name, fs::path{dir} / name, fs::copy_options::overwrite_existing);
+        }
+    }
+
+    // 256 global sprites, alternating between json and cfg
+    std::string global_list{};
+    for (int i = 0; i < 0x100; i++) {
+        global_list += fstring("%02X %s\n", i, i % 2 ? "test.cfg" : "test.json");
+    }
+    write_file("bench_list_global.txt", global_list);
+
+    // every per-level slot of every level plus all the global ones, 0x2100 sprites
+    std::string per_level_list{};
+    for (int level = 0; level < 0x200; level++) {
+        for (int number = 0xB0; number < 0xC0; number++) {
+            per_level_list += fstring("%03X:%02X %s\n", level, number, number % 2 ? "test.cfg" : "test.json");
+        }
+    }
+    per_level_list += global_list;
+    write_file("bench_list_perlevel.txt", per_level_list);
+}
+
+void populate(benchmark::State& state, const char* list, bool per_level) {
+    prepare_inputs();
+    cfg.reset();
+    cfg.PerLevel = per_level;
+    auto registry = std::make_unique<sprite_registry>();
+    for (auto _ : state) {
+        state.PauseTiming();
+        iohandler::init();
+        state.ResumeTiming();
+        // clearing is part of what pixi_run pays for every list it reads in a reused process
+        registry->clear();
+        if (!populate_sprite_list(cfg.GetPaths(), *registry, list, nullptr)) {
+            state.SkipWithError(iohandler::get_global().last_error().c_str());
+            break;
+        }
+    }
+    cfg.reset();
+}
+
+sprite parsed_sprite(const char* file) {
+    prepare_inputs();
+    sprite spr{};
+    spr.directory = "sprites/";
+    spr.cfg_file = std::string{"sprites/"} + file;
+    if (fs::path{file}.extension() == ".json")
+        (void)read_json_file(&spr);
+    else
+        (void)read_cfg_file(&spr);
+    return spr;
+}
+
+} // namespace
+
+static void BM_PopulateGlobalList(benchmark::State& state) {
+    populate(state, "bench_list_global.txt", false);
+}
+BENCHMARK(BM_PopulateGlobalList)->Unit(benchmark::kMillisecond);
+
+static void BM_PopulatePerLevelList(benchmark::State& state) {
+    populate(state, "bench_list_perlevel.txt", true);
+}
+BENCHMARK(BM_PopulatePerLevelList)->Unit(benchmark::kMillisecond);
+
+// tokenizing alone, without looking the sprites up or parsing their files, reported as lines per second
+static void BM_TokenizePerLevelList(benchmark::State& state) {
+    prepare_inputs();
+    std::string contents{};
+    if (!read_list_file("bench_list_perlevel.txt", contents)) {
+        state.SkipWithError("couldn't read bench_list_perlevel.txt");
+        return;
+    }
+    const auto lines = static_cast<int64_t>(std::count(contents.begin(), contents.end(), '\n'));
+    for (auto _ : state) {
+        list_tokens tokens = tokenize_list(contents, true);
+        benchmark::DoNotOptimize(tokens.entries.data());
+    }
+    state.SetItemsProcessed(state.iterations() * lines);
+}
+BENCHMARK(BM_TokenizePerLevelList);
+
+static void BM_ReadCfgFile(benchmark::State& state) {
+    prepare_inputs();
+    sprite spr{};
+    for (auto _ : state) {
+        spr.clear();
+        spr.directory = "sprites/";
+        spr.cfg_file = "sprites/test.cfg";
+        benchmark::DoNotOptimize(read_cfg_file(&spr));
+    }
+}
+BENCHMARK(BM_ReadCfgFile);
+
+static void BM_ReadJsonFile(benchmark::State& state) {
+    prepare_inputs();
+    sprite spr{};
+    for (auto _ : state) {
+        spr.clear();
+        spr.directory = "sprites/";
+        spr.cfg_file = "sprites/test.json";
+        benchmark::DoNotOptimize(read_json_file(&spr));
+    }
+}
+BENCHMARK(BM_ReadJsonFile);
+
+// the same file loaded back from a .pixicache instead of being parsed
+static void BM_RestoreCachedJson(benchmark::State& state) {
+    sprite spr = parsed_sprite("test.json");
+    MetadataCache cache{};
+    cache.begin("bench_cache.txt");
+    cache.store(&spr, {});
+    cache.save();
+    cache.begin("bench_cache.txt");
+    std::vector<std::string> warnings{};
+    for (auto _ : state) {
+        spr.clear();
+        spr.directory = "sprites/";
+        spr.cfg_file = "sprites/test.json";
+        warnings.clear();
+        benchmark::DoNotOptimize(cache.restore(&spr, warnings));
+    }
+}
+BENCHMARK(BM_RestoreCachedJson);
+
+static void BM_Base64Decode(benchmark::State& state) {
+    // map16 data is 8 bytes per tile
+    std::vector<unsigned char> data(static_cast<size_t>(state.range(0)));
+    lcg rng{};
+    for (auto& byte : data) {
+        byte = static_cast<unsigned char>(rng.next());
+    }
+    const std::string encoded = base64_encode(data);
+    std::vector<map16> tiles(data.size() / sizeof(map16));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(base64_decode(encoded, std::span{tiles}));
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(encoded.size()));
+}
+BENCHMARK(BM_Base64Decode)->RangeMultiplier(4)->Range(0x20, 0x2000);
+
+static void BM_Base64Encode(benchmark::State& state) {
+    std::vector<unsigned char> data(static_cast<size_t>(state.range(0)));
+    lcg rng{};
+    for (auto& byte : data) {
+        byte = static_cast<unsigned char>(rng.next());
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(base64_encode(data));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(data.size()));
+}
+BENCHMARK(BM_Base64Encode)->RangeMultiplier(4)->Range(0x20, 0x2000);
+
+static std::vector<int> translatable_pc_addresses(const ROM& rom) {
+    // the largest rom each mapper can address
+    const int rom_size = rom.mapper == MapperType::lorom ? 0x400000 : rom.mapper == MapperType::sa1rom ? 0x800000
+                                                                                                        : 0x600000;
+    std::vector<int> addresses{};
+    lcg rng{};
+    while (addresses.size() < 0x1000) {
+        int pc = static_cast<int>(rng.next() % rom_size);
+        if (rom.pc_to_snes(pc).raw_value() != -1)
+            addresses.push_back(pc);
+    }
+    return addresses;
+}
+
+static void BM_RatsIndexBuild(benchmark::State& state) {
+    // random data with a valid tag every 4KB, like a ROM with a lot of small insertions
+    std::vector<unsigned char> rom(static_cast<size_t>(state.range(0)) * 0x8000);
+    lcg rng{};
+    for (auto& byte : rom) {
+        byte = static_cast<unsigned char>(rng.next());
+    }
+    for (size_t pc = 0x80000; pc + 0x1000 <= rom.size(); pc += 0x1000) {
+        constexpr uint16_t size = 0x800 - 1;
+        memcpy(rom.data() + pc, "STAR", 4);
+        rom[pc + 4] = size & 0xFF;
+        rom[pc + 5] = size >> 8;
+        rom[pc + 6] = (size ^ 0xFFFF) & 0xFF;
+        rom[pc + 7] = (size ^ 0xFFFF) >> 8;
+    }
+    RatsIndex index{};
+    for (auto _ : state) {
+        index.build(rom);
+        benchmark::DoNotOptimize(index.tags().data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(rom.size()));
+}
+BENCHMARK(BM_RatsIndexBuild)->ArgName("banks")->RangeMultiplier(4)->Range(0x20, 0x200)->Unit(benchmark::kMicrosecond);
+
+static void BM_SnesToPc(benchmark::State& state) {
+    ROM rom{};
+    rom.mapper = static_cast<MapperType>(state.range(0));
+    std::vector<int> snes_addresses{};
+    for (int pc : translatable_pc_addresses(rom)) {
+        snes_addresses.push_back(rom.pc_to_snes(pc).raw_value());
+    }
+    for (auto _ : state) {
+        for (int snes : snes_addresses) {
+            benchmark::DoNotOptimize(rom.snes_to_pc(snes));
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(snes_addresses.size()));
+}
+BENCHMARK(BM_SnesToPc)->ArgName("mapper")->DenseRange(0, 2);
+
+static void BM_PcToSnes(benchmark::State& state) {
+    ROM rom{};
+    rom.mapper = static_cast<MapperType>(state.range(0));
+    const std::vector<int> pc_addresses = translatable_pc_addresses(rom);
+    for (auto _ : state) {
+        for (int pc : pc_addresses) {
+            benchmark::DoNotOptimize(rom.pc_to_snes(pc));
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(pc_addresses.size()));
+}
+BENCHMARK(BM_PcToSnes)->ArgName("mapper")->DenseRange(0, 2);
+
+static void BM_FindFreeMap(benchmark::State& state) {
+    // the first 0x3000 tiles are taken except for a few scattered single holes, like a well used s16
+    std::vector<map16> map(MAP16_SIZE);
+    lcg rng{};
+    for (size_t i = 0; i < 0x3000; i++) {
+        if (rng.next() % 16 != 0)
+            map[i].top_left.tile = 1;
+    }
+    const size_t count = static_cast<size_t>(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(find_free_map(map.data(), map.size(), count));
+    }
+}
+BENCHMARK(BM_FindFreeMap)->ArgName("tiles")->RangeMultiplier(4)->Range(1, 16);
+
+static void BM_GenerateSscData(benchmark::State& state) {
+    const sprite spr = parsed_sprite("test.json");
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(generate_ssc_data(&spr, 0, 0x300));
+    }
+}
+BENCHMARK(BM_GenerateSscData);
+
+static void BM_GenerateLmData(benchmark::State& state) {
+    prepare_inputs();
+    cfg.reset();
+    iohandler::init();
+    auto registry = std::make_unique<sprite_registry>();
+    if (!populate_sprite_list(cfg.GetPaths(), *registry, "bench_list_global.txt", nullptr)) {
+        state.SkipWithError(iohandler::get_global().last_error().c_str());
+        return;
+    }
+    auto map = std::make_unique<map16[]>(MAP16_SIZE);
+    auto& map_ref = *reinterpret_cast<map16(*)[MAP16_SIZE]>(map.get());
+    unsigned char extra_bytes[0x200]{};
+    std::array<FILE*, 4> files{};
+    for (auto& file : files) {
+        file = std::tmpfile();
+    }
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::fill_n(map.get(), MAP16_SIZE, map16{});
+        for (FILE* file : files) {
+            std::rewind(file);
+        }
+        state.ResumeTiming();
+        if (!generate_lm_data(*registry, map_ref, extra_bytes, files[0], files[1], files[2], files[3], false)) {
+            state.SkipWithError("generate_lm_data failed");
+            break;
+        }
+    }
+    for (FILE* file : files) {
+        std::fclose(file);
+    }
+}
+BENCHMARK(BM_GenerateLmData)->Unit(benchmark::kMicrosecond);
+
+static void BM_PatchfileFprintf(benchmark::State& state) {
+    // what patch_sprites_all_in_one writes for every sprite
+    constexpr const char entry[] = R"(freecode cleaned
+namespace SPRITE_ENTRY_%d
+SPRITE_ENTRY_%d:
+    incsrc "%s"
+namespace off
+print "__PIXI_INTERNAL_SPRITE_SEPARATOR__"
+)";
+    for (auto _ : state) {
+        patchfile file{"bench_patch.asm"};
+        for (int i = 0; i < 0x100; i++) {
+            file.fprintf(entry, i, i, "sprites/some_folder/some_sprite.asm");
+        }
+        file.close();
+        benchmark::DoNotOptimize(file.vfile().length);
+    }
+}
+BENCHMARK(BM_PatchfileFprintf);
+
+static void BM_GeneratePatches(benchmark::State& state) {
+    // the generated patches of a project with 300 routines and 600 sprites: shared.asm, shared_incsrc.asm, the
+    // cleanup patch and the sprites' --onepatch patch
+    constexpr int routines = 300;
+    constexpr int sprites = 600;
+    size_t bytes = 0;
+    for (auto _ : state) {
+        patchfile shared{"bench_shared.asm"};
+        patchfile shared_incsrc{"bench_shared_incsrc.asm"};
+        shared_incsrc.fprintf("macro safe_macro_label_wrapper()\n");
+        for (int i = 0; i < routines; i++) {
+            shared.fprintf("macro Routine%d()\n"
+                           "\t!Routine%d ?= 1\n"
+                           "\tJSL Routine%d\n"
+                           "endmacro\n",
+                           i, i, i);
+            shared_incsrc.fprintf("\t%%include_once(\"%s%s%d.asm\", Routine%d, $%02X)\n", "routines/", "Routine", i, i,
+                                  i * 3);
+        }
+        shared_incsrc.fprintf("endmacro\n");
+        shared.close();
+        shared_incsrc.close();
+
+        patchfile cleanup{"bench_cleanup.asm"};
+        cleanup.fprintf(";Per-Level sprites\n");
+        for (int i = 0; i < sprites * 2 + routines; i++) {
+            cleanup.fprintf("autoclean $%06X\n", 0x108000 + i * 0x20);
+        }
+        cleanup.close();
+
+        patchfile sprite_patch{"bench_sprites.asm"};
+        sprite_patch.fprintf("namespace nested on\nincsrc \"%ssa1def.asm\"\n", "asm/");
+        for (int i = 0; i < sprites; i++) {
+            sprite_patch.fprintf("freecode cleaned\n"
+                                 "namespace SPRITE_ENTRY_%d\n"
+                                 "SPRITE_ENTRY_%d:\n"
+                                 "    incsrc \"%s%d.asm\"\n"
+                                 "namespace off\n"
+                                 "print \"__PIXI_INTERNAL_SPRITE_SEPARATOR__\"\n",
+                                 i, i, "sprites/some_folder/sprite", i);
+        }
+        sprite_patch.fprintf("incsrc \"shared_incsrc.asm\"\nnamespace nested off\n");
+        sprite_patch.close();
+        bytes = shared.vfile().length + shared_incsrc.vfile().length + cleanup.vfile().length +
+                sprite_patch.vfile().length;
+        benchmark::DoNotOptimize(bytes);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+}
+BENCHMARK(BM_GeneratePatches)->Unit(benchmark::kMicrosecond);
+
+static void BM_MeiMeiLevelScan(benchmark::State& state) {
+    prepare_inputs();
+    // every level gets its own sprite data with 16 sprites in bank $10, so all 0x200 levels are scanned
+    {
+        std::vector<char> rom(fs::file_size("base.smc"));
+        std::ifstream{"base.smc", std::ios::binary}.read(rom.data(), static_cast<std::streamsize>(rom.size()));
+        constexpr int header = 0x200;
+        constexpr int bank_bytes = 0x077300;    // $0EF100, headered
+        constexpr int data_pointers = 0x02EE00; // $05EC00, headered
+        int data_pc = 0x080000;                 // $108000
+        lcg rng{};
+        for (int level = 0; level < 0x200; level++) {
+            const int snes = ((data_pc << 1) & 0x7F0000) | (data_pc & 0x7FFF) | 0x8000;
+            rom[bank_bytes + level] = static_cast<char>(snes >> 16);
+            rom[data_pointers + level * 2] = static_cast<char>(snes & 0xFF);
+            rom[data_pointers + level * 2 + 1] = static_cast<char>((snes >> 8) & 0xFF);
+            rom[header + data_pc++] = 0x00; // sprite header
+            for (int i = 0; i < 16; i++) {
+                rom[header + data_pc++] = static_cast<char>((rng.next() & 0xF0) | (i & 1)); // YYYYEEsy
+                rom[header + data_pc++] = static_cast<char>(rng.next());                    // XXXXSSSS
+                rom[header + data_pc++] = static_cast<char>(rng.next() % 0xB0);             // NNNNNNNN
+            }
+            rom[header + data_pc++] = static_cast<char>(0xFF);
+        }
+        std::ofstream{"bench_meimei.smc", std::ios::binary | std::ios::trunc}.write(
+            rom.data(), static_cast<std::streamsize>(rom.size()));
+    }
+    for (auto _ : state) {
+        state.PauseTiming();
+        iohandler::init();
+        MeiMei meimei{};
+        meimei.AlwaysRemap() = true;
+        ROM rom;
+        if (!rom.open("bench_meimei.smc") || !meimei.initialize(rom)) {
+            state.SkipWithError("couldn't open bench_meimei.smc");
+            break;
+        }
+        state.ResumeTiming();
+        if (meimei.run(rom) != 0) {
+            state.SkipWithError(iohandler::get_global().last_error().c_str());
+            break;
+        }
+    }
+}
+BENCHMARK(BM_MeiMeiLevelScan)->Unit(benchmark::kMillisecond);
@@ -17,25 +17,11 @@ def make_var_name(desc: str) -> str:
     var_name: str = desc.title()
     return var_name.replace('_', '')
 
-def make_cpp_func_name(ram_addr: str) -> str:
-    return ram_addr.replace('$', 'j').lower()
-
 def make_cs_class_name(ram_addr: str) -> str:
     return ram_addr.replace('$', 'Value')
 
-cpp_prelude = "#include <nlohmann/json.hpp>\n"
-
 cs_prelude = "using Newtonsoft.Json;\n\n"
 
-cpp_func_proto = """
-auto {}(const nlohmann::json& j) {{
-    unsigned char c = 0;
-    auto& byte = j["{}"];
-{}
-    return c;
-}}
-"""
-
 cs_class_proto = """
     public class {} : ByteRepresentant 
     {{
@@ -43,25 +29,121 @@ cs_class_proto = """
     }}
 """
 
-def construct_cpp_func(address: str, values) -> str:
+cpp_file_proto = """// Generated by generate_json.py from tweak_bit_names.json, edit those instead.
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace tweak_schema {{
+
+// a flag or a number inside of a tweak byte, the mask is where it sits in the byte (e.g. 0x0E for the palette)
+struct field {{
+    std::string_view name;
+    uint8_t byte;
+    uint8_t mask;
+    uint8_t shift;
+    bool number;
+}};
+
+constexpr std::array<std::string_view, {byte_count}> addresses{{{addresses}}};
+
+constexpr std::array<field, {field_count}> fields{{{{
+{fields}
+}}}};
+
+// the fields of tweak byte i are fields[first_field[i]] up to fields[first_field[i + 1]]
+constexpr std::array<uint8_t, {byte_count_plus_one}> first_field{{{first_field}}};
+
+// FNV-1a with a seed picked by the generator so that no two field names end up in the same slot, the slot is taken
+// from the top bits since the bottom ones barely depend on the seed
+constexpr uint32_t hash_seed = 0x{seed:08X};
+constexpr int hash_slot_bits = {slot_bits};
+constexpr std::array<int8_t, 1 << hash_slot_bits> hash_slots{{{{
+{slots}
+}}}};
+
+constexpr uint32_t hash(std::string_view key) {{
+    uint32_t h = hash_seed;
+    for (char c : key)
+        h = (h ^ static_cast<uint8_t>(c)) * 0x01000193u;
+    return h;
+}}
+
+// index into fields of the field called key, -1 if there's none
+constexpr int find(std::string_view key) {{
+    const int i = hash_slots[hash(key) >> (32 - hash_slot_bits)];
+    return i >= 0 && fields[i].name == key ? i : -1;
+}}
+
+// numbers are masked to the bits they own, flags set all of theirs
+constexpr uint8_t encode(const field& f, int value) {{
+    if (f.number)
+        return static_cast<uint8_t>((value & (f.mask >> f.shift)) << f.shift);
+    return value ? f.mask : 0;
+}}
+
+constexpr int decode(const field& f, uint8_t byte) {{
+    if (f.number)
+        return (byte & f.mask) >> f.shift;
+    return (byte & f.mask) != 0;
+}}
+
+// every field is found by its name, and the fields of each byte cover all of its bits exactly once
+constexpr bool verify() {{
+    for (size_t b = 0; b < addresses.size(); b++) {{
+        unsigned int covered = 0;
+        for (size_t i = first_field[b]; i < first_field[b + 1]; i++) {{
+            if (fields[i].byte != b || find(fields[i].name) != static_cast<int>(i) || (covered & fields[i].mask) != 0)
+                return false;
+            covered |= fields[i].mask;
+            for (int value = 0; value <= (fields[i].number ? fields[i].mask >> fields[i].shift : 1); value++) {{
+                if (decode(fields[i], encode(fields[i], value)) != value)
+                    return false;
+            }}
+        }}
+        if (covered != 0xFF)
+            return false;
+    }}
+    return true;
+}}
+static_assert(verify(), "tweak_bit_names.json doesn't describe every bit of every tweak byte exactly once");
+
+}} // namespace tweak_schema
+"""
+
+def fnv1a(seed: int, key: str) -> int:
+    h = seed
+    for b in key.encode('utf-8'):
+        h = ((h ^ b) * 0x01000193) & 0xFFFFFFFF
+    return h
+
+def field_layout(address: str, values):
+    # same rules as the CFG editor classes below: a leading number takes the bits that aren't flags,
+    # $166E has a flag before its palette number
     num_val = len(values)
     if num_val == 8:
-        cpp_func_body = '\n'.join([f'    c |= (byte["{v}"] ? 0x{0x01 << i:02X} : 0);' for i, v in enumerate(values)])
+        return [(v, 0x01 << i, i, False) for i, v in enumerate(values)]
+    diff = 8 - num_val
+    if address == "$166E":
+        layout = [(values[0], 0x01, 0, False), (values[1], ((0x01 << (diff + 1)) - 1) << 1, 1, True)]
+        diff += 1
+        cut = 2
     else:
-        diff = 8 - num_val
-        if address == "$166E":
-            first_val = values[0]
-            palette_val = values[1]
-            cpp_func_body = f'    c |= (byte["{first_val}"] ? 0x01 : 0);\n'
-            cpp_func_body += f'    c |= (((int)byte["{palette_val}"] & 0x07) << 1);\n'
-            diff += 1
-            cut = 2
-        else:
-            first_val = values[0]
-            cpp_func_body = f'    c |= (((int)byte["{first_val}"] & 0x{(0x01 << (diff + 1)) - 1:02X}) << 0);\n'
-            cut = 1
-        cpp_func_body += '\n'.join([f'    c |= (byte["{v}"] ? 0x{0x01 << (i + diff + 1):02X} : 0);' for i, v in enumerate(values[cut:])])
-    return str.format(cpp_func_proto, make_cpp_func_name(address), address, cpp_func_body)
+        layout = [(values[0], (0x01 << (diff + 1)) - 1, 0, True)]
+        cut = 1
+    layout += [(v, 0x01 << (i + diff + 1), i + diff + 1, False) for i, v in enumerate(values[cut:])]
+    return layout
+
+def hash_slot(seed: int, key: str, slot_bits: int) -> int:
+    return fnv1a(seed, key) >> (32 - slot_bits)
+
+def find_hash_seed(names, slot_bits: int) -> int:
+    for seed in range(0x811C9DC5, 0x811C9DC5 + 100000):
+        if len({hash_slot(seed, name, slot_bits) for name in names}) == len(names):
+            return seed
+    raise RuntimeError('no perfect hash seed found for the tweak bit names')
 
 def construct_cs_class(address: str, values) -> str:
     num_val = len(values)
@@ -84,9 +166,35 @@ def construct_cs_class(address: str, values) -> str:
     return str.format(cs_class_proto, make_cs_class_name(address), cs_func_body)
 
 def construct_cpp_file():
+    fields = []
+    first_field = []
+    for byte, (addr, vals) in enumerate(data.items()):
+        first_field.append(len(fields))
+        fields += [(name, byte, mask, shift, number) for name, mask, shift, number in field_layout(addr, vals)]
+    first_field.append(len(fields))
+    names = [f[0] for f in fields]
+    if len(set(names)) != len(names):
+        raise RuntimeError('tweak bit names have to be unique')
+    # about three slots per name keeps the seed search short
+    slot_bits = max(len(names) * 3 - 1, 1).bit_length()
+    slot_count = 1 << slot_bits
+    seed = find_hash_seed(names, slot_bits)
+    slots = [-1] * slot_count
+    for i, name in enumerate(names):
+        slots[hash_slot(seed, name, slot_bits)] = i
     with open(cpp_filename, 'w') as f:
-        f.write(cpp_prelude)
-        f.writelines([construct_cpp_func(addr, vals) for addr, vals in data.items()])
+        f.write(cpp_file_proto.format(
+            byte_count=len(data),
+            byte_count_plus_one=len(data) + 1,
+            addresses=', '.join(json.dumps(addr) for addr in data),
+            field_count=len(fields),
+            fields='\n'.join(f'    {{{json.dumps(name)}, {byte}, 0x{mask:02X}, {shift}, {"true" if number else "false"}}},'
+                             for name, byte, mask, shift, number in fields),
+            first_field=', '.join(str(i) for i in first_field),
+            seed=seed,
+            slot_bits=slot_bits,
+            slots='\n'.join('    ' + ', '.join(f'{v:>2}' for v in slots[i:i + 16]) + ','
+                             for i in range(0, slot_count, 16))))
 
 def construct_cs_file():
     with open(cs_filename, 'w') as f:
@@ -39,6 +39,10 @@ bool& MeiMei::KeepTemp() {
     return MeiMei::keepTemp;
 }
 
+const std::vector<rom_range>& MeiMei::Written() const {
+    return written;
+}
+
 std::string escapeDefines(const std::string& path) {
     std::stringstream ss("");
     for (char c : path) {
@@ -90,6 +94,9 @@ bool MeiMei::patch(const patchfile& patch, const std::vector<patchfile>& patchfi
         return false;
     }
 
+    auto ranges = asar_written_ranges(rom);
+    written.insert(written.end(), ranges.begin(), ranges.end());
+
     if (MeiMei::debug) {
         int print_count = 0;
         const char* const* prints = asar_getprints(&print_count);
@@ -109,49 +116,23 @@ struct AddressConstants {
     static constexpr int LevelSpriteDataPointerTable = 0x02EE00;      /* $05EC00 */
 };
 
-bool MeiMei::initialize(const char* rom_name) {
-    MeiMei::name = std::string(rom_name);
-
+bool MeiMei::initialize(const ROM& rom) {
     memset(prevEx, 0x03, 0x400);
     memset(nowEx, 0x03, 0x400);
 
-    if (!prev.open(MeiMei::name))
-        return false;
-    if (prev.read_byte(AddressConstants::LMPresentFlagPointer) == 0x42) {
-        auto addr =
-            prev.snes_to_pc(prev.read_long(AddressConstants::LMSizeTableAddressPointer));
-        prev.read_data(prevEx, 0x0400, addr);
+    hasSizeTable = rom.read_byte(AddressConstants::LMPresentFlagPointer) == 0x42;
+    if (hasSizeTable) {
+        auto addr = rom.snes_to_pc(rom.read_long(AddressConstants::LMSizeTableAddressPointer));
+        rom.read_data(prevEx, 0x0400, addr);
     }
     return true;
 }
 
-int MeiMei::run() {
-    ROM rom;
-    iohandler& io = iohandler::get_global();
-    if (!rom.open(MeiMei::name))
-        return 1;
-
-    int returnValue = MeiMei::run(rom);
-
-    if (returnValue) {
-        prev.close();
-        io.error("\n\nError occurred in MeiMei.\n"
-                 "Your rom has reverted to before pixi insert.\n");
-        return returnValue;
-    }
-
-    rom.close();
-    return returnValue;
-}
-
 int MeiMei::run(ROM& rom) {
     iohandler& io = iohandler::get_global();
-    ROM now;
-    if (!now.open(MeiMei::name))
-        return 1;
-    if (prev.read_byte(AddressConstants::LMPresentFlagPointer) == 0x42) {
-        auto addr = now.snes_to_pc(now.read_long(AddressConstants::LMSizeTableAddressPointer));
-        now.read_data(nowEx, 0x0400, addr);
+    if (hasSizeTable) {
+        auto addr = rom.snes_to_pc(rom.read_long(AddressConstants::LMSizeTableAddressPointer));
+        rom.read_data(nowEx, 0x0400, addr);
     }
 
     bool changeEx = false;
@@ -178,9 +159,9 @@ int MeiMei::run(ROM& rom) {
 
         for (int lv = 0; lv < 0x200; lv++) {
 
-            int sprAddrSNES = (now.read_byte(AddressConstants::LMLevelSpriteDataBankBytePointer + lv) << 16) +
-                              now.read_word(AddressConstants::LevelSpriteDataPointerTable + lv * 2);
-            auto sprAddrPC = now.snes_to_pc(sprAddrSNES);
+            int sprAddrSNES = (rom.read_byte(AddressConstants::LMLevelSpriteDataBankBytePointer + lv) << 16) +
+                              rom.read_word(AddressConstants::LevelSpriteDataPointerTable + lv * 2);
+            auto sprAddrPC = rom.snes_to_pc(sprAddrSNES);
             if (sprAddrPC == -1) {
                 ERR("Sprite Data has invalid address.")
             }
@@ -190,14 +171,14 @@ int MeiMei::run(ROM& rom) {
 
             memset(sprAllData, 0, SPR_ADDR_LIMIT);
 
-            sprAllData[0] = now.read_byte(sprAddrPC);
+            sprAllData[0] = rom.read_byte(sprAddrPC);
             int prevOfs = 1;
             int nowOfs = 1;
             bool exlevelFlag = sprAllData[0] & (uint8_t)0x20;
             bool changeData = false;
 
             while (true) {
-                now.read_data(sprCommonData, 3, sprAddrPC + prevOfs);
+                rom.read_data(sprCommonData, 3, sprAddrPC + prevOfs);
                 if (nowOfs >= SPR_ADDR_LIMIT - 3) {
                     ERR("Sprite data is too large!")
                 }
@@ -213,7 +194,7 @@ int MeiMei::run(ROM& rom) {
                         break;
                     } else {
                         prevOfs += 2;
-                        now.read_data(sprCommonData, 3, sprAddrPC + prevOfs);
+                        rom.read_data(sprCommonData, 3, sprAddrPC + prevOfs);
                     }
                 }
 
@@ -227,7 +208,7 @@ int MeiMei::run(ROM& rom) {
                     changeData = true;
                     int i;
                     for (i = 3; i < prevEx[sprNum]; i++) {
-                        sprAllData[nowOfs++] = now.read_byte(sprAddrPC + prevOfs + i);
+                        sprAllData[nowOfs++] = rom.read_byte(sprAddrPC + prevOfs + i);
                         ASSERT_SPR_DATA_ADDR_SIZE(nowOfs)
                     }
                     for (; i < nowEx[sprNum]; i++) {
@@ -237,12 +218,12 @@ int MeiMei::run(ROM& rom) {
                 } else if (nowEx[sprNum] < prevEx[sprNum]) {
                     changeData = true;
                     for (int i = 3; i < nowEx[sprNum]; i++) {
-                        sprAllData[nowOfs++] = now.read_byte(sprAddrPC + prevOfs + i);
+                        sprAllData[nowOfs++] = rom.read_byte(sprAddrPC + prevOfs + i);
                         ASSERT_SPR_DATA_ADDR_SIZE(nowOfs)
                     }
                 } else {
                     for (int i = 3; i < nowEx[sprNum]; i++) {
-                        sprAllData[nowOfs++] = now.read_byte(sprAddrPC + prevOfs + i);
+                        sprAllData[nowOfs++] = rom.read_byte(sprAddrPC + prevOfs + i);
                         ASSERT_SPR_DATA_ADDR_SIZE(nowOfs)
                     }
                 }
@@ -270,9 +251,9 @@ int MeiMei::run(ROM& rom) {
 
                 // create actual asar patch
                 const auto levelBankAddress =
-                    now.pc_to_snes(AddressConstants::LMLevelSpriteDataBankBytePointer + lv);
+                    rom.pc_to_snes(AddressConstants::LMLevelSpriteDataBankBytePointer + lv);
                 const auto levelWordAddress =
-                    now.pc_to_snes(AddressConstants::LevelSpriteDataPointerTable + lv * 2);
+                    rom.pc_to_snes(AddressConstants::LevelSpriteDataPointerTable + lv * 2);
                 const char* binL = binaryLabel.c_str();
                 spriteDataPatch.fprintf(
                     "!level_%03X_oldDataPointer = read2($%06X)|(read1($%06X)<<16)\n"
@@ -316,6 +297,8 @@ int MeiMei::run(ROM& rom) {
     }
 end:
     if (revert) {
+        io.error("\n\nError occurred in MeiMei.\n"
+                 "Your rom has reverted to before pixi insert.\n");
         return 1;
     }
 
@@ -3,23 +3,27 @@
 
 class MeiMei {
   private:
-    std::string name;
-    ROM prev;
+    // whether Lunar Magic's extra byte size table was there before pixi's insertion
+    bool hasSizeTable{false};
     unsigned char prevEx[0x400];
     unsigned char nowEx[0x400];
     bool always{false};
     bool debug{false};
     bool keepTemp{false};
     std::string sa1DefPath;
+    std::vector<rom_range> written;
 
     bool patch(const patchfile& patch, const std::vector<patchfile>& patchfiles, ROM& rom);
-    int run(ROM &rom);
 
   public:
-    [[nodiscard]] bool initialize(const char *n);
-    int run();
+    // reads the extra byte sizes from the ROM as it was before pixi touched it
+    [[nodiscard]] bool initialize(const ROM& rom);
+    // remaps the sprite data of the in-memory ROM if the sizes changed, on failure the ROM must not be saved
+    int run(ROM& rom);
     bool& Debug();
     bool& AlwaysRemap();
     bool& KeepTemp();
+    // ranges written by MeiMei's own patches during run()
+    const std::vector<rom_range>& Written() const;
     void configureSa1Def(const std::string& pathToSa1Def);
 };
\ No newline at end of file
@@ -180,6 +180,23 @@ namespace PixiCLR
         [DllImport("pixi_api", EntryPoint = "pixi_output", CharSet = CharSet.Ansi, CallingConvention = CallingConvention.Cdecl)]
         private static extern sbyte** _pixi_output(out int size);
 
+        [DllImport("pixi_api", EntryPoint = "pixi_load_dependency_graph", CharSet = CharSet.Ansi, CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I4)]
+        private static extern int _pixi_load_dependency_graph(string filename);
+        [DllImport("pixi_api", EntryPoint = "pixi_dependencies", CharSet = CharSet.Ansi, CallingConvention = CallingConvention.Cdecl)]
+        private static extern sbyte** _pixi_dependencies(string filename, out int size);
+        [DllImport("pixi_api", EntryPoint = "pixi_dependents", CharSet = CharSet.Ansi, CallingConvention = CallingConvention.Cdecl)]
+        private static extern sbyte** _pixi_dependents(string filename, out int size);
+
+        [DllImport("pixi_api", EntryPoint = "pixi_rom_changes", CharSet = CharSet.Ansi, CallingConvention = CallingConvention.Cdecl)]
+        private static extern IntPtr* _pixi_rom_changes(out int size);
+        [DllImport("pixi_api", EntryPoint = "pixi_rom_change_offset", CharSet = CharSet.Ansi, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int _pixi_rom_change_offset(IntPtr change);
+        [DllImport("pixi_api", EntryPoint = "pixi_rom_change_size", CharSet = CharSet.Ansi, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int _pixi_rom_change_size(IntPtr change);
+        [DllImport("pixi_api", EntryPoint = "pixi_rom_change_source", CharSet = CharSet.Ansi, CallingConvention = CallingConvention.Cdecl)]
+        private static extern sbyte* _pixi_rom_change_source(IntPtr change, out int size);
+
         [DllImport("pixi_api", EntryPoint = "pixi_create_map16_buffer", CharSet = CharSet.Ansi, CallingConvention = CallingConvention.Cdecl)]
         private static extern IntPtr* _pixi_create_map16_array(int size);
         [DllImport("pixi_api", EntryPoint = "pixi_generate_s16", CharSet = CharSet.Ansi, CallingConvention = CallingConvention.Cdecl)]
@@ -190,6 +207,8 @@ namespace PixiCLR
         private static extern sbyte* _pixi_generate_mwt(IntPtr sprite, IntPtr collection, int coll_idx);
         [DllImport("pixi_api", EntryPoint = "pixi_generate_mw2", CharSet = CharSet.Ansi, CallingConvention = CallingConvention.Cdecl)]
         private static extern byte* _pixi_generate_mw2(IntPtr sprite, IntPtr collection, out int size);
+        [DllImport("pixi_api", EntryPoint = "pixi_generate_tweak_json", CharSet = CharSet.Ansi, CallingConvention = CallingConvention.Cdecl)]
+        private static extern sbyte* _pixi_generate_tweak_json(IntPtr sprite);
 
         public abstract class PointerInternalBase : IDisposable
         {
@@ -309,6 +328,27 @@ namespace PixiCLR
             }
         }
 
+        public class RomChange : PointerInternalBase
+        {
+            public RomChange(IntPtr data_pointer) : base(data_pointer)
+            {
+            }
+            public int Offset()
+            {
+                return _pixi_rom_change_offset(data_pointer);
+            }
+            public int Size()
+            {
+                return _pixi_rom_change_size(data_pointer);
+            }
+            public string Source()
+            {
+                var cstr = _pixi_rom_change_source(data_pointer, out int size);
+                string str = new(cstr, 0, size, Encoding.UTF8);
+                return str;
+            }
+        }
+
         public class Display : PointerInternalBase
         {
             public Display(IntPtr data_pointer) : base(data_pointer)
@@ -581,6 +621,13 @@ namespace PixiCLR
                 _pixi_free_byte_array(bytes);
                 return mw2;
             }
+            public string TweakJson()
+            {
+                var cstr = _pixi_generate_tweak_json(data_pointer);
+                var tweaks = new string(cstr);
+                _pixi_free_string(cstr);
+                return tweaks;
+            }
         }
 
         public enum SpriteType : int
@@ -693,5 +740,62 @@ namespace PixiCLR
             }
             return str;
         }
+
+        /// <summary>
+        /// Loads a dependency graph saved by pixi (romname.pixideps) in place of the one built by the last run
+        /// </summary>
+        /// <param name="filename">Path of the .pixideps file</param>
+        /// <returns>True on success, False otherwise</returns>
+        public static bool LoadDependencyGraph(string filename)
+        {
+            return _pixi_load_dependency_graph(filename) == 1;
+        }
+
+        private static string[] ToStringArray(sbyte** carr, int size)
+        {
+            string[] str = new string[size];
+            for (int i = 0; i < size; i++)
+            {
+                str[i] = new(carr[i]);
+            }
+            return str;
+        }
+
+        /// <summary>
+        /// Every file the given file depends on, directly or not
+        /// </summary>
+        /// <param name="filename">The asm file to look up</param>
+        /// <returns>The paths of the dependencies, sorted</returns>
+        public static string[] Dependencies(string filename)
+        {
+            var carr = _pixi_dependencies(filename, out int size);
+            return ToStringArray(carr, size);
+        }
+
+        /// <summary>
+        /// Every file that depends on the given file, directly or not
+        /// </summary>
+        /// <param name="filename">The file to look up</param>
+        /// <returns>The paths of the dependent files, sorted</returns>
+        public static string[] Dependents(string filename)
+        {
+            var carr = _pixi_dependents(filename, out int size);
+            return ToStringArray(carr, size);
+        }
+
+        /// <summary>
+        /// What the last run changed in the ROM, only tracked with --track-changes or --emit-patch
+        /// </summary>
+        /// <returns>The changed ranges, in ascending order</returns>
+        public static RomChange[] RomChanges()
+        {
+            IntPtr* ret = _pixi_rom_changes(out int size);
+            RomChange[] changes = new RomChange[size];
+            for (int i = 0; i < size; i++)
+            {
+                changes[i] = new RomChange(ret[i]);
+            }
+            return changes;
+        }
     }
 }
\ No newline at end of file
@@ -4,7 +4,7 @@ import sys
 from typing import Callable, Optional
 from enum import IntEnum
 
-__all__ = ["run", "api_version", "check_api_version", "Sprite", "ParsedListResult", "SpriteTable", "Tile", "StatusPointers", "Map8x8", "Map16", "Display", "Collection"]
+__all__ = ["run", "api_version", "check_api_version", "Sprite", "ParsedListResult", "SpriteTable", "Tile", "StatusPointers", "Map8x8", "Map16", "Display", "Collection", "load_dependency_graph", "dependencies", "dependents"]
 _pixi = None
 
 class ListType(IntEnum):
@@ -113,12 +113,16 @@ def __init_pixi_dll():
 
     _pixi.setup_func("last_error", [POINTER(c_int)], c_char_p)
     _pixi.setup_func("output", [POINTER(c_int)], POINTER(c_char_p))
+    _pixi.setup_func("load_dependency_graph", [c_char_p], c_int)
+    _pixi.setup_func("dependencies", [c_char_p, POINTER(c_int)], POINTER(c_char_p))
+    _pixi.setup_func("dependents", [c_char_p, POINTER(c_int)], POINTER(c_char_p))
 
     _pixi.setup_func("create_map16_buffer", [c_int], POINTER(c_void_p))
     _pixi.setup_func("generate_s16", [c_void_p, POINTER(c_void_p), c_int, POINTER(c_int), POINTER(c_int)], POINTER(c_void_p))
     _pixi.setup_func("generate_ssc", [c_void_p, c_int, c_int], c_void_p)
     _pixi.setup_func("generate_mwt", [c_void_p, c_void_p, c_int], c_void_p)
     _pixi.setup_func("generate_mw2", [c_void_p, c_void_p, POINTER(c_int)], POINTER(c_ubyte))
+    _pixi.setup_func("generate_tweak_json", [c_void_p], c_void_p)
 
 __init_pixi_dll()
 
@@ -452,6 +456,12 @@ class Sprite:
             mw2.append(mw2raw[i])
         _pixi.funcs["free_byte_array"](mw2raw)
         return mw2
+
+    def tweak_json(self) -> str:
+        cstr: c_void_p = _pixi.funcs["generate_tweak_json"](self.data_ptr)
+        tweaks = str(string_at(cstr), encoding="utf-8")
+        _pixi.funcs["free_string"](cstr)
+        return tweaks
     
     def type(self) -> int:
         return int(_pixi.funcs["sprite_type"](self.data_ptr))
@@ -554,3 +564,36 @@ def output() -> list[str]:
         retval.append(str(cstr[i], encoding="utf-8"))
     return retval
 
+def load_dependency_graph(filename: str) -> bool:
+    """
+    Load a dependency graph saved by PIXI (<romname>.pixideps) in place of the one built by the last run.
+    :param filename: Path of the .pixideps file.
+    :return: True on success, False otherwise.
+    """
+    return bool(_pixi.funcs["load_dependency_graph"](c_char_p(filename.encode("utf-8"))))
+
+def dependencies(filename: str) -> list[str]:
+    """
+    Get every file the given file depends on, directly or not.
+    :param filename: The asm file to look up.
+    :return: The paths of the dependencies, sorted.
+    """
+    retval: list[str] = []
+    size = c_int()
+    carr: POINTER(c_char_p) = _pixi.funcs["dependencies"](c_char_p(filename.encode("utf-8")), byref(size))
+    for i in range(size.value):
+        retval.append(str(carr[i], encoding="utf-8"))
+    return retval
+
+def dependents(filename: str) -> list[str]:
+    """
+    Get every file that depends on the given file, directly or not.
+    :param filename: The file to look up.
+    :return: The paths of the dependent files, sorted.
+    """
+    retval: list[str] = []
+    size = c_int()
+    carr: POINTER(c_char_p) = _pixi.funcs["dependents"](c_char_p(filename.encode("utf-8")), byref(size))
+    for i in range(size.value):
+        retval.append(str(carr[i], encoding="utf-8"))
+    return retval
@@ -1,5 +1,6 @@
 #include "argparser.h"
 
+#include "charconv_compat.h"
 #include "iohandler.h"
 #include <charconv>
 #include <filesystem>
@@ -14,27 +15,6 @@
 #include <unistd.h>
 #endif
 
-#if defined(__APPLE__) || (defined(__clang__) && __clang_major__ < 14) ||                                              \
-    defined(__MINGW32__)// vvvv clang 13/macos/mingw workaround
-struct ec_compat {
-    const char* ptr;
-    std::errc ec;
-};
-ec_compat from_chars_double(const char* first, [[maybe_unused]] const char* last, double& value) {
-    char* end = nullptr;
-    value = std::strtod(first, &end);
-    if (end == first) {
-        // error
-        return {end, std::errc::invalid_argument};
-    }
-    return {};
-}
-#else  // ^^^^ clang 13/macos/mingw workaround -- vvvv everything else
-auto from_chars_double(const char* first, const char* last, double& value) {
-    return std::from_chars(first, last, value);
-}
-#endif // ^^^^ everything else
-
 static std::string GetExecutableName() {
 #ifdef _WIN32
     // this is an arbitrary path length that I picked that should never hopefully be reached
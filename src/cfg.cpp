@@ -59,7 +59,7 @@ bool read_cfg_file(sprite* spr) {
     };
 
     if (spr->displays_in_lm) {
-        std::string sprite_name = fs::path{spr->cfg_file}.filename().replace_extension("").generic_string();
+        std::string sprite_name = fs::path{spr->cfg_file.str()}.filename().replace_extension("").generic_string();
 
         spr->collections.push_back(
             collection{.name = sprite_name + " (extra bit clear)", .extra_bit = false, .prop = {}});
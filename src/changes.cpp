@@ -0,0 +1,234 @@
+#include "changes.h"
+#include "iohandler.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr size_t no_source = static_cast<size_t>(-1);
+
+constexpr std::array<uint32_t, 256> crc32_table = [] {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        table[i] = crc;
+    }
+    return table;
+}();
+
+uint32_t crc32(std::span<const unsigned char> data) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (unsigned char byte : data)
+        crc = crc32_table[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+std::string lowercase_extension(const std::string& path) {
+    std::string ext = fs::path{path}.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+    return ext;
+}
+
+bool write_file(const std::string& path, std::span<const unsigned char> data) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        iohandler::get_global().error("Couldn't open %s for writing\n", path.c_str());
+        return false;
+    }
+    const bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    fclose(file);
+    if (!ok)
+        iohandler::get_global().error("Couldn't write %s\n", path.c_str());
+    return ok;
+}
+
+// the changes without their sources, joining the ones that are at most `gap` bytes apart
+std::vector<rom_range> merged_ranges(const std::vector<rom_change>& changes, int gap) {
+    std::vector<rom_range> ranges{};
+    for (const rom_change& change : changes) {
+        if (!ranges.empty() && change.pc - (ranges.back().pc + ranges.back().size) <= gap)
+            ranges.back().size = change.pc + change.size - ranges.back().pc;
+        else
+            ranges.push_back({change.pc, change.size});
+    }
+    return ranges;
+}
+
+} // namespace
+
+void ChangeTracker::reset() {
+    m_enabled = false;
+    m_original.clear();
+    m_final.clear();
+    m_sources.clear();
+    m_writes.clear();
+    m_changes.clear();
+    m_change_ptrs.clear();
+}
+
+void ChangeTracker::begin(const ROM& rom) {
+    reset();
+    m_enabled = true;
+    m_original.resize(static_cast<size_t>(rom.size + rom.header_size));
+    rom.read_data(m_original.data(), m_original.size(), 0);
+}
+
+void ChangeTracker::record(std::string source, std::span<const rom_range> ranges) {
+    if (!m_enabled || ranges.empty())
+        return;
+    m_sources.push_back(std::move(source));
+    for (const rom_range& range : ranges)
+        m_writes.push_back({range, m_sources.size() - 1});
+}
+
+void ChangeTracker::finish(const ROM& rom) {
+    if (!m_enabled)
+        return;
+    m_final.resize(static_cast<size_t>(rom.size + rom.header_size));
+    rom.read_data(m_final.data(), m_final.size(), 0);
+
+    // last writer of every byte, as a map from the start of each run to its source
+    std::map<int, size_t> owners{{0, no_source}};
+    auto split = [&](int pos) {
+        auto it = std::prev(owners.upper_bound(pos));
+        if (it->first != pos)
+            owners.emplace(pos, it->second);
+    };
+    for (const write& w : m_writes) {
+        const int end = w.range.pc + w.range.size;
+        split(w.range.pc);
+        split(end);
+        owners.erase(owners.lower_bound(w.range.pc), owners.lower_bound(end));
+        owners[w.range.pc] = w.source;
+    }
+
+    m_changes.clear();
+    auto add_change = [&](int start, int end) {
+        for (auto it = std::prev(owners.upper_bound(start)); start < end; ++it) {
+            const auto next = std::next(it);
+            const int stop = next == owners.end() ? end : std::min(end, next->first);
+            std::string source = it->second == no_source ? "unknown" : m_sources[it->second];
+            if (!m_changes.empty() && m_changes.back().pc + m_changes.back().size == start &&
+                m_changes.back().source == source)
+                m_changes.back().size += stop - start;
+            else
+                m_changes.push_back({start, stop - start, std::move(source)});
+            start = stop;
+        }
+    };
+    const size_t common = std::min(m_original.size(), m_final.size());
+    auto orig_it = m_original.begin();
+    auto final_it = m_final.begin();
+    const auto orig_end = m_original.begin() + static_cast<std::ptrdiff_t>(common);
+    while (orig_it != orig_end) {
+        std::tie(orig_it, final_it) = std::mismatch(orig_it, orig_end, final_it);
+        if (orig_it == orig_end)
+            break;
+        const auto [same_orig, same_final] =
+            std::mismatch(orig_it, orig_end, final_it, [](unsigned char a, unsigned char b) { return a != b; });
+        add_change(static_cast<int>(orig_it - m_original.begin()), static_cast<int>(same_orig - m_original.begin()));
+        orig_it = same_orig;
+        final_it = same_final;
+    }
+    // everything the ROM grew by is new
+    if (m_final.size() > common)
+        add_change(static_cast<int>(common), static_cast<int>(m_final.size()));
+
+    m_change_ptrs.clear();
+    m_change_ptrs.reserve(m_changes.size());
+    for (const rom_change& change : m_changes)
+        m_change_ptrs.push_back(&change);
+}
+
+bool ChangeTracker::supported_patch_format(const std::string& path) {
+    const std::string ext = lowercase_extension(path);
+    return ext == ".ips" || ext == ".bps";
+}
+
+bool ChangeTracker::write_patch(const std::string& path) const {
+    return lowercase_extension(path) == ".ips" ? write_ips(path) : write_bps(path);
+}
+
+bool ChangeTracker::write_ips(const std::string& path) const {
+    std::vector<unsigned char> out{'P', 'A', 'T', 'C', 'H'};
+    // a record header is 5 bytes, smaller gaps are cheaper to include in the record
+    for (rom_range range : merged_ranges(m_changes, 5)) {
+        while (range.size > 0) {
+            // an offset of "EOF" would end the patch early
+            if (range.pc == 0x454F46) {
+                range.pc--;
+                range.size++;
+            }
+            if (range.pc > 0xFFFFFF) {
+                iohandler::get_global().error("The ROM is too big to be described by an IPS patch, use BPS instead\n");
+                return false;
+            }
+            const int chunk = std::min(range.size, 0xFFFF);
+            out.insert(out.end(), {static_cast<unsigned char>(range.pc >> 16),
+                                   static_cast<unsigned char>(range.pc >> 8), static_cast<unsigned char>(range.pc),
+                                   static_cast<unsigned char>(chunk >> 8), static_cast<unsigned char>(chunk)});
+            out.insert(out.end(), m_final.begin() + range.pc, m_final.begin() + range.pc + chunk);
+            range.pc += chunk;
+            range.size -= chunk;
+        }
+    }
+    out.insert(out.end(), {'E', 'O', 'F'});
+    // truncation extension
+    if (m_final.size() < m_original.size()) {
+        const size_t size = m_final.size();
+        out.insert(out.end(), {static_cast<unsigned char>(size >> 16), static_cast<unsigned char>(size >> 8),
+                               static_cast<unsigned char>(size)});
+    }
+    return write_file(path, out);
+}
+
+bool ChangeTracker::write_bps(const std::string& path) const {
+    std::vector<unsigned char> out{'B', 'P', 'S', '1'};
+    auto number = [&](uint64_t value) {
+        while (true) {
+            const unsigned char x = value & 0x7F;
+            value >>= 7;
+            if (value == 0) {
+                out.push_back(0x80 | x);
+                break;
+            }
+            out.push_back(x);
+            value--;
+        }
+    };
+    enum : uint64_t { source_read = 0, target_read = 1 };
+    auto action = [&](uint64_t mode, size_t length) { number(((length - 1) << 2) | mode); };
+    auto write_crc = [&](uint32_t crc) {
+        for (int i = 0; i < 4; i++)
+            out.push_back(static_cast<unsigned char>(crc >> (i * 8)));
+    };
+
+    number(m_original.size());
+    number(m_final.size());
+    number(0); // no metadata
+    size_t pos = 0;
+    // a single unchanged byte costs the same either way
+    for (const rom_range& range : merged_ranges(m_changes, 1)) {
+        const auto pc = static_cast<size_t>(range.pc);
+        if (pc > pos)
+            action(source_read, pc - pos);
+        action(target_read, range.size);
+        out.insert(out.end(), m_final.begin() + range.pc, m_final.begin() + range.pc + range.size);
+        pos = pc + range.size;
+    }
+    if (pos < m_final.size())
+        action(source_read, m_final.size() - pos);
+    write_crc(crc32(m_original));
+    write_crc(crc32(m_final));
+    write_crc(crc32(out));
+    return write_file(path, out);
+}
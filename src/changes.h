@@ -0,0 +1,60 @@
+#pragma once
+#include "structs.h"
+#include <span>
+#include <string>
+#include <vector>
+
+// a run of bytes that differs between the ROM before and after the insertion, pc is headered
+struct rom_change {
+    int pc = 0;
+    int size = 0;
+    // what wrote these bytes last: a sprite's asm file, a patch, MeiMei or "unknown" (e.g. freed by autoclean)
+    std::string source{};
+};
+
+/**
+    Tracks what an insertion changed in the ROM (--emit-patch, --track-changes).
+
+    The ROM as it was opened is kept, and every asar call records the blocks it wrote along with what was
+    being assembled. Once the run is over the final ROM in memory is compared against the original byte by byte,
+    which gives the exact changes, each attributed to the last patch that wrote there. The file on disk isn't
+    needed for any of it, so --emit-patch-only never writes to it.
+    The changes can be written as an IPS or BPS patch and are exposed through the C API.
+*/
+class ChangeTracker {
+    struct write {
+        rom_range range{};
+        size_t source = 0;
+    };
+
+    bool m_enabled = false;
+    std::vector<unsigned char> m_original{};
+    std::vector<unsigned char> m_final{};
+    std::vector<std::string> m_sources{};
+    std::vector<write> m_writes{};
+    std::vector<rom_change> m_changes{};
+    std::vector<const rom_change*> m_change_ptrs{};
+
+  public:
+    void reset();
+    // starts tracking from the ROM as it is now, before anything was written to it
+    void begin(const ROM& rom);
+    bool enabled() const {
+        return m_enabled;
+    }
+    void record(std::string source, std::span<const rom_range> ranges);
+    // works out the changes once everything (MeiMei included) has been written to the ROM
+    void finish(const ROM& rom);
+    const std::vector<rom_change>& changes() const {
+        return m_changes;
+    }
+    std::span<const rom_change* const> change_pointers() const {
+        return m_change_ptrs;
+    }
+    // IPS or BPS depending on the extension
+    [[nodiscard]] bool write_patch(const std::string& path) const;
+    [[nodiscard]] bool write_ips(const std::string& path) const;
+    [[nodiscard]] bool write_bps(const std::string& path) const;
+
+    static bool supported_patch_format(const std::string& path);
+};
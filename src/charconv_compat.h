@@ -0,0 +1,28 @@
+#pragma once
+#include <charconv>
+#include <cstdlib>
+#include <string>
+#include <system_error>
+
+#if defined(__APPLE__) || (defined(__clang__) && __clang_major__ < 14) ||                                              \
+    defined(__MINGW32__) // vvvv clang 13/macos/mingw workaround
+struct ec_compat {
+    const char* ptr;
+    std::errc ec;
+};
+// std::from_chars for floating point isn't there, strtod needs a terminated string so [first, last) gets copied
+inline ec_compat from_chars_double(const char* first, const char* last, double& value) {
+    const std::string copy{first, last};
+    char* end = nullptr;
+    value = std::strtod(copy.c_str(), &end);
+    if (end == copy.c_str()) {
+        // error
+        return {first, std::errc::invalid_argument};
+    }
+    return {first + (end - copy.c_str()), std::errc{}};
+}
+#else  // ^^^^ clang 13/macos/mingw workaround -- vvvv everything else
+inline auto from_chars_double(const char* first, const char* last, double& value) {
+    return std::from_chars(first, last, value);
+}
+#endif // ^^^^ everything else
@@ -142,12 +142,22 @@ class PixiConfig {
         DisableMeiMei = false;
         DisableAllExtensionFiles = false;
         AllSpritesOnePatch = false;
+        Incremental = false;
+        NoMetadataCache = false;
+        DumpDeps = false;
+        Jobs = 1;
         Routines = DEFAULT_ROUTINES;
         AsmDir = "";
         AsmDirPath = "";
         SymbolsType = "";
         AsarStdIncludes = "";
         AsarStdDefines = "";
+        ServeSocket = "";
+        TracePath = "";
+        EmitPatchPath = "";
+        EmitPatchOnly = false;
+        FreespaceReportPath = "";
+        TrackChanges = false;
         for (size_t i = 0; i < FromEnum(PathType::__SIZE__); i++) {
             m_Paths[static_cast<PathType>(i)] = DefaultPaths::get(static_cast<PathType>(i));
         }
@@ -181,13 +191,23 @@ class PixiConfig {
     bool DisableMeiMei = false;
     bool DisableAllExtensionFiles = false;
     bool AllSpritesOnePatch = false;
+    bool Incremental = false;
+    bool NoMetadataCache = false;
+    bool DumpDeps = false;
     bool SearchForFilesInExePath = false;
     int Routines = DEFAULT_ROUTINES;
+    int Jobs = 1;
     std::string AsmDir{};
     std::string AsmDirPath{};
     std::string SymbolsType{};
     std::string AsarStdIncludes{};
     std::string AsarStdDefines{};
+    std::string ServeSocket{};
+    std::string TracePath{};
+    std::string EmitPatchPath{};
+    bool EmitPatchOnly = false;
+    std::string FreespaceReportPath{};
+    bool TrackChanges = false;
     constexpr bool warningsEnabled() const {
         return Warnings && !NoWarnings;
     }
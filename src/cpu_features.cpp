@@ -0,0 +1,57 @@
+#include "cpu_features.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+#ifdef PIXI_X86
+
+#if defined(__x86_64__) || defined(_M_X64)
+// part of x86-64, there's nothing to ask
+constexpr bool sse2_baseline = true;
+#else
+constexpr bool sse2_baseline = false;
+#endif
+
+#if defined(_MSC_VER)
+PIXI_TARGET("xsave")
+bool os_saves_ymm() {
+    return (_xgetbv(0) & 0x6) == 0x6;
+}
+#endif
+
+cpu_features detect_cpu_features() {
+    cpu_features features{};
+#if defined(_MSC_VER)
+    int regs[4]{};
+    __cpuid(regs, 0);
+    const int max_leaf = regs[0];
+    __cpuid(regs, 1);
+    features.sse2 = sse2_baseline || (regs[3] & (1 << 26)) != 0;
+    features.ssse3 = (regs[2] & (1 << 9)) != 0;
+    const bool osxsave = (regs[2] & (1 << 27)) != 0;
+    if (max_leaf >= 7 && osxsave && os_saves_ymm()) {
+        __cpuidex(regs, 7, 0);
+        features.avx2 = (regs[1] & (1 << 5)) != 0;
+    }
+#else
+    features.sse2 = sse2_baseline || __builtin_cpu_supports("sse2");
+    features.ssse3 = __builtin_cpu_supports("ssse3");
+    features.avx2 = __builtin_cpu_supports("avx2");
+#endif
+    return features;
+}
+
+#endif
+
+} // namespace
+
+const cpu_features& detected_cpu_features() {
+#ifdef PIXI_X86
+    static const cpu_features features = detect_cpu_features();
+#else
+    static const cpu_features features{};
+#endif
+    return features;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+/**
+    Which SIMD instruction sets the CPU supports, for the vectorized loops (base64 in JSON files, the RATS tag scan)
+    to pick the best kernel they have once per process.
+
+    PIXI_X86 is defined when building for x86, where PIXI_TARGET(x) lets a function use the instructions of x no
+    matter what the rest of the file is compiled for. Such a function may only be called when the CPU supports x.
+*/
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PIXI_X86
+#include <immintrin.h>
+// MSVC lets any function use any intrinsic, gcc and clang (clang-cl included) need to be told per function
+#if defined(_MSC_VER) && !defined(__clang__)
+#define PIXI_TARGET(x)
+#else
+#define PIXI_TARGET(x) __attribute__((target(x)))
+#endif
+#endif
+
+struct cpu_features {
+    // always there on x86-64, only 32 bit builds ask the CPU
+    bool sse2 = false;
+    bool ssse3 = false;
+    // also requires the OS to save the upper halves of the ymm registers
+    bool avx2 = false;
+};
+
+// detected the first time it's called, everything is false when not building for x86
+const cpu_features& detected_cpu_features();
@@ -0,0 +1,169 @@
+#include "defines.h"
+#include "cfg.h"
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+
+static std::string_view strip_asm_comment(std::string_view line) {
+    bool in_quotes = false;
+    for (size_t i = 0; i < line.size(); i++) {
+        if (line[i] == '"')
+            in_quotes = !in_quotes;
+        else if (line[i] == ';' && !in_quotes)
+            return line.substr(0, i);
+    }
+    return line;
+}
+
+static bool is_name_char(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+static std::string lowercase_word(std::string_view stmt) {
+    std::string word{stmt.substr(0, std::min(stmt.find_first_of(" \t("), stmt.size()))};
+    std::transform(word.begin(), word.end(), word.begin(),
+                   [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+    return word;
+}
+
+static void find_define_mentions(std::string_view stmt, define_file& out) {
+    for (size_t pos = stmt.find('!'); pos != std::string_view::npos; pos = stmt.find('!', pos + 1)) {
+        if (pos > 0 && stmt[pos - 1] == '\\')
+            continue;
+        size_t end = pos + 1;
+        while (end < stmt.size() && is_name_char(stmt[end]))
+            end++;
+        if (end > pos + 1)
+            out.mentions.emplace(stmt.substr(pos + 1, end - pos - 1));
+        else if (end < stmt.size() && (stmt[end] == '{' || stmt[end] == '!'))
+            out.dynamic_mentions = true;
+    }
+}
+
+// !name = value or !name ?= value, where the value doesn't depend on anything else
+static std::optional<define_file::assignment> parse_plain_assignment(std::string_view stmt) {
+    if (stmt.size() < 2 || stmt[0] != '!')
+        return std::nullopt;
+    size_t end = 1;
+    while (end < stmt.size() && is_name_char(stmt[end]))
+        end++;
+    define_file::assignment assignment{.name = std::string{stmt.substr(1, end - 1)}};
+    if (assignment.name.empty())
+        return std::nullopt;
+    while (end < stmt.size() && std::isspace(static_cast<unsigned char>(stmt[end])))
+        end++;
+    if (stmt.substr(end).starts_with("?=")) {
+        assignment.conditional = true;
+        end += 2;
+    } else if (stmt.substr(end).starts_with("=") && !stmt.substr(end).starts_with("==")) {
+        end += 1;
+    } else {
+        return std::nullopt;
+    }
+    assignment.value = stmt.substr(end);
+    trim(assignment.value);
+    std::string& value = assignment.value;
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+        value = value.substr(1, value.size() - 2);
+    // other defines, escapes and further statements on the same line are left to asar
+    if (value.find_first_of("!\\\":") != std::string::npos)
+        return std::nullopt;
+    return assignment;
+}
+
+define_file read_define_file(const std::string& file) {
+    define_file result{};
+    std::ifstream stream{file};
+    if (!stream)
+        return result;
+    bool plain = true;
+    int macro_depth = 0;
+    std::string line;
+    while (std::getline(stream, line)) {
+        std::string stmt{strip_asm_comment(line)};
+        trim(stmt);
+        if (stmt.empty())
+            continue;
+        const std::string word = lowercase_word(stmt);
+        // macro bodies only use defines once they're called, which happens after every define of the prelude exists
+        if (word == "macro") {
+            plain = false;
+            macro_depth++;
+            continue;
+        }
+        if (word == "endmacro") {
+            macro_depth = std::max(macro_depth - 1, 0);
+            continue;
+        }
+        if (macro_depth > 0)
+            continue;
+        find_define_mentions(stmt, result);
+        if (word == "include" || word == "includeonce")
+            continue;
+        if (auto assignment = parse_plain_assignment(stmt))
+            result.assignments.push_back(std::move(*assignment));
+        else
+            plain = false;
+    }
+    result.plain = plain;
+    return result;
+}
+
+static void assign(std::vector<definedata>& defines, const define_file::assignment& assignment) {
+    auto it = std::find_if(defines.begin(), defines.end(),
+                           [&](const definedata& define) { return assignment.name == define.name; });
+    if (it == defines.end())
+        defines.push_back({.name = assignment.name.c_str(), .contents = assignment.value.c_str()});
+    else if (!assignment.conditional)
+        it->contents = assignment.value.c_str();
+}
+
+const define_file& DefinePreludes::file(const std::string& path) {
+    auto it = m_files.find(path);
+    if (it == m_files.end())
+        it = m_files.emplace(path, read_define_file(path)).first;
+    return it->second;
+}
+
+void DefinePreludes::add(prelude& pre, const std::string& path) {
+    const define_file& f = file(path);
+    const bool evaluate = f.plain && !pre.dynamic_mentions &&
+                          std::none_of(f.mentions.begin(), f.mentions.end(),
+                                       [&](const std::string& name) { return pre.mentioned.contains(name); });
+    if (evaluate) {
+        for (const auto& assignment : f.assignments)
+            assign(pre.defines, assignment);
+        return;
+    }
+    pre.includes.push_back(path);
+    pre.mentioned.insert(f.mentions.begin(), f.mentions.end());
+    pre.dynamic_mentions |= f.dynamic_mentions;
+}
+
+void DefinePreludes::clear() {
+    m_files.clear();
+    m_base.reset();
+    m_folders.clear();
+}
+
+void DefinePreludes::begin(std::span<const definedata> config_defines, std::span<const std::string> files) {
+    m_folders.clear();
+    m_base.emplace();
+    m_base->defines.assign(config_defines.begin(), config_defines.end());
+    for (const auto& path : files)
+        add(*m_base, path);
+}
+
+const DefinePreludes::prelude& DefinePreludes::folder(const std::string& header_file) {
+    assert(m_base.has_value());
+    auto it = m_folders.find(header_file);
+    if (it != m_folders.end())
+        return it->second;
+    prelude pre = *m_base;
+    // shared.asm only defines the routine macros, it doesn't use any define until they're called
+    pre.includes.emplace_back("shared.asm");
+    add(pre, header_file);
+    return m_folders.emplace(header_file, std::move(pre)).first->second;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "structs.h"
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// What an asm file does with defines outside of macros, as far as it can be told without assembling it.
+struct define_file {
+    struct assignment {
+        std::string name{};
+        std::string value{};
+        // !name ?= value, only assigns if the define doesn't exist yet
+        bool conditional = false;
+    };
+    // set if the file does nothing but assign plain values to defines, e.g. `!ram = $7FAB10`, then the
+    // assignments are everything it does, in order
+    bool plain = false;
+    std::vector<assignment> assignments{};
+    // every define the file uses or assigns outside of macros
+    std::unordered_set<std::string> mentions{};
+    // set if the file uses a define whose name is built from another one, e.g. !{prefix}_ram
+    bool dynamic_mentions = false;
+};
+
+define_file read_define_file(const std::string& file);
+
+/**
+    The files every sprite patch starts with (sa1def.asm, the ones in ExtraDefines and the folder's _header.asm)
+    are read once per run. The files that only assign plain values to defines are evaluated by pixi and handed to
+    asar as additional defines, next to the ones from the command line, only the others still get incsrc'd.
+
+    A file is only evaluated if none of the files incsrc'd before it use or assign its defines, since its defines
+    now exist before any of them are assembled.
+*/
+class DefinePreludes {
+  public:
+    struct prelude {
+        // files asar still has to incsrc, in order
+        std::vector<std::string> includes{};
+        // the command line defines followed by the evaluated ones, pointing into the cached files
+        std::vector<definedata> defines{};
+        std::unordered_set<std::string> mentioned{};
+        bool dynamic_mentions = false;
+    };
+
+  private:
+    std::unordered_map<std::string, define_file> m_files{};
+    std::optional<prelude> m_base{};
+    std::unordered_map<std::string, prelude> m_folders{};
+
+    const define_file& file(const std::string& path);
+    void add(prelude& pre, const std::string& path);
+
+  public:
+    void clear();
+    // sets up what comes before the shared routines in every sprite patch
+    void begin(std::span<const definedata> config_defines, std::span<const std::string> files);
+    // the prelude for sprites in the folder whose _header.asm this is
+    const prelude& folder(const std::string& header_file);
+};
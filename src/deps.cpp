@@ -0,0 +1,455 @@
+#include "deps.h"
+#include "cfg.h"
+#include "iohandler.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+constexpr int DEPENDENCY_GRAPH_VERSION = 1;
+constexpr const char* edge_type_names[]{"incsrc", "incbin", "routine", "header"};
+
+static std::string_view strip_asm_comment(std::string_view line) {
+    bool in_quotes = false;
+    for (size_t i = 0; i < line.size(); i++) {
+        if (line[i] == '"')
+            in_quotes = !in_quotes;
+        else if (line[i] == ';' && !in_quotes)
+            return line.substr(0, i);
+    }
+    return line;
+}
+
+// returns false if a macro whose name is built from a define or a macro argument gets called
+static bool find_macro_calls(std::string_view stmt, std::vector<std::string>& out) {
+    auto is_name_char = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+    bool resolved = true;
+    for (size_t pos = stmt.find('%'); pos != std::string_view::npos; pos = stmt.find('%', pos + 1)) {
+        size_t end = pos + 1;
+        bool dynamic = false;
+        while (end < stmt.size() && (is_name_char(stmt[end]) || stmt[end] == '!' || stmt[end] == '<' ||
+                                     stmt[end] == '>')) {
+            dynamic |= !is_name_char(stmt[end]);
+            end++;
+        }
+        // %0101 binary literals and the like aren't followed by a parenthesis
+        if (end == pos + 1 || end >= stmt.size() || stmt[end] != '(')
+            continue;
+        if (dynamic) {
+            resolved = false;
+            continue;
+        }
+        std::string name{stmt.substr(pos + 1, end - pos - 1)};
+        if (std::find(out.begin(), out.end(), name) == out.end())
+            out.push_back(std::move(name));
+    }
+    return resolved;
+}
+
+static std::string normal_path(const std::string& file) {
+    return fs::path{file}.lexically_normal().generic_string();
+}
+
+asm_references scan_asm_file(const std::string& file) {
+    asm_references refs{};
+    std::ifstream stream{file};
+    if (!stream) {
+        refs.unresolved = true;
+        return refs;
+    }
+    const fs::path base = fs::path{file}.parent_path();
+    std::string line;
+    while (std::getline(stream, line)) {
+        std::string stmt{strip_asm_comment(line)};
+        trim(stmt);
+        if (!find_macro_calls(stmt, refs.macro_calls))
+            refs.dynamic_macro_calls = true;
+        if (stmt.size() < 7)
+            continue;
+        std::string directive = stmt.substr(0, 11);
+        std::transform(directive.begin(), directive.end(), directive.begin(),
+                       [](char c) { return static_cast<char>(std::tolower(c)); });
+        if (directive == "includeonce" && stmt.size() == 11) {
+            refs.include_once = true;
+            continue;
+        }
+        directive.resize(6);
+        if (directive.starts_with("macro") && libconsole::isspace(stmt[5])) {
+            std::string name = stmt.substr(6, stmt.find('(', 6) - 6);
+            trim(name);
+            if (!name.empty())
+                refs.macro_definitions.push_back(std::move(name));
+            continue;
+        }
+        if ((directive != "incsrc" && directive != "incbin") || !libconsole::isspace(stmt[6]))
+            continue;
+        std::string target = stmt.substr(7);
+        trim(target);
+        if (!target.empty() && target.front() == '"') {
+            auto end = target.find('"', 1);
+            target = target.substr(1, end == std::string::npos ? std::string::npos : end - 1);
+        } else {
+            auto end = std::find_if(target.begin(), target.end(), [](char c) { return libconsole::isspace(c); });
+            target.erase(end, target.end());
+        }
+        if (target.empty() || target.find('!') != std::string::npos) {
+            refs.unresolved = true;
+            continue;
+        }
+        fs::path resolved = base / target;
+        std::error_code ec;
+        if (!fs::is_regular_file(resolved, ec)) {
+            refs.unresolved = true;
+            continue;
+        }
+        std::string resolved_str = resolved.lexically_normal().generic_string();
+        if (std::none_of(refs.includes.begin(), refs.includes.end(),
+                         [&](const auto& include) { return include.file == resolved_str; }))
+            refs.includes.push_back({std::move(resolved_str), directive == "incbin"});
+    }
+    return refs;
+}
+
+void DependencyGraph::clear() {
+    m_nodes.clear();
+    m_index.clear();
+    m_routines.clear();
+    m_routine_names.clear();
+    m_shared.clear();
+    m_query.clear();
+}
+
+size_t DependencyGraph::add_node(const std::string& file, bool& added) {
+    std::string normal = normal_path(file);
+    auto [it, inserted] = m_index.try_emplace(normal, m_nodes.size());
+    added = inserted;
+    if (inserted)
+        m_nodes.push_back(
+            node{.file = std::move(normal), .routine = {}, .sprite = false, .unresolved = false, .edges = {}});
+    return it->second;
+}
+
+void DependencyGraph::set_routines(const std::string& routine_path, const std::vector<std::string>& routine_files) {
+    m_routines.clear();
+    m_routine_names.clear();
+    for (const auto& file : routine_files) {
+        fs::path rel{file};
+        std::string name{};
+        for (const auto& path_part : rel.replace_extension()) {
+            name += path_part.generic_string();
+        }
+        m_routine_names.push_back(name);
+        m_routines.emplace(std::move(name), normal_path((fs::path{routine_path} / file).generic_string()));
+    }
+}
+
+void DependencyGraph::scan_from(size_t start) {
+    std::vector<size_t> pending{start};
+    while (!pending.empty()) {
+        const size_t index = pending.back();
+        pending.pop_back();
+        asm_references refs = scan_asm_file(m_nodes[index].file);
+        m_nodes[index].unresolved = refs.unresolved || refs.dynamic_macro_calls;
+        // m_nodes may grow while linking, so no references into it are kept around
+        auto link = [&](const std::string& file, edge_type type, bool scan) {
+            bool added = false;
+            size_t target = add_node(file, added);
+            m_nodes[index].edges.push_back({target, type});
+            if (added && scan)
+                pending.push_back(target);
+            return target;
+        };
+        for (const auto& include : refs.includes) {
+            link(include.file, include.binary ? edge_type::incbin : edge_type::incsrc, !include.binary);
+        }
+        for (const auto& name : refs.macro_calls) {
+            auto it = m_routines.find(name);
+            if (it == m_routines.end())
+                continue;
+            size_t target = link(it->second, edge_type::routine, true);
+            m_nodes[target].routine = name;
+        }
+    }
+}
+
+void DependencyGraph::add_sprite(const sprite& spr) {
+    if (spr.asm_file.empty())
+        return;
+    bool added = false;
+    const size_t index = add_node(spr.asm_file, added);
+    m_nodes[index].sprite = true;
+    if (!added)
+        return;
+    // pixi itself incsrcs the _header.asm of the sprite's folder before the sprite
+    const std::string header = spr.directory.str() + "_header.asm";
+    std::error_code ec;
+    if (fs::is_regular_file(header, ec)) {
+        bool header_added = false;
+        size_t target = add_node(header, header_added);
+        m_nodes[index].edges.push_back({target, edge_type::header});
+        if (header_added)
+            scan_from(target);
+    }
+    scan_from(index);
+}
+
+void DependencyGraph::add_shared_file(const std::string& file) {
+    bool added = false;
+    const size_t index = add_node(file, added);
+    m_shared.push_back(index);
+    if (added)
+        scan_from(index);
+}
+
+std::optional<size_t> DependencyGraph::find(std::string_view file) const {
+    if (auto it = m_index.find(normal_path(std::string{file})); it != m_index.end())
+        return it->second;
+    // the graph keeps the paths the way pixi got them, they might have been written differently
+    std::error_code ec;
+    const fs::path wanted = fs::absolute(fs::path{file}, ec).lexically_normal();
+    for (size_t i = 0; i < m_nodes.size(); i++) {
+        if (fs::absolute(fs::path{m_nodes[i].file}, ec).lexically_normal() == wanted)
+            return i;
+    }
+    return std::nullopt;
+}
+
+static void collect_reachable(size_t start, const std::vector<std::vector<size_t>>& adjacency,
+                              const std::vector<DependencyGraph::node>& nodes, std::vector<const char*>& out) {
+    std::vector<bool> seen(nodes.size());
+    std::vector<size_t> pending{start};
+    seen[start] = true;
+    while (!pending.empty()) {
+        const size_t index = pending.back();
+        pending.pop_back();
+        for (size_t target : adjacency[index]) {
+            if (seen[target])
+                continue;
+            seen[target] = true;
+            out.push_back(nodes[target].file.c_str());
+            pending.push_back(target);
+        }
+    }
+    std::sort(out.begin(), out.end(), [](const char* a, const char* b) { return strcmp(a, b) < 0; });
+}
+
+std::span<const char* const> DependencyGraph::dependencies(std::string_view file) {
+    m_query.clear();
+    auto start = find(file);
+    if (!start)
+        return m_query;
+    std::vector<std::vector<size_t>> adjacency(m_nodes.size());
+    for (size_t i = 0; i < m_nodes.size(); i++) {
+        for (const edge& e : m_nodes[i].edges) {
+            adjacency[i].push_back(e.target);
+        }
+    }
+    collect_reachable(*start, adjacency, m_nodes, m_query);
+    return m_query;
+}
+
+std::span<const char* const> DependencyGraph::dependents(std::string_view file) {
+    m_query.clear();
+    auto start = find(file);
+    if (!start)
+        return m_query;
+    std::vector<std::vector<size_t>> reverse(m_nodes.size());
+    for (size_t i = 0; i < m_nodes.size(); i++) {
+        for (const edge& e : m_nodes[i].edges) {
+            reverse[e.target].push_back(i);
+        }
+    }
+    collect_reachable(*start, reverse, m_nodes, m_query);
+    return m_query;
+}
+
+std::optional<std::vector<std::string>> DependencyGraph::routine_order(std::span<const std::string> files) const {
+    std::vector<size_t> roots{m_shared};
+    for (const auto& file : files) {
+        auto index = find(file);
+        if (!index)
+            return std::nullopt;
+        roots.push_back(*index);
+    }
+
+    // the routines each routine calls, directly or through the files it includes
+    std::vector<bool> seen(m_nodes.size());
+    auto called_routines = [&](std::span<const size_t> from) -> std::optional<std::vector<size_t>> {
+        std::vector<size_t> called{};
+        std::vector<size_t> pending{};
+        std::fill(seen.begin(), seen.end(), false);
+        for (size_t index : from) {
+            seen[index] = true;
+            pending.push_back(index);
+        }
+        while (!pending.empty()) {
+            const size_t index = pending.back();
+            pending.pop_back();
+            if (m_nodes[index].unresolved)
+                return std::nullopt;
+            for (const edge& e : m_nodes[index].edges) {
+                if (e.type == edge_type::incbin || seen[e.target])
+                    continue;
+                seen[e.target] = true;
+                if (m_nodes[e.target].routine.empty())
+                    pending.push_back(e.target);
+                else
+                    called.push_back(e.target);
+            }
+        }
+        return called;
+    };
+    auto root_calls = called_routines(roots);
+    if (!root_calls)
+        return std::nullopt;
+    std::unordered_map<size_t, std::vector<size_t>> calls{};
+    std::vector<size_t> pending{*root_calls};
+    while (!pending.empty()) {
+        const size_t routine = pending.back();
+        pending.pop_back();
+        if (calls.contains(routine))
+            continue;
+        auto called = called_routines(std::span{&routine, 1});
+        if (!called)
+            return std::nullopt;
+        pending.insert(pending.end(), called->begin(), called->end());
+        calls.emplace(routine, std::move(*called));
+    }
+
+    // Tarjan's algorithm gives the strongly connected components callees first
+    struct visit {
+        size_t index = 0;
+        size_t lowlink = 0;
+        bool on_stack = false;
+    };
+    std::unordered_map<size_t, visit> visits{};
+    std::vector<size_t> stack{};
+    std::vector<std::vector<size_t>> components{};
+    size_t counter = 0;
+    auto strong_connect = [&](auto& self, size_t routine) -> void {
+        visits[routine] = {counter, counter, true};
+        counter++;
+        stack.push_back(routine);
+        for (size_t callee : calls.at(routine)) {
+            if (auto it = visits.find(callee); it == visits.end()) {
+                self(self, callee);
+                visits[routine].lowlink = std::min(visits[routine].lowlink, visits[callee].lowlink);
+            } else if (it->second.on_stack) {
+                visits[routine].lowlink = std::min(visits[routine].lowlink, it->second.index);
+            }
+        }
+        if (visits[routine].lowlink != visits[routine].index)
+            return;
+        std::vector<size_t>& component = components.emplace_back();
+        size_t member = 0;
+        do {
+            member = stack.back();
+            stack.pop_back();
+            visits[member].on_stack = false;
+            component.push_back(member);
+        } while (member != routine);
+    };
+    for (size_t routine : *root_calls) {
+        if (!visits.contains(routine))
+            strong_connect(strong_connect, routine);
+    }
+
+    // a routine is only inserted once one of its callers has been, so callers go first. Routines calling each
+    // other in a cycle are listed once per member, which is enough for any of them to pull in all the others.
+    std::vector<std::string> order{};
+    for (auto it = components.rbegin(); it != components.rend(); ++it) {
+        const size_t passes = it->size();
+        for (size_t pass = 0; pass < passes; pass++) {
+            for (size_t routine : *it) {
+                order.push_back(m_nodes[routine].routine);
+            }
+        }
+    }
+    return order;
+}
+
+void DependencyGraph::dump() const {
+    iohandler& io = iohandler::get_global();
+    io.print("Dependency graph (%zu files):\n", m_nodes.size());
+    for (const node& n : m_nodes) {
+        if (n.edges.empty() && !n.unresolved)
+            continue;
+        io.print("%s%s%s%s:\n", n.file.c_str(), n.routine.empty() ? "" : " (routine ", n.routine.c_str(),
+                 n.routine.empty() ? "" : ")");
+        for (const edge& e : n.edges) {
+            io.print("    %-7s %s\n", edge_type_names[static_cast<size_t>(e.type)], m_nodes[e.target].file.c_str());
+        }
+        if (n.unresolved)
+            io.print("    (some includes or routine calls can't be resolved without assembling)\n");
+    }
+}
+
+bool DependencyGraph::save(const std::string& path) const {
+    json files = json::array();
+    for (const node& n : m_nodes) {
+        json edges = json::array();
+        for (const edge& e : n.edges) {
+            edges.push_back({e.target, edge_type_names[static_cast<size_t>(e.type)]});
+        }
+        files.push_back({{"file", n.file},
+                         {"routine", n.routine},
+                         {"sprite", n.sprite},
+                         {"unresolved", n.unresolved},
+                         {"edges", std::move(edges)}});
+    }
+    json j{{"version", DEPENDENCY_GRAPH_VERSION}, {"files", std::move(files)}};
+    std::ofstream file{path, std::ios::trunc};
+    if (!file) {
+        iohandler::get_global().error("Couldn't write dependency graph file %s\n", path.c_str());
+        return false;
+    }
+    // file names aren't guaranteed to be valid UTF-8
+    file << j.dump(1, '\t', false, json::error_handler_t::replace);
+    return true;
+}
+
+bool DependencyGraph::load(const std::string& path) {
+    iohandler& io = iohandler::get_global();
+    clear();
+    std::ifstream file{path};
+    if (!file) {
+        io.error("Couldn't open dependency graph file %s\n", path.c_str());
+        return false;
+    }
+    json j = json::parse(file, nullptr, false);
+    if (j.is_discarded() || !j.is_object() || j.value("version", 0) != DEPENDENCY_GRAPH_VERSION) {
+        io.error("Dependency graph file %s is corrupted or from a different version of pixi\n", path.c_str());
+        return false;
+    }
+    try {
+        const auto& files = j.at("files");
+        for (const auto& jnode : files) {
+            node n{.file = jnode.at("file").get<std::string>(),
+                   .routine = jnode.at("routine").get<std::string>(),
+                   .sprite = jnode.at("sprite").get<bool>(),
+                   .unresolved = jnode.at("unresolved").get<bool>(),
+                   .edges = {}};
+            for (const auto& jedge : jnode.at("edges")) {
+                size_t target = jedge.at(0).get<size_t>();
+                std::string type = jedge.at(1).get<std::string>();
+                auto name = std::find(std::begin(edge_type_names), std::end(edge_type_names), type);
+                if (target >= files.size() || name == std::end(edge_type_names))
+                    throw std::out_of_range{"invalid edge"};
+                n.edges.push_back({target, static_cast<edge_type>(name - std::begin(edge_type_names))});
+            }
+            m_index.emplace(n.file, m_nodes.size());
+            if (!n.routine.empty())
+                m_routines.emplace(n.routine, n.file);
+            m_nodes.push_back(std::move(n));
+        }
+    } catch (const std::exception& err) {
+        io.error("Dependency graph file %s is corrupted: %s\n", path.c_str(), err.what());
+        clear();
+        return false;
+    }
+    return true;
+}
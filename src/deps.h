@@ -0,0 +1,95 @@
+#pragma once
+#include "structs.h"
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// What a single asm file pulls in, as far as it can be told without assembling it.
+struct asm_references {
+    struct include {
+        std::string file{};
+        bool binary = false;
+    };
+    // incsrc/incbin targets that exist, resolved relative to the including file, in order of appearance
+    std::vector<include> includes{};
+    // names of every macro called as %name(...)
+    std::vector<std::string> macro_calls{};
+    // names of every macro the file itself defines
+    std::vector<std::string> macro_definitions{};
+    // set if the file has an includeonce, including it a second time doesn't define anything again
+    bool include_once = false;
+    // set if the file couldn't be read or an include couldn't be resolved (e.g. it uses a define)
+    bool unresolved = false;
+    // set if a macro whose name depends on a define or a macro argument gets called, e.g. %!name()
+    bool dynamic_macro_calls = false;
+};
+
+asm_references scan_asm_file(const std::string& file);
+
+/**
+    Which files each sprite actually pulls in: incsrc/incbin'd files, its folder's _header.asm and the
+    shared routines it calls through their %Routine() macros, recursing into all of them.
+
+    Built by pixi_run after the list has been parsed, dumped by --deps and queryable through the C API.
+    Saved next to the ROM as <romname>.pixideps with --deps and --incremental.
+*/
+class DependencyGraph {
+  public:
+    enum class edge_type : uint8_t { incsrc, incbin, routine, header };
+    struct edge {
+        size_t target = 0;
+        edge_type type = edge_type::incsrc;
+    };
+    struct node {
+        std::string file{};
+        // name of the routine if this file is a shared routine
+        std::string routine{};
+        bool sprite = false;
+        bool unresolved = false;
+        std::vector<edge> edges{};
+    };
+
+  private:
+    std::vector<node> m_nodes{};
+    std::unordered_map<std::string, size_t> m_index{};
+    std::unordered_map<std::string, std::string> m_routines{};
+    // in the order of their entries in the routine table
+    std::vector<std::string> m_routine_names{};
+    std::vector<size_t> m_shared{};
+    std::vector<const char*> m_query{};
+
+    size_t add_node(const std::string& file, bool& added);
+    void scan_from(size_t index);
+    std::optional<size_t> find(std::string_view file) const;
+
+  public:
+    void clear();
+    // registers the routines the same way create_shared_patch names them, must be called before add_sprite
+    void set_routines(const std::string& routine_path, const std::vector<std::string>& routine_files);
+    std::span<const std::string> routine_names() const {
+        return m_routine_names;
+    }
+    void add_sprite(const sprite& spr);
+    // a file every sprite patch includes, like the ones in ExtraDefines
+    void add_shared_file(const std::string& file);
+
+    const std::vector<node>& nodes() const {
+        return m_nodes;
+    }
+    // every file `file` depends on, directly or not, sorted by path
+    std::span<const char* const> dependencies(std::string_view file);
+    // every file that depends on `file`, directly or not, sorted by path
+    std::span<const char* const> dependents(std::string_view file);
+
+    // the routines a patch with these sprites (and the shared files) can call, each after the routines that call it.
+    // nullopt if any file along the way can't be resolved without assembling it.
+    std::optional<std::vector<std::string>> routine_order(std::span<const std::string> files) const;
+
+    void dump() const;
+    [[nodiscard]] bool save(const std::string& path) const;
+    [[nodiscard]] bool load(const std::string& path);
+};
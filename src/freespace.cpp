@@ -0,0 +1,257 @@
+#include "freespace.h"
+#include "iohandler.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+namespace fs = std::filesystem;
+
+constexpr int FREESPACE_BANK_SIZE = 0x8000;
+// asar never puts anything in the first 512KB
+constexpr int FREESPACE_FIRST_BANK = 0x10;
+constexpr unsigned char FREESPACE_BYTE = 0x00;
+// a RATS tag and at least one byte
+constexpr int FREESPACE_MIN_RUN = 9;
+
+const char* freespace_owner_name(FreespaceMap::owner type) {
+    switch (type) {
+    case FreespaceMap::owner::per_level:
+        return "per-level";
+    case FreespaceMap::owner::routine:
+        return "routine";
+    case FreespaceMap::owner::sprite:
+        return "sprite";
+    case FreespaceMap::owner::meimei:
+        return "meimei";
+    case FreespaceMap::owner::patch:
+        return "patch";
+    case FreespaceMap::owner::foreign:
+        break;
+    }
+    return "foreign";
+}
+
+void FreespaceMap::reset() {
+    m_enabled = false;
+    m_claims.clear();
+    m_banks.clear();
+    m_rom_name.clear();
+}
+
+void FreespaceMap::claim(pcaddress pc, owner type, std::string name) {
+    if (!m_enabled || pc == -1)
+        return;
+    m_claims.push_back({.range = {pc.raw_value(), 1}, .type = type, .name = std::move(name)});
+}
+
+void FreespaceMap::claim(std::span<const rom_range> ranges, owner type, const std::string& name) {
+    if (!m_enabled)
+        return;
+    for (const rom_range& range : ranges)
+        m_claims.push_back({.range = range, .type = type, .name = name});
+}
+
+void FreespaceMap::build(const RatsIndex& rats, ROM& rom) {
+    m_banks.clear();
+    m_rom_name = rom.name;
+    const std::span<const RatsIndex::tag> blocks = rats.blocks();
+    // the protected blocks never overlap, so their ends are sorted as well
+    auto first_ending_after = [&](int pc) {
+        return std::partition_point(blocks.begin(), blocks.end(),
+                                    [pc](const RatsIndex::tag& b) { return b.end() <= pc; });
+    };
+
+    std::vector<const ownership*> owners(blocks.size(), nullptr);
+    auto assign = [&](size_t index, const ownership* by) {
+        if (owners[index] != nullptr && owners[index]->type <= by->type)
+            return false;
+        owners[index] = by;
+        return true;
+    };
+    std::vector<size_t> claimed{};
+    for (const ownership& c : m_claims) {
+        for (auto it = first_ending_after(c.range.pc); it != blocks.end() && it->pc < c.range.pc + c.range.size; ++it) {
+            const auto index = static_cast<size_t>(it - blocks.begin());
+            if (assign(index, &c))
+                claimed.push_back(index);
+        }
+    }
+
+    // "PROT", 3 byte pointers to the data of other blocks, "STOP" at the start of a block's data
+    const int rom_end = rom.size + rom.header_size;
+    while (!claimed.empty()) {
+        const size_t index = claimed.back();
+        claimed.pop_back();
+        const RatsIndex::tag& block = blocks[index];
+        const unsigned char* data = rom.data + pcaddress{block.data()};
+        if (block.size < 4 || memcmp(data, "PROT", 4) != 0)
+            continue;
+        for (int offset = 4; offset + 3 <= block.size; offset += 3) {
+            if (offset + 4 <= block.size && memcmp(data + offset, "STOP", 4) == 0)
+                break;
+            const int snes = data[offset] | (data[offset + 1] << 8) | (data[offset + 2] << 16);
+            const pcaddress pc = rom.snes_to_pc(snes);
+            if (pc == -1 || pc.raw_value() >= rom_end)
+                continue;
+            auto it = first_ending_after(pc.raw_value());
+            if (it == blocks.end() || it->pc > pc.raw_value())
+                continue;
+            const auto protected_index = static_cast<size_t>(it - blocks.begin());
+            if (assign(protected_index, owners[index]))
+                claimed.push_back(protected_index);
+        }
+    }
+
+    const unsigned char* data = rom.unheadered_data();
+    const int bank_count = (rom.size + FREESPACE_BANK_SIZE - 1) / FREESPACE_BANK_SIZE;
+    auto next_block = blocks.begin();
+    for (int number = FREESPACE_FIRST_BANK; number < bank_count; number++) {
+        bank current{};
+        current.number = number;
+        current.pc = number * FREESPACE_BANK_SIZE + rom.header_size;
+        current.snes = rom.pc_to_snes(current.pc).raw_value();
+        current.size = std::min(FREESPACE_BANK_SIZE, rom.size - number * FREESPACE_BANK_SIZE);
+        const int bank_end = current.pc + current.size;
+
+        auto add_gap = [&](int from, int to) {
+            int at = from;
+            while (at < to) {
+                const unsigned char* start =
+                    std::find(data + at - rom.header_size, data + to - rom.header_size, FREESPACE_BYTE);
+                at = static_cast<int>(start - data) + rom.header_size;
+                const unsigned char* end = std::find_if(start, data + to - rom.header_size,
+                                                        [](unsigned char b) { return b != FREESPACE_BYTE; });
+                const int size = static_cast<int>(end - start);
+                if (size == 0)
+                    break;
+                current.free += size;
+                current.largest_free = std::max(current.largest_free, size);
+                if (size >= FREESPACE_MIN_RUN)
+                    current.runs.push_back({at, rom.pc_to_snes(at).raw_value(), size});
+                at += size;
+            }
+        };
+
+        // blocks before the first bank, a block running over from the previous bank is kept
+        while (next_block != blocks.end() && next_block->end() <= current.pc)
+            ++next_block;
+        int pc = current.pc;
+        for (; next_block != blocks.end() && next_block->pc < bank_end; ++next_block) {
+            const RatsIndex::tag& tag = *next_block;
+            add_gap(pc, std::max(pc, tag.pc));
+            const int covered_end = std::min(tag.end(), bank_end);
+            current.used += covered_end - std::max(tag.pc, current.pc);
+            pc = covered_end;
+            if (tag.pc < current.pc)
+                continue;
+            const ownership* by = owners[static_cast<size_t>(next_block - blocks.begin())];
+            current.blocks.push_back({.tag = tag,
+                                      .snes = rom.pc_to_snes(tag.pc).raw_value(),
+                                      .type = by != nullptr ? by->type : owner::foreign,
+                                      .name = by != nullptr ? by->name : std::string{}});
+            if (tag.end() > bank_end)
+                break;
+        }
+        add_gap(pc, bank_end);
+        m_banks.push_back(std::move(current));
+    }
+}
+
+int FreespaceMap::free_bytes() const {
+    int free = 0;
+    for (const bank& b : m_banks)
+        free += b.free;
+    return free;
+}
+
+double FreespaceMap::fragmentation() const {
+    int free = 0;
+    int largest = 0;
+    for (const bank& b : m_banks) {
+        free += b.free;
+        largest += b.largest_free;
+    }
+    return free == 0 ? 0.0 : 1.0 - static_cast<double>(largest) / free;
+}
+
+std::string FreespaceMap::summary() const {
+    int largest = 0;
+    for (const bank& b : m_banks)
+        largest = std::max(largest, b.largest_free);
+    return fstring("%d bytes free in %zu banks, largest free run %d bytes, %.1f%% fragmented", free_bytes(),
+                   m_banks.size(), largest, fragmentation() * 100.0);
+}
+
+std::string FreespaceMap::text() const {
+    std::string out = fstring("Freespace of %s\n%s\n", m_rom_name.c_str(), summary().c_str());
+    for (const bank& b : m_banks) {
+        out += fstring("\nBank $%02X (pc 0x%06X): %d bytes used in %zu blocks, %d free, largest free run %d, "
+                       "%.1f%% fragmented\n",
+                       (b.snes >> 16) & 0xFF, b.pc, b.used, b.blocks.size(), b.free, b.largest_free,
+                       b.fragmentation() * 100.0);
+        // blocks and free runs merged by address
+        size_t next_run = 0;
+        auto print_runs_before = [&](int pc) {
+            for (; next_run < b.runs.size() && b.runs[next_run].pc < pc; next_run++)
+                out += fstring("    $%06X %6d  free\n", b.runs[next_run].snes, b.runs[next_run].size);
+        };
+        for (const block& blk : b.blocks) {
+            print_runs_before(blk.tag.pc);
+            std::string line = fstring("    $%06X %6d  %-9s %s", blk.snes, blk.tag.end() - blk.tag.pc,
+                                       freespace_owner_name(blk.type), blk.name.c_str());
+            if (blk.tag.type == RatsIndex::kind::sprite_tool)
+                line += " (sprite_tool tag)";
+            line.erase(line.find_last_not_of(' ') + 1);
+            out.append(line).push_back('\n');
+        }
+        print_runs_before(b.pc + b.size);
+    }
+    return out;
+}
+
+std::string FreespaceMap::json() const {
+    using json = nlohmann::json;
+    json banks = json::array();
+    for (const bank& b : m_banks) {
+        json blocks = json::array();
+        for (const block& blk : b.blocks) {
+            blocks.push_back({{"pc", blk.tag.pc},
+                              {"snes", blk.snes},
+                              {"size", blk.tag.end() - blk.tag.pc},
+                              {"owner", freespace_owner_name(blk.type)},
+                              {"name", blk.name},
+                              {"sprite_tool", blk.tag.type == RatsIndex::kind::sprite_tool}});
+        }
+        json runs = json::array();
+        for (const free_run& run : b.runs)
+            runs.push_back({{"pc", run.pc}, {"snes", run.snes}, {"size", run.size}});
+        banks.push_back({{"bank", b.number},
+                         {"pc", b.pc},
+                         {"snes", b.snes},
+                         {"size", b.size},
+                         {"used", b.used},
+                         {"free", b.free},
+                         {"largest_free", b.largest_free},
+                         {"fragmentation", b.fragmentation()},
+                         {"blocks", std::move(blocks)},
+                         {"free_runs", std::move(runs)}});
+    }
+    json j{{"rom", m_rom_name},
+           {"free", free_bytes()},
+           {"fragmentation", fragmentation()},
+           {"banks", std::move(banks)}};
+    // file names aren't guaranteed to be valid UTF-8
+    return j.dump(1, '\t', false, json::error_handler_t::replace);
+}
+
+bool FreespaceMap::write(const std::string& path) const {
+    std::ofstream file{path, std::ios::trunc};
+    if (!file) {
+        iohandler::get_global().error("Couldn't write freespace report %s\n", path.c_str());
+        return false;
+    }
+    file << (fs::path{path}.extension() == ".json" ? json() : text());
+    return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "rats.h"
+#include "structs.h"
+#include <span>
+#include <string>
+#include <vector>
+
+/**
+    Bank by bank map of the ROM's freespace once the insertion is done (--freespace-report).
+
+    Every RATS protected block from bank $10 on is listed with what it belongs to. While inserting, pixi claims the
+    addresses it knows about: the code of every sprite (through its pointers, so sprites kept by --incremental are
+    found too), the shared routines (through their pointer table at $03E05C), the per-level tables, the blocks MeiMei
+    wrote and the ones written by the core patches and ExtraHijacks. A block protected with prot by a block that
+    is claimed belongs to the same owner, blocks nobody claimed were put there by another tool.
+
+    The rest of each bank is split in runs of free bytes ($00, asar's default freespace byte). Runs shorter than a
+    RATS tag and one byte can't hold anything and aren't listed, but they still count as free.
+    A bank's fragmentation is 1 - largest free run / free bytes, the ROM's is the same with the sum of each bank's
+    largest run since a block never crosses a bank.
+*/
+class FreespaceMap {
+  public:
+    // in order of precedence, a block claimed as more than one keeps the first
+    enum class owner { per_level, routine, sprite, meimei, patch, foreign };
+    struct block {
+        RatsIndex::tag tag{};
+        int snes = 0;
+        owner type = owner::foreign;
+        std::string name{};
+    };
+    struct free_run {
+        int pc = 0;
+        int snes = 0;
+        int size = 0;
+    };
+    struct bank {
+        // 32KB bank of the file, counted from the start of the unheadered ROM
+        int number = 0;
+        int pc = 0;
+        int snes = 0;
+        int size = 0;
+        std::vector<block> blocks{};
+        std::vector<free_run> runs{};
+        int used = 0;
+        int free = 0;
+        int largest_free = 0;
+        double fragmentation() const {
+            return free == 0 ? 0.0 : 1.0 - static_cast<double>(largest_free) / free;
+        }
+    };
+
+  private:
+    struct ownership {
+        rom_range range{};
+        owner type = owner::foreign;
+        std::string name{};
+    };
+
+    bool m_enabled = false;
+    std::vector<ownership> m_claims{};
+    std::vector<bank> m_banks{};
+    std::string m_rom_name{};
+
+  public:
+    void reset();
+    void enable() {
+        m_enabled = true;
+    }
+    bool enabled() const {
+        return m_enabled;
+    }
+    // the blocks containing or overlapping these addresses belong to `name`, pc is headered
+    void claim(pcaddress pc, owner type, std::string name);
+    void claim(std::span<const rom_range> ranges, owner type, const std::string& name);
+
+    // maps the ROM as it is now, rats has to be built from the same data
+    void build(const RatsIndex& rats, ROM& rom);
+    std::span<const bank> banks() const {
+        return m_banks;
+    }
+    int free_bytes() const;
+    double fragmentation() const;
+
+    // a one line summary for the output
+    std::string summary() const;
+    // JSON if the path ends in .json, text otherwise
+    [[nodiscard]] bool write(const std::string& path) const;
+    std::string text() const;
+    std::string json() const;
+};
+
+const char* freespace_owner_name(FreespaceMap::owner type);
@@ -0,0 +1,308 @@
+#include "incremental.h"
+#include "cfg.h"
+#include "deps.h"
+#include "iohandler.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <nlohmann/json.hpp>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+constexpr int INCREMENTAL_STATE_VERSION = 2;
+
+fnv1a& fnv1a::update(const void* data, size_t size) {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        m_hash ^= bytes[i];
+        m_hash *= 0x100000001b3ull;
+    }
+    return *this;
+}
+
+fnv1a& fnv1a::update(std::string_view str) {
+    update(str.data(), str.size());
+    // separator so that ("ab", "c") and ("a", "bc") don't hash the same
+    return update_value('\0');
+}
+
+bool fnv1a::update_file(const std::string& path) {
+    update(path);
+    std::ifstream file{path, std::ios::binary};
+    if (!file)
+        return false;
+    std::string contents{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    update(contents);
+    return true;
+}
+
+// Finds every file pulled in by incsrc/incbin starting from `file`, recursing into incsrc'd files.
+// If an include can't be resolved without assembling (e.g. it uses a define), `unresolved` is set.
+void collect_asm_includes(const std::string& file, std::vector<std::string>& out, bool& unresolved) {
+    asm_references refs = scan_asm_file(file);
+    unresolved |= refs.unresolved;
+    for (auto& include : refs.includes) {
+        if (std::find(out.begin(), out.end(), include.file) != out.end())
+            continue;
+        out.push_back(include.file);
+        if (!include.binary)
+            collect_asm_includes(include.file, out, unresolved);
+    }
+}
+
+uint64_t hash_global_inputs(const PixiConfig& config, const std::vector<std::string>& extra_defines,
+                            const std::vector<definedata>& config_defines, int version) {
+    fnv1a hash{};
+    hash.update_value(version);
+    hash.update_value(config.PerLevel);
+    for (const auto& define : config_defines) {
+        hash.update(define.name);
+        hash.update(define.contents);
+    }
+    for (const auto& file : extra_defines) {
+        hash.update_file(file);
+    }
+    hash.update_file(config.AsmDir + "sa1def.asm");
+    if (!config.AsarStdIncludes.empty())
+        hash.update_file(config.AsarStdIncludes);
+    if (!config.AsarStdDefines.empty())
+        hash.update_file(config.AsarStdDefines);
+
+    // the routines make up shared.asm and are shared between all the sprites, hash all of them.
+    const std::string& routine_path = config[PathType::Routines];
+    std::vector<std::string> routines{};
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator{routine_path, ec}; !ec && it != fs::recursive_directory_iterator{};
+         it.increment(ec)) {
+        if (it->is_regular_file() && it->path().extension() == ".asm")
+            routines.push_back(it->path().generic_string());
+    }
+    std::sort(routines.begin(), routines.end());
+    std::vector<std::string> includes{};
+    bool unresolved = false;
+    for (const auto& routine : routines) {
+        hash.update_file(routine);
+        collect_asm_includes(routine, includes, unresolved);
+    }
+    for (const auto& include : includes) {
+        hash.update_file(include);
+    }
+    return hash.value();
+}
+
+void IncrementalState::reset() {
+    m_enabled = false;
+    m_previous_valid = false;
+    m_path.clear();
+    m_global_hash = 0;
+    m_previous.clear();
+    m_current.clear();
+    m_source_hashes.clear();
+    m_preserved.clear();
+    m_kept.clear();
+    m_kept_routines.clear();
+    m_asm_files = asm_file_index{};
+}
+
+uint64_t IncrementalState::source_hash(const sprite& spr) {
+    const std::string& file = key(spr.asm_file);
+    if (auto it = m_source_hashes.find(file); it != m_source_hashes.end())
+        return it->second;
+    fnv1a hash{};
+    hash.update_value(m_global_hash);
+    bool unresolved = !hash.update_file(spr.asm_file);
+    hash.update_file(spr.directory.str() + "_header.asm");
+    std::vector<std::string> includes{};
+    collect_asm_includes(spr.asm_file, includes, unresolved);
+    for (const auto& include : includes) {
+        hash.update_file(include);
+    }
+    // 0 is reserved for "can't tell if it changed", those always get reassembled.
+    uint64_t value = unresolved ? 0 : (hash.value() == 0 ? 1 : hash.value());
+    m_source_hashes.emplace(file, value);
+    return value;
+}
+
+void IncrementalState::begin(const ROM& rom, uint64_t global_hash) {
+    iohandler& io = iohandler::get_global();
+    m_enabled = true;
+    m_global_hash = global_hash;
+    m_path = fs::path{rom.name}.replace_extension(".pixiinc").generic_string();
+
+    std::ifstream file{m_path};
+    if (!file) {
+        io.debug("No incremental state found at %s, all sprites will be inserted\n", m_path.c_str());
+        return;
+    }
+    json j = json::parse(file, nullptr, false);
+    if (j.is_discarded() || !j.is_object()) {
+        io.print("Incremental state file %s is corrupted, all sprites will be inserted\n", m_path.c_str());
+        return;
+    }
+    if (j.value("version", 0) != INCREMENTAL_STATE_VERSION || j.value("global_hash", uint64_t{0}) != global_hash) {
+        io.debug("Shared sources changed since the last insertion, all sprites will be inserted\n");
+        return;
+    }
+    try {
+        for (const auto& jentry : j.at("sprites")) {
+            entry e{};
+            e.type = ToEnum<ListType>(jentry.at("type").get<uint8_t>());
+            e.source_hash = jentry.at("hash").get<uint64_t>();
+            e.init = jentry.at("init").get<int>();
+            e.main = jentry.at("main").get<int>();
+            e.cape = jentry.at("cape").get<int>();
+            const auto& ptrs = jentry.at("ptrs");
+            e.ptrs.carriable = ptrs.at(0).get<int>();
+            e.ptrs.kicked = ptrs.at(1).get<int>();
+            e.ptrs.carried = ptrs.at(2).get<int>();
+            e.ptrs.mouth = ptrs.at(3).get<int>();
+            e.ptrs.goal = ptrs.at(4).get<int>();
+            for (const auto& jblock : jentry.at("blocks")) {
+                e.blocks.push_back(
+                    {jblock.at(0).get<int>(), jblock.at(1).get<int>(), jblock.at(2).get<uint64_t>()});
+            }
+            m_previous.emplace(jentry.at("asm_file").get<std::string>(), std::move(e));
+        }
+    } catch (const json::exception& err) {
+        io.print("Incremental state file %s is corrupted (%s), all sprites will be inserted\n", m_path.c_str(),
+                 err.what());
+        m_previous.clear();
+        return;
+    }
+    m_previous_valid = true;
+}
+
+void IncrementalState::plan(const sprite_registry& registry, const ROM& rom) {
+    if (!m_previous_valid)
+        return;
+    const int rom_end = rom.size + rom.header_size;
+    auto intact = [&](const entry& e) {
+        return std::all_of(e.blocks.begin(), e.blocks.end(), [&](const block& b) {
+            if (b.pc < rom.header_size || b.size <= 0 || b.pc + b.size > rom_end)
+                return false;
+            return fnv1a{}.update(rom.data + pcaddress{b.pc}, b.size).value() == b.hash;
+        });
+    };
+    for (size_t t = 0; t < FromEnum(ListType::__SIZE__); t++) {
+        for (const sprite* sprite_ptr : registry.sprites(ToEnum<ListType>(static_cast<uint8_t>(t)))) {
+            const sprite& spr = *sprite_ptr;
+            if (spr.asm_file.empty())
+                continue;
+            const std::string& file = key(spr.asm_file);
+            if (m_current.contains(file))
+                continue;
+            auto it = m_previous.find(file);
+            if (it == m_previous.end())
+                continue;
+            const entry& prev = it->second;
+            uint64_t hash = source_hash(spr);
+            if (prev.type != spr.sprite_type || hash == 0 || hash != prev.source_hash || !intact(prev))
+                continue;
+            m_current.emplace(file, prev);
+            m_kept.insert(file);
+            for (const pointer& ptr : {prev.init, prev.main, prev.cape, prev.ptrs.carriable, prev.ptrs.kicked,
+                                       prev.ptrs.carried, prev.ptrs.mouth, prev.ptrs.goal}) {
+                if (!ptr.is_empty())
+                    m_preserved.insert(ptr.raw());
+            }
+        }
+    }
+}
+
+void IncrementalState::plan_routines(const DependencyGraph& deps, const sprite_registry& registry) {
+    if (!m_previous_valid)
+        return;
+    const std::span<const std::string> names = deps.routine_names();
+    std::vector<std::string> files{};
+    std::unordered_set<std::string_view> seen{};
+    for (size_t t = 0; t < FromEnum(ListType::__SIZE__); t++) {
+        for (const sprite* spr : registry.sprites(ToEnum<ListType>(static_cast<uint8_t>(t)))) {
+            if (!spr->asm_file.empty() && seen.insert(spr->asm_file).second)
+                files.push_back(spr->asm_file);
+        }
+    }
+    auto reached = deps.routine_order(files);
+    // without knowing which routines the kept sprites call none of them can go
+    if (!reached) {
+        iohandler::get_global().debug("Can't tell which routines the list calls, keeping all of them\n");
+        m_kept_routines.assign(names.size(), true);
+        return;
+    }
+    const std::unordered_set<std::string_view> called{reached->begin(), reached->end()};
+    m_kept_routines.assign(names.size(), false);
+    for (size_t i = 0; i < names.size(); i++) {
+        m_kept_routines[i] = called.contains(names[i]);
+    }
+}
+
+bool IncrementalState::reuse(sprite& spr) {
+    if (!m_enabled)
+        return false;
+    const std::string& file = key(spr.asm_file);
+    auto it = m_current.find(file);
+    if (it == m_current.end() || !m_kept.contains(file))
+        return false;
+    const entry& e = it->second;
+    spr.table.init = e.init;
+    spr.table.main = e.main;
+    spr.extended_cape_ptr = e.cape;
+    spr.ptrs = e.ptrs;
+    iohandler::get_global().debug("%s unchanged, keeping previous insertion (INIT: $%06X, MAIN: $%06X)\n",
+                                  spr.asm_file.c_str(), e.init.raw(), e.main.raw());
+    return true;
+}
+
+void IncrementalState::record(const sprite& spr, const ROM& rom, std::span<const rom_range> written) {
+    if (!m_enabled)
+        return;
+    uint64_t hash = source_hash(spr);
+    if (hash == 0)
+        return;
+    entry e{.type = spr.sprite_type,
+            .source_hash = hash,
+            .init = spr.table.init,
+            .main = spr.table.main,
+            .cape = spr.extended_cape_ptr,
+            .ptrs = spr.ptrs,
+            .blocks = {}};
+    for (const auto& range : written) {
+        e.blocks.push_back({range.pc, range.size, fnv1a{}.update(rom.data + pcaddress{range.pc}, range.size).value()});
+    }
+    m_current.insert_or_assign(key(spr.asm_file), std::move(e));
+}
+
+bool IncrementalState::save() const {
+    if (!m_enabled)
+        return true;
+    json j{};
+    j["version"] = INCREMENTAL_STATE_VERSION;
+    j["global_hash"] = m_global_hash;
+    json sprites = json::array();
+    for (const auto& [asm_file, e] : m_current) {
+        json jblocks = json::array();
+        for (const auto& b : e.blocks) {
+            jblocks.push_back({b.pc, b.size, b.hash});
+        }
+        sprites.push_back({{"asm_file", asm_file},
+                           {"type", FromEnum(e.type)},
+                           {"hash", e.source_hash},
+                           {"init", e.init.raw()},
+                           {"main", e.main.raw()},
+                           {"cape", e.cape.raw()},
+                           {"ptrs",
+                            {e.ptrs.carriable.raw(), e.ptrs.kicked.raw(), e.ptrs.carried.raw(), e.ptrs.mouth.raw(),
+                             e.ptrs.goal.raw()}},
+                           {"blocks", jblocks}});
+    }
+    j["sprites"] = std::move(sprites);
+    std::ofstream file{m_path, std::ios::trunc};
+    if (!file) {
+        iohandler::get_global().error("Couldn't write incremental state file %s\n", m_path.c_str());
+        return false;
+    }
+    // file names aren't guaranteed to be valid UTF-8, the ones that aren't just won't match on the next run
+    file << j.dump(1, '\t', false, json::error_handler_t::replace);
+    return true;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include "config.h"
+#include "deps.h"
+#include "registry.h"
+#include "structs.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// 64-bit FNV-1a, used to fingerprint sources and ROM blocks.
+class fnv1a {
+    uint64_t m_hash = 0xcbf29ce484222325ull;
+
+  public:
+    fnv1a& update(const void* data, size_t size);
+    fnv1a& update(std::string_view str);
+    template <typename T> fnv1a& update_value(const T& value) {
+        return update(&value, sizeof(T));
+    }
+    // returns false if the file couldn't be read, the name is always hashed in.
+    bool update_file(const std::string& path);
+    uint64_t value() const {
+        return m_hash;
+    }
+};
+
+/**
+    Keeps track of what the previous run inserted so that sprites whose sources haven't changed
+    and whose code is still intact in the ROM can be kept as-is instead of being cleaned and reassembled.
+
+    The state is saved next to the ROM as <romname>.pixiinc after a successful run. Sprites are keyed by the
+    canonical path of their asm file, the same one asm_file_index compares them by.
+*/
+class IncrementalState {
+  public:
+    struct block {
+        int pc = 0;
+        int size = 0;
+        uint64_t hash = 0;
+    };
+    struct entry {
+        ListType type = ListType::Sprite;
+        uint64_t source_hash = 0;
+        pointer init{};
+        pointer main{};
+        pointer cape{};
+        status_pointers ptrs{};
+        std::vector<block> blocks{};
+    };
+
+  private:
+    bool m_enabled = false;
+    bool m_previous_valid = false;
+    std::string m_path{};
+    uint64_t m_global_hash = 0;
+    std::unordered_map<std::string, entry> m_previous{};
+    std::unordered_map<std::string, entry> m_current{};
+    std::unordered_map<std::string, uint64_t> m_source_hashes{};
+    std::unordered_set<int> m_preserved{};
+    std::unordered_set<std::string> m_kept{};
+    // by routine table entry
+    std::vector<bool> m_kept_routines{};
+    asm_file_index m_asm_files{};
+
+    const std::string& key(const interned_string& asm_file) {
+        return m_asm_files.canonical(asm_file).str();
+    }
+    uint64_t source_hash(const sprite& spr);
+
+  public:
+    void reset();
+    void begin(const ROM& rom, uint64_t global_hash);
+    void plan(const sprite_registry& registry, const ROM& rom);
+    // the routines the list still reaches are kept in place for the sprites that call them, the others are cleaned
+    void plan_routines(const DependencyGraph& deps, const sprite_registry& registry);
+    bool reuse(sprite& spr);
+    void record(const sprite& spr, const ROM& rom, std::span<const rom_range> written);
+    [[nodiscard]] bool save() const;
+
+    bool enabled() const {
+        return m_enabled;
+    }
+    // routines are only kept if nothing that the shared routines depend on changed and the list still reaches them
+    bool keeps_routine(size_t slot) const {
+        return m_enabled && m_previous_valid && slot < m_kept_routines.size() && m_kept_routines[slot];
+    }
+    bool keeps(const interned_string& asm_file) {
+        return m_enabled && m_kept.contains(key(asm_file));
+    }
+    bool preserves(pointer ptr) const {
+        return m_enabled && m_preserved.contains(ptr.raw());
+    }
+    size_t kept_count() const {
+        return m_kept.size();
+    }
+};
+
+uint64_t hash_global_inputs(const PixiConfig& config, const std::vector<std::string>& extra_defines,
+                            const std::vector<definedata>& config_defines, int version);
+void collect_asm_includes(const std::string& file, std::vector<std::string>& out, bool& unresolved);
@@ -0,0 +1,54 @@
+#include "intern.h"
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+struct interned_string::string_pool {
+    std::mutex mutex{};
+    // the entries are allocated one by one so that they (and the keys pointing into them) never move
+    std::unordered_map<std::string_view, std::unique_ptr<entry>> index{};
+    // never collected, every default constructed handle refers to it
+    entry empty{};
+};
+
+interned_string::string_pool& interned_string::pool() {
+    // never destroyed, the handles in other static objects are released after it would have been
+    static string_pool* instance = new string_pool{};
+    return *instance;
+}
+
+interned_string::interned_string() : m_entry{&pool().empty} {
+    m_entry->references.fetch_add(1, std::memory_order_relaxed);
+}
+
+interned_string::entry* interned_string::intern(std::string_view str) {
+    string_pool& p = pool();
+    if (str.empty()) {
+        p.empty.references.fetch_add(1, std::memory_order_relaxed);
+        return &p.empty;
+    }
+    std::lock_guard lock{p.mutex};
+    auto it = p.index.find(str);
+    if (it == p.index.end()) {
+        auto stored = std::make_unique<entry>();
+        stored->str = str;
+        const std::string_view key = stored->str;
+        it = p.index.emplace(key, std::move(stored)).first;
+    }
+    it->second->references.fetch_add(1, std::memory_order_relaxed);
+    return it->second.get();
+}
+
+size_t interned_string::collect() {
+    string_pool& p = pool();
+    std::lock_guard lock{p.mutex};
+    return std::erase_if(p.index, [](const auto& item) {
+        return item.second->references.load(std::memory_order_acquire) == 0;
+    });
+}
+
+size_t interned_string::pool_size() {
+    string_pool& p = pool();
+    std::lock_guard lock{p.mutex};
+    return p.index.size();
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+
+/**
+    A string stored once in a process-wide pool, used for the paths every sprite carries around (its directory,
+    asm and cfg file) which are the same for most of the sprites in a list.
+
+    Copying one is copying a pointer and bumping a reference count, and since equal strings share the same entry
+    comparing two of them is a pointer comparison too. Interning is thread safe, the parser threads set the asm
+    file of the sprites they read.
+
+    An entry stays in the pool (and its c_str() valid) as long as a handle refers to it, no matter which run
+    created it: the sprites handed out by the API and the ones a resident server caches outlive the run that
+    parsed them. collect() drops the entries nothing refers to anymore, pixi_reset() calls it so that a process
+    doing many runs doesn't keep the paths of every list it ever read.
+*/
+class interned_string {
+    struct entry {
+        std::string str{};
+        std::atomic<size_t> references = 0;
+    };
+    struct string_pool;
+    entry* m_entry;
+
+    static string_pool& pool();
+    static entry* intern(std::string_view str);
+    void release() {
+        m_entry->references.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+  public:
+    interned_string();
+    explicit interned_string(std::string_view str) : m_entry{intern(str)} {
+    }
+    interned_string(const interned_string& other) : m_entry{other.m_entry} {
+        m_entry->references.fetch_add(1, std::memory_order_relaxed);
+    }
+    interned_string& operator=(const interned_string& other) {
+        other.m_entry->references.fetch_add(1, std::memory_order_relaxed);
+        release();
+        m_entry = other.m_entry;
+        return *this;
+    }
+    interned_string& operator=(std::string_view str) {
+        entry* interned = intern(str);
+        release();
+        m_entry = interned;
+        return *this;
+    }
+    ~interned_string() {
+        release();
+    }
+
+    const std::string& str() const {
+        return m_entry->str;
+    }
+    operator const std::string&() const {
+        return m_entry->str;
+    }
+    operator std::string_view() const {
+        return m_entry->str;
+    }
+    const char* c_str() const {
+        return m_entry->str.c_str();
+    }
+    size_t size() const {
+        return m_entry->str.size();
+    }
+    bool empty() const {
+        return m_entry->str.empty();
+    }
+    void clear() {
+        *this = interned_string{};
+    }
+
+    bool operator==(const interned_string& other) const {
+        return m_entry == other.m_entry;
+    }
+    bool operator==(std::string_view other) const {
+        return m_entry->str == other;
+    }
+
+    // removes the strings no handle refers to, returns how many there were. Must not run while other threads
+    // intern strings.
+    static size_t collect();
+    // number of strings in the pool, the empty string isn't counted
+    static size_t pool_size();
+
+    friend std::hash<interned_string>;
+};
+
+template <> struct std::hash<interned_string> {
+    size_t operator()(const interned_string& str) const noexcept {
+        return std::hash<const void*>{}(str.m_entry);
+    }
+};
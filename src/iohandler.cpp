@@ -1,5 +1,7 @@
 #include "iohandler.h"
 
+thread_local iohandler::deferred_output* iohandler::s_deferred = nullptr;
+
 void iohandler::init() {
     iohandler& handler = get_global();
 
@@ -19,6 +21,15 @@ iohandler& iohandler::get_global() {
 
 iohandler::iohandler() : m_debug_enabled{false} {
 }
+void iohandler::replay(const deferred_output& output) {
+    for (const deferred_line& line : output) {
+        if (line.error)
+            error("%s", line.text.c_str());
+        else
+            print("%s", line.text.c_str());
+    }
+}
+
 char iohandler::getc() {
     return static_cast<char>(fgetc(stdin));
 }
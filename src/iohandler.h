@@ -25,6 +25,32 @@ class iohandler {
 
     using con = libconsole::console;
 
+  public:
+    // output produced on a worker thread, held back until the main thread replays it in order
+    struct deferred_line {
+        bool error = false;
+        std::string text{};
+    };
+    using deferred_output = std::vector<deferred_line>;
+
+    // while alive, everything this thread prints goes into `output` instead
+    class defer_scope {
+        deferred_output* m_previous;
+
+      public:
+        explicit defer_scope(deferred_output& output) : m_previous{s_deferred} {
+            s_deferred = &output;
+        }
+        defer_scope(const defer_scope&) = delete;
+        defer_scope& operator=(const defer_scope&) = delete;
+        ~defer_scope() {
+            s_deferred = m_previous;
+        }
+    };
+
+  private:
+    static thread_local deferred_output* s_deferred;
+
     bool m_debug_enabled{};
     std::string m_last_error;
     std::vector<const char*> m_output_lines;
@@ -43,6 +69,13 @@ class iohandler {
     }
 
     template <typename... Args> void print_generic(const char* message, Args... args) {
+        if (s_deferred != nullptr) {
+            if constexpr (sizeof...(Args) == 0)
+                s_deferred->push_back({false, message});
+            else
+                s_deferred->push_back({false, fstring(message, args...)});
+            return;
+        }
         append_to_output(message, args...);
 #ifdef PIXI_EXE_BUILD
         con::cprintf(message, args...);
@@ -62,12 +95,23 @@ class iohandler {
     void enable_debug() {
         m_debug_enabled = true;
     }
+    bool debug_enabled() const {
+        return m_debug_enabled;
+    }
     void error(const char* message) {
+        if (s_deferred != nullptr) {
+            s_deferred->push_back({true, message});
+            return;
+        }
         // prints to stdout for backwards compatibility
         m_last_error += message;
         print_generic(message);
     }
     template <typename... Args> void error(_In_z_ _Printf_format_string_ const char* message, Args... args) {
+        if (s_deferred != nullptr) {
+            s_deferred->push_back({true, fstring(message, args...)});
+            return;
+        }
         // prints to stdout for backwards compatibility
         m_last_error += fstring(message, args...);
         print_generic(message, args...);
@@ -87,6 +131,8 @@ class iohandler {
             print_generic(message, args...);
         }
     }
+    // prints what a defer_scope held back, as if it had been printed just now
+    void replay(const deferred_output& output);
     int scanf(const char* fmt, ...);
     size_t read(char* buf, int size);
     char* readline(char* buf, int size);
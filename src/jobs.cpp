@@ -0,0 +1,314 @@
+#include "jobs.h"
+#include "iohandler.h"
+#include "rats.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifndef ON_WINDOWS
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#endif
+
+extern std::vector<std::string> warnings;
+
+#ifndef ON_WINDOWS
+namespace {
+
+FILE* create_result_file() {
+#ifdef __linux__
+    // keep the results in memory when possible
+    int fd = memfd_create("pixi-job", 0);
+    if (fd != -1) {
+        if (FILE* file = fdopen(fd, "w+b"); file != nullptr)
+            return file;
+        ::close(fd);
+    }
+#endif
+    return tmpfile();
+}
+
+void write_int(FILE* file, int value) {
+    fwrite(&value, sizeof(value), 1, file);
+}
+
+void write_string(FILE* file, std::string_view str) {
+    write_int(file, static_cast<int>(str.size()));
+    fwrite(str.data(), 1, str.size(), file);
+}
+
+bool read_int(FILE* file, int& value) {
+    return fread(&value, sizeof(value), 1, file) == 1;
+}
+
+bool read_string(FILE* file, std::string& str) {
+    int size = 0;
+    if (!read_int(file, size) || size < 0)
+        return false;
+    str.resize(size);
+    return fread(str.data(), 1, size, file) == static_cast<size_t>(size);
+}
+
+// makes the free bytes of a 32KiB bank look protected to asar's freespace search by putting a RATS tag over every
+// run of them, the data and the blocks already in the bank are left alone
+void hide_bank(ROM& rom, const RatsIndex& rats, int pc) {
+    // a tag and at least one byte, shorter runs can't be used by asar anyway
+    constexpr int min_run = 9;
+    const std::span<const RatsIndex::tag> blocks = rats.blocks();
+    const int bank_end = pc + 0x8000;
+    int at = pc;
+    while (at < bank_end) {
+        auto next = std::partition_point(blocks.begin(), blocks.end(),
+                                         [at](const RatsIndex::tag& b) { return b.end() <= at; });
+        if (next != blocks.end() && next->pc <= at) {
+            at = next->end();
+            continue;
+        }
+        const int limit = next != blocks.end() ? std::min(bank_end, next->pc) : bank_end;
+        unsigned char* const data = rom.data + pcaddress{0};
+        unsigned char* start = std::find(data + at, data + limit, 0x00);
+        unsigned char* end = std::find_if(start, data + limit, [](unsigned char b) { return b != 0x00; });
+        const int size = static_cast<int>(end - start);
+        if (size >= min_run) {
+            const auto protected_size = static_cast<uint16_t>(size - 8 - 1);
+            const auto inverse = static_cast<uint16_t>(protected_size ^ 0xFFFF);
+            memcpy(start, "STAR", 4);
+            start[4] = protected_size & 0xFF;
+            start[5] = protected_size >> 8;
+            start[6] = inverse & 0xFF;
+            start[7] = inverse >> 8;
+        }
+        at = end == start ? limit : static_cast<int>(end - data);
+    }
+}
+
+[[noreturn]] void run_worker(int index, int workers, std::span<sprite* const> sprites, ROM& rom,
+                             const std::function<bool(sprite*)>& assemble_one, FILE* out) {
+    iohandler& io = iohandler::get_global();
+    // the parent replays the output of the results it accepts, don't print it twice.
+    if (int devnull = ::open("/dev/null", O_WRONLY); devnull != -1)
+        dup2(devnull, STDOUT_FILENO);
+
+    // freespace starts at bank $10 (pc 0x80000), every worker only gets to see the free space of every n-th bank
+    const int rom_end = rom.size + rom.header_size;
+    RatsIndex rats{};
+    rats.build(rom);
+    for (int pc = 0x80000 + rom.header_size; pc + 0x8000 <= rom_end; pc += 0x8000) {
+        if (((pc - rom.header_size) / 0x8000) % workers != index)
+            hide_bank(rom, rats, pc);
+    }
+
+    for (size_t i = index; i < sprites.size(); i += workers) {
+        sprite* spr = sprites[i];
+        const size_t output_before = io.output_lines().size();
+        const size_t warnings_before = warnings.size();
+        bool ok = assemble_one(spr);
+        write_int(out, static_cast<int>(i));
+        write_int(out, ok ? 1 : 0);
+        if (!ok)
+            continue;
+        for (const pointer& ptr : {spr->table.init, spr->table.main, spr->extended_cape_ptr, spr->ptrs.carriable,
+                                   spr->ptrs.kicked, spr->ptrs.carried, spr->ptrs.mouth, spr->ptrs.goal}) {
+            write_int(out, ptr.raw());
+        }
+        write_int(out, rom.size);
+        auto ranges = asar_written_ranges(rom);
+        write_int(out, static_cast<int>(ranges.size()));
+        for (const auto& range : ranges) {
+            write_int(out, range.pc);
+            write_int(out, range.size);
+            fwrite(rom.data + pcaddress{range.pc}, 1, range.size, out);
+        }
+        write_int(out, static_cast<int>(warnings.size() - warnings_before));
+        for (size_t w = warnings_before; w < warnings.size(); w++) {
+            write_string(out, warnings[w]);
+        }
+        const auto& output = io.output_lines();
+        write_int(out, static_cast<int>(output.size() - output_before));
+        for (size_t o = output_before; o < output.size(); o++) {
+            write_string(out, output[o]);
+        }
+    }
+    fflush(out);
+    // skip atexit handlers and destructors, those belong to the parent.
+    _exit(EXIT_SUCCESS);
+}
+
+bool read_result(FILE* file, AsarJobPool::result& res, int& index) {
+    int ok = 0;
+    if (!read_int(file, index) || !read_int(file, ok))
+        return false;
+    res.ok = ok != 0;
+    if (!res.ok)
+        return true;
+    int ptrs[8]{};
+    for (int& ptr : ptrs) {
+        if (!read_int(file, ptr))
+            return false;
+    }
+    res.init = ptrs[0];
+    res.main = ptrs[1];
+    res.cape = ptrs[2];
+    res.ptrs.carriable = ptrs[3];
+    res.ptrs.kicked = ptrs[4];
+    res.ptrs.carried = ptrs[5];
+    res.ptrs.mouth = ptrs[6];
+    res.ptrs.goal = ptrs[7];
+    int count = 0;
+    if (!read_int(file, res.rom_size) || !read_int(file, count))
+        return false;
+    for (int r = 0; r < count; r++) {
+        rom_range range{};
+        if (!read_int(file, range.pc) || !read_int(file, range.size) || range.size < 0)
+            return false;
+        size_t offset = res.data.size();
+        res.data.resize(offset + range.size);
+        if (fread(res.data.data() + offset, 1, range.size, file) != static_cast<size_t>(range.size))
+            return false;
+        res.ranges.push_back(range);
+    }
+    for (auto* strings : {&res.warnings, &res.output}) {
+        if (!read_int(file, count))
+            return false;
+        for (int s = 0; s < count; s++) {
+            if (!read_string(file, strings->emplace_back()))
+                return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+#endif
+
+bool AsarJobPool::supported() {
+#ifdef ON_WINDOWS
+    return false;
+#else
+    return true;
+#endif
+}
+
+void AsarJobPool::reset() {
+    m_jobs = 1;
+    m_results.clear();
+    m_written.clear();
+    m_last_committed.clear();
+    m_stale_workers.clear();
+    m_committed = 0;
+    m_rejected = 0;
+}
+
+void AsarJobPool::assemble([[maybe_unused]] std::span<sprite* const> sprites, [[maybe_unused]] ROM& rom,
+                           [[maybe_unused]] const std::function<bool(sprite*)>& assemble_one) {
+    m_results.clear();
+    m_written.clear();
+    m_stale_workers.clear();
+#ifndef ON_WINDOWS
+    if (!enabled() || sprites.size() < 2)
+        return;
+    iohandler& io = iohandler::get_global();
+    const int workers = static_cast<int>(std::min(sprites.size(), static_cast<size_t>(m_jobs)));
+    m_stale_workers.assign(workers, false);
+    std::vector<std::pair<pid_t, FILE*>> children{};
+    fflush(stdout);
+    for (int i = 0; i < workers; i++) {
+        FILE* out = create_result_file();
+        if (out == nullptr) {
+            io.debug("Couldn't create the result file for worker %d\n", i);
+            continue;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            run_worker(i, workers, sprites, rom, assemble_one, out);
+        } else if (pid == -1) {
+            io.debug("Couldn't start worker %d: %s\n", i, strerror(errno));
+            fclose(out);
+            continue;
+        }
+        children.emplace_back(pid, out);
+    }
+    for (auto& [pid, out] : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+            io.debug("Worker %d didn't exit cleanly, its sprites will be assembled serially\n", pid);
+        // even a crashed worker may have left complete results behind, keep whatever can be read back
+        fseek(out, 0, SEEK_SET);
+        while (true) {
+            result res{};
+            int index = -1;
+            if (!read_result(out, res, index) || index < 0 || static_cast<size_t>(index) >= sprites.size())
+                break;
+            res.worker = index % workers;
+            m_results.insert_or_assign(sprites[index]->asm_file, std::move(res));
+        }
+        fclose(out);
+    }
+    io.debug("%zu sprites speculatively assembled by %d workers\n", m_results.size(), workers);
+#endif
+}
+
+bool AsarJobPool::commit(sprite& spr, ROM& rom) {
+    m_last_committed.clear();
+    auto it = m_results.find(spr.asm_file);
+    if (it == m_results.end())
+        return false;
+    result res = std::move(it->second);
+    m_results.erase(it);
+    if (!res.ok || m_stale_workers[res.worker])
+        return reject(res);
+
+    std::vector<rom_range> ranges{};
+    std::vector<size_t> offsets{};
+    size_t offset = 0;
+    for (const auto& range : res.ranges) {
+        // every patch rewrites it, that isn't a conflict
+        if (is_header_checksum(range, rom)) {
+            offset += range.size;
+            continue;
+        }
+        bool collides = std::any_of(m_written.begin(), m_written.end(),
+                                    [&](const rom_range& written) { return written.overlaps(range); });
+        if (collides || range.pc + range.size > MAX_ROM_SIZE + rom.header_size)
+            return reject(res);
+        ranges.push_back(range);
+        offsets.push_back(offset);
+        offset += range.size;
+    }
+
+    for (size_t i = 0; i < ranges.size(); i++) {
+        memcpy(rom.data + pcaddress{ranges[i].pc}, res.data.data() + offsets[i], ranges[i].size);
+    }
+    rom.size = std::max(rom.size, res.rom_size);
+    m_written.insert(m_written.end(), ranges.begin(), ranges.end());
+    m_last_committed = std::move(ranges);
+
+    spr.table.init = res.init;
+    spr.table.main = res.main;
+    spr.extended_cape_ptr = res.cape;
+    spr.ptrs = res.ptrs;
+    warnings.insert(warnings.end(), res.warnings.begin(), res.warnings.end());
+    iohandler& io = iohandler::get_global();
+    for (const auto& line : res.output) {
+        io.print("%s", line.c_str());
+    }
+    m_committed++;
+    return true;
+}
+
+bool AsarJobPool::reject(const result& res) {
+    m_stale_workers[res.worker] = true;
+    m_rejected++;
+    return false;
+}
+
+void AsarJobPool::mark_written(std::span<const rom_range> ranges) {
+    if (enabled())
+        m_written.insert(m_written.end(), ranges.begin(), ranges.end());
+}
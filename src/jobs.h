@@ -0,0 +1,79 @@
+#pragma once
+#include "structs.h"
+#include <functional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+    Assembles sprites speculatively in worker processes (--jobs N).
+
+    Asar keeps global state so it can't be used from multiple threads, instead each worker is a fork of pixi
+    which gets a copy-on-write snapshot of the ROM in which only the free space of its share of the banks is
+    visible (the free runs of the other banks are covered with RATS tags, what's already there is left alone),
+    so that workers don't all pick the same freespace.
+    The results are committed back into the real ROM in list order, a result that overlaps anything
+    written since the snapshot was taken is discarded and the sprite has to be reassembled serially.
+    The routines the sprites call are inserted before the workers start whenever they can be told statically, so
+    that the workers only use them. Otherwise a worker assembles its sprites one after the other on the same ROM,
+    and a sprite can JSL to a shared routine that an earlier sprite of the same worker inserted. Once a result is discarded, the results that worker
+    assembled after it are discarded as well since the routines they may call never made it into the real ROM.
+
+    Only available on POSIX systems, on Windows everything is assembled serially.
+*/
+class AsarJobPool {
+  public:
+    struct result {
+        bool ok = false;
+        // the worker that assembled it
+        int worker = 0;
+        pointer init{};
+        pointer main{};
+        pointer cape{};
+        status_pointers ptrs{};
+        int rom_size = 0;
+        std::vector<rom_range> ranges{};
+        std::vector<unsigned char> data{};
+        std::vector<std::string> warnings{};
+        std::vector<std::string> output{};
+    };
+
+  private:
+    int m_jobs = 1;
+    std::unordered_map<std::string, result> m_results{};
+    std::vector<rom_range> m_written{};
+    std::vector<rom_range> m_last_committed{};
+    // workers one of whose results was discarded, nothing they assembled afterwards can be committed
+    std::vector<bool> m_stale_workers{};
+    size_t m_committed = 0;
+    size_t m_rejected = 0;
+
+    bool reject(const result& res);
+
+  public:
+    static bool supported();
+    void reset();
+    void set_jobs(int jobs) {
+        m_jobs = jobs;
+    }
+    bool enabled() const {
+        return m_jobs > 1;
+    }
+    // assembles the sprites across the workers, `assemble_one` is what each worker runs for a single sprite
+    void assemble(std::span<sprite* const> sprites, ROM& rom, const std::function<bool(sprite*)>& assemble_one);
+    // applies the speculative result for this sprite to the ROM, returns false if there's none or it collided
+    bool commit(sprite& spr, ROM& rom);
+    // ranges written by the last successful commit()
+    std::span<const rom_range> last_committed() const {
+        return m_last_committed;
+    }
+    // ranges written to the ROM outside of the pool (e.g. by a serial reassembly)
+    void mark_written(std::span<const rom_range> ranges);
+    size_t committed() const {
+        return m_committed;
+    }
+    size_t rejected() const {
+        return m_rejected;
+    }
+};
@@ -1,4 +1,5 @@
 #include "json.h"
+#include "charconv_compat.h"
 #include "file_io.h"
 #include "iohandler.h"
 #include "json_const.h"
@@ -6,14 +7,862 @@
 #include "structs.h"
 #include "json/base64.h"
 #include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <fstream>
+#include <iterator>
 #include <nlohmann/json.hpp>
+#include <span>
 #include <filesystem>
 
 using json = nlohmann::json;
 
+namespace {
+
+// a scalar exactly as the tokenizer handed it over, converted the same way nlohmann's get<T>() would
+struct raw_value {
+    enum class kind : uint8_t { missing, null, boolean, integer, unsigned_integer, floating, string, structured };
+    kind type = kind::missing;
+    bool boolean = false;
+    int64_t integer = 0;
+    uint64_t unsigned_integer = 0;
+    double floating = 0.0;
+    std::string string{};
+
+    // numbers and booleans, anything else is a type error
+    template <typename T> bool number(T& out) const {
+        switch (type) {
+        case kind::boolean:
+            out = static_cast<T>(boolean);
+            return true;
+        case kind::integer:
+            out = static_cast<T>(integer);
+            return true;
+        case kind::unsigned_integer:
+            out = static_cast<T>(unsigned_integer);
+            return true;
+        case kind::floating:
+            out = static_cast<T>(floating);
+            return true;
+        default:
+            return false;
+        }
+    }
+    bool flag(bool& out) const {
+        out = boolean;
+        return type == kind::boolean;
+    }
+    const std::string* text() const {
+        return type == kind::string ? &string : nullptr;
+    }
+};
+
+template <size_t N> struct key_table {
+    std::array<std::string_view, N> keys;
+    constexpr int find(std::string_view key) const {
+        for (size_t i = 0; i < N; i++) {
+            if (keys[i].size() == key.size() && keys[i] == key)
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+};
+
+enum root_key : int {
+    ActLike,
+    Type,
+    AsmFile,
+    ExtraProperty1,
+    ExtraProperty2,
+    ByteCount,
+    ExtraByteCount,
+    Map16,
+    DisplayType,
+    Tweak1656,
+    Tweak1662,
+    Tweak166E,
+    Tweak167A,
+    Tweak1686,
+    Tweak190F,
+    Displays,
+    Collection,
+    RootKeyCount
+};
+constexpr key_table<RootKeyCount> root_keys{{"ActLike", "Type", "AsmFile", "Extra Property Byte 1",
+                                             "Extra Property Byte 2", "Additional Byte Count (extra bit clear)",
+                                             "Additional Byte Count (extra bit set)", "Map16", "DisplayType", "$1656",
+                                             "$1662", "$166E", "$167A", "$1686", "$190F", "Displays", "Collection"}};
+static_assert([] {
+    for (size_t i = 0; i < tweak_schema::addresses.size(); i++) {
+        if (root_keys.keys[Tweak1656 + i] != tweak_schema::addresses[i])
+            return false;
+    }
+    return Tweak1656 + tweak_schema::addresses.size() == Tweak190F + 1;
+}());
+
+enum display_key : int {
+    Description,
+    Index,
+    Value,
+    X,
+    Y,
+    UseText,
+    DisplayText,
+    DisplayExtraBit,
+    GFXInfo,
+    Tiles,
+    DisplayKeyCount
+};
+constexpr key_table<DisplayKeyCount> display_keys{
+    {"Description", "Index", "Value", "X", "Y", "UseText", "DisplayText", "ExtraBit", "GFXInfo", "Tiles"}};
+
+enum tile_key : int { XOffset, YOffset, TileNumber, TileKeyCount };
+constexpr key_table<TileKeyCount> tile_keys{{"X offset", "Y offset", "map16 tile"}};
+
+enum gfx_key : int { GfxValue, GfxSeparate, GfxKeyCount };
+constexpr key_table<GfxKeyCount> gfx_keys{{"Value", "Separate"}};
+constexpr key_table<4> gfx_indexes{{"0", "1", "2", "3"}};
+
+// byte counts are clamped to 15, collections can ask for that many extra property bytes
+constexpr int max_collection_props = 15;
+enum collection_key : int {
+    Name,
+    CollectionExtraBit,
+    CollectionProp1,
+    CollectionKeyCount = CollectionProp1 + max_collection_props
+};
+constexpr key_table<CollectionKeyCount> collection_keys{
+    {"Name", "ExtraBit", "Extra Property Byte 1", "Extra Property Byte 2", "Extra Property Byte 3",
+     "Extra Property Byte 4", "Extra Property Byte 5", "Extra Property Byte 6", "Extra Property Byte 7",
+     "Extra Property Byte 8", "Extra Property Byte 9", "Extra Property Byte 10", "Extra Property Byte 11",
+     "Extra Property Byte 12", "Extra Property Byte 13", "Extra Property Byte 14", "Extra Property Byte 15"}};
+
+struct raw_display {
+    std::array<raw_value, DisplayKeyCount> values{};
+    std::array<std::array<raw_value, GfxKeyCount>, 4> gfx{};
+    std::array<bool, 4> has_gfx{};
+    std::vector<std::array<raw_value, TileKeyCount>> tiles{};
+};
+
+struct raw_collection {
+    std::array<raw_value, CollectionKeyCount> values{};
+};
+
+/**
+    Fills in the fields of a JSON sprite straight from the token stream of stream_json, without building a DOM.
+
+    Values are only collected while parsing, since e.g. the byte counts that the displays and collections
+    depend on can come after them in the file. Anything that doesn't have the shape of a sprite file (wrong
+    types, missing keys, ...) just marks the file as unexpected, the DOM reader then reports it exactly as before.
+*/
+class sprite_json_reader {
+    enum class context : uint8_t { root, tweak, displays, display, gfxinfo, gfx, tiles, tile, collections, collection,
+                                   skip };
+    struct frame {
+        context ctx = context::skip;
+        // which tweak byte or gfx file the object is
+        int index = 0;
+        // the known key whose value comes next, -1 if it isn't one we care about
+        int key = -1;
+    };
+
+    std::vector<frame> m_stack{};
+    bool m_unexpected = false;
+    std::array<raw_value, RootKeyCount> m_root{};
+    // indexed like tweak_schema::fields
+    std::array<raw_value, tweak_schema::fields.size()> m_tweaks{};
+    std::array<bool, tweak_schema::addresses.size()> m_has_tweak{};
+    std::vector<raw_display> m_displays{};
+    std::vector<raw_collection> m_collections{};
+
+    raw_value* field() {
+        frame& top = m_stack.back();
+        if (top.key < 0)
+            return nullptr;
+        switch (top.ctx) {
+        case context::root:
+            return &m_root[top.key];
+        case context::tweak:
+            return &m_tweaks[top.key];
+        case context::display:
+            return &m_displays.back().values[top.key];
+        case context::gfx:
+            return &m_displays.back().gfx[top.index][top.key];
+        case context::tile:
+            return &m_displays.back().tiles.back()[top.key];
+        case context::collection:
+            return &m_collections.back().values[top.key];
+        default:
+            return nullptr;
+        }
+    }
+
+    bool scalar(raw_value value) {
+        if (m_stack.empty()) {
+            m_unexpected = true;
+            return false;
+        }
+        switch (m_stack.back().ctx) {
+        case context::skip:
+            return true;
+        case context::gfxinfo:
+            // the DOM reader would index into this
+            if (m_stack.back().key >= 0) {
+                m_unexpected = true;
+                return false;
+            }
+            return true;
+        case context::displays:
+        case context::tiles:
+        case context::collections:
+            // the DOM reader would call .at() on this
+            m_unexpected = true;
+            return false;
+        default:
+            if (raw_value* target = field())
+                *target = std::move(value);
+            return true;
+        }
+    }
+
+    // what the value of the current key opens, skip if it's nothing the reader looks at
+    frame child(bool array) {
+        if (m_stack.empty())
+            return {array ? context::skip : context::root};
+        const frame& top = m_stack.back();
+        auto expect = [&](bool want_array, context ctx, int index = 0) {
+            if (array != want_array) {
+                m_unexpected = true;
+                return frame{};
+            }
+            return frame{ctx, index};
+        };
+        switch (top.ctx) {
+        case context::root:
+            if (top.key >= Tweak1656 && top.key <= Tweak190F) {
+                const int byte = top.key - Tweak1656;
+                m_has_tweak[byte] = true;
+                std::fill(m_tweaks.begin() + tweak_schema::first_field[byte],
+                          m_tweaks.begin() + tweak_schema::first_field[byte + 1], raw_value{});
+                return expect(false, context::tweak, byte);
+            }
+            if (top.key == Displays) {
+                m_displays.clear();
+                m_root[Displays].type = raw_value::kind::structured;
+                return expect(true, context::displays);
+            }
+            if (top.key == Collection) {
+                m_collections.clear();
+                m_root[Collection].type = raw_value::kind::structured;
+                return expect(true, context::collections);
+            }
+            break;
+        case context::display:
+            if (top.key == GFXInfo) {
+                m_displays.back().has_gfx = {};
+                return expect(false, context::gfxinfo);
+            }
+            if (top.key == Tiles) {
+                m_displays.back().tiles.clear();
+                m_displays.back().values[Tiles].type = raw_value::kind::structured;
+                return expect(true, context::tiles);
+            }
+            break;
+        case context::gfxinfo:
+            if (top.key >= 0) {
+                m_displays.back().has_gfx[top.key] = true;
+                m_displays.back().gfx[top.key] = {};
+                return expect(false, context::gfx, top.key);
+            }
+            break;
+        case context::displays:
+            if (array)
+                break;
+            m_displays.emplace_back();
+            return {context::display};
+        case context::tiles:
+            if (array)
+                break;
+            m_displays.back().tiles.emplace_back();
+            return {context::tile};
+        case context::collections:
+            if (array)
+                break;
+            m_collections.emplace_back();
+            return {context::collection};
+        default:
+            break;
+        }
+        if (top.ctx == context::displays || top.ctx == context::tiles || top.ctx == context::collections) {
+            m_unexpected = true;
+        } else if (raw_value* target = field()) {
+            // a value we'd have read as a scalar
+            *target = {};
+            target->type = raw_value::kind::structured;
+        }
+        return {};
+    }
+
+    bool open(bool array) {
+        frame next = m_stack.empty() || m_stack.back().ctx != context::skip ? child(array) : frame{};
+        if (m_unexpected)
+            return false;
+        m_stack.push_back(next);
+        return true;
+    }
+
+  public:
+    sprite_json_reader() {
+        m_stack.reserve(8);
+    }
+    bool unexpected() const {
+        return m_unexpected;
+    }
+
+    // same interface as nlohmann's SAX parsers
+    bool null() {
+        return scalar({.type = raw_value::kind::null});
+    }
+    bool boolean(bool val) {
+        return scalar({.type = raw_value::kind::boolean, .boolean = val});
+    }
+    bool number_integer(json::number_integer_t val) {
+        return scalar({.type = raw_value::kind::integer, .integer = val});
+    }
+    bool number_unsigned(json::number_unsigned_t val) {
+        return scalar({.type = raw_value::kind::unsigned_integer, .unsigned_integer = val});
+    }
+    bool number_float(json::number_float_t val, const json::string_t&) {
+        return scalar({.type = raw_value::kind::floating, .floating = val});
+    }
+    bool string(json::string_t& val) {
+        return scalar({.type = raw_value::kind::string, .string = std::move(val)});
+    }
+    bool start_object(std::size_t) {
+        return open(false);
+    }
+    bool start_array(std::size_t) {
+        return open(true);
+    }
+    bool end_object() {
+        m_stack.pop_back();
+        return true;
+    }
+    bool end_array() {
+        m_stack.pop_back();
+        return true;
+    }
+    bool key(json::string_t& val) {
+        frame& top = m_stack.back();
+        switch (top.ctx) {
+        case context::root:
+            top.key = root_keys.find(val);
+            break;
+        case context::tweak:
+            top.key = tweak_schema::find(val);
+            // a field of another tweak byte is just an unknown key here
+            if (top.key >= 0 && tweak_schema::fields[top.key].byte != top.index)
+                top.key = -1;
+            break;
+        case context::display:
+            top.key = display_keys.find(val);
+            break;
+        case context::gfxinfo:
+            top.key = gfx_indexes.find(val);
+            break;
+        case context::gfx:
+            top.key = gfx_keys.find(val);
+            break;
+        case context::tile:
+            top.key = tile_keys.find(val);
+            break;
+        case context::collection:
+            top.key = collection_keys.find(val);
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+
+    // converts what was collected the way read_json_file_dom does, false if anything would have thrown there
+    bool apply(sprite* spr, std::vector<std::string>& new_warnings) const;
+};
+
+bool sprite_json_reader::apply(sprite* spr, std::vector<std::string>& new_warnings) const {
+    if (m_unexpected)
+        return false;
+    const auto& root = m_root;
+    unsigned char actlike = 0;
+    unsigned char type = 0;
+    if (!root[ActLike].number(actlike) || !root[Type].number(type))
+        return false;
+
+    std::string asm_file{};
+    unsigned char extra[2] = {spr->table.extra[0], spr->table.extra[1]};
+    uint8_t byte_count = spr->byte_count;
+    uint8_t extra_byte_count = spr->extra_byte_count;
+    if (type) {
+        const std::string* asm_name = root[AsmFile].text();
+        if (asm_name == nullptr || !root[ExtraProperty1].number(extra[0]) || !root[ExtraProperty2].number(extra[1]) ||
+            !root[ByteCount].number(byte_count) || !root[ExtraByteCount].number(extra_byte_count))
+            return false;
+        asm_file = append_to_dir(spr->cfg_file, *asm_name);
+        byte_count = std::clamp(byte_count, uint8_t{0}, uint8_t{15});
+        extra_byte_count = std::clamp(extra_byte_count, uint8_t{0}, uint8_t{15});
+    }
+
+    unsigned char tweak[tweak_schema::addresses.size()] = {};
+    if (std::find(m_has_tweak.begin(), m_has_tweak.end(), false) != m_has_tweak.end())
+        return false;
+    for (size_t i = 0; i < tweak_schema::fields.size(); i++) {
+        const tweak_schema::field& f = tweak_schema::fields[i];
+        int value = 0;
+        bool set = false;
+        if (f.number ? !m_tweaks[i].number(value) : !m_tweaks[i].flag(set))
+            return false;
+        tweak[f.byte] |= tweak_schema::encode(f, f.number ? value : set);
+    }
+
+    const std::string* map16_data = root[Map16].text();
+    if (map16_data == nullptr)
+        return false;
+    // a partial tile at the end is dropped, like it always was
+    const auto map16_size = base64_decoded_size(*map16_data);
+    if (!map16_size)
+        return false;
+    std::vector<map16> map_data(*map16_size / sizeof(map16));
+    if (!base64_decode(*map16_data, std::span{map_data}))
+        return false;
+
+    display_type disp_type = display_type::XYPosition;
+    if (root[DisplayType].type != raw_value::kind::missing) {
+        const std::string* name = root[DisplayType].text();
+        if (name == nullptr)
+            return false;
+        if (*name == "ExByte")
+            disp_type = display_type::ExtensionByte;
+        else if (*name != "XY")
+            return false;
+    }
+
+    // both have to be there as arrays
+    if (root[Displays].type != raw_value::kind::structured || root[Collection].type != raw_value::kind::structured)
+        return false;
+    std::vector<display> displays(m_displays.size());
+    for (size_t d = 0; d < m_displays.size(); d++) {
+        const auto& values = m_displays[d].values;
+        display& dis = displays[d];
+        const std::string* description = values[Description].text();
+        if (description == nullptr)
+            return false;
+        dis.description = *description;
+        if (disp_type == display_type::ExtensionByte) {
+            // the extra bit isn't known yet at this point in the DOM reader, so the clear byte count is the limit
+            if (!values[Index].number(dis.x_or_index) || !values[Value].number(dis.y_or_value))
+                return false;
+            dis.x_or_index = std::clamp(dis.x_or_index, uint8_t{0}, byte_count) + 3;
+        } else {
+            if (!values[X].number(dis.x_or_index) || !values[Y].number(dis.y_or_value))
+                return false;
+            dis.x_or_index = std::clamp(dis.x_or_index, uint8_t{0}, uint8_t{0x0F});
+            dis.y_or_value = std::clamp(dis.y_or_value, uint8_t{0}, uint8_t{0x0F});
+        }
+        if (values[GFXInfo].type != raw_value::kind::missing)
+            return false; // present, but not an object
+        for (size_t i = 0; i < 4; i++) {
+            if (!m_displays[d].has_gfx[i])
+                continue;
+            const auto& gfx = m_displays[d].gfx[i];
+            int gfx_num = 0;
+            if (!gfx[GfxValue].number(gfx_num) || !gfx[GfxSeparate].flag(dis.gfx_files.gfx_files[i].sep))
+                return false;
+            dis.gfx_files.gfx_files[i].gfx_num = gfx_num;
+        }
+        bool use_text = false;
+        if (!values[UseText].flag(use_text))
+            return false;
+        if (use_text) {
+            const std::string* text = values[DisplayText].text();
+            if (text == nullptr)
+                return false;
+            dis.tiles.push_back({0, 0, 0, *text});
+        } else {
+            if (values[Tiles].type != raw_value::kind::structured)
+                return false;
+            dis.tiles.resize(m_displays[d].tiles.size());
+            for (size_t t = 0; t < dis.tiles.size(); t++) {
+                const auto& jtile = m_displays[d].tiles[t];
+                tile& til = dis.tiles[t];
+                if (!jtile[XOffset].number(til.x_offset) || !jtile[YOffset].number(til.y_offset) ||
+                    !jtile[TileNumber].number(til.tile_number))
+                    return false;
+            }
+        }
+        if (!values[DisplayExtraBit].flag(dis.extra_bit))
+            return false;
+    }
+    // mixed extension byte indexes are an error, left to the DOM reader to report
+    if (!displays.empty() && disp_type == display_type::ExtensionByte &&
+        !std::all_of(displays.begin(), displays.end(),
+                     [&](const display& disp) { return disp.x_or_index == displays.front().x_or_index; }))
+        return false;
+
+    std::vector<collection> collections(m_collections.size());
+    std::vector<std::string> missing{};
+    for (size_t c = 0; c < m_collections.size(); c++) {
+        const auto& values = m_collections[c].values;
+        collection& col = collections[c];
+        const std::string* name = values[Name].text();
+        if (name == nullptr || !values[CollectionExtraBit].flag(col.extra_bit))
+            return false;
+        col.name = *name;
+        const int count = col.extra_bit ? extra_byte_count : byte_count;
+        for (int i = 1; i <= count; i++) {
+            const raw_value& prop = values[CollectionProp1 + i - 1];
+            unsigned char value = 0;
+            if (prop.type == raw_value::kind::missing) {
+                // if it's not specified in the json just set it at 0, who cares anyway, just add a warning
+                missing.push_back("Your json file \"" +
+                                  std::filesystem::path(spr->cfg_file.str()).filename().generic_string() +
+                                  "\" is missing a definition for Extra Property Byte " + std::to_string(i) +
+                                  " at collection \"" + col.name + "\"");
+            } else if (!prop.number(value)) {
+                return false;
+            }
+            if (i <= static_cast<int>(sizeof(col.prop)))
+                col.prop[i - 1] = value;
+        }
+    }
+
+    spr->table.actlike = actlike;
+    spr->table.type = type;
+    if (type) {
+        spr->asm_file = std::move(asm_file);
+        spr->table.extra[0] = extra[0];
+        spr->table.extra[1] = extra[1];
+        spr->byte_count = byte_count;
+        spr->extra_byte_count = extra_byte_count;
+    }
+    std::copy(std::begin(tweak), std::end(tweak), spr->table.tweak);
+    spr->map_data = std::move(map_data);
+    spr->disp_type = disp_type;
+    spr->displays = std::move(displays);
+    spr->collections = std::move(collections);
+    new_warnings.insert(new_warnings.end(), std::make_move_iterator(missing.begin()),
+                        std::make_move_iterator(missing.end()));
+    return true;
+}
+
+// length of the UTF-8 sequence starting at p, 0 if it's malformed (same rules as nlohmann's lexer)
+size_t utf8_sequence_length(const char* p, const char* end) {
+    auto byte = [&](size_t i) { return static_cast<unsigned char>(p[i]); };
+    auto in = [&](size_t i, unsigned char lo, unsigned char hi) {
+        return p + i < end && byte(i) >= lo && byte(i) <= hi;
+    };
+    const unsigned char c = byte(0);
+    if (c >= 0xC2 && c <= 0xDF)
+        return in(1, 0x80, 0xBF) ? 2 : 0;
+    if (c == 0xE0)
+        return in(1, 0xA0, 0xBF) && in(2, 0x80, 0xBF) ? 3 : 0;
+    if ((c >= 0xE1 && c <= 0xEC) || c == 0xEE || c == 0xEF)
+        return in(1, 0x80, 0xBF) && in(2, 0x80, 0xBF) ? 3 : 0;
+    if (c == 0xED)
+        return in(1, 0x80, 0x9F) && in(2, 0x80, 0xBF) ? 3 : 0;
+    if (c == 0xF0)
+        return in(1, 0x90, 0xBF) && in(2, 0x80, 0xBF) && in(3, 0x80, 0xBF) ? 4 : 0;
+    if (c >= 0xF1 && c <= 0xF3)
+        return in(1, 0x80, 0xBF) && in(2, 0x80, 0xBF) && in(3, 0x80, 0xBF) ? 4 : 0;
+    if (c == 0xF4)
+        return in(1, 0x80, 0x8F) && in(2, 0x80, 0xBF) && in(3, 0x80, 0xBF) ? 4 : 0;
+    return 0;
+}
+
+/**
+    Tokenizes a JSON document straight into a SAX handler, producing the same events and values as
+    nlohmann::json::sax_parse in non-strict mode (anything after the root value is ignored).
+
+    It only handles what sprite files actually contain: unicode escapes and syntax errors make it return false
+    so that the caller can fall back to nlohmann, which also gives the proper error message.
+*/
+template <typename Handler> bool stream_json(std::string_view input, Handler& handler) {
+    const char* p = input.data();
+    const char* const end = p + input.size();
+    if (input.starts_with("\xEF\xBB\xBF"))
+        p += 3;
+    std::vector<char> open{};
+    std::string text{};
+
+    auto skip_whitespace = [&] {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            p++;
+    };
+    auto read_string = [&]() {
+        // p is on the opening quote
+        text.clear();
+        const char* run = ++p;
+        while (p < end) {
+            const auto c = static_cast<unsigned char>(*p);
+            if (c == '"') {
+                text.append(run, p++);
+                return true;
+            }
+            if (c == '\\') {
+                text.append(run, p++);
+                if (p == end)
+                    return false;
+                switch (*p++) {
+                case '"':
+                    text += '"';
+                    break;
+                case '\\':
+                    text += '\\';
+                    break;
+                case '/':
+                    text += '/';
+                    break;
+                case 'b':
+                    text += '\b';
+                    break;
+                case 'f':
+                    text += '\f';
+                    break;
+                case 'n':
+                    text += '\n';
+                    break;
+                case 'r':
+                    text += '\r';
+                    break;
+                case 't':
+                    text += '\t';
+                    break;
+                default:
+                    return false;
+                }
+                run = p;
+            } else if (c < 0x20) {
+                return false;
+            } else if (c < 0x80) {
+                p++;
+            } else {
+                const size_t length = utf8_sequence_length(p, end);
+                if (length == 0)
+                    return false;
+                p += length;
+            }
+        }
+        return false;
+    };
+    auto is_digit = [&] { return p < end && *p >= '0' && *p <= '9'; };
+    auto read_number = [&]() {
+        const char* start = p;
+        const bool negative = *p == '-';
+        if (negative)
+            p++;
+        if (!is_digit())
+            return false;
+        if (*p++ != '0') {
+            while (is_digit())
+                p++;
+        }
+        bool floating = false;
+        for (const char* marks : {".", "eE"}) {
+            if (p < end && std::strchr(marks, *p) != nullptr) {
+                floating = true;
+                p++;
+                if (marks[0] == 'e' && p < end && (*p == '+' || *p == '-'))
+                    p++;
+                if (!is_digit())
+                    return false;
+                while (is_digit())
+                    p++;
+            }
+        }
+        // integers that don't fit become floats, like in nlohmann
+        if (!floating && negative) {
+            json::number_integer_t value = 0;
+            if (std::from_chars(start, p, value).ec == std::errc{})
+                return handler.number_integer(value);
+        } else if (!floating) {
+            json::number_unsigned_t value = 0;
+            if (std::from_chars(start, p, value).ec == std::errc{})
+                return handler.number_unsigned(value);
+        }
+        json::number_float_t value = 0.0;
+        if (from_chars_double(start, p, value).ec != std::errc{})
+            return false;
+        text.assign(start, p);
+        return handler.number_float(value, text);
+    };
+    auto literal = [&](std::string_view word) {
+        if (static_cast<size_t>(end - p) < word.size() || std::string_view{p, word.size()} != word)
+            return false;
+        p += word.size();
+        return true;
+    };
+
+    enum class state { value, after_value, key } next = state::value;
+    while (true) {
+        skip_whitespace();
+        if (next == state::key) {
+            if (p == end || *p != '"' || !read_string() || !handler.key(text))
+                return false;
+            skip_whitespace();
+            if (p == end || *p++ != ':')
+                return false;
+            next = state::value;
+            continue;
+        }
+        if (next == state::after_value) {
+            if (open.empty())
+                return true;
+            if (p == end)
+                return false;
+            const char c = *p++;
+            if (c == ',') {
+                next = open.back() == '{' ? state::key : state::value;
+            } else if (c == '}' && open.back() == '{') {
+                open.pop_back();
+                if (!handler.end_object())
+                    return false;
+            } else if (c == ']' && open.back() == '[') {
+                open.pop_back();
+                if (!handler.end_array())
+                    return false;
+            } else {
+                return false;
+            }
+            continue;
+        }
+        if (p == end)
+            return false;
+        bool ok = true;
+        switch (*p) {
+        case '{':
+            p++;
+            ok = handler.start_object(static_cast<std::size_t>(-1));
+            skip_whitespace();
+            if (ok && p < end && *p == '}') {
+                p++;
+                ok = handler.end_object();
+            } else {
+                open.push_back('{');
+                next = state::key;
+                break;
+            }
+            next = state::after_value;
+            break;
+        case '[':
+            p++;
+            ok = handler.start_array(static_cast<std::size_t>(-1));
+            skip_whitespace();
+            if (ok && p < end && *p == ']') {
+                p++;
+                ok = handler.end_array();
+                next = state::after_value;
+            } else {
+                open.push_back('[');
+            }
+            break;
+        case '"':
+            ok = read_string() && handler.string(text);
+            next = state::after_value;
+            break;
+        case 't':
+            ok = literal("true") && handler.boolean(true);
+            next = state::after_value;
+            break;
+        case 'f':
+            ok = literal("false") && handler.boolean(false);
+            next = state::after_value;
+            break;
+        case 'n':
+            ok = literal("null") && handler.null();
+            next = state::after_value;
+            break;
+        default:
+            ok = read_number();
+            next = state::after_value;
+            break;
+        }
+        if (!ok)
+            return false;
+    }
+}
+
+bool read_json_file_dom(sprite* spr, std::vector<std::string>& new_warnings);
+
+} // namespace
+
 bool read_json_file(sprite* spr) {
+    return read_json_file(spr, warnings);
+}
+
+bool read_json_file(sprite* spr, std::vector<std::string>& new_warnings) {
+    std::string contents{};
+    if (FILE* file = fopen(spr->cfg_file.c_str(), "rb"); file != nullptr) {
+        contents.resize(file_size(file));
+        const bool read = fread(contents.data(), 1, contents.size(), file) == contents.size();
+        fclose(file);
+        sprite_json_reader reader{};
+        if (read && stream_json(contents, reader) && reader.apply(spr, new_warnings)) {
+            iohandler::get_global().debug("Parsed %s\n", spr->cfg_file.c_str());
+            return true;
+        }
+    }
+    // errors are rare, the DOM reader has always reported them and keeps doing so word for word
+    return read_json_file_dom(spr, new_warnings);
+}
+
+std::string tweak_json(const sprite_table& table) {
+    auto j = nlohmann::ordered_json::object();
+    for (size_t b = 0; b < tweak_schema::addresses.size(); b++) {
+        auto& byte = j[std::string{tweak_schema::addresses[b]}];
+        for (size_t i = tweak_schema::first_field[b]; i < tweak_schema::first_field[b + 1]; i++) {
+            const tweak_schema::field& f = tweak_schema::fields[i];
+            const int value = tweak_schema::decode(f, table.tweak[b]);
+            if (f.number)
+                byte[std::string{f.name}] = value;
+            else
+                byte[std::string{f.name}] = value != 0;
+        }
+    }
+    return j.dump(2);
+}
+
+namespace {
+
+// one pass over the members of each "$XXXX" object, a missing or mistyped field throws like it would in at()
+void read_tweaks(const json& j, unsigned char (&tweak)[tweak_schema::addresses.size()]) {
+    for (size_t b = 0; b < tweak_schema::addresses.size(); b++) {
+        const json& byte = j.at(std::string{tweak_schema::addresses[b]});
+        unsigned char value = 0;
+        unsigned int seen = 0;
+        if (byte.is_object()) {
+            for (const auto& [key, member] : byte.items()) {
+                const int i = tweak_schema::find(key);
+                if (i < 0 || tweak_schema::fields[i].byte != b)
+                    continue;
+                const tweak_schema::field& f = tweak_schema::fields[i];
+                value |= tweak_schema::encode(f, f.number ? member.get<int>() : member.get<bool>());
+                seen |= f.mask;
+            }
+        }
+        for (size_t i = tweak_schema::first_field[b]; i < tweak_schema::first_field[b + 1]; i++) {
+            if ((seen & tweak_schema::fields[i].mask) != 0)
+                continue;
+            // operator[] is what used to complain about something that isn't an object
+            const std::string name{tweak_schema::fields[i].name};
+            static_cast<void>(byte.is_object() ? byte.at(name) : byte[name]);
+        }
+        tweak[b] = value;
+    }
+}
+
+bool read_json_file_dom(sprite* spr, std::vector<std::string>& new_warnings) {
     iohandler& io = iohandler::get_global();
     json j;
     try {
@@ -76,18 +925,17 @@ bool read_json_file(sprite* spr) {
             spr->byte_count = std::clamp(spr->byte_count, uint8_t{0}, uint8_t{15});
             spr->extra_byte_count = std::clamp(spr->extra_byte_count, uint8_t{0}, uint8_t{15});
         }
-        spr->table.tweak[0] = j1656(j);
-        spr->table.tweak[1] = j1662(j);
-        spr->table.tweak[2] = j166e(j);
-        spr->table.tweak[3] = j167a(j);
-        spr->table.tweak[4] = j1686(j);
-        spr->table.tweak[5] = j190f(j);
-
-        std::string decoded = base64_decode(j.at("Map16"));
-        size_t map_block_count = decoded.size() / sizeof(map16);
-        spr->map_data.resize(map_block_count);
-        if (map_block_count > 0)
-            memcpy(spr->map_data.data(), decoded.c_str(), map_block_count * sizeof(map16));
+        read_tweaks(j, spr->table.tweak);
+
+        const std::string map16_data = j.at("Map16");
+        const auto map16_size = base64_decoded_size(map16_data);
+        spr->map_data.resize(map16_size.value_or(0) / sizeof(map16));
+        if (!map16_size || !base64_decode(map16_data, std::span{spr->map_data})) {
+            io.error("The Map16 data in json file %s isn't valid base64, please make sure that the json file has the "
+                     "correct format.\n",
+                     spr->cfg_file.c_str());
+            return false;
+        }
         // displays
         auto disp_type_it = j.find("DisplayType");
         if (disp_type_it != j.end()) {
@@ -175,16 +1023,21 @@ bool read_json_file(sprite* spr) {
             col.name = jCollection.at("Name").get<std::string>();
             col.extra_bit = jCollection.at("ExtraBit");
             for (int i = 1; i <= (col.extra_bit ? spr->extra_byte_count : spr->byte_count); i++) {
-                try {
-                    col.prop[i - 1] = jCollection.at("Extra Property Byte " + std::to_string(i));
-                } catch (const std::out_of_range&) {
-                    col.prop[i - 1] = 0;
+                // .at() throws json::out_of_range, which isn't a std::out_of_range, so look the key up instead
+                auto prop_it = jCollection.find("Extra Property Byte " + std::to_string(i));
+                unsigned char value = 0;
+                if (prop_it != jCollection.end()) {
+                    value = *prop_it;
+                } else {
                     // if it's not specified in the json just set it at 0, who cares anyway, just add a warning
-                    warnings.push_back("Your json file \"" +
-                                       std::filesystem::path(spr->cfg_file).filename().generic_string() +
-                                       "\" is missing a definition for Extra Property Byte " + std::to_string(i) +
-                                       " at collection \"" + col.name + "\"");
+                    new_warnings.push_back("Your json file \"" +
+                                           std::filesystem::path(spr->cfg_file.str()).filename().generic_string() +
+                                           "\" is missing a definition for Extra Property Byte " + std::to_string(i) +
+                                           " at collection \"" + col.name + "\"");
                 }
+                // byte counts go up to 15, there's only room for 12
+                if (i <= static_cast<int>(sizeof(col.prop)))
+                    col.prop[i - 1] = value;
             }
             counter++;
         }
@@ -201,3 +1054,5 @@ bool read_json_file(sprite* spr) {
         return false;
     }
 }
+
+} // namespace
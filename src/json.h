@@ -7,6 +7,7 @@
 
 extern std::vector<std::string> warnings;
 struct sprite;
+struct sprite_table;
 
 /**
     Reads the content of a JSON file into a sprite and writes some debug info into
@@ -16,5 +17,11 @@ struct sprite;
     @param output to write the debug information into, leave as nullptr for no output to be used
 */
 bool read_json_file(sprite *spr);
+// same as above, but the warnings go into new_warnings instead of the global list
+bool read_json_file(sprite *spr, std::vector<std::string> &new_warnings);
+
+// the "$1656" to "$190F" objects a JSON file needs for these tweak bytes, e.g. to turn a CFG sprite into a JSON one,
+// as the text of a single JSON object indented like the files the CFG editor writes
+std::string tweak_json(const sprite_table &table);
 
 #endif
\ No newline at end of file
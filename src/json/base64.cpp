@@ -1,93 +1,266 @@
 #include "base64.h"
-#include <sstream>
+#include "../cpu_features.h"
+#include <array>
+#include <cstdint>
 
-static const std::string base64_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-                                        "abcdefghijklmnopqrstuvwxyz"
-                                        "0123456789+/";
+namespace {
 
-static inline bool is_base64(unsigned char c) {
-    return (isalnum(c) || (c == '+') || (c == '/'));
-}
+constexpr char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                "abcdefghijklmnopqrstuvwxyz"
+                                "0123456789+/";
 
-std::string base64_encode(unsigned char const *bytes_to_encode, unsigned int in_len) {
-    std::stringstream ret{};
-    int i = 0;
-    int j = 0;
-    unsigned char char_array_3[3];
-    unsigned char char_array_4[4];
-
-    while (in_len--) {
-        char_array_3[i++] = *(bytes_to_encode++);
-        if (i == 3) {
-            char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-            char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-            char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-            char_array_4[3] = char_array_3[2] & 0x3f;
-
-            for (i = 0; (i < 4); i++)
-                ret << base64_chars[char_array_4[i]];
-            i = 0;
-        }
-    }
+constexpr uint8_t invalid_char = 0xFF;
+constexpr std::array<uint8_t, 256> decode_table = [] {
+    std::array<uint8_t, 256> table{};
+    table.fill(invalid_char);
+    for (uint8_t i = 0; i < 64; i++)
+        table[static_cast<unsigned char>(base64_chars[i])] = i;
+    return table;
+}();
+
+// the vectorized loops below only do whole blocks and return how much of the input they got through, the scalar
+// code picks up from there (and finds out where exactly the input was invalid, if that's why they stopped)
+using decode_kernel = size_t (*)(const char* in, size_t in_len, unsigned char* out, size_t out_len);
+using encode_kernel = size_t (*)(const unsigned char* in, size_t in_len, char* out);
+
+size_t decode_none(const char*, size_t, unsigned char*, size_t) {
+    return 0;
+}
+size_t encode_none(const unsigned char*, size_t, char*) {
+    return 0;
+}
 
-    if (i) {
-        for (j = i; j < 3; j++)
-            char_array_3[j] = '\0';
+#ifdef PIXI_X86
 
-        char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-        char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-        char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-        char_array_4[3] = char_array_3[2] & 0x3f;
+/*
+    Both directions are the pshufb based ones from Wojciech Muła and Daniel Lemire's "Faster Base64 Encoding and
+    Decoding using AVX2 Instructions". When decoding, the low and high nibble of every character index two tables
+    whose entries only have a bit in common for characters outside of the alphabet, a third table indexed by the
+    high nibble gives the offset from the character to its 6 bit value.
+*/
 
-        for (j = 0; (j < i + 1); j++)
-            ret << base64_chars[char_array_4[j]];
+PIXI_TARGET("ssse3")
+size_t decode_ssse3(const char* in, size_t in_len, unsigned char* out, size_t out_len) {
+    const __m128i lut_lo =
+        _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi =
+        _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_2f = _mm_set1_epi8(0x2F);
+    size_t done = 0;
+    // every block stores 16 bytes, of which only 12 are output
+    while (in_len - done >= 16 && done / 4 * 3 + 16 <= out_len) {
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done));
+        const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(chars, 4), mask_2f);
+        const __m128i lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(chars, mask_2f));
+        const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xFFFF)
+            break;
+        const __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(chars, mask_2f), hi_nibbles));
+        chars = _mm_add_epi8(chars, roll);
+        // 4x6 bits to 3 bytes
+        const __m128i merged = _mm_madd_epi16(_mm_maddubs_epi16(chars, _mm_set1_epi32(0x01400140)),
+                                              _mm_set1_epi32(0x00011000));
+        const __m128i packed =
+            _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + done / 4 * 3), packed);
+        done += 16;
+    }
+    return done;
+}
 
-        while ((i++ < 3))
-            ret << '=';
+PIXI_TARGET("avx2")
+size_t decode_avx2(const char* in, size_t in_len, unsigned char* out, size_t out_len) {
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+                                            0x1B, 0x1B, 0x1B, 0x1A, 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0, 0, 16, 19, 4,
+                                              -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+    size_t done = 0;
+    // every block stores 32 bytes, of which only 24 are output
+    while (in_len - done >= 32 && done / 4 * 3 + 32 <= out_len) {
+        __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + done));
+        const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(chars, 4), mask_2f);
+        const __m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(chars, mask_2f));
+        const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        if (!_mm256_testz_si256(lo, hi))
+            break;
+        const __m256i roll =
+            _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(_mm256_cmpeq_epi8(chars, mask_2f), hi_nibbles));
+        chars = _mm256_add_epi8(chars, roll);
+        const __m256i merged = _mm256_madd_epi16(_mm256_maddubs_epi16(chars, _mm256_set1_epi32(0x01400140)),
+                                                 _mm256_set1_epi32(0x00011000));
+        const __m256i lanes = _mm256_shuffle_epi8(
+            merged, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9,
+                                     8, 14, 13, 12, -1, -1, -1, -1));
+        // both lanes have 12 bytes at the bottom, put them next to each other
+        const __m256i packed = _mm256_permutevar8x32_epi32(lanes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + done / 4 * 3), packed);
+        done += 32;
     }
+    return done;
+}
 
-    return ret.str();
+PIXI_TARGET("ssse3")
+size_t encode_ssse3(const unsigned char* in, size_t in_len, char* out) {
+    const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    size_t done = 0;
+    // every block loads 16 bytes, of which only 12 are encoded
+    while (in_len - done >= 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done));
+        bytes = _mm_shuffle_epi8(bytes, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+        // 3 bytes to 4x6 bits, one per byte
+        const __m128i t0 =
+            _mm_mulhi_epu16(_mm_and_si128(bytes, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+        const __m128i t1 =
+            _mm_mullo_epi16(_mm_and_si128(bytes, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+        const __m128i indices = _mm_or_si128(t0, t1);
+        // 0-25 go to 13 ('A'), 26-51 to 0 ('a' - 26), then 1-12 for the digits, '+' and '/'
+        __m128i offsets = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        offsets =
+            _mm_or_si128(offsets, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+        const __m128i chars = _mm_add_epi8(_mm_shuffle_epi8(shift_lut, offsets), indices);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + done / 3 * 4), chars);
+        done += 12;
+    }
+    return done;
 }
 
-std::string base64_decode(std::string const &encoded_string) {
-    size_t in_len = encoded_string.size();
-    size_t i = 0;
-    size_t j = 0;
-    int in_ = 0;
-    unsigned char char_array_4[4], char_array_3[3];
-    std::stringstream ret{};
-
-    while (in_len-- && (encoded_string[in_] != '=') && is_base64(encoded_string[in_])) {
-        char_array_4[i++] = encoded_string[in_];
-        in_++;
-        if (i == 4) {
-            for (i = 0; i < 4; i++)
-                char_array_4[i] = static_cast<unsigned char>(base64_chars.find(char_array_4[i]));
-
-            char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-            char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-            char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-
-            for (i = 0; (i < 3); i++)
-                ret << char_array_3[i];
-            i = 0;
-        }
+PIXI_TARGET("avx2")
+size_t encode_avx2(const unsigned char* in, size_t in_len, char* out) {
+    const __m256i shift_lut = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '+' - 62, '/' - 63, 'A', 0, 0, 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    size_t done = 0;
+    // both lanes load 16 bytes and encode 12 of them, the second one starts 12 bytes in
+    while (in_len - done >= 28) {
+        const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done));
+        const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done + 12));
+        __m256i bytes = _mm256_inserti128_si256(_mm256_castsi128_si256(first), second, 1);
+        bytes = _mm256_shuffle_epi8(bytes, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, 1, 0, 2,
+                                                            1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+        const __m256i t0 =
+            _mm256_mulhi_epu16(_mm256_and_si256(bytes, _mm256_set1_epi32(0x0FC0FC00)), _mm256_set1_epi32(0x04000040));
+        const __m256i t1 =
+            _mm256_mullo_epi16(_mm256_and_si256(bytes, _mm256_set1_epi32(0x003F03F0)), _mm256_set1_epi32(0x01000010));
+        const __m256i indices = _mm256_or_si256(t0, t1);
+        __m256i offsets = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        offsets = _mm256_or_si256(
+            offsets, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+        const __m256i chars = _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, offsets), indices);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + done / 3 * 4), chars);
+        done += 24;
     }
+    return done;
+}
 
-    if (i) {
-        for (j = i; j < 4; j++)
-            char_array_4[j] = 0;
+#endif
 
-        for (j = 0; j < 4; j++)
-            char_array_4[j] = static_cast<unsigned char>(base64_chars.find(char_array_4[j]));
+struct kernels {
+    decode_kernel decode = decode_none;
+    encode_kernel encode = encode_none;
+};
 
-        char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-        char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-        char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+const kernels& best_kernels() {
+    static const kernels best = [] {
+        kernels k{};
+#ifdef PIXI_X86
+        const cpu_features& cpu = detected_cpu_features();
+        if (cpu.avx2)
+            k = {decode_avx2, encode_avx2};
+        else if (cpu.ssse3)
+            k = {decode_ssse3, encode_ssse3};
+#endif
+        return k;
+    }();
+    return best;
+}
 
-        for (j = 0; (j < i - 1); j++)
-            ret << char_array_3[j];
+// the '=' at the end, there's never more than 2
+size_t padding_of(std::string_view encoded) {
+    size_t padding = 0;
+    while (padding < 2 && padding < encoded.size() && encoded[encoded.size() - 1 - padding] == '=')
+        padding++;
+    return padding;
+}
+
+} // namespace
+
+std::string base64_encode(std::span<const unsigned char> bytes) {
+    std::string encoded((bytes.size() + 2) / 3 * 4, '\0');
+    const unsigned char* in = bytes.data();
+    char* out = encoded.data();
+    size_t i = best_kernels().encode(in, bytes.size(), out);
+    size_t o = i / 3 * 4;
+    for (; bytes.size() - i >= 3; i += 3, o += 4) {
+        const uint32_t group = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+        out[o] = base64_chars[group >> 18];
+        out[o + 1] = base64_chars[(group >> 12) & 0x3F];
+        out[o + 2] = base64_chars[(group >> 6) & 0x3F];
+        out[o + 3] = base64_chars[group & 0x3F];
     }
+    if (const size_t left = bytes.size() - i; left != 0) {
+        const uint32_t group = (in[i] << 16) | (left == 2 ? in[i + 1] << 8 : 0);
+        out[o] = base64_chars[group >> 18];
+        out[o + 1] = base64_chars[(group >> 12) & 0x3F];
+        out[o + 2] = left == 2 ? base64_chars[(group >> 6) & 0x3F] : '=';
+        out[o + 3] = '=';
+    }
+    return encoded;
+}
 
-    return ret.str();
-}
\ No newline at end of file
+std::optional<size_t> base64_decoded_size(std::string_view encoded) {
+    const size_t padding = padding_of(encoded);
+    // padded input comes in groups of 4, and a group can't have a single character
+    if ((padding != 0 && encoded.size() % 4 != 0) || (encoded.size() - padding) % 4 == 1)
+        return std::nullopt;
+    const size_t chars = encoded.size() - padding;
+    return chars / 4 * 3 + (chars % 4 == 0 ? 0 : chars % 4 - 1);
+}
+
+bool base64_decode(std::string_view encoded, std::span<unsigned char> out) {
+    const auto decoded_size = base64_decoded_size(encoded);
+    if (!decoded_size || *decoded_size < out.size())
+        return false;
+    const size_t chars = encoded.size() - padding_of(encoded);
+    const size_t whole_groups = chars / 4 * 4;
+    const char* in = encoded.data();
+
+    size_t i = best_kernels().decode(in, whole_groups, out.data(), out.size());
+    size_t o = i / 4 * 3;
+    // bytes past the end of out are only validated
+    auto put = [&](size_t at, uint32_t byte) {
+        if (at < out.size())
+            out[at] = static_cast<unsigned char>(byte);
+    };
+    for (; i < whole_groups; i += 4, o += 3) {
+        const uint32_t a = decode_table[static_cast<unsigned char>(in[i])];
+        const uint32_t b = decode_table[static_cast<unsigned char>(in[i + 1])];
+        const uint32_t c = decode_table[static_cast<unsigned char>(in[i + 2])];
+        const uint32_t d = decode_table[static_cast<unsigned char>(in[i + 3])];
+        if ((a | b | c | d) == invalid_char)
+            return false;
+        const uint32_t group = (a << 18) | (b << 12) | (c << 6) | d;
+        put(o, group >> 16);
+        put(o + 1, (group >> 8) & 0xFF);
+        put(o + 2, group & 0xFF);
+    }
+    if (const size_t left = chars - whole_groups; left != 0) {
+        const uint32_t a = decode_table[static_cast<unsigned char>(in[i])];
+        const uint32_t b = decode_table[static_cast<unsigned char>(in[i + 1])];
+        const uint32_t c = left == 3 ? decode_table[static_cast<unsigned char>(in[i + 2])] : 0;
+        if ((a | b | c) == invalid_char)
+            return false;
+        const uint32_t group = (a << 18) | (b << 12) | (c << 6);
+        put(o, group >> 16);
+        if (left == 3)
+            put(o + 1, (group >> 8) & 0xFF);
+    }
+    return true;
+}
@@ -1,6 +1,30 @@
 #ifndef _BASE64_H_
 #define _BASE64_H_
+#include <cstddef>
+#include <optional>
+#include <span>
 #include <string>
-std::string base64_encode(unsigned char const *, unsigned int len);
-std::string base64_decode(std::string const &s);
-#endif
\ No newline at end of file
+#include <string_view>
+#include <type_traits>
+
+std::string base64_encode(std::span<const unsigned char> bytes);
+// number of bytes encoded decodes to if it's valid, nothing if its length or padding already says it isn't
+std::optional<size_t> base64_decoded_size(std::string_view encoded);
+// decodes the first out.size() bytes of encoded into out, the whole input is still validated (padding is optional)
+// false if encoded isn't valid base64 or is too short to fill out
+bool base64_decode(std::string_view encoded, std::span<unsigned char> out);
+
+// same as above for arrays of plain structs, e.g. the map16 tiles of a sprite
+template <typename T>
+    requires(std::is_trivially_copyable_v<T> && !std::is_same_v<std::remove_const_t<T>, unsigned char>)
+std::string base64_encode(std::span<const T> values) {
+    return base64_encode(
+        std::span<const unsigned char>{reinterpret_cast<const unsigned char *>(values.data()), values.size_bytes()});
+}
+template <typename T>
+    requires(std::is_trivially_copyable_v<T> && !std::is_const_v<T> && !std::is_same_v<T, unsigned char>)
+bool base64_decode(std::string_view encoded, std::span<T> out) {
+    return base64_decode(encoded,
+                         std::span<unsigned char>{reinterpret_cast<unsigned char *>(out.data()), out.size_bytes()});
+}
+#endif
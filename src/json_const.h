@@ -1,75 +1,126 @@
-#include <nlohmann/json.hpp>
+// Generated by generate_json.py from tweak_bit_names.json, edit those instead.
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
 
-auto j1656(const nlohmann::json& j) {
-    unsigned char c = 0;
-    auto& byte = j["$1656"];
-    c |= (((int)byte["Object Clipping"] & 0x0F) << 0);
-    c |= (byte["Can be jumped on"] ? 0x10 : 0);
-    c |= (byte["Dies when jumped on"] ? 0x20 : 0);
-    c |= (byte["Hop in/kick shell"] ? 0x40 : 0);
-    c |= (byte["Disappears in cloud of smoke"] ? 0x80 : 0);
-    return c;
-}
+namespace tweak_schema {
+
+// a flag or a number inside of a tweak byte, the mask is where it sits in the byte (e.g. 0x0E for the palette)
+struct field {
+    std::string_view name;
+    uint8_t byte;
+    uint8_t mask;
+    uint8_t shift;
+    bool number;
+};
+
+constexpr std::array<std::string_view, 6> addresses{"$1656", "$1662", "$166E", "$167A", "$1686", "$190F"};
+
+constexpr std::array<field, 38> fields{{
+    {"Object Clipping", 0, 0x0F, 0, true},
+    {"Can be jumped on", 0, 0x10, 4, false},
+    {"Dies when jumped on", 0, 0x20, 5, false},
+    {"Hop in/kick shell", 0, 0x40, 6, false},
+    {"Disappears in cloud of smoke", 0, 0x80, 7, false},
+    {"Sprite Clipping", 1, 0x3F, 0, true},
+    {"Use shell as death frame", 1, 0x40, 6, false},
+    {"Fall straight down when killed", 1, 0x80, 7, false},
+    {"Use second graphics page", 2, 0x01, 0, false},
+    {"Palette", 2, 0x0E, 1, true},
+    {"Disable fireball killing", 2, 0x10, 4, false},
+    {"Disable cape killing", 2, 0x20, 5, false},
+    {"Disable water splash", 2, 0x40, 6, false},
+    {"Don't interact with Layer 2", 2, 0x80, 7, false},
+    {"Don't disable cliping when starkilled", 3, 0x01, 0, false},
+    {"Invincible to star/cape/fire/bounce blk.", 3, 0x02, 1, false},
+    {"Process when off screen", 3, 0x04, 2, false},
+    {"Don't change into shell when stunned", 3, 0x08, 3, false},
+    {"Can't be kicked like shell", 3, 0x10, 4, false},
+    {"Process interaction with Mario every frame", 3, 0x20, 5, false},
+    {"Gives power-up when eaten by yoshi", 3, 0x40, 6, false},
+    {"Don't use default interaction with Mario", 3, 0x80, 7, false},
+    {"Inedible", 4, 0x01, 0, false},
+    {"Stay in Yoshi's mouth", 4, 0x02, 1, false},
+    {"Weird ground behaviour", 4, 0x04, 2, false},
+    {"Don't interact with other sprites", 4, 0x08, 3, false},
+    {"Don't change direction if touched", 4, 0x10, 4, false},
+    {"Don't turn into coin when goal passed", 4, 0x20, 5, false},
+    {"Spawn a new sprite", 4, 0x40, 6, false},
+    {"Don't interact with objects", 4, 0x80, 7, false},
+    {"Make platform passable from below", 5, 0x01, 0, false},
+    {"Don't erase when goal passed", 5, 0x02, 1, false},
+    {"Can't be killed by sliding", 5, 0x04, 2, false},
+    {"Takes 5 fireballs to kill", 5, 0x08, 3, false},
+    {"Can be jumped on with upwards Y speed", 5, 0x10, 4, false},
+    {"Death frame two tiles high", 5, 0x20, 5, false},
+    {"Don't turn into a coin with silver POW", 5, 0x40, 6, false},
+    {"Don't get stuck in walls (carryable sprites)", 5, 0x80, 7, false},
+}};
 
-auto j1662(const nlohmann::json& j) {
-    unsigned char c = 0;
-    auto& byte = j["$1662"];
-    c |= (((int)byte["Sprite Clipping"] & 0x3F) << 0);
-    c |= (byte["Use shell as death frame"] ? 0x40 : 0);
-    c |= (byte["Fall straight down when killed"] ? 0x80 : 0);
-    return c;
+// the fields of tweak byte i are fields[first_field[i]] up to fields[first_field[i + 1]]
+constexpr std::array<uint8_t, 7> first_field{0, 5, 8, 14, 22, 30, 38};
+
+// FNV-1a with a seed picked by the generator so that no two field names end up in the same slot, the slot is taken
+// from the top bits since the bottom ones barely depend on the seed
+constexpr uint32_t hash_seed = 0x811C9DE5;
+constexpr int hash_slot_bits = 7;
+constexpr std::array<int8_t, 1 << hash_slot_bits> hash_slots{{
+     0, -1, -1,  7, 25, -1, -1, 21, 32, -1, -1, -1, -1, -1, 14, 33,
+     8, 17, -1, -1, 31, -1, -1, -1,  1, 20, 12, -1,  5, -1, -1, -1,
+     3, -1, -1, -1, -1, 29, 10, -1, -1, 16, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 11, -1, -1, -1, 18, 36,
+    15, -1, -1, -1, -1, -1, -1, -1, 30, 35, -1, -1, 27, -1, -1, -1,
+    -1,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    28, 23,  2, -1, -1, 34, -1, -1, 22,  4, -1, -1, -1, 37, -1, -1,
+    -1, -1, 26, -1, -1, 24, -1, -1, 19, 13,  9, -1, -1, -1, -1, -1,
+}};
+
+constexpr uint32_t hash(std::string_view key) {
+    uint32_t h = hash_seed;
+    for (char c : key)
+        h = (h ^ static_cast<uint8_t>(c)) * 0x01000193u;
+    return h;
 }
 
-auto j166e(const nlohmann::json& j) {
-    unsigned char c = 0;
-    auto& byte = j["$166E"];
-    c |= (byte["Use second graphics page"] ? 0x01 : 0);
-    c |= (((int)byte["Palette"] & 0x07) << 1);
-    c |= (byte["Disable fireball killing"] ? 0x10 : 0);
-    c |= (byte["Disable cape killing"] ? 0x20 : 0);
-    c |= (byte["Disable water splash"] ? 0x40 : 0);
-    c |= (byte["Don't interact with Layer 2"] ? 0x80 : 0);
-    return c;
+// index into fields of the field called key, -1 if there's none
+constexpr int find(std::string_view key) {
+    const int i = hash_slots[hash(key) >> (32 - hash_slot_bits)];
+    return i >= 0 && fields[i].name == key ? i : -1;
 }
 
-auto j167a(const nlohmann::json& j) {
-    unsigned char c = 0;
-    auto& byte = j["$167A"];
-    c |= (byte["Don't disable cliping when starkilled"] ? 0x01 : 0);
-    c |= (byte["Invincible to star/cape/fire/bounce blk."] ? 0x02 : 0);
-    c |= (byte["Process when off screen"] ? 0x04 : 0);
-    c |= (byte["Don't change into shell when stunned"] ? 0x08 : 0);
-    c |= (byte["Can't be kicked like shell"] ? 0x10 : 0);
-    c |= (byte["Process interaction with Mario every frame"] ? 0x20 : 0);
-    c |= (byte["Gives power-up when eaten by yoshi"] ? 0x40 : 0);
-    c |= (byte["Don't use default interaction with Mario"] ? 0x80 : 0);
-    return c;
+// numbers are masked to the bits they own, flags set all of theirs
+constexpr uint8_t encode(const field& f, int value) {
+    if (f.number)
+        return static_cast<uint8_t>((value & (f.mask >> f.shift)) << f.shift);
+    return value ? f.mask : 0;
 }
 
-auto j1686(const nlohmann::json& j) {
-    unsigned char c = 0;
-    auto& byte = j["$1686"];
-    c |= (byte["Inedible"] ? 0x01 : 0);
-    c |= (byte["Stay in Yoshi's mouth"] ? 0x02 : 0);
-    c |= (byte["Weird ground behaviour"] ? 0x04 : 0);
-    c |= (byte["Don't interact with other sprites"] ? 0x08 : 0);
-    c |= (byte["Don't change direction if touched"] ? 0x10 : 0);
-    c |= (byte["Don't turn into coin when goal passed"] ? 0x20 : 0);
-    c |= (byte["Spawn a new sprite"] ? 0x40 : 0);
-    c |= (byte["Don't interact with objects"] ? 0x80 : 0);
-    return c;
+constexpr int decode(const field& f, uint8_t byte) {
+    if (f.number)
+        return (byte & f.mask) >> f.shift;
+    return (byte & f.mask) != 0;
 }
 
-auto j190f(const nlohmann::json& j) {
-    unsigned char c = 0;
-    auto& byte = j["$190F"];
-    c |= (byte["Make platform passable from below"] ? 0x01 : 0);
-    c |= (byte["Don't erase when goal passed"] ? 0x02 : 0);
-    c |= (byte["Can't be killed by sliding"] ? 0x04 : 0);
-    c |= (byte["Takes 5 fireballs to kill"] ? 0x08 : 0);
-    c |= (byte["Can be jumped on with upwards Y speed"] ? 0x10 : 0);
-    c |= (byte["Death frame two tiles high"] ? 0x20 : 0);
-    c |= (byte["Don't turn into a coin with silver POW"] ? 0x40 : 0);
-    c |= (byte["Don't get stuck in walls (carryable sprites)"] ? 0x80 : 0);
-    return c;
+// every field is found by its name, and the fields of each byte cover all of its bits exactly once
+constexpr bool verify() {
+    for (size_t b = 0; b < addresses.size(); b++) {
+        unsigned int covered = 0;
+        for (size_t i = first_field[b]; i < first_field[b + 1]; i++) {
+            if (fields[i].byte != b || find(fields[i].name) != static_cast<int>(i) || (covered & fields[i].mask) != 0)
+                return false;
+            covered |= fields[i].mask;
+            for (int value = 0; value <= (fields[i].number ? fields[i].mask >> fields[i].shift : 1); value++) {
+                if (decode(fields[i], encode(fields[i], value)) != value)
+                    return false;
+            }
+        }
+        if (covered != 0xFF)
+            return false;
+    }
+    return true;
 }
+static_assert(verify(), "tweak_bit_names.json doesn't describe every bit of every tweak byte exactly once");
+
+} // namespace tweak_schema
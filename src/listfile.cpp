@@ -0,0 +1,153 @@
+#include "listfile.h"
+#include "file_io.h"
+#include "iohandler.h"
+#include "libconsole/libconsole.h"
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <utility>
+
+using namespace std::string_view_literals;
+
+namespace {
+
+std::string_view trimmed(std::string_view s) {
+    while (!s.empty() && libconsole::isspace(s.front()))
+        s.remove_prefix(1);
+    while (!s.empty() && libconsole::isspace(s.back()))
+        s.remove_suffix(1);
+    return s;
+}
+
+// same as sscanf's %x: leading whitespace and a 0x prefix are allowed, the rest of s is left in place
+bool parse_hex(std::string_view& s, unsigned int& value) {
+    s = trimmed(s);
+    if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X') && isxdigit(static_cast<unsigned char>(s[2])))
+        s.remove_prefix(2);
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), value, 16);
+    if (ec != std::errc{})
+        return false;
+    s.remove_prefix(static_cast<size_t>(ptr - s.data()));
+    return true;
+}
+
+bool is_extension(std::string_view ext, std::string_view lower, std::string_view upper) {
+    return ext == lower || ext == upper;
+}
+
+} // namespace
+
+list_tokens tokenize_list(std::string_view contents, bool per_level) {
+    constexpr std::array<std::pair<std::string_view, ListType>, 8> type_names{
+        {{"SPRITE:"sv, ListType::Sprite},
+         {"CLUSTER:"sv, ListType::Cluster},
+         {"EXTENDED:"sv, ListType::Extended},
+         {"MINOREXTENDED:"sv, ListType::MinorExtended},
+         {"BOUNCE:"sv, ListType::Bounce},
+         {"SMOKE:"sv, ListType::Smoke},
+         {"SPINNINGCOIN:"sv, ListType::SpinningCoin},
+         {"SCORE:"sv, ListType::Score}}};
+
+    list_tokens tokens{};
+    ListType type = ListType::Sprite;
+    int lineno = 0;
+    auto error = [&](const char* format, auto... args) {
+        tokens.errors.push_back({lineno, fstring(format, args...)});
+    };
+    while (!contents.empty()) {
+        const size_t newline = contents.find('\n');
+        std::string_view line = contents.substr(0, newline);
+        contents.remove_prefix(newline == std::string_view::npos ? contents.size() : newline + 1);
+        lineno++;
+
+        line = trimmed(line.substr(0, line.find(';')));
+        if (line.empty())
+            continue;
+
+        list_entry entry{.line = lineno, .type = type};
+        std::string_view rest = line;
+        const size_t colon = line.find(':');
+        if (colon == std::string_view::npos) { // if there's no : in the line, it's a non per-level sprite
+            if (!parse_hex(rest, entry.number)) {
+                error("List line %d was malformed: \"%.*s\"\n", lineno, static_cast<int>(line.size()), line.data());
+                continue;
+            }
+        } else if (colon == line.size() - 1) { // if it's the last char in the line, it's a type change
+            for (const auto& [name, list_type] : type_names) {
+                if (name == line)
+                    type = list_type;
+            }
+            continue;
+        } else { // if there's a ':' but it's not at the end, it may be a per level sprite
+            const bool level_read = parse_hex(rest, entry.level) && rest.starts_with(':');
+            if (level_read)
+                rest.remove_prefix(1);
+            if (!level_read || !parse_hex(rest, entry.number)) {
+                error("List line %d was malformed: \"%.*s\"\n", lineno, static_cast<int>(line.size()), line.data());
+                continue;
+            }
+            if (!per_level) {
+                error("Trying to insert per level sprites without using the -pl flag, at list line %d: \"%.*s\"\n",
+                      lineno, static_cast<int>(line.size()), line.data());
+                continue;
+            }
+        }
+        rest = trimmed(rest);
+
+        const size_t dot = rest.find_last_of('.');
+        if (dot == std::string_view::npos) {
+            error("Error on list line %d: missing extension on filename %.*s\n", lineno, static_cast<int>(rest.size()),
+                  rest.data());
+            continue;
+        }
+        const size_t space_after_ext = rest.find(' ', dot);
+        entry.file = rest.substr(0, space_after_ext);
+        entry.extension = entry.file.substr(dot + 1);
+        const std::string_view display =
+            space_after_ext == std::string_view::npos ? std::string_view{} : trimmed(rest.substr(space_after_ext + 1));
+        const bool has_display = space_after_ext != std::string_view::npos;
+
+        if (type != ListType::Sprite) {
+            if (!is_extension(entry.extension, "asm", "ASM")) {
+                error("Error on list line %d: not an asm file\n", lineno);
+                continue;
+            }
+            if (has_display) {
+                error("Error on list line %d: display type not supported for ASM files\n", lineno);
+                continue;
+            }
+        } else if (is_extension(entry.extension, "cfg", "CFG")) {
+            if (has_display) {
+                if (display == "display"sv) {
+                    entry.display = true;
+                } else if (display != "nodisplay"sv) {
+                    error("Error on list line %d: Unknown display type %.*s\n", lineno,
+                          static_cast<int>(display.size()), display.data());
+                    continue;
+                }
+            }
+        } else if (is_extension(entry.extension, "json", "JSON")) {
+            if (has_display) {
+                error("Error on list line %d: display type not supported for JSON files\n", lineno);
+                continue;
+            }
+        } else {
+            error("Error on list line %d: Unknown filetype %.*s\n", lineno, static_cast<int>(entry.extension.size()),
+                  entry.extension.data());
+            continue;
+        }
+        tokens.entries.push_back(entry);
+    }
+    return tokens;
+}
+
+bool read_list_file(std::string_view path, std::string& contents) {
+    FILE* file = fopen(std::string{path}.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+    contents.resize(file_size(file));
+    const bool ok = fread(contents.data(), 1, contents.size(), file) == contents.size();
+    fclose(file);
+    return ok;
+}
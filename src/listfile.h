@@ -0,0 +1,42 @@
+#pragma once
+#include "config.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// one sprite line of a list file, the views point into the list's contents
+struct list_entry {
+    int line = 0;
+    ListType type = ListType::Sprite;
+    unsigned int level = 0x200;
+    unsigned int number = 0;
+    // file name as written in the list, relative to the directory of the sprite type
+    std::string_view file{};
+    std::string_view extension{};
+    // "display" was appended to a CFG entry
+    bool display = false;
+};
+
+struct list_error {
+    int line = 0;
+    std::string message{};
+};
+
+struct list_tokens {
+    std::vector<list_entry> entries{};
+    // every malformed line, not just the first one
+    std::vector<list_error> errors{};
+};
+
+/**
+    Splits the contents of a list file into its sprite entries in a single pass, without copying any of it.
+
+    Possible line formats: xxx:yy filename.<cfg/json/asm> [display|nodisplay] [; ...]
+                           yy filename.<cfg/json/asm> [; ...]
+                           TYPE: [; ...]
+    Only the syntax is checked here, whether the sprite slots are valid is up to the caller.
+*/
+list_tokens tokenize_list(std::string_view contents, bool per_level);
+
+// reads the whole list file in one go, false if it couldn't be opened
+[[nodiscard]] bool read_list_file(std::string_view path, std::string& contents);
@@ -3,17 +3,9 @@
 #include <cstdio>
 #include <sstream>
 
-static const sprite* from_table(const sprite (&sprite_list)[MAX_SPRITE_COUNT], int level, int number, bool perlevel) {
-    if (!perlevel)
-        return &sprite_list[number];
-
-    if (level > 0x200 || number > 0xFF)
-        return nullptr;
-    if (level == 0x200)
-        return &sprite_list[0x2000 + number];
-    else if (number >= 0xB0 && number < 0xC0)
-        return &sprite_list[(level * 0x10) + (number - 0xB0)];
-    return nullptr;
+// the global sprite with this number, nullptr if the list doesn't have one
+static const sprite* global_sprite(const sprite_registry& registry, int number, bool perlevel) {
+    return registry.find(ListType::Sprite, perlevel ? 0x2000 + number : number);
 }
 
 std::pair<size_t, std::span<const map16>> generate_s16_data(const sprite* spr, const map16* const map,
@@ -117,18 +109,17 @@ std::string generate_ssc_data(const sprite* spr, int i, size_t map16_tile) {
     return ssc.str();
 }
 
-bool generate_lm_data(const sprite (&sprite_list)[MAX_SPRITE_COUNT], map16 (&map)[MAP16_SIZE],
-                      unsigned char (&extra_bytes)[0x200], FILE* ssc, FILE* mwt, FILE* mw2, FILE* s16, bool perlevel) {
+bool generate_lm_data(const sprite_registry& registry, map16 (&map)[MAP16_SIZE], unsigned char (&extra_bytes)[0x200],
+                      FILE* ssc, FILE* mwt, FILE* mw2, FILE* s16, bool perlevel) {
     auto& io = iohandler::get_global();
     for (int i = 0; i < 0x100; i++) {
-        auto* spr = from_table(sprite_list, 0x200, i, perlevel);
-        if (!spr || (perlevel && i >= 0xB0 && i < 0xC0)) {
+        if (perlevel && i >= 0xB0 && i < 0xC0) {
             extra_bytes[i] = 7; // 3 bytes + 4 extra bytes because the old one broke basically any sprite that wasn't
                                 // using exactly 9 extra bytes
             extra_bytes[i + 0x100] = 7; // 12 was wrong anyway, should've been 15
         } else {
-            // line number within the list file indicates we've got a filled out sprite
-            if (spr->line) {
+            // only the slots the list uses have a sprite
+            if (auto* spr = global_sprite(registry, i, perlevel)) {
                 extra_bytes[i] = (unsigned char)(3 + spr->byte_count);
                 extra_bytes[i + 0x100] = (unsigned char)(3 + spr->extra_byte_count);
 
@@ -161,7 +152,7 @@ bool generate_lm_data(const sprite (&sprite_list)[MAX_SPRITE_COUNT], map16 (&map
                     fprintf(mwt, "%s", mwt_data.c_str());
                     first = false;
                 }
-                // no line means unused sprite, so just set to default 3.
+                // unused sprite, so just set to default 3.
             } else {
                 extra_bytes[i] = 3;
                 extra_bytes[i + 0x100] = 3;
@@ -173,20 +164,18 @@ bool generate_lm_data(const sprite (&sprite_list)[MAX_SPRITE_COUNT], map16 (&map
     return true;
 }
 
-bool generate_lm_data_ex_bytes_only(const sprite (&sprite_list)[MAX_SPRITE_COUNT], unsigned char (&extra_bytes)[0x200],
-                                    bool perlevel) {
+bool generate_lm_data_ex_bytes_only(const sprite_registry& registry, unsigned char (&extra_bytes)[0x200], bool perlevel) {
     for (int i = 0; i < 0x100; i++) {
-        auto* spr = from_table(sprite_list, 0x200, i, perlevel);
-        if (!spr || (perlevel && i >= 0xB0 && i < 0xC0)) {
+        if (perlevel && i >= 0xB0 && i < 0xC0) {
             extra_bytes[i] = 7; // 3 bytes + 4 extra bytes because the old one broke basically any sprite that wasn't
                                 // using exactly 9 extra bytes
             extra_bytes[i + 0x100] = 7; // 12 was wrong anyway, should've been 15
         } else {
-            // line number within the list file indicates we've got a filled out sprite
-            if (spr->line) {
+            // only the slots the list uses have a sprite
+            if (auto* spr = global_sprite(registry, i, perlevel)) {
                 extra_bytes[i] = (unsigned char)(3 + spr->byte_count);
                 extra_bytes[i + 0x100] = (unsigned char)(3 + spr->extra_byte_count);
-                // no line means unused sprite, so just set to default 3.
+                // unused sprite, so just set to default 3.
             } else {
                 extra_bytes[i] = 3;
                 extra_bytes[i + 0x100] = 3;
@@ -0,0 +1,321 @@
+#include "metacache.h"
+#include "file_io.h"
+#include "incremental.h"
+#include "iohandler.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <type_traits>
+
+namespace fs = std::filesystem;
+
+// bump whenever the layout below or what the parsers produce changes
+constexpr uint32_t METADATA_CACHE_VERSION = 1;
+constexpr char METADATA_CACHE_MAGIC[8] = {'P', 'I', 'X', 'I', 'M', 'E', 'T', 'A'};
+
+static_assert(std::is_trivially_copyable_v<sprite_table> && sizeof(sprite_table) == 0x10);
+static_assert(std::is_trivially_copyable_v<map16> && sizeof(map16) == 8);
+
+namespace {
+
+std::string cache_key(const sprite& spr) {
+    std::error_code ec;
+    const std::string& file = spr.cfg_file;
+    fs::path absolute = fs::absolute(file, ec);
+    return (ec ? file : absolute.lexically_normal().generic_string()) + '\n' + file +
+           (spr.displays_in_lm ? "\ndisplay" : "");
+}
+
+bool stat_file(const std::string& path, uint64_t& size, int64_t& modified) {
+    std::error_code ec;
+    size = fs::file_size(path, ec);
+    if (ec)
+        return false;
+    auto time = fs::last_write_time(path, ec);
+    if (ec)
+        return false;
+    modified = static_cast<int64_t>(time.time_since_epoch().count());
+    return true;
+}
+
+bool read_whole_file(const std::string& path, std::vector<unsigned char>& contents) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+    contents.resize(file_size(file));
+    const bool ok = fread(contents.data(), 1, contents.size(), file) == contents.size();
+    fclose(file);
+    return ok;
+}
+
+bool hash_file(const std::string& path, uint64_t& hash) {
+    std::vector<unsigned char> contents{};
+    if (!read_whole_file(path, contents))
+        return false;
+    hash = fnv1a{}.update(contents.data(), contents.size()).value();
+    return true;
+}
+
+class writer {
+    std::vector<unsigned char>& m_out;
+
+  public:
+    explicit writer(std::vector<unsigned char>& out) : m_out{out} {
+    }
+    void bytes(const void* data, size_t size) {
+        const auto* begin = static_cast<const unsigned char*>(data);
+        m_out.insert(m_out.end(), begin, begin + size);
+    }
+    template <typename T> void value(T v) {
+        static_assert(std::is_integral_v<T>);
+        for (size_t i = 0; i < sizeof(T); i++)
+            m_out.push_back(static_cast<unsigned char>(static_cast<std::make_unsigned_t<T>>(v) >> (i * 8)));
+    }
+    void string(const std::string& s) {
+        value(static_cast<uint32_t>(s.size()));
+        bytes(s.data(), s.size());
+    }
+};
+
+// every read is bounds checked, a truncated or corrupted cache only makes ok() false
+class reader {
+    std::span<const unsigned char> m_in;
+    bool m_ok = true;
+
+  public:
+    explicit reader(std::span<const unsigned char> in) : m_in{in} {
+    }
+    bool ok() const {
+        return m_ok;
+    }
+    bool at_end() const {
+        return m_in.empty();
+    }
+    void bytes(void* data, size_t size) {
+        if (!m_ok || size > m_in.size()) {
+            m_ok = false;
+            return;
+        }
+        memcpy(data, m_in.data(), size);
+        m_in = m_in.subspan(size);
+    }
+    template <typename T> T value() {
+        static_assert(std::is_integral_v<T>);
+        std::make_unsigned_t<T> v = 0;
+        unsigned char raw[sizeof(T)] = {};
+        bytes(raw, sizeof(T));
+        for (size_t i = 0; i < sizeof(T); i++)
+            v |= static_cast<std::make_unsigned_t<T>>(static_cast<std::make_unsigned_t<T>>(raw[i]) << (i * 8));
+        return static_cast<T>(v);
+    }
+    // element counts are checked against what's left so that a bad count can't allocate gigabytes
+    uint32_t count(size_t min_element_size) {
+        const auto n = value<uint32_t>();
+        if (static_cast<uint64_t>(n) * min_element_size > m_in.size()) {
+            m_ok = false;
+            return 0;
+        }
+        return n;
+    }
+    std::string string() {
+        std::string s(count(1), '\0');
+        bytes(s.data(), s.size());
+        return s;
+    }
+};
+
+void write_sprite(writer& out, const sprite& spr) {
+    out.bytes(&spr.table, sizeof(spr.table));
+    out.value(spr.byte_count);
+    out.value(spr.extra_byte_count);
+    out.string(spr.asm_file);
+    out.value(static_cast<uint32_t>(spr.map_data.size()));
+    out.bytes(spr.map_data.data(), spr.map_data.size() * sizeof(map16));
+    out.value(static_cast<uint8_t>(spr.disp_type));
+    out.value(static_cast<uint32_t>(spr.displays.size()));
+    for (const display& dis : spr.displays) {
+        out.string(dis.description);
+        out.value(static_cast<uint32_t>(dis.tiles.size()));
+        for (const tile& til : dis.tiles) {
+            out.value(static_cast<int32_t>(til.x_offset));
+            out.value(static_cast<int32_t>(til.y_offset));
+            out.value(static_cast<int32_t>(til.tile_number));
+            out.string(til.text);
+        }
+        out.value(static_cast<uint8_t>(dis.extra_bit));
+        out.value(dis.x_or_index);
+        out.value(dis.y_or_value);
+        for (const auto& gfx : dis.gfx_files.gfx_files) {
+            out.value(gfx.gfx_num);
+            out.value(static_cast<uint8_t>(gfx.sep));
+        }
+    }
+    out.value(static_cast<uint32_t>(spr.collections.size()));
+    for (const collection& col : spr.collections) {
+        out.string(col.name);
+        out.value(static_cast<uint8_t>(col.extra_bit));
+        out.bytes(col.prop, sizeof(col.prop));
+    }
+}
+
+void read_sprite(reader& in, sprite& spr) {
+    in.bytes(&spr.table, sizeof(spr.table));
+    spr.byte_count = in.value<uint8_t>();
+    spr.extra_byte_count = in.value<uint8_t>();
+    spr.asm_file = in.string();
+    spr.map_data.resize(in.count(sizeof(map16)));
+    in.bytes(spr.map_data.data(), spr.map_data.size() * sizeof(map16));
+    spr.disp_type = in.value<uint8_t>() ? display_type::ExtensionByte : display_type::XYPosition;
+    spr.displays.resize(in.count(4));
+    for (display& dis : spr.displays) {
+        dis.description = in.string();
+        dis.tiles.resize(in.count(16));
+        for (tile& til : dis.tiles) {
+            til.x_offset = in.value<int32_t>();
+            til.y_offset = in.value<int32_t>();
+            til.tile_number = in.value<int32_t>();
+            til.text = in.string();
+        }
+        dis.extra_bit = in.value<uint8_t>() != 0;
+        dis.x_or_index = in.value<uint8_t>();
+        dis.y_or_value = in.value<uint8_t>();
+        for (auto& gfx : dis.gfx_files.gfx_files) {
+            gfx.gfx_num = in.value<uint32_t>();
+            gfx.sep = in.value<uint8_t>() != 0;
+        }
+    }
+    spr.collections.resize(in.count(4));
+    for (collection& col : spr.collections) {
+        col.name = in.string();
+        col.extra_bit = in.value<uint8_t>() != 0;
+        in.bytes(col.prop, sizeof(col.prop));
+    }
+}
+
+} // namespace
+
+void MetadataCache::reset() {
+    m_enabled = false;
+    m_dirty = false;
+    m_path.clear();
+    m_entries.clear();
+}
+
+void MetadataCache::begin(const std::string& list_path) {
+    iohandler& io = iohandler::get_global();
+    reset();
+    m_enabled = true;
+    m_path = fs::path{list_path}.replace_extension(".pixicache").generic_string();
+
+    std::vector<unsigned char> contents{};
+    if (!read_whole_file(m_path, contents)) {
+        io.debug("No sprite metadata cache found at %s, every sprite file will be parsed\n", m_path.c_str());
+        // written the first time around even if nothing changes
+        m_dirty = true;
+        return;
+    }
+    reader in{contents};
+    char magic[sizeof(METADATA_CACHE_MAGIC)] = {};
+    in.bytes(magic, sizeof(magic));
+    const auto version = in.value<uint32_t>();
+    if (!in.ok() || memcmp(magic, METADATA_CACHE_MAGIC, sizeof(magic)) != 0 || version != METADATA_CACHE_VERSION) {
+        io.debug("Sprite metadata cache %s is outdated, every sprite file will be parsed\n", m_path.c_str());
+        m_dirty = true;
+        return;
+    }
+    const uint32_t entries = in.count(1);
+    for (uint32_t i = 0; i < entries && in.ok(); i++) {
+        std::string key = in.string();
+        entry e{};
+        e.size = in.value<uint64_t>();
+        e.modified = in.value<int64_t>();
+        e.hash = in.value<uint64_t>();
+        read_sprite(in, e.parsed);
+        e.warnings.resize(in.count(4));
+        for (std::string& warning : e.warnings)
+            warning = in.string();
+        m_entries.insert_or_assign(std::move(key), std::move(e));
+    }
+    if (!in.ok() || !in.at_end()) {
+        io.print("Sprite metadata cache %s is corrupted, every sprite file will be parsed\n", m_path.c_str());
+        m_entries.clear();
+        m_dirty = true;
+    }
+}
+
+bool MetadataCache::restore(sprite* spr, std::vector<std::string>& warnings) {
+    if (!m_enabled)
+        return false;
+    auto it = m_entries.find(cache_key(*spr));
+    if (it == m_entries.end())
+        return false;
+    entry& e = it->second;
+    uint64_t size = 0;
+    int64_t modified = 0;
+    if (!stat_file(spr->cfg_file, size, modified) || size != e.size)
+        return false;
+    if (modified != e.modified) {
+        // touched, but maybe not changed
+        uint64_t hash = 0;
+        if (!hash_file(spr->cfg_file, hash) || hash != e.hash)
+            return false;
+        e.modified = modified;
+        m_dirty = true;
+    }
+    spr->copy_parsed(e.parsed);
+    warnings.insert(warnings.end(), e.warnings.begin(), e.warnings.end());
+    e.used = true;
+    return true;
+}
+
+void MetadataCache::store(const sprite* spr, std::span<const std::string> warnings) {
+    if (!m_enabled)
+        return;
+    entry e{.size = 0,
+            .modified = 0,
+            .hash = 0,
+            .parsed = {},
+            .warnings = {warnings.begin(), warnings.end()},
+            .used = true};
+    if (!stat_file(spr->cfg_file, e.size, e.modified) || !hash_file(spr->cfg_file, e.hash))
+        return;
+    e.parsed.copy_parsed(*spr);
+    m_entries.insert_or_assign(cache_key(*spr), std::move(e));
+    m_dirty = true;
+}
+
+void MetadataCache::save() {
+    if (!m_enabled)
+        return;
+    // entries that weren't used this time are dropped
+    const auto used = static_cast<uint32_t>(
+        std::count_if(m_entries.begin(), m_entries.end(), [](const auto& kv) { return kv.second.used; }));
+    if (!m_dirty && used == m_entries.size())
+        return;
+    std::vector<unsigned char> contents{};
+    writer out{contents};
+    out.bytes(METADATA_CACHE_MAGIC, sizeof(METADATA_CACHE_MAGIC));
+    out.value(METADATA_CACHE_VERSION);
+    out.value(used);
+    for (const auto& [key, e] : m_entries) {
+        if (!e.used)
+            continue;
+        out.string(key);
+        out.value(e.size);
+        out.value(e.modified);
+        out.value(e.hash);
+        write_sprite(out, e.parsed);
+        out.value(static_cast<uint32_t>(e.warnings.size()));
+        for (const std::string& warning : e.warnings)
+            out.string(warning);
+    }
+    // not being able to write the cache only makes the next run slower
+    FILE* file = fopen(m_path.c_str(), "wb");
+    const bool ok = file != nullptr && fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+    if (file != nullptr)
+        fclose(file);
+    if (!ok)
+        iohandler::get_global().print("Warning: couldn't write sprite metadata cache %s\n", m_path.c_str());
+    m_dirty = false;
+}
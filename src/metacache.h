@@ -0,0 +1,45 @@
+#pragma once
+#include "structs.h"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+    Keeps the parsed contents of every CFG/JSON sprite file in a binary file next to the list (<listname>.pixicache),
+    so that files which didn't change since the last run are loaded back as they are instead of being parsed again.
+
+    Entries are keyed by the file's path (and whether "display" was given), and are only used while the file has
+    the same size and modification time. If only the modification time changed, the contents are hashed and
+    compared instead, so touching a file doesn't throw its entry away.
+*/
+class MetadataCache {
+    struct entry {
+        uint64_t size = 0;
+        int64_t modified = 0;
+        uint64_t hash = 0;
+        sprite parsed{};
+        std::vector<std::string> warnings{};
+        // entries nobody asked for during this run aren't saved again
+        bool used = false;
+    };
+
+    bool m_enabled = false;
+    bool m_dirty = false;
+    std::string m_path{};
+    std::unordered_map<std::string, entry> m_entries{};
+
+  public:
+    void reset();
+    // loads the cache that belongs to the list file, a missing or outdated cache just starts empty
+    void begin(const std::string& list_path);
+    bool enabled() const {
+        return m_enabled;
+    }
+    // fills in what read_cfg_file/read_json_file would, along with the warnings they gave, returns false on a miss
+    bool restore(sprite* spr, std::vector<std::string>& warnings);
+    void store(const sprite* spr, std::span<const std::string> warnings);
+    // only writes the file if something changed since it was loaded, failing to do so is just a warning
+    void save();
+};
@@ -45,6 +45,7 @@ typedef const struct map16* pixi_map16_t;
 typedef const struct status_pointers* pixi_status_pointers_t;
 typedef const struct sprite_table* pixi_sprite_table_t;
 typedef const struct sprite* pixi_sprite_t;
+typedef const struct rom_change* pixi_rom_change_t;
 typedef const char* pixi_string;
 typedef const char* const* pixi_string_array;
 typedef const unsigned char* pixi_byte_array;
@@ -53,6 +54,7 @@ typedef const pixi_display_t* pixi_display_array;
 typedef const pixi_collection_t* pixi_collection_array;
 typedef const pixi_tile_t* pixi_tile_array;
 typedef const pixi_sprite_t* pixi_sprite_array;
+typedef const pixi_rom_change_t* pixi_rom_change_array;
 
 /// <summary>
 /// Runs the complete pixi program.
@@ -83,11 +85,10 @@ PIXI_EXPORT int pixi_check_api_version(int version_edition, int version_major, i
 
 /// <summary>
 /// Parses a given list file with optional per-level support. The list file is searched via the current working
-/// directory <para> Beware that enabling per-level support encurs in a pretty big allocation done up front.
-/// </para>
+/// directory
 /// </summary>
 /// <param name="filename">Filename to parse</param>
-/// <param name="per_level">Enable per-level support (at the cost of extra allocation)</param>
+/// <param name="per_level">Enable per-level support (allows level:number lines, as with -pl)</param>
 /// <returns>The parse result struct</returns>
 PIXI_EXPORT pixi_list_result_t pixi_parse_list_file(const char* filename, bool per_level);
 /// <summary>
@@ -555,6 +556,73 @@ PIXI_EXPORT pixi_string pixi_last_error(int* size);
 /// <returns>A pixi string containing the entire output</returns>
 PIXI_EXPORT pixi_string_array pixi_output(int* size);
 
+// Dependency information
+
+/// <summary>
+/// Loads a dependency graph saved by pixi (<romname>.pixideps, written with --deps or --incremental)
+/// in place of the one built by the last call to pixi_run.
+/// </summary>
+/// <param name="filename">Path of the .pixideps file</param>
+/// <returns>1 on success, 0 on failure, the reason can be retrieved with pixi_last_error</returns>
+PIXI_EXPORT int pixi_load_dependency_graph(const char* filename);
+/// <summary>
+/// Returns every file the given file depends on, directly or not (incsrc, incbin, _header.asm and the shared routines
+/// it calls), according to the graph built by the last call to pixi_run or loaded with pixi_load_dependency_graph.
+/// <para>
+/// The array doesn't need to be freed, it stays valid until the next call to pixi_dependencies, pixi_dependents,
+/// pixi_load_dependency_graph or pixi_run.
+/// </para>
+/// </summary>
+/// <param name="filename">The asm file to look up</param>
+/// <param name="size">An out-param that receives the size of the array, 0 if the file isn't in the graph</param>
+/// <returns>A pixi string array with one path per entry, sorted</returns>
+PIXI_EXPORT pixi_string_array pixi_dependencies(const char* filename, int* size);
+/// <summary>
+/// Returns every file that depends on the given file, directly or not, i.e. what has to be reassembled when it changes.
+/// <para>
+/// The array doesn't need to be freed, it stays valid until the next call to pixi_dependencies, pixi_dependents,
+/// pixi_load_dependency_graph or pixi_run.
+/// </para>
+/// </summary>
+/// <param name="filename">The file to look up</param>
+/// <param name="size">An out-param that receives the size of the array, 0 if the file isn't in the graph</param>
+/// <returns>A pixi string array with one path per entry, sorted</returns>
+PIXI_EXPORT pixi_string_array pixi_dependents(const char* filename, int* size);
+
+// ROM change information
+
+/// <summary>
+/// Returns what the last call to pixi_run changed in the ROM, as runs of bytes that differ from the ROM as it was
+/// before the insertion, in ascending order.
+/// Changes are only tracked when pixi_run is given --track-changes or --emit-patch.
+/// <para>
+/// The array doesn't need to be freed, it stays valid until the next call to pixi_run.
+/// </para>
+/// </summary>
+/// <param name="size">An out-param that receives the size of the array</param>
+/// <returns>An array of changes that can be given to any of the pixi_rom_change_x apis</returns>
+PIXI_EXPORT pixi_rom_change_array pixi_rom_changes(int* size);
+/// <summary>
+/// Returns the offset of the change in the ROM file (headered)
+/// </summary>
+/// <param name="pixi_rom_change_t">Change to get the offset of</param>
+/// <returns>Offset in bytes</returns>
+PIXI_EXPORT int pixi_rom_change_offset(pixi_rom_change_t);
+/// <summary>
+/// Returns the number of bytes that changed
+/// </summary>
+/// <param name="pixi_rom_change_t">Change to get the size of</param>
+/// <returns>Size in bytes</returns>
+PIXI_EXPORT int pixi_rom_change_size(pixi_rom_change_t);
+/// <summary>
+/// Returns what wrote the change last: the asm file of a sprite, the path of a patch, "MeiMei" or "unknown" for bytes
+/// that weren't reported by asar (e.g. freed by autoclean)
+/// </summary>
+/// <param name="pixi_rom_change_t">Change to get the source of</param>
+/// <param name="size">An out-param that receives the size of the string</param>
+/// <returns>A pixi string, doesn't need to be freed</returns>
+PIXI_EXPORT pixi_string pixi_rom_change_source(pixi_rom_change_t, int* size);
+
 /// <summary>
 /// Allocates a map16 buffer to be used with pixi_generate_s16
 /// The buffer is to be freed with pixi_free_map16_buffer
@@ -597,6 +665,13 @@ PIXI_EXPORT pixi_string pixi_generate_mwt(pixi_sprite_t spr, pixi_collection_t c
 /// <param name="size">An out-param that will have the size of the returned array</param>
 /// <returns>A byte array with the mw2 data, to be freed with pixi_free_byte_array</returns>
 PIXI_EXPORT pixi_byte_array pixi_generate_mw2(pixi_sprite_t spr, pixi_collection_t coll, int* size);
+/// <summary>
+/// Generates the tweak objects ("$1656" to "$190F") of a JSON sprite file from the sprite's tweak bytes,
+/// works for sprites read from CFG files as well
+/// </summary>
+/// <param name="spr">The sprite to generate the tweak objects of</param>
+/// <returns>A null-terminated c-string with a JSON object, to be freed with pixi_free_string</returns>
+PIXI_EXPORT pixi_string pixi_generate_tweak_json(pixi_sprite_t spr);
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -1,8 +1,13 @@
 #include "cfg.h"
+#include "changes.h"
+#include "deps.h"
 #include "iohandler.h"
 #include "json.h"
 #include "lmdata.h"
+#include "registry.h"
 #include "structs.h"
+#include <array>
+#include <utility>
 
 #ifdef PIXI_DLL_BUILD
 #ifdef _WIN32
@@ -14,6 +19,10 @@
 #define PIXI_EXPORT
 #endif
 
+extern PixiConfig cfg;
+extern DependencyGraph g_deps;
+extern ChangeTracker g_changes;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -28,6 +37,7 @@ typedef const struct map16* pixi_map16_t;
 typedef const struct status_pointers* pixi_status_pointers_t;
 typedef const struct sprite_table* pixi_sprite_table_t;
 typedef const struct sprite* pixi_sprite_t;
+typedef const struct rom_change* pixi_rom_change_t;
 typedef const char* pixi_string;
 typedef const char* const* pixi_string_array;
 typedef const unsigned char* pixi_byte_array;
@@ -36,28 +46,31 @@ typedef const pixi_display_t* pixi_display_array;
 typedef const pixi_collection_t* pixi_collection_array;
 typedef const pixi_tile_t* pixi_tile_array;
 typedef const pixi_sprite_t* pixi_sprite_array;
+typedef const pixi_rom_change_t* pixi_rom_change_array;
 
 PIXI_EXPORT pixi_list_result_t pixi_parse_list_file(const char* filename, bool per_level) {
     list_result* result = new list_result;
     static Paths paths{};
-    std::vector<sprite> sprite_list{per_level ? MAX_SPRITE_COUNT : 0x100ull};
-    std::vector<sprite> cluster_list{SPRITE_COUNT};
-    std::vector<sprite> extended_list{SPRITE_COUNT};
-    std::vector<sprite> minor_extended_list{LESS_SPRITE_COUNT};
-    std::vector<sprite> bounce_list{LESS_SPRITE_COUNT};
-    std::vector<sprite> smoke_list{LESS_SPRITE_COUNT};
-    std::vector<sprite> spinningcoin_list{MINOR_SPRITE_COUNT};
-    std::vector<sprite> score_list{MINOR_SPRITE_COUNT};
-    std::array sprites_list_list{sprite_list.data(),         extended_list.data(), cluster_list.data(),
-                                 minor_extended_list.data(), bounce_list.data(),   smoke_list.data(),
-                                 spinningcoin_list.data(),   score_list.data()};
-    result->success = populate_sprite_list(paths, sprites_list_list, filename, nullptr);
+    auto registry = std::make_unique<sprite_registry>();
+    const bool was_per_level = std::exchange(cfg.PerLevel, per_level);
+    result->success = populate_sprite_list(paths, *registry, filename, nullptr);
+    cfg.PerLevel = was_per_level;
 
-    for (auto& sprites : result->sprite_arrays) {
-        for (const auto& spr : sprite_list) {
-            if (spr.asm_file.empty())
+    // the API numbers the list types differently (cluster comes before extended)
+    constexpr std::array<std::pair<ListType, int>, FromEnum(ListType::__SIZE__)> api_types{
+        {{ListType::Sprite, 0},
+         {ListType::Cluster, 1},
+         {ListType::Extended, 2},
+         {ListType::MinorExtended, 3},
+         {ListType::Bounce, 4},
+         {ListType::Smoke, 5},
+         {ListType::SpinningCoin, 6},
+         {ListType::Score, 7}}};
+    for (const auto& [type, api_type] : api_types) {
+        for (const sprite* spr : registry->sprites(type)) {
+            if (spr->asm_file.empty())
                 continue;
-            sprites.push_back(new sprite{spr});
+            result->sprite_arrays[api_type].push_back(new sprite{*spr});
         }
     }
     return result;
@@ -320,6 +333,36 @@ PIXI_EXPORT pixi_string_array pixi_output(int* size) {
     return history.data();
 }
 
+PIXI_EXPORT int pixi_load_dependency_graph(const char* filename) {
+    return g_deps.load(filename) ? 1 : 0;
+}
+PIXI_EXPORT pixi_string_array pixi_dependencies(const char* filename, int* size) {
+    auto files = g_deps.dependencies(filename);
+    *size = static_cast<int>(files.size());
+    return files.data();
+}
+PIXI_EXPORT pixi_string_array pixi_dependents(const char* filename, int* size) {
+    auto files = g_deps.dependents(filename);
+    *size = static_cast<int>(files.size());
+    return files.data();
+}
+
+PIXI_EXPORT pixi_rom_change_array pixi_rom_changes(int* size) {
+    auto changes = g_changes.change_pointers();
+    *size = static_cast<int>(changes.size());
+    return changes.data();
+}
+PIXI_EXPORT int pixi_rom_change_offset(pixi_rom_change_t change) {
+    return change->pc;
+}
+PIXI_EXPORT int pixi_rom_change_size(pixi_rom_change_t change) {
+    return change->size;
+}
+PIXI_EXPORT pixi_string pixi_rom_change_source(pixi_rom_change_t change, int* size) {
+    *size = static_cast<int>(change->source.size());
+    return change->source.c_str();
+}
+
 PIXI_EXPORT pixi_map16_t pixi_create_map16_buffer(int size) {
     const map16* map16_array = new map16[size];
     return map16_array;
@@ -356,6 +399,12 @@ PIXI_EXPORT pixi_byte_array pixi_generate_mw2(pixi_sprite_t spr, pixi_collection
     *size = static_cast<int>(mw2.size());
     return uc;
 }
+PIXI_EXPORT pixi_string pixi_generate_tweak_json(pixi_sprite_t spr) {
+    const auto text = tweak_json(reinterpret_cast<const sprite*>(spr)->table);
+    char* c = new char[text.size() + 1];
+    strcpy(c, text.c_str());
+    return c;
+}
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
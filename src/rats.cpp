@@ -0,0 +1,142 @@
+#include "rats.h"
+#include "cpu_features.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace {
+
+constexpr unsigned char rats_magic[4]{'S', 'T', 'A', 'R'};
+constexpr size_t rats_tag_size = 8;
+
+// the vectorized loops compare whole blocks and return the first match they find or where they stopped,
+// the scalar loop picks up from there
+using find_kernel = size_t (*)(const unsigned char* data, size_t size, size_t from);
+
+size_t find_none(const unsigned char*, size_t, size_t from) {
+    return from;
+}
+
+#ifdef PIXI_X86
+
+// the 4 bytes of the tag are compared at 4 consecutive offsets so that a bit is only left set in the mask
+// where a whole "STAR" starts, which is rare enough in a ROM that the first one found is returned right away
+PIXI_TARGET("sse2")
+size_t find_sse2(const unsigned char* data, size_t size, size_t from) {
+    const __m128i s = _mm_set1_epi8('S');
+    const __m128i t = _mm_set1_epi8('T');
+    const __m128i a = _mm_set1_epi8('A');
+    const __m128i r = _mm_set1_epi8('R');
+    size_t i = from;
+    for (; i + 16 + 3 <= size; i += 16) {
+        const unsigned char* p = data + i;
+        const __m128i st = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), s),
+                                         _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1)), t));
+        const __m128i ar = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 2)), a),
+                                         _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 3)), r));
+        const __m128i match = _mm_and_si128(st, ar);
+        if (const auto mask = static_cast<unsigned int>(_mm_movemask_epi8(match)); mask != 0)
+            return i + std::countr_zero(mask);
+    }
+    return i;
+}
+
+PIXI_TARGET("avx2")
+size_t find_avx2(const unsigned char* data, size_t size, size_t from) {
+    const __m256i s = _mm256_set1_epi8('S');
+    const __m256i t = _mm256_set1_epi8('T');
+    const __m256i a = _mm256_set1_epi8('A');
+    const __m256i r = _mm256_set1_epi8('R');
+    size_t i = from;
+    for (; i + 32 + 3 <= size; i += 32) {
+        const unsigned char* p = data + i;
+        const __m256i st =
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), s),
+                             _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1)), t));
+        const __m256i ar =
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 2)), a),
+                             _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 3)), r));
+        const __m256i match = _mm256_and_si256(st, ar);
+        if (const auto mask = static_cast<unsigned int>(_mm256_movemask_epi8(match)); mask != 0)
+            return i + std::countr_zero(mask);
+    }
+    return i;
+}
+
+find_kernel detect_kernel() {
+    const cpu_features& cpu = detected_cpu_features();
+    return cpu.avx2 ? find_avx2 : cpu.sse2 ? find_sse2 : find_none;
+}
+
+#endif
+
+find_kernel best_kernel() {
+#ifdef PIXI_X86
+    static const find_kernel best = detect_kernel();
+    return best;
+#else
+    return find_none;
+#endif
+}
+
+uint16_t read_u16(const unsigned char* data) {
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+} // namespace
+
+size_t find_rats_tag(std::span<const unsigned char> data, size_t from) {
+    if (data.size() < sizeof(rats_magic))
+        return data.size();
+    const size_t last = data.size() - sizeof(rats_magic);
+    for (size_t i = best_kernel()(data.data(), data.size(), from); i <= last; i++) {
+        if (memcmp(data.data() + i, rats_magic, sizeof(rats_magic)) == 0)
+            return i;
+    }
+    return data.size();
+}
+
+void RatsIndex::build(std::span<const unsigned char> rom, int header_size) {
+    clear();
+    size_t offset = find_rats_tag(rom);
+    while (offset + rats_tag_size <= rom.size()) {
+        const unsigned char* star = rom.data() + offset;
+        const uint16_t size = read_u16(star + 4);
+        const uint16_t check = read_u16(star + 6);
+        tag found{.pc = static_cast<int>(offset) + header_size, .size = size, .type = kind::bad};
+        if ((size ^ 0xFFFF) == check) {
+            found.type = kind::valid;
+            found.size = size + 1;
+        } else if (size + check == 0x10000) {
+            found.type = kind::sprite_tool;
+        }
+        size_t next = offset + sizeof(rats_magic);
+        // a tag claiming more than what's left of the ROM isn't protecting anything
+        if (found.type != kind::bad && offset + rats_tag_size + found.size > rom.size())
+            found.type = kind::bad;
+        if (found.type != kind::bad) {
+            m_blocks.push_back(found);
+            next = offset + rats_tag_size + found.size;
+        }
+        m_tags.push_back(found);
+        offset = find_rats_tag(rom, next);
+    }
+}
+
+const RatsIndex::tag* RatsIndex::containing(pcaddress pc) const {
+    auto it = std::upper_bound(m_blocks.begin(), m_blocks.end(), pc.raw_value(),
+                               [](int value, const tag& block) { return value < block.pc; });
+    if (it == m_blocks.begin())
+        return nullptr;
+    --it;
+    return pc.raw_value() < it->end() ? &*it : nullptr;
+}
+
+const RatsIndex::tag* RatsIndex::protecting(pcaddress pc) const {
+    const int tag_pc = pc.raw_value() - static_cast<int>(rats_tag_size);
+    auto it = std::lower_bound(m_blocks.begin(), m_blocks.end(), tag_pc,
+                               [](const tag& block, int value) { return block.pc < value; });
+    if (it == m_blocks.end() || it->pc != tag_pc || it->type != kind::valid)
+        return nullptr;
+    return &*it;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "structs.h"
+#include <span>
+#include <vector>
+
+/**
+    Every RATS tag in the ROM, found by a single vectorized scan for "STAR" over the whole file instead of each
+    cleanup step searching (or trusting) the bytes around the address it's interested in.
+
+    A tag is "STAR", u16 size - 1, u16 (size - 1) ^ 0xFFFF, followed by the size bytes it protects.
+    Old versions of sprite_tool wrote the size itself and its two's complement instead, those tags are kept too
+    so that their insertions can be removed. The bytes a tag protects are skipped by the scan, like every RATS
+    aware tool does, so the protected blocks never overlap and the one containing an address is a binary search.
+    Tags whose size doesn't match either checksum aren't protecting anything and are only listed.
+*/
+class RatsIndex {
+  public:
+    enum class kind { valid, sprite_tool, bad };
+    struct tag {
+        // of the "STAR", headered like pcaddress
+        int pc = 0;
+        // bytes protected after the 8 bytes of the tag
+        int size = 0;
+        kind type = kind::valid;
+
+        constexpr int data() const {
+            return pc + 8;
+        }
+        constexpr int end() const {
+            return data() + size;
+        }
+    };
+
+  private:
+    // every tag found, sorted by pc
+    std::vector<tag> m_tags{};
+    // the valid and sprite_tool tags, these never overlap
+    std::vector<tag> m_blocks{};
+
+  public:
+    void clear() {
+        m_tags.clear();
+        m_blocks.clear();
+    }
+    // rom is the unheadered file, header_size is added to the addresses of the tags
+    void build(std::span<const unsigned char> rom, int header_size = 0);
+    void build(ROM& rom) {
+        build({rom.unheadered_data(), static_cast<size_t>(rom.size)}, rom.header_size);
+    }
+
+    std::span<const tag> tags() const {
+        return m_tags;
+    }
+    std::span<const tag> blocks() const {
+        return m_blocks;
+    }
+    // the protected block whose tag or data contains pc, if any
+    const tag* containing(pcaddress pc) const;
+    // the valid tag whose data starts exactly at pc, if any
+    const tag* protecting(pcaddress pc) const;
+};
+
+// first "STAR" at or after from in data, data.size() if there is none
+size_t find_rats_tag(std::span<const unsigned char> data, size_t from = 0);
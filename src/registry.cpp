@@ -0,0 +1,106 @@
+#include "registry.h"
+#include <algorithm>
+#include <cassert>
+#include <filesystem>
+
+// the binary tables are written straight from these arrays
+static_assert(sizeof(sprite_table) == 0x10 && sizeof(status_pointers) == 15 && sizeof(pointer) == 3);
+
+namespace {
+
+constexpr std::array<size_t, FromEnum(ListType::__SIZE__)> list_capacities{
+    MAX_SPRITE_COUNT,   // ListType::Sprite
+    SPRITE_COUNT,       // ListType::Extended
+    SPRITE_COUNT,       // ListType::Cluster
+    LESS_SPRITE_COUNT,  // ListType::MinorExtended
+    LESS_SPRITE_COUNT,  // ListType::Bounce
+    LESS_SPRITE_COUNT,  // ListType::Smoke
+    MINOR_SPRITE_COUNT, // ListType::SpinningCoin
+    MINOR_SPRITE_COUNT, // ListType::Score
+};
+
+} // namespace
+
+sprite_registry::sprite_registry() {
+    for (size_t t = 0; t < m_lists.size(); t++) {
+        list& l = m_lists[t];
+        const size_t count = list_capacities[t];
+        l.index.resize(count);
+        l.tables.resize(count);
+        l.statuses.resize(count);
+        l.capes.resize(count);
+    }
+}
+
+size_t sprite_registry::capacity(ListType type) {
+    return list_capacities[FromEnum(type)];
+}
+
+sprite* sprite_registry::find(ListType type, size_t slot) {
+    const list& l = m_lists[FromEnum(type)];
+    if (slot >= l.index.size() || l.index[slot] == 0)
+        return nullptr;
+    return &m_sprites[l.index[slot] - 1];
+}
+
+const sprite* sprite_registry::find(ListType type, size_t slot) const {
+    return const_cast<sprite_registry*>(this)->find(type, slot);
+}
+
+sprite& sprite_registry::add(ListType type, size_t slot) {
+    list& l = m_lists[FromEnum(type)];
+    assert(slot < l.index.size() && l.index[slot] == 0);
+    sprite& spr = m_sprites.emplace_back();
+    m_placements.push_back({type, static_cast<uint32_t>(slot)});
+    l.index[slot] = static_cast<uint32_t>(m_sprites.size());
+    // lists are usually written in slot order, so this is almost always an append
+    const auto pos = std::upper_bound(l.slots.begin(), l.slots.end(), static_cast<uint32_t>(slot));
+    l.sprites.insert(l.sprites.begin() + (pos - l.slots.begin()), &spr);
+    l.slots.insert(pos, static_cast<uint32_t>(slot));
+    return spr;
+}
+
+void sprite_registry::clear() {
+    for (const placement& p : m_placements) {
+        list& l = m_lists[FromEnum(p.type)];
+        l.index[p.slot] = 0;
+        l.tables[p.slot] = sprite_table{};
+        l.statuses[p.slot] = status_pointers{};
+        l.capes[p.slot] = pointer{};
+    }
+    for (list& l : m_lists) {
+        l.slots.clear();
+        l.sprites.clear();
+    }
+    m_placements.clear();
+    m_sprites.clear();
+}
+
+void sprite_registry::publish_tables() {
+    for (size_t i = 0; i < m_sprites.size(); i++) {
+        const sprite& spr = m_sprites[i];
+        list& l = m_lists[FromEnum(m_placements[i].type)];
+        const uint32_t slot = m_placements[i].slot;
+        l.tables[slot] = spr.table;
+        l.statuses[slot] = spr.ptrs;
+        l.capes[slot] = spr.extended_cape_ptr;
+    }
+}
+
+interned_string asm_file_index::canonical(const interned_string& file) {
+    auto [it, inserted] = m_canonical.try_emplace(file, file);
+    if (inserted) {
+        // made absolute first, weakly_canonical leaves a relative path to a missing file as it is but not ./file
+        std::error_code ec{};
+        const auto absolute = std::filesystem::absolute(file.str(), ec);
+        const auto path = ec ? absolute : std::filesystem::weakly_canonical(absolute, ec);
+        if (!ec)
+            it->second = path.generic_string();
+    }
+    return it->second;
+}
+
+sprite* asm_file_index::find_or_add(sprite* spr) {
+    auto [it, inserted] = m_first.try_emplace(canonical(spr->asm_file), spr);
+    return inserted ? nullptr : it->second;
+}
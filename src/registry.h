@@ -0,0 +1,93 @@
+#pragma once
+#include "structs.h"
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+/**
+    The sprites of a list, for every list type.
+
+    Only the slots the list uses get a sprite. They're stored densely in the order they were added, and every list
+    type has a slot -> sprite table to find them, so clearing the registry costs as much as the list had sprites
+    instead of going through all 0x2100 + 0x200 slots.
+
+    The parts of the sprites that end up in the binary tables (_defaulttables.bin, _customstatusptr.bin, the
+    pointers of the other sprite types) are also kept for every slot in plain arrays, which default to the same
+    values an unused slot always had. publish_tables() copies them from the sprites once they have been inserted.
+*/
+class sprite_registry {
+    struct list {
+        // position in m_sprites + 1 for every slot, 0 for slots that aren't used
+        std::vector<uint32_t> index{};
+        // the used slots in order and their sprites
+        std::vector<uint32_t> slots{};
+        std::vector<sprite*> sprites{};
+        std::vector<sprite_table> tables{};
+        std::vector<status_pointers> statuses{};
+        std::vector<pointer> capes{};
+    };
+    struct placement {
+        ListType type;
+        uint32_t slot;
+    };
+
+    std::deque<sprite> m_sprites{};
+    std::vector<placement> m_placements{};
+    std::array<list, FromEnum(ListType::__SIZE__)> m_lists{};
+
+  public:
+    sprite_registry();
+    sprite_registry(const sprite_registry&) = delete;
+    sprite_registry& operator=(const sprite_registry&) = delete;
+
+    // number of slots of a list type, 0x2100 for normal sprites (0x200 levels with 0x10 slots and 0x100 global ones)
+    static size_t capacity(ListType type);
+
+    // the sprite in a slot, nullptr if the list doesn't use it
+    sprite* find(ListType type, size_t slot);
+    const sprite* find(ListType type, size_t slot) const;
+    // gives an unused slot a sprite, the slot has to be in range
+    sprite& add(ListType type, size_t slot);
+    // the sprites of a list type in slot order, the pointers stay valid until clear()
+    std::span<sprite* const> sprites(ListType type) const {
+        return m_lists[FromEnum(type)].sprites;
+    }
+    size_t size() const {
+        return m_sprites.size();
+    }
+    void clear();
+
+    void publish_tables();
+    std::span<const sprite_table> tables(ListType type) const {
+        return m_lists[FromEnum(type)].tables;
+    }
+    std::span<const status_pointers> status_pointer_tables(ListType type) const {
+        return m_lists[FromEnum(type)].statuses;
+    }
+    std::span<const pointer> cape_pointers(ListType type) const {
+        return m_lists[FromEnum(type)].capes;
+    }
+};
+
+/**
+    Tells which sprites of a list use the same asm file, so that every file is only assembled once.
+
+    Files are compared by their weakly canonical path, sprites/a.asm and sprites/./a.asm are the same file.
+    Every spelling is only resolved once.
+*/
+class asm_file_index {
+    std::unordered_map<interned_string, interned_string> m_canonical{};
+    std::unordered_map<interned_string, sprite*> m_first{};
+
+  public:
+    // the canonical path of an asm file, the file itself if it can't be resolved
+    interned_string canonical(const interned_string& file);
+    // the first sprite added with the same asm file as spr, nullptr if there was none and spr is now that sprite
+    sprite* find_or_add(sprite* spr);
+};
+
+[[nodiscard]] bool populate_sprite_list(const Paths& paths, sprite_registry& registry, std::string_view listPath,
+                                        const ROM* rom);
@@ -0,0 +1,375 @@
+#include "server.h"
+#include "iohandler.h"
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <nlohmann/json.hpp>
+
+#ifndef ON_WINDOWS
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#endif
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+extern std::vector<std::string> warnings;
+
+namespace {
+
+constexpr size_t MAX_REQUEST_SIZE = 1 << 20;
+// a client that connects and never sends its request (or never reads the reply) can't hold up the others longer
+constexpr time_t CLIENT_TIMEOUT_SECONDS = 5;
+
+std::string normalize(const std::string& path) {
+    std::error_code ec;
+    fs::path absolute = fs::absolute(path, ec);
+    std::string normal = (ec ? fs::path{path} : absolute).lexically_normal().generic_string();
+    while (normal.size() > 1 && normal.back() == '/')
+        normal.pop_back();
+    return normal;
+}
+
+// the cfg reader's output depends on the display type given in the list and the folder the sprite is in
+std::string sprite_key(const sprite& spr) {
+    return normalize(spr.cfg_file) + '\n' + spr.directory.str() + (spr.displays_in_lm ? "\ndisplay" : "");
+}
+
+std::string_view key_path(std::string_view key) {
+    return key.substr(0, key.find('\n'));
+}
+
+#ifndef ON_WINDOWS
+volatile std::sig_atomic_t s_stop_requested = 0;
+
+void request_stop(int) {
+    s_stop_requested = 1;
+}
+
+bool send_all(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t sent = send(fd, data.data(), data.size(), 0);
+        if (sent <= 0) {
+            if (sent == -1 && errno == EINTR)
+                continue;
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(sent));
+    }
+    return true;
+}
+#endif
+
+} // namespace
+
+bool PixiServer::supported() {
+#ifdef ON_WINDOWS
+    return false;
+#else
+    return true;
+#endif
+}
+
+bool PixiServer::restore(sprite* spr) {
+    if (!m_active)
+        return false;
+    auto it = m_sprites.find(sprite_key(*spr));
+    if (it == m_sprites.end()) {
+        m_misses++;
+        return false;
+    }
+    if (m_inotify == -1) {
+        // nobody is telling us about changes, check for ourselves
+        std::error_code ec;
+        auto modified = fs::last_write_time(spr->cfg_file.str(), ec);
+        if (ec || modified != it->second.modified) {
+            m_sprites.erase(it);
+            m_misses++;
+            return false;
+        }
+    }
+    spr->copy_parsed(it->second.parsed);
+    warnings.insert(warnings.end(), it->second.warnings.begin(), it->second.warnings.end());
+    m_hits++;
+    return true;
+}
+
+void PixiServer::store(const sprite* spr, std::span<const std::string> new_warnings) {
+    if (!m_active)
+        return;
+    cached_sprite entry{.parsed = *spr, .warnings = {new_warnings.begin(), new_warnings.end()}, .modified = {}};
+    std::error_code ec;
+    entry.modified = fs::last_write_time(spr->cfg_file.str(), ec);
+    if (ec)
+        return;
+    m_sprites.insert_or_assign(sprite_key(*spr), std::move(entry));
+    watch(fs::path{normalize(spr->cfg_file)}.parent_path().generic_string(), false);
+}
+
+bool PixiServer::restore_directory(std::string_view kind, const std::string& root, std::vector<std::string>& entries) {
+    // without inotify there's no cheap way to tell if a folder changed, those get scanned every time
+    if (!m_active || m_inotify == -1)
+        return false;
+    auto it = m_directories.find(std::string{kind} + '\n' + normalize(root));
+    if (it == m_directories.end()) {
+        m_misses++;
+        return false;
+    }
+    entries = it->second.entries;
+    m_hits++;
+    return true;
+}
+
+void PixiServer::store_directory(std::string_view kind, const std::string& root, bool recursive,
+                                 const std::vector<std::string>& entries) {
+    if (!m_active || m_inotify == -1)
+        return;
+    std::string normal = normalize(root);
+    m_directories.insert_or_assign(std::string{kind} + '\n' + normal,
+                                   cached_directory{.root = normal, .recursive = recursive, .entries = entries});
+    watch(normal, recursive);
+}
+
+void PixiServer::watch([[maybe_unused]] const std::string& dir, [[maybe_unused]] bool recursive) {
+#ifdef __linux__
+    if (m_inotify == -1)
+        return;
+    constexpr uint32_t mask = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                              IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+    auto add = [&](const std::string& path) {
+        // watching the same folder again hands back the same descriptor
+        if (int wd = inotify_add_watch(m_inotify, path.c_str(), mask); wd != -1)
+            m_watches[wd] = path;
+    };
+    add(dir);
+    if (!recursive)
+        return;
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator{dir, ec}; !ec && it != fs::recursive_directory_iterator{};
+         it.increment(ec)) {
+        if (it->is_directory())
+            add(it->path().lexically_normal().generic_string());
+    }
+#endif
+}
+
+void PixiServer::invalidate(const std::string& path, bool is_directory) {
+    const std::string parent = fs::path{path}.parent_path().generic_string();
+    const std::string prefix = path + '/';
+    std::erase_if(m_sprites, [&](const auto& entry) {
+        std::string_view file = key_path(entry.first);
+        return file == path || (is_directory && file.starts_with(prefix));
+    });
+    std::erase_if(m_directories, [&](const auto& entry) {
+        const cached_directory& dir = entry.second;
+        return dir.root == path || dir.root == parent || (dir.recursive && parent.starts_with(dir.root + '/')) ||
+               (is_directory && dir.root.starts_with(prefix));
+    });
+}
+
+void PixiServer::process_events() {
+#ifdef __linux__
+    if (m_inotify == -1)
+        return;
+    alignas(inotify_event) char buffer[4096];
+    while (true) {
+        ssize_t len = read(m_inotify, buffer, sizeof(buffer));
+        if (len <= 0)
+            break;
+        for (char* ptr = buffer; ptr < buffer + len;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(ptr);
+            ptr += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                // events were lost, nothing cached can be trusted anymore
+                m_sprites.clear();
+                m_directories.clear();
+                continue;
+            }
+            auto it = m_watches.find(event->wd);
+            if (it == m_watches.end())
+                continue;
+            if (event->mask & IN_IGNORED) {
+                m_watches.erase(it);
+                continue;
+            }
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF) || event->len == 0) {
+                invalidate(it->second, true);
+                continue;
+            }
+            invalidate(it->second + '/' + event->name, (event->mask & IN_ISDIR) != 0);
+        }
+    }
+#endif
+}
+
+bool PixiServer::handle_request([[maybe_unused]] int client, [[maybe_unused]] const std::string& program,
+                                [[maybe_unused]] const run_function& run_one) {
+#ifndef ON_WINDOWS
+    iohandler& io = iohandler::get_global();
+    std::string request{};
+    char buffer[4096];
+    bool timed_out = false;
+    while (request.find('\n') == std::string::npos && request.size() < MAX_REQUEST_SIZE) {
+        ssize_t len = recv(client, buffer, sizeof(buffer), 0);
+        if (len == -1 && errno == EINTR && !s_stop_requested)
+            continue;
+        if (len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            timed_out = true;
+        if (len <= 0)
+            break;
+        request.append(buffer, static_cast<size_t>(len));
+    }
+    request.erase(std::min(request.find('\n'), request.size()));
+
+    if (timed_out) {
+        const json response{
+            {"exit_code", EXIT_FAILURE}, {"output", json::array()}, {"error", "Timed out waiting for the request"}};
+        send_all(client, response.dump() + '\n');
+        return true;
+    }
+
+    bool keep_running = true;
+    json response{};
+    try {
+        json j = json::parse(request);
+        const std::string command = j.value("command", "insert");
+        if (command == "shutdown") {
+            response = {{"exit_code", EXIT_SUCCESS}, {"output", json::array()}, {"error", ""}};
+            keep_running = false;
+        } else if (command == "insert") {
+            const auto args = j.at("args").get<std::vector<std::string>>();
+            std::vector<const char*> argv{program.c_str()};
+            for (const auto& arg : args) {
+                argv.push_back(arg.c_str());
+            }
+            // pick up anything that was saved right before the request came in
+            process_events();
+            const size_t hits_before = m_hits;
+            int exit_code = run_one(static_cast<int>(argv.size()), argv.data());
+            std::vector<std::string> output{io.output_lines().begin(), io.output_lines().end()};
+            response = {{"exit_code", exit_code}, {"output", std::move(output)}, {"error", io.last_error()}};
+            io.print("Request done with exit code %d, %zu cached entries reused\n", exit_code, m_hits - hits_before);
+            fflush(stdout);
+        } else {
+            response = {{"exit_code", EXIT_FAILURE},
+                        {"output", json::array()},
+                        {"error", "Unknown command \"" + command + "\""}};
+        }
+    } catch (const json::exception& err) {
+        response = {{"exit_code", EXIT_FAILURE},
+                    {"output", json::array()},
+                    {"error", std::string{"Malformed request: "} + err.what()}};
+    }
+    // paths and asar output aren't guaranteed to be valid UTF-8
+    std::string reply = response.dump(-1, ' ', false, json::error_handler_t::replace) + '\n';
+    if (!send_all(client, reply))
+        io.debug("Couldn't send the reply to the client: %s\n", strerror(errno));
+    return keep_running;
+#else
+    return false;
+#endif
+}
+
+int PixiServer::run([[maybe_unused]] std::string socket_path, [[maybe_unused]] std::string program,
+                    [[maybe_unused]] std::vector<plugins::plugin>& plugins,
+                    [[maybe_unused]] const run_function& run_one) {
+    iohandler& io = iohandler::get_global();
+#ifdef ON_WINDOWS
+    io.error("--serve is not supported on Windows\n");
+    return EXIT_FAILURE;
+#else
+    sockaddr_un addr{};
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        io.error("Socket path \"%s\" is too long\n", socket_path.c_str());
+        return EXIT_FAILURE;
+    }
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == -1) {
+        io.error("Couldn't create socket: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    fcntl(listener, F_SETFD, FD_CLOEXEC);
+    // a socket left behind by a server that didn't shut down cleanly
+    if (struct stat st{}; lstat(socket_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(socket_path.c_str());
+    if (bind(listener, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == -1 || listen(listener, 8) == -1) {
+        io.error("Couldn't listen on \"%s\": %s\n", socket_path.c_str(), strerror(errno));
+        close(listener);
+        return EXIT_FAILURE;
+    }
+
+#ifdef __linux__
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify == -1)
+        io.print("Couldn't initialize inotify (%s), changes will be checked on every request\n", strerror(errno));
+#endif
+
+    // no SA_RESTART, poll() has to return so that the loop can see the flag
+    struct sigaction stop_action{};
+    stop_action.sa_handler = request_stop;
+    sigemptyset(&stop_action.sa_mask);
+    struct sigaction old_int{}, old_term{}, old_pipe{};
+    sigaction(SIGINT, &stop_action, &old_int);
+    sigaction(SIGTERM, &stop_action, &old_term);
+    // a client going away mid-reply shouldn't take the server down with it
+    struct sigaction ignore_action{};
+    ignore_action.sa_handler = SIG_IGN;
+    sigemptyset(&ignore_action.sa_mask);
+    sigaction(SIGPIPE, &ignore_action, &old_pipe);
+
+    s_stop_requested = 0;
+    m_active = true;
+    m_plugins = &plugins;
+    io.print("Listening on %s\n", socket_path.c_str());
+    while (!s_stop_requested) {
+        pollfd fds[2]{{listener, POLLIN, 0}, {m_inotify, POLLIN, 0}};
+        if (poll(fds, m_inotify == -1 ? 1 : 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            io.error("Waiting for requests failed: %s\n", strerror(errno));
+            break;
+        }
+        if (m_inotify != -1 && (fds[1].revents & POLLIN))
+            process_events();
+        if (!(fds[0].revents & POLLIN))
+            continue;
+        int client = accept(listener, nullptr, nullptr);
+        if (client == -1)
+            continue;
+        fcntl(client, F_SETFD, FD_CLOEXEC);
+        const timeval timeout{.tv_sec = CLIENT_TIMEOUT_SECONDS, .tv_usec = 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        if (!handle_request(client, program, run_one))
+            s_stop_requested = 1;
+        close(client);
+    }
+    m_active = false;
+    m_plugins = nullptr;
+    m_sprites.clear();
+    m_directories.clear();
+    m_watches.clear();
+    if (m_inotify != -1) {
+        close(m_inotify);
+        m_inotify = -1;
+    }
+    close(listener);
+    unlink(socket_path.c_str());
+    sigaction(SIGINT, &old_int, nullptr);
+    sigaction(SIGTERM, &old_term, nullptr);
+    sigaction(SIGPIPE, &old_pipe, nullptr);
+    io.print("Server on %s stopped\n", socket_path.c_str());
+    return EXIT_SUCCESS;
+#endif
+}
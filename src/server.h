@@ -0,0 +1,77 @@
+#pragma once
+#include "libplugin/libplugin.h"
+#include "structs.h"
+#include <filesystem>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+    Resident mode (--serve <socket>).
+
+    Keeps asar, the plugins and everything parsed from the sprite folders loaded between insertions and
+    takes insert requests on a unix domain socket. A request is a single line of JSON,
+    {"args": ["-l", "list.txt", "rom.smc"]}, with the same arguments the command line takes
+    (relative paths are relative to the directory the server was started in), {"command": "shutdown"}
+    stops the server. Every request gets back a single line of JSON with "exit_code", "output" and "error".
+
+    Parsed CFG/JSON files and the routine/ExtraDefines folder scans are kept between requests,
+    on Linux inotify tells which of them changed, elsewhere CFG/JSON files are checked for modifications before
+    being reused and the folders are scanned every time.
+
+    Not available on Windows.
+*/
+class PixiServer {
+  public:
+    using run_function = std::function<int(int argc, const char** argv)>;
+
+  private:
+    struct cached_sprite {
+        sprite parsed{};
+        std::vector<std::string> warnings{};
+        std::filesystem::file_time_type modified{};
+    };
+    struct cached_directory {
+        std::string root{};
+        bool recursive = false;
+        std::vector<std::string> entries{};
+    };
+
+    bool m_active = false;
+    int m_inotify = -1;
+    std::vector<plugins::plugin>* m_plugins = nullptr;
+    std::unordered_map<std::string, cached_sprite> m_sprites{};
+    std::unordered_map<std::string, cached_directory> m_directories{};
+    std::unordered_map<int, std::string> m_watches{};
+    size_t m_hits = 0;
+    size_t m_misses = 0;
+
+    void watch(const std::string& dir, bool recursive);
+    void process_events();
+    void invalidate(const std::string& path, bool is_directory);
+    bool handle_request(int client, const std::string& program, const run_function& run_one);
+
+  public:
+    static bool supported();
+    bool active() const {
+        return m_active;
+    }
+    std::vector<plugins::plugin>& plugins() {
+        return *m_plugins;
+    }
+    // runs until a shutdown request or SIGINT/SIGTERM, `run_one` performs a single insertion
+    // the arguments are copied, every request resets the configuration they might come from
+    int run(std::string socket_path, std::string program, std::vector<plugins::plugin>& plugins,
+            const run_function& run_one);
+
+    // fills in what read_cfg_file/read_json_file would from the cache, returns false on a miss
+    bool restore(sprite* spr);
+    void store(const sprite* spr, std::span<const std::string> new_warnings);
+    // folder scans, `kind` tells apart scans of the same folder that list different things
+    bool restore_directory(std::string_view kind, const std::string& root, std::vector<std::string>& entries);
+    void store_directory(std::string_view kind, const std::string& root, bool recursive,
+                         const std::vector<std::string>& entries);
+};
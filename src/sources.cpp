@@ -0,0 +1,79 @@
+#include "sources.h"
+#include "paths.h"
+#include <filesystem>
+#include <fstream>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+void MemoryFileTable::clear() {
+    if (m_prefetch.valid())
+        m_prefetch.wait();
+    m_prefetch = {};
+    m_files.clear();
+    m_index.clear();
+    m_sources.clear();
+}
+
+void MemoryFileTable::add(const memoryfile& file) {
+    auto [it, added] = m_index.try_emplace(file.path, m_files.size());
+    memoryfile entry{.path = it->first.c_str(), .buffer = file.buffer, .length = file.length};
+    if (added)
+        m_files.push_back(entry);
+    else
+        m_files[it->second] = entry;
+}
+
+bool MemoryFileTable::remove(const std::string& path) {
+    auto it = m_index.find(path);
+    if (it == m_index.end())
+        return false;
+    const size_t index = it->second;
+    m_index.erase(it);
+    if (index != m_files.size() - 1) {
+        m_files[index] = m_files.back();
+        m_index.find(m_files[index].path)->second = index;
+    }
+    m_files.pop_back();
+    return true;
+}
+
+void MemoryFileTable::prefetch(std::vector<std::string> folders) {
+    m_prefetch = std::async(std::launch::async, [folders = std::move(folders)] {
+        std::vector<source> sources{};
+        // the folders can be the same or inside each other
+        std::unordered_set<std::string> seen{};
+        for (const auto& folder : folders) {
+            std::error_code ec;
+            fs::recursive_directory_iterator it{cleanPathTrail(folder), ec};
+            for (; !ec && it != fs::recursive_directory_iterator{}; it.increment(ec)) {
+                std::error_code file_ec;
+                if (!it->is_regular_file(file_ec) || !nameEndWithAsmExtension(it->path().generic_string()))
+                    continue;
+                std::string path = it->path().lexically_normal().generic_string();
+                if (!seen.insert(path).second)
+                    continue;
+                // files that can't be read are left to asar, which reports the error
+                std::ifstream stream{it->path(), std::ios::binary};
+                const auto size = it->file_size(file_ec);
+                if (!stream || file_ec)
+                    continue;
+                std::string contents(static_cast<size_t>(size), '\0');
+                if (!stream.read(contents.data(), static_cast<std::streamsize>(size)))
+                    continue;
+                sources.push_back({std::move(path), std::move(contents)});
+            }
+        }
+        return sources;
+    });
+}
+
+void MemoryFileTable::finish_prefetch() {
+    if (!m_prefetch.valid())
+        return;
+    m_sources = m_prefetch.get();
+    for (const source& src : m_sources) {
+        if (!contains(src.path))
+            add(memoryfile{.path = src.path.c_str(), .buffer = src.contents.data(), .length = src.contents.size()});
+    }
+}
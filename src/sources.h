@@ -0,0 +1,50 @@
+#pragma once
+#include "structs.h"
+#include <future>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+    The files pixi hands to asar as memory files instead of letting it read them from disk: the patches and
+    tables pixi generates, and every asm file under the configured folders, which are read once per run on
+    a background thread while the list is being parsed.
+
+    asar takes the files as one contiguous array, a hash index by path next to it lets single files be added,
+    replaced and removed (like the temporary sprite patches) without searching the whole array.
+    A generated file always wins over a source file read from disk with the same path.
+*/
+class MemoryFileTable {
+    struct source {
+        std::string path{};
+        std::string contents{};
+    };
+
+    std::vector<memoryfile> m_files{};
+    // path -> index in m_files, the paths of the memoryfiles point to these keys
+    std::unordered_map<std::string, size_t> m_index{};
+    // contents of the prefetched files, never modified once they're in the table since the memoryfiles point to them
+    std::vector<source> m_sources{};
+    std::future<std::vector<source>> m_prefetch{};
+
+  public:
+    void clear();
+    // adds the file, replacing the one with the same path if there is one
+    void add(const memoryfile& file);
+    // returns false if there's no file with this path
+    bool remove(const std::string& path);
+    bool contains(const std::string& path) const {
+        return m_index.contains(path);
+    }
+    const memoryfile* data() const {
+        return m_files.data();
+    }
+    size_t size() const {
+        return m_files.size();
+    }
+
+    // starts reading every asm file under the folders in the background
+    void prefetch(std::vector<std::string> folders);
+    // waits for prefetch() to be done and adds the files it read, must be called before asar uses the table
+    void finish_prefetch();
+};
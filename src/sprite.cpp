@@ -1,10 +1,13 @@
 #include <cstdio>
 
 #include <array>
+#include <atomic>
 #include <exception>
 #include <filesystem>
 #include <fstream>
+#include <optional>
 #include <sstream>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -18,15 +21,29 @@
 #include "asar/asar.h"
 #endif
 #include "cfg.h"
+#include "changes.h"
 #include "config.h"
+#include "defines.h"
+#include "deps.h"
 #include "file_io.h"
+#include "freespace.h"
+#include "incremental.h"
+#include "jobs.h"
 #include "iohandler.h"
 #include "json.h"
 #include "libconsole/libconsole.h"
 #include "libplugin/libplugin.h"
+#include "listfile.h"
 #include "lmdata.h"
 #include "map16.h"
+#include "metacache.h"
 #include "paths.h"
+#include "rats.h"
+#include "registry.h"
+#include "server.h"
+#include "sources.h"
+#include "symbols.h"
+#include "trace.h"
 
 namespace fs = std::filesystem;
 
@@ -39,24 +56,6 @@ namespace fs = std::filesystem;
 #define DYLIB_EXT ".so"
 #endif
 
-#include <chrono>
-namespace cr = std::chrono;
-struct PatchTimer {
-    cr::high_resolution_clock::time_point m_start;
-    std::string m_name;
-
-    PatchTimer(std::string name) : m_start(cr::high_resolution_clock::now()), m_name(std::move(name)) {
-    }
-
-    ~PatchTimer() {
-        auto end = cr::high_resolution_clock::now();
-        [[maybe_unused]] auto dur = cr::duration_cast<cr::milliseconds>(end - m_start);
-#if 0
-        iohandler::get_global().debug("%s took %lld ms to patch\n", m_name.c_str(), dur.count());
-#endif
-    }
-};
-
 #define STRIMPL(x) #x
 #define STR(x) STRIMPL(x)
 
@@ -106,19 +105,34 @@ int PLS_DATA_ADDR = 0;
 std::vector<std::string> warnings{};
 PixiConfig cfg{};
 iohandler& io = iohandler::get_global();
-std::vector<memoryfile> g_memory_files{};
+MemoryFileTable g_memory_files{};
 patchfile g_shared_patch{"shared.asm"};
 patchfile g_shared_inscrc_patch{"shared_incsrc.asm"};
+// the %include_once() line of every routine, by name
+std::unordered_map<std::string, std::string> g_routine_includes{};
+// every routine's name, in the order of their pointers at $03E05C
+std::vector<std::string> g_routines{};
 std::vector<definedata> g_config_defines{};
+DefinePreludes g_define_preludes{};
+SymbolDatabase g_symbols{};
+RatsIndex g_rats{};
+FreespaceMap g_freespace{};
+IncrementalState g_incremental{};
+AsarJobPool g_jobs{};
+PixiServer g_server{};
+MetadataCache g_metadata_cache{};
+DependencyGraph g_deps{};
+Tracer g_trace{};
+ChangeTracker g_changes{};
 
 struct addtempfile {
-    const memoryfile& m_memory_file;
-    addtempfile(const patchfile& file) : m_memory_file{g_memory_files.emplace_back(file.vfile())} {
+    const std::string& m_path;
+    addtempfile(const patchfile& file) : m_path{file.path()} {
+        g_memory_files.add(file.vfile());
     }
     ~addtempfile() {
-        [[maybe_unused]] size_t s =
-            std::erase_if(g_memory_files, [&](const memoryfile& mem) { return &mem == &m_memory_file; });
-        assert(s == 1);
+        [[maybe_unused]] bool removed = g_memory_files.remove(m_path);
+        assert(removed);
     }
 };
 
@@ -209,32 +223,88 @@ void clean_sprite_generic(patchfile& clean_patch, int table_address, int origina
     if (table != original_value) // check with default/uninserted address
         for (size_t i = 0; i < count; i++) {
             pointer pointer = rom.pointer_snes(table + 3 * static_cast<int>(i));
-            if (!pointer.is_empty())
+            if (!pointer.is_empty() && !g_incremental.preserves(pointer))
                 clean_patch.fprintf("autoclean $%06X\n", pointer.raw());
         }
 }
 
-template <size_t COUNT> [[nodiscard]] patchfile write_sprite_generic(sprite (&list)[COUNT], const char* filename) {
-    unsigned char file[COUNT * 3]{};
-    for (size_t i = 0; i < COUNT; i++)
-        memcpy(file + (i * 3), &list[i].table.main, 3);
-    return write_all(file, cfg[PathType::Asm], filename, COUNT * 3);
+[[nodiscard]] patchfile write_sprite_generic(std::span<const sprite_table> tables, const char* filename) {
+    std::vector<unsigned char> file(tables.size() * 3);
+    for (size_t i = 0; i < tables.size(); i++)
+        memcpy(file.data() + (i * 3), &tables[i].main, 3);
+    return write_all(file.data(), cfg[PathType::Asm], filename, static_cast<unsigned int>(file.size()));
 }
 
-template <typename T> T* from_table(T* table, int level, int number) {
+// slot of a normal sprite in the registry
+std::optional<size_t> sprite_slot(unsigned int level, unsigned int number) {
+    if (number > 0xFF)
+        return std::nullopt;
     if (!cfg.PerLevel)
-        return table + number;
+        return number;
 
-    if (level > 0x200 || number > 0xFF)
-        return nullptr;
+    if (level > 0x200)
+        return std::nullopt;
     if (level == 0x200)
-        return table + (0x2000 + number);
+        return 0x2000 + number;
     else if (number >= 0xB0 && number < 0xC0)
-        return table + ((level * 0x10) + (number - 0xB0));
-    return nullptr;
+        return (level * 0x10) + (number - 0xB0);
+    return std::nullopt;
+}
+
+// every label of the last asar_patch_ex call
+static std::span<const labeldata> asar_labels() {
+    int label_count = 0;
+    const labeldata* labels = asar_getalllabels(&label_count);
+    return {labels, static_cast<size_t>(label_count)};
 }
 
-[[nodiscard]] bool patch(const patchfile& file, ROM& rom) {
+// bytes the last asar_patch_ex call wrote to the rom, only used for --trace
+static long long written_bytes() {
+    int block_count = 0;
+    const writtenblockdata* blocks = asar_getwrittenblocks(&block_count);
+    long long total = 0;
+    for (int i = 0; i < block_count; i++)
+        total += blocks[i].numbytes;
+    return total;
+}
+
+// files the last asar_patch_ex call read, taken from the source file list of its wla symbols, and how many of
+// them were in g_memory_files; the rest were read from disk. Only used for -d and --trace.
+struct source_reads {
+    long long files = 0;
+    long long from_memory = 0;
+    std::vector<std::string> from_disk{};
+};
+static source_reads asar_source_reads() {
+    source_reads reads{};
+    std::string_view symbols{asar_getsymbolsfile("wla")};
+    constexpr std::string_view section{"[source files]\n"};
+    const size_t start = symbols.find(section);
+    if (start == std::string_view::npos)
+        return reads;
+    symbols.remove_prefix(start + section.size());
+    // "index crc32 path" lines up to the next section
+    constexpr size_t path_offset = std::string_view{"0000 00000000 "}.size();
+    while (!symbols.empty() && symbols.front() != '[') {
+        const size_t eol = symbols.find('\n');
+        std::string_view line = symbols.substr(0, eol);
+        symbols.remove_prefix(eol == std::string_view::npos ? symbols.size() : eol + 1);
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        if (line.size() <= path_offset)
+            continue;
+        std::string path = fs::path{line.substr(path_offset)}.lexically_normal().generic_string();
+        reads.files++;
+        if (g_memory_files.contains(path))
+            reads.from_memory++;
+        else
+            reads.from_disk.push_back(std::move(path));
+    }
+    return reads;
+}
+
+[[nodiscard]] bool patch(const patchfile& file, ROM& rom, const sprite* spr = nullptr,
+                         std::span<const definedata> defines = g_config_defines) {
     // clang-format off
     constexpr struct warnsetting disabled_warnings[] {
         {.warnid = "Wrelative_path_used", .enabled = false},
@@ -251,8 +321,8 @@ template <typename T> T* from_table(T* table, int level, int number) {
         .includepaths = nullptr,
         .numincludepaths = 0,
         .should_reset = true,
-        .additional_defines = g_config_defines.data(), 
-        .additional_define_count = static_cast<int>(g_config_defines.size()),
+        .additional_defines = defines.data(), 
+        .additional_define_count = static_cast<int>(defines.size()),
         .stdincludesfile = cfg.AsarStdIncludes.empty() ? nullptr : cfg.AsarStdIncludes.c_str(),
         .stddefinesfile = cfg.AsarStdDefines.empty() ? nullptr : cfg.AsarStdDefines.c_str(),
         .warning_settings = disabled_warnings,
@@ -263,6 +333,10 @@ template <typename T> T* from_table(T* table, int level, int number) {
         .generate_checksum = true
     };
     // clang-format on
+    auto span = g_trace.scope("asar_patch_ex", "asar");
+    span.arg("patch", file.path());
+    if (spr != nullptr)
+        span.arg("sprite", spr->number).arg("asm_file", spr->asm_file);
     if (!asar_patch_ex(&params)) {
         int error_count;
         const errordata* errors = asar_geterrors(&error_count);
@@ -271,6 +345,20 @@ template <typename T> T* from_table(T* table, int level, int number) {
             io.error("%s\n", errors[i].fullerrdata);
         return false;
     }
+    if (span.active())
+        span.arg("bytes", written_bytes());
+    if (span.active() || io.debug_enabled()) {
+        const source_reads reads = asar_source_reads();
+        span.arg("files_read", reads.files).arg("memory_files_read", reads.from_memory);
+        io.debug("Asar read %lld files for %s, %lld of them from memory\n", reads.files, file.path().c_str(),
+                 reads.from_memory);
+        for (const std::string& path : reads.from_disk)
+            io.debug("\tfrom disk: %s\n", path.c_str());
+    }
+    if (g_changes.enabled())
+        g_changes.record(spr != nullptr ? spr->asm_file : file.path(), asar_written_ranges(rom));
+    if (g_freespace.enabled() && spr != nullptr)
+        g_freespace.claim(asar_written_ranges(rom), FreespaceMap::owner::sprite, spr->asm_file);
     int warn_count = 0;
     const errordata* loc_warnings = asar_getwarnings(&warn_count);
     for (int i = 0; i < warn_count; i++)
@@ -280,16 +368,6 @@ template <typename T> T* from_table(T* table, int level, int number) {
     for (int i = 0; i < print_count; i++)
         io.debug("Asar print from %s: %s\n", file.path().c_str(), asar_prints[i]);
 
-    if (!cfg.SymbolsType.empty()) {
-        const char* symbols_contents = asar_getsymbolsfile(cfg.SymbolsType.c_str());
-        std::string symbols_path{fs::path{file.path()}.replace_extension(cfg.SymbolsType).generic_string()};
-        FILE* wla = open(symbols_path.c_str(), "w");
-        if (wla) {
-            fwrite(symbols_contents, 1, strlen(symbols_contents), wla);
-            fclose(wla);
-        }
-    }
-
     return true;
 }
 
@@ -321,6 +399,8 @@ template <typename T> T* from_table(T* table, int level, int number) {
         .generate_checksum = true
     };
     // clang-format on
+    auto span = g_trace.scope("asar_patch_ex", "asar");
+    span.arg("patch", patch_path);
     if (!asar_patch_ex(&params)) {
         int error_count;
         const errordata* errors = asar_geterrors(&error_count);
@@ -329,20 +409,19 @@ template <typename T> T* from_table(T* table, int level, int number) {
             io.error("%s\n", errors[i].fullerrdata);
         return false;
     }
+    if (span.active())
+        span.arg("bytes", written_bytes());
+    if (g_changes.enabled())
+        g_changes.record(patch_path, asar_written_ranges(rom));
+    if (g_freespace.enabled())
+        g_freespace.claim(asar_written_ranges(rom), FreespaceMap::owner::patch, patch_path);
     int warn_count = 0;
     const errordata* loc_warnings = asar_getwarnings(&warn_count);
     for (int i = 0; i < warn_count; i++)
         warnings.emplace_back(loc_warnings[i].fullerrdata);
 
-    if (!cfg.SymbolsType.empty()) {
-        const char* symbols_contents = asar_getsymbolsfile(cfg.SymbolsType.c_str());
-        std::string symbols_path{fs::path{patch_name_rel}.replace_extension(cfg.SymbolsType).generic_string()};
-        FILE* wla = open(symbols_path.c_str(), "w");
-        if (wla) {
-            fwrite(symbols_contents, 1, strlen(symbols_contents), wla);
-            fclose(wla);
-        }
-    }
+    if (g_symbols.enabled())
+        g_symbols.add(asar_labels(), symbol_namespace(patch_path));
 
     int print_count = 0;
     const char* const* asar_prints = asar_getprints(&print_count);
@@ -358,9 +437,21 @@ template <typename T> T* from_table(T* table, int level, int number) {
     return ret;
 }
 
+std::string escapeDefines(std::string_view path, const char* repl = "\\!") {
+    std::stringstream ss("");
+    for (char c : path) {
+        if (c == '!') {
+            ss << repl;
+        } else {
+            ss << c;
+        }
+    }
+    return ss.str();
+}
+
 void addIncScrToFile(patchfile& file, const std::vector<std::string>& toInclude) {
     for (std::string const& incPath : toInclude) {
-        file.fprintf("incsrc \"%s\"\n", incPath.c_str());
+        file.fprintf("incsrc \"%s\"\n", escapeDefines(incPath).c_str());
     }
 }
 
@@ -400,18 +491,6 @@ constexpr bool ends_with(const char* str, const char* suffix) {
     }
 }
 
-std::string escapeDefines(std::string_view path, const char* repl = "\\!") {
-    std::stringstream ss("");
-    for (char c : path) {
-        if (c == '!') {
-            ss << repl;
-        } else {
-            ss << c;
-        }
-    }
-    return ss.str();
-}
-
 static bool strccmp(std::string_view first, std::string_view second) {
     if (first.size() != second.size())
         return false;
@@ -419,31 +498,41 @@ static bool strccmp(std::string_view first, std::string_view second) {
                       [](char a, char b) { return std::tolower(a) == std::tolower(b); });
 }
 
-[[nodiscard]] patchfile create_base_sprite_patch(const std::vector<std::string>& extraDefines, const std::string& dir) {
-    std::string escapedDir = escapeDefines(dir);
-    std::string escapedAsmdir = escapeDefines(cfg.AsmDir);
+// The files every sprite patch of the folder starts with, the ones pixi evaluated itself have to be passed to asar
+// as additional defines instead, with prelude.defines.
+[[nodiscard]] patchfile create_base_sprite_patch(const DefinePreludes::prelude& prelude) {
     patchfile sprite_patch{TEMP_SPR_FILE};
 
-    const char prelude[] = R"(namespace nested on
+    const char header[] = R"(namespace nested on
 warnings push
 warnings disable Wrelative_path_used
 warnings disable W65816_xx_y_assume_16_bit
-incsrc "%ssa1def.asm"
-)";
-    const char epilogue[] = R"(incsrc "shared.asm"
-incsrc "%s_header.asm"
 )";
-    sprite_patch.fprintf(prelude, escapedAsmdir.c_str());
-    addIncScrToFile(sprite_patch, extraDefines);
-    sprite_patch.fprintf(epilogue, escapedDir.c_str());
+    sprite_patch.fprintf(header);
+    addIncScrToFile(sprite_patch, prelude.includes);
     return sprite_patch;
 }
 
-void add_epilogue_to_sprite_patch(patchfile& sprite_patch) {
-    const char epilogue[] = R"(incsrc "shared_incsrc.asm"
-warnings pull
+// Inserts the routines the sprites called. When everything the sprites (and the routines they call) include can be
+// resolved statically, only the reachable routines are listed, callers first, and asar goes over them once.
+// Otherwise asar has to go over every routine again as long as the previous pass pulled in a new one.
+void add_routines_to_patch(patchfile& sprite_patch, std::span<const std::string> asm_files) {
+    auto order = g_deps.routine_order(asm_files);
+    if (order && std::all_of(order->begin(), order->end(),
+                             [](const std::string& name) { return g_routine_includes.contains(name); })) {
+        for (const auto& name : *order) {
+            sprite_patch.fprintf("%s", g_routine_includes.at(name).c_str());
+        }
+    } else {
+        sprite_patch.fprintf("incsrc \"shared_incsrc.asm\"\n");
+    }
+}
+
+void add_epilogue_to_sprite_patch(patchfile& sprite_patch, std::span<const std::string> asm_files) {
+    const char epilogue[] = R"(warnings pull
 namespace nested off
 )";
+    add_routines_to_patch(sprite_patch, asm_files);
     sprite_patch.fprintf(epilogue);
     sprite_patch.close();
 }
@@ -460,44 +549,24 @@ print "__PIXI_INTERNAL_SPRITE_SEPARATOR__"
     sprite_patch.fprintf(patchstr, spr->number, spr->number, escapedAsmfile.c_str());
 }
 
-[[nodiscard]] bool patch_sprite(const std::vector<std::string>& extraDefines, sprite* spr, ROM& rom) {
-    std::string escapedDir = escapeDefines(spr->directory);
+[[nodiscard]] bool patch_sprite(sprite* spr, ROM& rom) {
     std::string escapedAsmfile = escapeDefines(spr->asm_file);
-    std::string escapedAsmdir = escapeDefines(cfg.AsmDir);
-    patchfile sprite_patch{TEMP_SPR_FILE};
-    const char prefix[] = R"(namespace nested on
-warnings push
-warnings disable Wrelative_path_used
-warnings disable W65816_xx_y_assume_16_bit
-incsrc "%ssa1def.asm"
-)";
-    const char postfix[] = R"(incsrc "shared.asm"
-incsrc "%s_header.asm"
-freecode cleaned
+    const DefinePreludes::prelude& prelude = g_define_preludes.folder(spr->directory.str() + "_header.asm");
+    patchfile sprite_patch = create_base_sprite_patch(prelude);
+    const char postfix[] = R"(freecode cleaned
 SPRITE_ENTRY_%d:
     incsrc "%s"
-incsrc "shared_incsrc.asm"
-warnings pull
-namespace nested off
 )";
-    sprite_patch.fprintf(prefix, escapedAsmdir.c_str());
-    addIncScrToFile(sprite_patch, extraDefines);
-    sprite_patch.fprintf(postfix, escapedDir.c_str(), spr->number, escapedAsmfile.c_str());
-    sprite_patch.close();
+    sprite_patch.fprintf(postfix, spr->number, escapedAsmfile.c_str());
+    add_epilogue_to_sprite_patch(sprite_patch, std::span{&spr->asm_file.str(), 1});
 
-    if (!patch(sprite_patch, rom))
+    if (!patch(sprite_patch, rom, spr, prelude.defines))
         return false;
 
-    if (!cfg.SymbolsType.empty()) {
-        fs::path symbols_to_file = fs::path{spr->asm_file}.replace_extension(cfg.SymbolsType);
-        fs::path symbols_from_file = fs::path{TEMP_SPR_FILE}.replace_extension(cfg.SymbolsType);
-        try {
-            fs::rename(symbols_from_file, symbols_to_file);
-        } catch (const fs::filesystem_error& err) {
-            io.error("Trying to rename symbol file of \"%s\" returned \"%s\", aborting insertion\n",
-                     spr->asm_file.c_str(), err.what());
-            return false;
-        }
+    if (g_symbols.enabled()) {
+        std::string ns = symbol_namespace(spr->asm_file);
+        const SymbolDatabase::sprite_namespace entry{.number = spr->number, .name = ns};
+        g_symbols.add(asar_labels(), ns, std::span{&entry, 1});
     }
 
     using ptr_map_t = std::unordered_map<std::string_view, pointer>;
@@ -761,81 +830,162 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
     return true;
 }
 
-[[nodiscard]] bool patch_sprites_all_in_one(std::vector<std::string>& extraDefines, sprite* sprite_list, int size,
-                                            ROM& rom, const std::string& dir) {
-    std::vector<sprite*> sprites;
-    for (int i = 0; i < size; i++) {
-        sprite* spr = sprite_list + i;
-        if (spr->asm_file.empty())
+namespace {
+
+// sprites that can go in the same patch: none of them use the same sprite number, which would redefine their entry
+// label and the labels in their namespace, and none of them define the same macro
+struct sprite_batch {
+    std::vector<sprite*> sprites{};
+    std::unordered_set<int> numbers{};
+    // macro name -> the includeonce'd file defining it, empty if it's not guarded
+    std::unordered_map<std::string, std::string> macros{};
+};
+
+using macro_definitions = std::vector<std::pair<std::string, std::string>>;
+
+// the macros an asm file defines, itself or through the files it includes, with the includeonce'd file that
+// defines each of them (empty if none)
+macro_definitions collect_macro_definitions(const std::string& asm_file,
+                                            std::unordered_map<std::string, asm_references>& scanned) {
+    macro_definitions definitions{};
+    std::unordered_set<std::string> visited{};
+    std::vector<std::string> pending{asm_file};
+    while (!pending.empty()) {
+        std::string file = std::move(pending.back());
+        pending.pop_back();
+        if (!visited.insert(file).second)
             continue;
-        auto it = std::find_if(sprites.begin(), sprites.end(),
-                               [spr](const sprite* other) { return other->asm_file == spr->asm_file; });
-        if (it == sprites.end()) {
-            sprites.push_back(spr);
-        }
-    }
+        auto it = scanned.find(file);
+        if (it == scanned.end())
+            it = scanned.emplace(file, scan_asm_file(file)).first;
+        const asm_references& refs = it->second;
+        for (const auto& name : refs.macro_definitions)
+            definitions.emplace_back(name, refs.include_once ? file : std::string{});
+        for (const auto& include : refs.includes) {
+            if (!include.binary)
+                pending.push_back(include.file);
+        }
+    }
+    return definitions;
+}
 
-    if (sprites.empty())
+bool conflicts(const sprite_batch& batch, const sprite* spr, const macro_definitions& definitions) {
+    if (batch.numbers.contains(spr->number))
         return true;
+    return std::any_of(definitions.begin(), definitions.end(), [&](const auto& definition) {
+        auto it = batch.macros.find(definition.first);
+        return it != batch.macros.end() && (definition.second.empty() || it->second != definition.second);
+    });
+}
 
-    patchfile file = create_base_sprite_patch(extraDefines, dir);
+// Splits the sprites into as few batches as a first fit allows, keeping their order within each batch.
+std::vector<sprite_batch> conflict_free_batches(std::span<sprite* const> sprites) {
+    std::vector<sprite_batch> batches{};
+    std::unordered_map<std::string, asm_references> scanned{};
     for (sprite* spr : sprites) {
-        add_sprite_to_patch(file, spr);
-    }
-    add_epilogue_to_sprite_patch(file);
+        const macro_definitions definitions = collect_macro_definitions(spr->asm_file, scanned);
+        auto batch = std::find_if(batches.begin(), batches.end(),
+                                  [&](const sprite_batch& b) { return !conflicts(b, spr, definitions); });
+        if (batch == batches.end())
+            batch = batches.emplace(batches.end());
+        batch->sprites.push_back(spr);
+        batch->numbers.insert(spr->number);
+        for (const auto& [name, file] : definitions)
+            batch->macros.try_emplace(name, file);
+    }
+    return batches;
+}
 
-    if (!patch(file, rom)) {
-        int error_count;
-        const errordata* cerrors = asar_geterrors(&error_count);
-        std::span errors{cerrors, static_cast<size_t>(error_count)};
-        if (std::any_of(errors.begin(), errors.end(), [](const errordata& err) { return err.errid == 5095 /* error_id_macro_redefined */; })) {
-            io.error("Macro redefinition errors can mean that two sprites define the same macro. This is "
-                     "incompatible with the `--onepatch` command line option. Please attempt insertion without it.");
-        }
+} // namespace
+
+// Inserts a batch of sprites with a single patch and keeps the prints of each of them. If asar fails the batch is
+// split in half and each half is tried on its own, until the sprite that can't be inserted is alone, only then its
+// errors are reported.
+[[nodiscard]] bool patch_sprite_batch(std::span<sprite* const> batch, ROM& rom, const std::string& dir,
+                                      asm_file_index& asm_files_seen,
+                                      std::unordered_map<interned_string, std::vector<std::string>>& sprite_prints) {
+    iohandler::deferred_output output{};
+    bool patched = false;
+    {
+        const DefinePreludes::prelude& prelude = g_define_preludes.folder(dir + "_header.asm");
+        patchfile file = create_base_sprite_patch(prelude);
+        std::vector<std::string> asm_files{};
+        for (sprite* spr : batch) {
+            add_sprite_to_patch(file, spr);
+            asm_files.push_back(spr->asm_file);
+        }
+        add_epilogue_to_sprite_patch(file, asm_files);
+        iohandler::defer_scope defer{output};
+        patched = patch(file, rom, nullptr, prelude.defines);
+    }
+    if (!patched && batch.size() > 1) {
+        io.debug("%zu sprites failed to be inserted in the same patch, splitting them up\n", batch.size());
+        const size_t half = batch.size() / 2;
+        return patch_sprite_batch(batch.first(half), rom, dir, asm_files_seen, sprite_prints) &&
+               patch_sprite_batch(batch.subspan(half), rom, dir, asm_files_seen, sprite_prints);
+    }
+    io.replay(output);
+    if (!patched)
         return false;
-    }
-    int print_count = 0;
-    int label_count = 0;
-    const char* const* asar_prints = asar_getprints(&print_count);
-    const labeldata* asar_labels = asar_getalllabels(&label_count);
-    std::vector<std::string> prints{};
-    std::vector<labeldata> labels{};
-    prints.reserve(print_count);
-    labels.reserve(label_count);
 
-    for (int i = 0; i < print_count; i++) { // trim prints since now we can't deal with starting spaces
-        trim(prints.emplace_back(asar_prints[i]));
-    }
-    for (int i = 0; i < label_count; i++) {
-        labels.push_back(asar_labels[i]);
+    if (g_symbols.enabled()) {
+        std::vector<SymbolDatabase::sprite_namespace> namespaces{};
+        for (const sprite* spr : batch)
+            namespaces.push_back({.number = spr->number, .name = symbol_namespace(spr->asm_file)});
+        g_symbols.add(asar_labels(), {}, namespaces);
     }
 
-    auto it = prints.begin();
-    std::unordered_map<std::string_view, std::span<std::string>> sprite_prints{};
+    int print_count = 0;
+    const char* const* asar_prints = asar_getprints(&print_count);
     constexpr auto separator = "__PIXI_INTERNAL_SPRITE_SEPARATOR__"sv;
     size_t idx = 0;
-    while (it != prints.end()) {
-        auto sep = std::find(it, prints.end(), separator);
-        if (sep != prints.end()) {
-            sprite_prints.insert(std::pair{std::string_view{sprites[idx]->asm_file}, std::span{&*it, &*sep}});
+    std::vector<std::string> prints{};
+    for (int i = 0; i < print_count; i++) {
+        // trim prints since now we can't deal with starting spaces
+        std::string print{asar_prints[i]};
+        trim(print);
+        if (print != separator) {
+            prints.push_back(std::move(print));
+        } else if (idx < batch.size()) {
+            sprite_prints.insert_or_assign(asm_files_seen.canonical(batch[idx]->asm_file), std::move(prints));
+            prints.clear();
             idx++;
-            it = sep + 1;
-        } else {
-            it = sep;
         }
     }
 
-    if (sprite_prints.size() != sprites.size()) {
+    if (idx != batch.size()) {
         io.error("Internal error: prints size does not match sprites size, please report this to the developers "
                  "of the tool here " GITHUB_ISSUE_LINK);
         return false;
     }
+    return true;
+}
 
-    for (int i = 0; i < size; i++) {
-        sprite* spr = sprite_list + i;
+[[nodiscard]] bool patch_sprites_all_in_one(std::span<sprite* const> sprite_list, ROM& rom, const std::string& dir) {
+    std::vector<sprite*> sprites;
+    asm_file_index asm_files_seen{};
+    for (sprite* spr : sprite_list) {
+        if (!spr->asm_file.empty() && !asm_files_seen.find_or_add(spr))
+            sprites.push_back(spr);
+    }
+
+    if (sprites.empty())
+        return true;
+
+    const std::vector<sprite_batch> batches = conflict_free_batches(sprites);
+    if (batches.size() > 1)
+        io.debug("Inserting %zu sprites with %zu patches to avoid macro and sprite number conflicts\n", sprites.size(),
+                 batches.size());
+    std::unordered_map<interned_string, std::vector<std::string>> sprite_prints{};
+    for (const sprite_batch& batch : batches) {
+        if (!patch_sprite_batch(batch.sprites, rom, dir, asm_files_seen, sprite_prints))
+            return false;
+    }
+
+    for (sprite* spr : sprite_list) {
         if (spr->asm_file.empty())
             continue;
-        if (!fill_single_sprite(spr, sprite_prints.at(spr->asm_file))) {
+        if (!fill_single_sprite(spr, sprite_prints.at(asm_files_seen.canonical(spr->asm_file)))) {
             return false;
         }
     }
@@ -843,31 +993,63 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
     return true;
 }
 
-[[nodiscard]] bool patch_sprites(std::vector<std::string>& extraDefines, sprite* sprite_list, int size, ROM& rom) {
-    for (int i = 0; i < size; i++) {
-        sprite* spr = sprite_list + i;
+// Every worker of --jobs would insert its own copy of the routines its sprites call, and all but the first one
+// committed would collide on the routine table. The routines the sprites reach are inserted once before the workers
+// start so that they only use them. If the calls can't be resolved statically the workers insert them as before.
+[[nodiscard]] bool insert_routines_for_workers(std::span<sprite* const> sprites, ROM& rom) {
+    std::vector<std::string> asm_files{};
+    for (const sprite* spr : sprites)
+        asm_files.push_back(spr->asm_file);
+    const auto order = g_deps.routine_order(asm_files);
+    if (!order || order->empty())
+        return true;
+    const DefinePreludes::prelude& prelude = g_define_preludes.folder(sprites.front()->directory.str() + "_header.asm");
+    patchfile routine_patch = create_base_sprite_patch(prelude);
+    for (const auto& name : *order)
+        routine_patch.fprintf("!%s = 1\n", name.c_str());
+    add_epilogue_to_sprite_patch(routine_patch, asm_files);
+    return patch(routine_patch, rom, nullptr, prelude.defines);
+}
+
+[[nodiscard]] bool patch_sprites(std::span<sprite* const> sprite_list, ROM& rom) {
+    if (g_jobs.enabled()) {
+        std::vector<sprite*> pending{};
+        asm_file_index seen{};
+        for (sprite* spr : sprite_list) {
+            if (!spr->asm_file.empty() && !seen.find_or_add(spr) && !g_incremental.keeps(spr->asm_file))
+                pending.push_back(spr);
+        }
+        if (pending.size() > 1 && !insert_routines_for_workers(pending, rom))
+            return false;
+        g_jobs.assemble(pending, rom, [&](sprite* spr) { return patch_sprite(spr, rom); });
+    }
+
+    asm_file_index assembled{};
+    for (sprite* spr : sprite_list) {
         if (spr->asm_file.empty())
             continue;
 
-        bool duplicate = false;
-        for (int j = i - 1; j >= 0; j--) {
-            if (!sprite_list[j].asm_file.empty()) {
-                if (spr->asm_file == sprite_list[j].asm_file) {
-                    spr->table.init = sprite_list[j].table.init;
-                    spr->table.main = sprite_list[j].table.main;
-                    spr->extended_cape_ptr = sprite_list[j].extended_cape_ptr;
-                    spr->ptrs = sprite_list[j].ptrs;
-                    duplicate = true;
-                    break;
-                }
+        const sprite* other = assembled.find_or_add(spr);
+        if (other) {
+            spr->table.init = other->table.init;
+            spr->table.main = other->table.main;
+            spr->extended_cape_ptr = other->extended_cape_ptr;
+            spr->ptrs = other->ptrs;
+        } else if (!g_incremental.reuse(*spr)) {
+            if (g_jobs.commit(*spr, rom)) {
+                g_incremental.record(*spr, rom, g_jobs.last_committed());
+                g_changes.record(spr->asm_file, g_jobs.last_committed());
+                g_freespace.claim(g_jobs.last_committed(), FreespaceMap::owner::sprite, spr->asm_file);
+            } else {
+                if (!patch_sprite(spr, rom))
+                    return false;
+                auto written = asar_written_ranges(rom);
+                g_jobs.mark_written(written);
+                std::erase_if(written, [&](const rom_range& range) { return is_header_checksum(range, rom); });
+                g_incremental.record(*spr, rom, written);
             }
         }
 
-        if (!duplicate) {
-            if (!patch_sprite(extraDefines, spr, rom))
-                return false;
-        }
-
         if (spr->level < 0x200 && spr->number >= 0xB0 && spr->number < 0xC0) {
             int pls_lv_addr = PLS_LEVEL_PTRS[spr->level * 2] + (PLS_LEVEL_PTRS[spr->level * 2 + 1] << 8);
             if (pls_lv_addr == 0x0000) {
@@ -922,7 +1104,8 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
                 auto level_table_address = rom.pointer_snes(0x02FFF1).addr();
                 if (level_table_address != 0xFFFFFF && level_table_address != 0x000000) {
                     auto cleanup_ptr = [&](pointer ptr, std::string_view comment) {
-                        if (auto addr = ptr.addr(); !ptr.is_empty() && (addr != 0x000000) && (addr != 0xFFFFFF)) {
+                        if (auto addr = ptr.addr(); !ptr.is_empty() && (addr != 0x000000) && (addr != 0xFFFFFF) &&
+                                                    !g_incremental.preserves(ptr)) {
                             clean_patch.fprintf("autoclean $%06X; %s\n", addr.raw_value(), comment.data());
                         }
                     };
@@ -946,9 +1129,9 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
                         io.error("Invalid custom pointers address or sprite data address, aborting cleanup\n");
                         return false;
                     }
-                    if (auto custom_pointers_size = rom.get_rats_size(pcaddress{custom_pointers_address, rom});
-                        custom_pointers_size.has_value()) {
-                        uint16_t block_size = custom_pointers_size.value();
+                    if (const auto* custom_pointers_block =
+                            g_rats.protecting(pcaddress{custom_pointers_address, rom})) {
+                        const auto block_size = static_cast<size_t>(custom_pointers_block->size);
                         constexpr size_t block_multiplier = sizeof(status_pointers) + 1;
                         if (block_size % block_multiplier != 0) {
                             io.error("Custom pointers block size is not a multiple of %d, aborting cleanup\n",
@@ -971,9 +1154,8 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
                                 cleanup_ptr(ptrs.mouth, "Per-level custom mouth pointer");
                         }
                     }
-                    if (auto sprite_data_size = rom.get_rats_size(pcaddress{sprite_data_address, rom});
-                        sprite_data_size.has_value()) {
-                        uint16_t block_size = sprite_data_size.value();
+                    if (const auto* sprite_data_block = g_rats.protecting(pcaddress{sprite_data_address, rom})) {
+                        const auto block_size = static_cast<size_t>(sprite_data_block->size);
                         constexpr size_t block_multiplier = sizeof(sprite_table);
                         if (block_size % block_multiplier != 0) {
                             io.error("Custom pointers block size is not a multiple of %d, aborting cleanup\n",
@@ -1006,7 +1188,7 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
                                 ";Encountered pointer to 0xFFFFFF, assuming there to be no sprites to clean!\n");
                             break;
                         }
-                        if (!main_pointer.is_empty()) {
+                        if (!main_pointer.is_empty() && !g_incremental.preserves(main_pointer)) {
                             clean_patch.fprintf("autoclean $%06X\n", main_pointer.raw());
                         }
                     }
@@ -1026,11 +1208,11 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
         if (rom.pointer_snes(global_table_address).addr() != 0xFFFFFF) {
             for (int table_offset = 0x08; table_offset < limit; table_offset += 0x10) {
                 pointer init_pointer = rom.pointer_snes(global_table_address + table_offset);
-                if (!init_pointer.is_empty()) {
+                if (!init_pointer.is_empty() && !g_incremental.preserves(init_pointer)) {
                     clean_patch.fprintf("autoclean $%06X\n", init_pointer.raw());
                 }
                 pointer main_pointer = rom.pointer_snes(global_table_address + table_offset + 3);
-                if (!main_pointer.is_empty()) {
+                if (!main_pointer.is_empty() && !g_incremental.preserves(main_pointer)) {
                     clean_patch.fprintf("autoclean $%06X\n", main_pointer.raw());
                 }
             }
@@ -1042,17 +1224,19 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
         if (pointer_table_address != 0xFFFFFF && rom.pointer_snes(pointer_table_address).addr() != 0xFFFFFF) {
             for (int table_offset = 0; table_offset < 0x100 * 15; table_offset += 3) {
                 pointer ptr = rom.pointer_snes(pointer_table_address + table_offset);
-                if (!ptr.is_empty() && ptr.addr() != 0) {
+                if (!ptr.is_empty() && ptr.addr() != 0 && !g_incremental.preserves(ptr)) {
                     clean_patch.fprintf("autoclean $%06X\n", ptr.raw());
                 }
             }
         }
 
         // shared routines
+        // kept sprites may still be calling them, so the ones the list reaches stay unless something they depend on
+        // changed
         clean_patch.fprintf("\n\n;Routines:\n");
         for (int i = 0; i < MAX_ROUTINES; i++) {
             auto routine_pointer = rom.pointer_snes(0x03E05C + i * 3).addr();
-            if (routine_pointer != 0xFFFFFF) {
+            if (routine_pointer != 0xFFFFFF && !g_incremental.keeps_routine(static_cast<size_t>(i))) {
                 clean_patch.fprintf("autoclean $%06X\n", routine_pointer.raw_value());
                 clean_patch.fprintf("\torg $%06X\n", 0x03E05C + i * 3);
                 clean_patch.fprintf("\tdl $FFFFFF\n");
@@ -1080,53 +1264,26 @@ bool fill_single_sprite(sprite* spr, std::span<std::string> prints) {
         if (!patch(spritetool_clean.c_str(), rom))
             return false;
         // removes all STAR####MDK tags
-        const char* mdk = "MDK"; // sprite tool added "MDK" after the rats tag to find it's insertions...
-        int number_of_banks = rom.size / 0x8000;
-        for (int i = 0x10; i < number_of_banks; ++i) {
-            char* bank = (char*)(rom.unheadered_data() + i * 0x8000);
-
-            int bank_offset = 8;
-            while (true) {
-                // look for data inserted on previous uses
-
-                int offset = bank_offset;
-                unsigned int j = 0;
-                for (; offset < 0x8000; offset++) {
-                    if (bank[offset] != mdk[j++])
-                        j = 0;
-                    if (j == strlen(mdk)) {
-                        offset -= static_cast<int>(strlen(mdk)) - 1; // set pointer to start of mdk string
-                        break;
-                    }
-                }
-
-                if (offset >= 0x8000)
-                    break;
-                bank_offset = offset + static_cast<int>(strlen(mdk));
-                if (strncmp((bank + offset - 8), "STAR", 4)) // check for "STAR"
+        // sprite tool added "MDK" after the rats tag to find it's insertions, only from bank $10 on
+        constexpr std::string_view mdk = "MDK";
+        const int first_pc = 0x80000 + rom.header_size;
+        const int rom_end = rom.size + rom.header_size;
+        for (const RatsIndex::tag& tag : g_rats.tags()) {
+            if (tag.pc < first_pc || tag.data() + static_cast<int>(mdk.size()) > rom_end ||
+                memcmp(rom.data + pcaddress{tag.data()}, mdk.data(), mdk.size()) != 0)
+                continue;
+            if (tag.type == RatsIndex::kind::bad) {
+                char answer;
+                const auto* header = rom.data + pcaddress{tag.pc};
+                io.print("size: %04X, inverted: %04X\n", header[4] | (header[5] << 8), header[6] | (header[7] << 8));
+                io.print("Bad sprite_tool RATS tag detected at $%06X / 0x%05X. Remove anyway (y/n) ",
+                         rom.pc_to_snes(tag.pc), tag.pc);
+                int read_values = io.scanf("%c", &answer);
+                if ((answer != 'Y' && answer != 'y') || read_values != 1)
                     continue;
-
-                // delete the amount that the RATS tag is protecting
-                int size = ((unsigned char)bank[offset - 3] << 8) + (unsigned char)bank[offset - 4] + 8;
-                int inverted = ((unsigned char)bank[offset - 1] << 8) + (unsigned char)bank[offset - 2];
-
-                if ((size - 8 + inverted) == 0x0FFFF) // new tag
-                    size++;
-
-                else if ((size - 8 + inverted) != 0x10000) { // (not old tag either =>) bad tag
-                    char answer;
-                    int pc = i * 0x8000 + offset - 8 + rom.header_size;
-                    io.print("size: %04X, inverted: %04X\n", size - 8, inverted);
-                    io.print("Bad sprite_tool RATS tag detected at $%06X / 0x%05X. Remove anyway (y/n) ",
-                             rom.pc_to_snes(pc), pc);
-                    int read_values = io.scanf("%c", &answer);
-                    if ((answer != 'Y' && answer != 'y') || read_values != 1)
-                        continue;
-                }
-
-                memset(bank + offset - 8, 0, size);
-                bank_offset = offset - 8 + size;
             }
+            // delete the tag and the amount that it is protecting
+            memset(rom.data + pcaddress{tag.pc}, 0, static_cast<size_t>(std::min(tag.end(), rom_end) - tag.pc));
         }
     }
     return true;
@@ -1151,6 +1308,9 @@ std::vector<std::string> listExtraAsm(const std::string& path, bool& has_error)
     if (!std::filesystem::exists(cleanPathTrail(path))) {
         return extraDefines;
     }
+    if (g_server.restore_directory("extra_asm", path, extraDefines)) {
+        return extraDefines;
+    }
     try {
         for (auto& file : std::filesystem::directory_iterator(path)) {
             std::string spath = file.path().generic_string();
@@ -1161,44 +1321,19 @@ std::vector<std::string> listExtraAsm(const std::string& path, bool& has_error)
     } catch (const std::filesystem::filesystem_error& err) {
         io.error("Trying to read folder \"%s\" returned \"%s\", aborting insertion\n", path.c_str(), err.what());
         has_error = true;
+        return extraDefines;
     }
     if (!extraDefines.empty())
         std::sort(extraDefines.begin(), extraDefines.end());
+    g_server.store_directory("extra_asm", path, false, extraDefines);
     return extraDefines;
 }
 
-[[nodiscard]] bool create_shared_patch(const std::string& routine_path, const PixiConfig& config) {
+// every .asm file under the routine folder, relative to it
+[[nodiscard]] bool list_routines(const std::string& routine_path, std::vector<std::string>& routine_files) {
     namespace fs = std::filesystem;
-
-    std::string escapedRoutinepath = escapeDefines(routine_path, R"(\\\!)");
-    g_shared_inscrc_patch.fprintf("macro include_once(target, base, offset)\n"
-                                  "	if defined(\"<base>\")\n"
-                                  "    	if !<base> == 1\n"
-                                  "	    	pushpc\n"
-                                  "		    if read3(<offset>+$03E05C) != $FFFFFF\n"
-                                  "			    <base> = read3(<offset>+$03E05C)\n"
-                                  "	    	else\n"
-                                  "	    		freecode cleaned\n"
-                                  "	    			global #<base>:\n"
-                                  "	    			print \"    Routine: <base> inserted at $\",pc\n"
-                                  "	    			namespace <base>\n"
-                                  "	    			incsrc \"<target>\"\n"
-                                  "                   namespace off\n"
-                                  "	    		ORG <offset>+$03E05C\n"
-                                  "	    			dl <base>\n"
-                                  "	    	endif\n"
-                                  "	    	pullpc\n"
-                                  "    	!<base> #= 2\n"
-                                  "    	!pixi_incsrc_again #= 1\n"
-                                  "    	endif\n"
-                                  "    endif\n"
-                                  "endmacro\n"
-                                  "macro safe_macro_label_wrapper()\n");
-    int routine_count = 0;
-    if (!fs::exists(cleanPathTrail(routine_path))) {
-        io.error("Couldn't open folder \"%s\" for reading.", routine_path.c_str());
-        return false;
-    }
+    if (g_server.restore_directory("routines", routine_path, routine_files))
+        return true;
     try {
         for (const auto& routine_file : fs::recursive_directory_iterator{routine_path}) {
             if (!routine_file.is_regular_file())
@@ -1206,124 +1341,141 @@ std::vector<std::string> listExtraAsm(const std::string& path, bool& has_error)
             const fs::path& p = routine_file.path();
             if (p.extension() != ".asm")
                 continue;
-            fs::path rel = fs::relative(p, routine_path);
-            std::string path{rel.generic_string()};
-            std::string name{};
-            for (const auto& path_part : rel.replace_extension()) {
-                name += path_part.generic_string();
-            }
-            if (routine_count > config.Routines) {
-                io.error(
-                    "More than %d routines located. Please remove some or change the max number of routines with the "
-                    "-nr option. \n",
-                    config.Routines);
-                return false;
-            }
-            const char* charName = name.c_str();
-            const char* charPath = path.c_str();
-            g_shared_patch.fprintf("macro %s()\n"
-                                   "\t!%s ?= 1\n"
-                                   "\tJSL %s\n"
-                                   "endmacro\n",
-                                   charName, charName, charName);
-            g_shared_inscrc_patch.fprintf("\t%%include_once(\"%s%s\", %s, $%02X)\n", escapedRoutinepath.c_str(),
-                                          charPath, charName, routine_count * 3);
-            routine_count++;
-        }
-        g_shared_inscrc_patch.fprintf("endmacro\n\n"
-                                      "!pixi_incsrc_again = 1\n"
-                                      "while !pixi_incsrc_again != 0\n"
-                                      "\t!pixi_incsrc_again #= 0\n"
-                                      "\t%%safe_macro_label_wrapper()    ; actually insert wrapped routines\n"
-                                      "endwhile\n");
+            routine_files.push_back(fs::relative(p, routine_path).generic_string());
+        }
     } catch (const fs::filesystem_error& err) {
         io.error("Trying to read folder \"%s\" returned \"%s\", aborting insertion\n", routine_path.c_str(),
                  err.what());
         return false;
     }
+    g_server.store_directory("routines", routine_path, true, routine_files);
+    return true;
+}
+
+[[nodiscard]] bool create_shared_patch(const std::string& routine_path, const PixiConfig& config) {
+    namespace fs = std::filesystem;
+
+    std::string escapedRoutinepath = escapeDefines(routine_path, R"(\\\!)");
+    g_shared_patch.fprintf("macro include_once(target, base, offset)\n"
+                           "	if defined(\"<base>\")\n"
+                           "    	if !<base> == 1\n"
+                           "	    	pushpc\n"
+                           "		    if read3(<offset>+$03E05C) != $FFFFFF\n"
+                           "			    <base> = read3(<offset>+$03E05C)\n"
+                           "	    	else\n"
+                           "	    		freecode cleaned\n"
+                           "	    			global #<base>:\n"
+                           "	    			print \"    Routine: <base> inserted at $\",pc\n"
+                           "	    			namespace <base>\n"
+                           "	    			incsrc \"<target>\"\n"
+                           "                   namespace off\n"
+                           "	    		ORG <offset>+$03E05C\n"
+                           "	    			dl <base>\n"
+                           "	    	endif\n"
+                           "	    	pullpc\n"
+                           "    	!<base> #= 2\n"
+                           "    	!pixi_incsrc_again #= 1\n"
+                           "    	endif\n"
+                           "    endif\n"
+                           "endmacro\n");
+    g_shared_inscrc_patch.fprintf("macro safe_macro_label_wrapper()\n");
+    int routine_count = 0;
+    if (!fs::exists(cleanPathTrail(routine_path))) {
+        io.error("Couldn't open folder \"%s\" for reading.", routine_path.c_str());
+        return false;
+    }
+    std::vector<std::string> routine_files{};
+    if (!list_routines(routine_path, routine_files))
+        return false;
+    for (const auto& path : routine_files) {
+        fs::path rel{path};
+        std::string name{};
+        for (const auto& path_part : rel.replace_extension()) {
+            name += path_part.generic_string();
+        }
+        if (routine_count > config.Routines) {
+            io.error(
+                "More than %d routines located. Please remove some or change the max number of routines with the "
+                "-nr option. \n",
+                config.Routines);
+            return false;
+        }
+        const char* charName = name.c_str();
+        const char* charPath = path.c_str();
+        g_shared_patch.fprintf("macro %s()\n"
+                               "\t!%s ?= 1\n"
+                               "\tJSL %s\n"
+                               "endmacro\n",
+                               charName, charName, charName);
+        std::string include = fstring("\t%%include_once(\"%s%s\", %s, $%02X)\n", escapedRoutinepath.c_str(), charPath,
+                                      charName, routine_count * 3);
+        g_shared_inscrc_patch.fprintf("%s", include.c_str());
+        g_routine_includes.emplace(name, std::move(include));
+        g_routines.push_back(name);
+        routine_count++;
+    }
+    g_shared_inscrc_patch.fprintf("endmacro\n\n"
+                                  "!pixi_incsrc_again = 1\n"
+                                  "while !pixi_incsrc_again != 0\n"
+                                  "\t!pixi_incsrc_again #= 0\n"
+                                  "\t%%safe_macro_label_wrapper()    ; actually insert wrapped routines\n"
+                                  "endwhile\n");
     io.print("%d Shared routines registered in \"%s\"\n", routine_count, routine_path.data());
     g_shared_patch.close();
     g_shared_inscrc_patch.close();
-    g_memory_files.push_back(g_shared_patch.vfile());
-    g_memory_files.push_back(g_shared_inscrc_patch.vfile());
+    g_memory_files.add(g_shared_patch.vfile());
+    g_memory_files.add(g_shared_inscrc_patch.vfile());
+    if (g_symbols.enabled()) {
+        std::vector<std::string> routine_names{};
+        for (const auto& [name, include] : g_routine_includes)
+            routine_names.push_back(name);
+        g_symbols.set_routines(routine_names);
+    }
     return true;
 }
 
-[[nodiscard]] bool populate_sprite_list(const Paths& paths,
-                                        const std::array<sprite*, FromEnum(ListType::__SIZE__)>& sprite_lists,
-                                        std::string_view listPath, const ROM* rom) {
-    using namespace std::string_view_literals;
-    std::ifstream listStream{listPath.data()};
-    if (!listStream) {
+// a CFG/JSON file used by one or more list lines
+struct sprite_parse {
+    sprite parsed{};
+    bool json = false;
+    // first list line that uses the file
+    int line = 0;
+    bool cached = false;
+    bool ok = false;
+    iohandler::deferred_output output{};
+    std::vector<std::string> warnings{};
+    Tracer::clock::time_point start{};
+    Tracer::clock::time_point end{};
+    int thread = 1;
+};
+
+[[nodiscard]] bool populate_sprite_list(const Paths& paths, sprite_registry& registry, std::string_view listPath,
+                                        const ROM* rom) {
+    std::string contents{};
+    if (!read_list_file(listPath, contents)) {
         io.error("Could not open list file \"%s\" for reading: %s", listPath.data(), strerror(errno));
         return false;
     }
-    unsigned int sprite_id, level;
-    int lineno = 0;
-    int read_res;
-    std::string line;
-    ListType type = ListType::Sprite;
+    list_tokens tokens = tokenize_list(contents, cfg.PerLevel);
+    if (!tokens.errors.empty()) {
+        for (const list_error& error : tokens.errors)
+            io.error("%s", error.message.c_str());
+        return false;
+    }
+    constexpr size_t no_parse = static_cast<size_t>(-1);
+    std::vector<sprite_parse> parses{};
+    std::unordered_map<std::string, size_t> parse_index{};
+    // every slot in list order along with the file that fills it in, no_parse for asm-only sprites
+    std::vector<std::pair<sprite*, size_t>> assigned{};
+    assigned.reserve(tokens.entries.size());
     sprite* spr = nullptr;
-    std::string cfgname{};
     const char* dir = nullptr;
-    while (std::getline(listStream, line)) {
-        int read_until = -1;
-        sprite* sprite_list = sprite_lists[FromEnum(type)];
-        // possible line formats: xxx:yy filename.<cfg/json/asm> [; ...]
-        //						  yy filename.<cfg/json/asm> [; ...]
-        // 						  TYPE: [; ...]
-        lineno++;
-        if (line.find(';') != std::string::npos)
-            line.erase(line.begin() + line.find_first_of(';'), line.end());
-        trim(line);
-        if (line.empty())
-            continue;
-        if (line.find(':') == std::string::npos) { // if there's no : in the string, it's a non per-level sprite
-            level = 0x200;
-            read_res = sscanf(line.c_str(), "%x %n", &sprite_id, &read_until);
-            if (read_res != 1 || read_res == EOF || read_until == -1) {
-                io.error("List line %d was malformed: \"%s\"\n", lineno, line.c_str());
-                return false;
-            }
-            cfgname = line.substr(read_until);
-        } else if (line.find(':') == line.length() - 1) { // if it's the last char in the string, it's a type change
-            using svt = std::pair<std::string_view, ListType>;
-            constexpr std::array typeArray{svt{"SPRITE:"sv, ListType::Sprite},
-                                           svt{"CLUSTER:"sv, ListType::Cluster},
-                                           svt{"EXTENDED:"sv, ListType::Extended},
-                                           svt{"MINOREXTENDED:"sv, ListType::MinorExtended},
-                                           svt{"BOUNCE:"sv, ListType::Bounce},
-                                           svt{"SMOKE:"sv, ListType::Smoke},
-                                           svt{"SPINNINGCOIN:"sv, ListType::SpinningCoin},
-                                           svt{"SCORE:"sv, ListType::Score}};
-            auto it = std::find_if(typeArray.begin(), typeArray.end(),
-                                   [&line](const svt& svtl) { return svtl.first == line; });
-            if (it != typeArray.end()) {
-                type = it->second;
-            }
-            continue;
-        } else { // if there's a ':' but it's not at the end, it may be a per level sprite
-            read_res = sscanf(line.c_str(), "%x:%x %n", &level, &sprite_id, &read_until);
-            if (read_res != 2 || read_res == EOF || read_until == -1) {
-                io.error("List line %d was malformed: \"%s\"\n", lineno, line.c_str());
-                return false;
-            }
-            if (!cfg.PerLevel) {
-                io.error("Trying to insert per level sprites without using the -pl flag, at list line %d: \"%s\"\n",
-                         lineno, line.c_str());
-                return false;
-            }
-            cfgname = line.substr(read_until);
-        }
-
-        size_t dot = cfgname.find_last_of('.');
-        if (dot == std::string::npos) {
-            io.error("Error on list line %d: missing extension on filename %s\n", lineno, cfgname.c_str());
-            return false;
-        }
-        size_t space_after_ext = cfgname.find_first_of(' ', dot);
-        std::string_view ext = std::string_view{cfgname}.substr(
-            dot + 1, space_after_ext == std::string::npos ? space_after_ext : space_after_ext - dot - 1);
+    for (const list_entry& entry : tokens.entries) {
+        const int lineno = entry.line;
+        const ListType type = entry.type;
+        const unsigned int level = entry.level;
+        const unsigned int sprite_id = entry.number;
+        const std::string_view ext = entry.extension;
 
         if (rom != nullptr) {
             if (sprite_id == GOAL_POST_SPRITE_ID && rom->is_exlevel()) {
@@ -1339,10 +1491,11 @@ std::vector<std::string> listExtraAsm(const std::string& path, bool& has_error)
             }
         }
 
+        std::optional<size_t> slot{};
         if (type == ListType::Sprite) {
-            spr = from_table<sprite>(sprite_list, level, sprite_id);
-            // verify sprite pointer and determine cause if invalid
-            if (!spr) {
+            slot = sprite_slot(level, sprite_id);
+            // verify sprite slot and determine cause if invalid
+            if (!slot) {
                 if (sprite_id >= 0x100) {
                     io.error("Error on list line %d: Sprite number must be less than 0x100\n", lineno);
                     return false;
@@ -1362,19 +1515,20 @@ std::vector<std::string> listExtraAsm(const std::string& path, bool& has_error)
                 return false;
             }
         } else {
-            size_t max_size = sprite_sizes[static_cast<size_t>(FromEnum(type)) - 1].second;
-            if (sprite_id > max_size) {
+            size_t max_size = sprite_registry::capacity(type);
+            if (sprite_id >= max_size) {
                 io.error("Error on list line %d: Sprite number must be less than %x\n", lineno, max_size);
                 return false;
             }
-            spr = sprite_list + sprite_id;
+            slot = sprite_id;
         }
 
-        if (spr->line) {
+        if (registry.find(type, *slot)) {
             io.error("Error on list line %d: Sprite number %x already used.\n", lineno, sprite_id);
             return false;
         }
         // initialize some.
+        spr = &registry.add(type, *slot);
         spr->line = lineno;
         spr->level = level;
         spr->number = sprite_id;
@@ -1396,53 +1550,97 @@ std::vector<std::string> listExtraAsm(const std::string& path, bool& has_error)
                 dir = paths[PathType::Generators].c_str();
         }
         spr->directory = dir;
-        std::string fullFileName = std::string{dir} + cfgname.substr(0, space_after_ext);
+        std::string fullFileName{dir};
+        fullFileName += entry.file;
 
+        // the extensions and display types have already been checked by the tokenizer
         if (type != ListType::Sprite) {
-            if (ext != "asm" && ext != "ASM") {
-                io.error("Error on list line %d: not an asm file\n", lineno, fullFileName.c_str());
-                return false;
-            }
-            if (space_after_ext != std::string::npos) {
-                io.error("Error on list line %d: display type not supported for ASM files\n", lineno);
-                return false;
-            }
             spr->asm_file = std::move(fullFileName);
-        } else {
-            spr->cfg_file = std::move(fullFileName);
-            if (ext == "cfg" || ext == "CFG") {
-                spr->displays_in_lm = false;
-                if (space_after_ext != std::string::npos) {
-                    // may be "display|nodisplay"
-                    std::string display = std::string{cfgname}.substr(space_after_ext + 1);
-                    trim(display);
-                    if (display == "nodisplay"sv) {
-                        spr->displays_in_lm = false;
-                    } else if (display == "display"sv) {
-                        spr->displays_in_lm = true;
-                    } else {
-                        io.error("Error on list line %d: Unknown display type %s\n", lineno, display.c_str());
-                        return false;
-                    }
-                }
-                if (!read_cfg_file(spr)) {
-                    io.error("Error on list line %d: Cannot parse CFG file %s.\n", lineno, spr->cfg_file.c_str());
-                    return false;
-                }
-            } else if (ext == "json" || ext == "JSON") {
-                if (space_after_ext != std::string::npos) {
-                    io.error("Error on list line %d: display type not supported for JSON files\n", lineno);
-                    return false;
-                }
-                if (!read_json_file(spr)) {
-                    io.error("Error on list line %d: Cannot parse JSON file %s.\n", lineno, spr->cfg_file.c_str());
-                    return false;
-                }
-                spr->displays_in_lm = true;
-            } else {
-                io.error("Error on list line %d: Unknown filetype %s\n", lineno, ext.data());
-                return false;
+            assigned.push_back({spr, no_parse});
+            continue;
+        }
+        spr->cfg_file = std::move(fullFileName);
+        const bool json = ext != "cfg" && ext != "CFG";
+        if (!json)
+            spr->displays_in_lm = entry.display;
+        std::string key = spr->cfg_file;
+        if (spr->displays_in_lm)
+            key += "\ndisplay";
+        auto [it, inserted] = parse_index.try_emplace(std::move(key), parses.size());
+        if (inserted) {
+            sprite_parse& parse = parses.emplace_back();
+            parse.json = json;
+            parse.line = lineno;
+            parse.parsed.cfg_file = spr->cfg_file;
+            parse.parsed.directory = spr->directory;
+            parse.parsed.displays_in_lm = spr->displays_in_lm;
+        }
+        assigned.push_back({spr, it->second});
+    }
+
+    // every file is parsed once no matter how many slots use it, the ones the server doesn't have cached are
+    // spread over a few threads since reading them is independent of everything else
+    std::vector<sprite_parse*> pending{};
+    for (sprite_parse& parse : parses) {
+        parse.cached = g_server.restore(&parse.parsed);
+        if (!parse.cached && g_metadata_cache.restore(&parse.parsed, parse.warnings)) {
+            parse.cached = true;
+            warnings.insert(warnings.end(), parse.warnings.begin(), parse.warnings.end());
+            g_server.store(&parse.parsed, parse.warnings);
+        }
+        if (!parse.cached)
+            pending.push_back(&parse);
+    }
+    {
+        auto span = g_trace.scope("parse sprite files", "list");
+        span.arg("files", static_cast<long long>(parses.size()));
+        span.arg("parsed", static_cast<long long>(pending.size()));
+        const size_t workers = std::min<size_t>(pending.size(), std::max(1u, std::thread::hardware_concurrency()));
+        std::atomic<size_t> next{0};
+        auto work = [&](int thread) {
+            for (size_t i = next++; i < pending.size(); i = next++) {
+                sprite_parse& parse = *pending[i];
+                iohandler::defer_scope defer{parse.output};
+                parse.thread = thread;
+                parse.start = Tracer::clock::now();
+                parse.ok = parse.json ? read_json_file(&parse.parsed, parse.warnings) : read_cfg_file(&parse.parsed);
+                parse.end = Tracer::clock::now();
             }
+        };
+        std::vector<std::thread> threads{};
+        for (size_t i = 1; i < workers; i++)
+            threads.emplace_back(work, static_cast<int>(i) + 1);
+        work(1);
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    // whatever the parsers printed comes out in list order, as if they had run one after the other
+    bool parsed_all = true;
+    for (sprite_parse& parse : parses) {
+        if (parse.cached)
+            continue;
+        io.replay(parse.output);
+        g_trace.complete(parse.json ? "parse JSON" : "parse CFG", "list", parse.start, parse.end,
+                         {{"file", parse.parsed.cfg_file}}, parse.thread);
+        if (!parse.ok) {
+            io.error("Error on list line %d: Cannot parse %s file %s.\n", parse.line, parse.json ? "JSON" : "CFG",
+                     parse.parsed.cfg_file.c_str());
+            parsed_all = false;
+            continue;
+        }
+        warnings.insert(warnings.end(), parse.warnings.begin(), parse.warnings.end());
+        g_server.store(&parse.parsed, parse.warnings);
+        g_metadata_cache.store(&parse.parsed, parse.warnings);
+    }
+    if (!parsed_all)
+        return false;
+
+    for (const auto& [spr, parse] : assigned) {
+        if (parse != no_parse) {
+            spr->copy_parsed(parses[parse].parsed);
+            if (parses[parse].json)
+                spr->displays_in_lm = true;
         }
 
         io.debug("Read from list line %d\n", spr->line);
@@ -1462,22 +1660,17 @@ std::vector<std::string> listExtraAsm(const std::string& path, bool& has_error)
     return true;
 }
 
-// spr      = sprite array
+// tables   = the sprite tables of every slot, in order
 // filename = duh
-// size     = number of sprites to loop over
-[[nodiscard]] patchfile write_long_table(sprite* spr, std::string_view dir, std::string_view filename,
-                                         unsigned int size = 0x800) {
+[[nodiscard]] patchfile write_long_table(std::span<const sprite_table> tables, std::string_view dir,
+                                         std::string_view filename) {
     unsigned char dummy[0x10] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
                                  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-    std::vector<unsigned char> file{};
-    file.resize(static_cast<size_t>(size) * 0x10);
-    if (is_empty_table({spr, size})) {
+    if (is_empty_table(tables)) {
         return write_all(dummy, dir, filename, 0x10);
     } else {
-        for (unsigned int i = 0; i < size; i++) {
-            memcpy(file.data() + (i * 0x10), &spr[i].table, 0x10);
-        }
-        return write_all(file.data(), dir, filename, size * 0x10);
+        return write_all(reinterpret_cast<const unsigned char*>(tables.data()), dir, filename,
+                         static_cast<unsigned int>(tables.size_bytes()));
     }
 }
 
@@ -1493,6 +1686,32 @@ void remove(std::string_view dir, const char* file) {
     fs::remove(fs::path{dir} / file);
 }
 
+// everything pixi knows it put in freespace, then the map of the ROM as it is now
+void map_freespace(const sprite_registry& registry, ROM& rom, std::span<const rom_range> meimei_written) {
+    auto claim_pointer = [&rom](const pointer& ptr, FreespaceMap::owner owner, std::string name) {
+        if (!ptr.is_empty() && ptr.raw() != 0xFFFFFF)
+            g_freespace.claim(rom.snes_to_pc(ptr.addr()), owner, std::move(name));
+    };
+    for (size_t t = 0; t < FromEnum(ListType::__SIZE__); t++) {
+        for (const sprite* spr : registry.sprites(ToEnum<ListType>(static_cast<uint8_t>(t)))) {
+            for (const pointer& ptr : {spr->table.init, spr->table.main, spr->extended_cape_ptr, spr->ptrs.carriable,
+                                       spr->ptrs.kicked, spr->ptrs.carried, spr->ptrs.mouth, spr->ptrs.goal})
+                claim_pointer(ptr, FreespaceMap::owner::sprite, spr->asm_file);
+        }
+    }
+    for (size_t i = 0; i < g_routines.size(); i++) {
+        claim_pointer(rom.pointer_snes(0x03E05C + static_cast<int>(i) * 3), FreespaceMap::owner::routine,
+                      g_routines[i]);
+    }
+    // the level pointers, the blocks of the other per-level tables are protected by it
+    if (cfg.PerLevel)
+        claim_pointer(rom.pointer_snes(0x02FFF1), FreespaceMap::owner::per_level, "per-level tables");
+    g_freespace.claim(meimei_written, FreespaceMap::owner::meimei, "MeiMei");
+
+    g_rats.build(rom);
+    g_freespace.build(g_rats, rom);
+}
+
 bool check_warnings() {
     if (!warnings.empty() && cfg.warningsEnabled()) {
         io.print("One or more warnings have been detected:\n");
@@ -1537,9 +1756,22 @@ void pixi_reset() {
     g_memory_files.clear();
     g_shared_patch.clear();
     g_shared_inscrc_patch.clear();
+    g_routine_includes.clear();
+    g_routines.clear();
     g_config_defines.clear();
+    g_define_preludes.clear();
+    g_symbols.reset();
+    g_rats.clear();
+    g_freespace.reset();
+    g_incremental.reset();
+    g_jobs.reset();
+    g_deps.clear();
+    g_changes.reset();
+    g_metadata_cache.reset();
     patchfile::set_keep(false, false);
     cfg.reset();
+    // after everything above let go of the sprites and paths of the previous run
+    interned_string::collect();
 }
 
 PIXI_EXPORT int pixi_api_version() {
@@ -1551,71 +1783,48 @@ PIXI_EXPORT int pixi_check_api_version(int version_edition, int version_major, i
 }
 
 PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
-#ifndef PIXI_EXE_BUILD
-    pixi_reset();
+#ifdef PIXI_EXE_BUILD
+    // the executable only runs once per process, unless it's serving requests
+    const bool reused_process = g_server.active();
+#else
+    const bool reused_process = true;
 #endif
+    // the sprites of every list type, only the slots the list uses are filled in
+    static sprite_registry registry{};
+    if (reused_process) {
+        // before the reset, so that the paths only the previous list used can be dropped
+        registry.clear();
+        pixi_reset();
+    }
+    // the trace starts here, the spans up to the argument parsing are recorded once --trace is known
+    g_trace.reset();
     ROM rom;
     MeiMei meimei{};
-    // individual lists containing the sprites for the specific sections
-    static sprite sprite_list[MAX_SPRITE_COUNT];
-    static sprite cluster_list[SPRITE_COUNT];
-    static sprite extended_list[SPRITE_COUNT];
-    static sprite minor_extended_list[LESS_SPRITE_COUNT];
-    static sprite bounce_list[LESS_SPRITE_COUNT];
-    static sprite smoke_list[LESS_SPRITE_COUNT];
-    static sprite spinningcoin_list[MINOR_SPRITE_COUNT];
-    static sprite score_list[MINOR_SPRITE_COUNT];
-
-    std::vector<plugins::plugin> plugin_list{};
-    const fs::path plugins_path = fs::current_path() / "plugins";
-    if (fs::is_directory(plugins_path)) {
-        for (const auto& entry : fs::directory_iterator(plugins_path)) {
-            if (entry.is_regular_file() && entry.path().extension() == DYLIB_EXT) {
-                plugin_list.emplace_back(entry.path().native());
+
+    // a resident server loads the plugins once and keeps them for every request
+    std::vector<plugins::plugin> loaded_plugins{};
+    std::vector<plugins::plugin>& plugin_list = g_server.active() ? g_server.plugins() : loaded_plugins;
+    if (!g_server.active()) {
+        const fs::path plugins_path = fs::current_path() / "plugins";
+        if (fs::is_directory(plugins_path)) {
+            for (const auto& entry : fs::directory_iterator(plugins_path)) {
+                if (entry.is_regular_file() && entry.path().extension() == DYLIB_EXT) {
+                    plugin_list.emplace_back(entry.path().native());
+                }
             }
-        }
-        for (auto& plugin : plugin_list) {
-            if (int code = plugin.load(); code != EXIT_SUCCESS) {
-                return EXIT_FAILURE;
+            for (auto& plugin : plugin_list) {
+                if (int code = plugin.load(); code != EXIT_SUCCESS) {
+                    return EXIT_FAILURE;
+                }
             }
         }
-    }
-
-    if (plugins::for_each_plugin(plugin_list, &plugins::plugin::check_version, (int)VERSION_FULL) != EXIT_SUCCESS) {
-        return EXIT_FAILURE;
-    };
 
-#ifndef PIXI_EXE_BUILD
-    for (auto& spr : sprite_list) {
-        spr.clear();
-    }
-    for (auto& spr : cluster_list) {
-        spr.clear();
-    }
-    for (auto& spr : extended_list) {
-        spr.clear();
-    }
-    for (auto& spr : minor_extended_list) {
-        spr.clear();
-    }
-    for (auto& spr : bounce_list) {
-        spr.clear();
-    }
-    for (auto& spr : smoke_list) {
-        spr.clear();
-    }
-    for (auto& spr : spinningcoin_list) {
-        spr.clear();
-    }
-    for (auto& spr : score_list) {
-        spr.clear();
+        if (plugins::for_each_plugin(plugin_list, &plugins::plugin::check_version, (int)VERSION_FULL) !=
+            EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        };
     }
-#endif
-
-    // the list containing the lists...
-    std::array<sprite*, FromEnum(ListType::__SIZE__)> sprites_list_list{
-        sprite_list, extended_list, cluster_list,      minor_extended_list,
-        bounce_list, smoke_list,    spinningcoin_list, score_list};
+    const auto plugins_loaded = Tracer::clock::now();
 
 #ifdef ON_WINDOWS
     std::string lm_handle;
@@ -1628,7 +1837,8 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
     // map16 for sprite displays
     static map16 map[MAP16_SIZE];
     argparser optparser{};
-    if (std::filesystem::exists("pixi_settings.json")) {
+    // requests sent to a resident server bring their own arguments
+    if (!g_server.active() && std::filesystem::exists("pixi_settings.json")) {
         nlohmann::json j;
         try {
             std::ifstream settings_file{"pixi_settings.json"};
@@ -1694,7 +1904,7 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
                     "Resolve list.txt and ssc/mw2/mwt/s16 paths relative to the executable rather than the ROM",
                     cfg.SearchForFilesInExePath)
         .add_option("-k", "Keep debug files", cfg.KeepFiles)
-        .add_option("--symbols", "SYMBOLSTYPE", "Enable writing debugging symbols files in format wla or nocash",
+        .add_option("--symbols", "SYMBOLSTYPE", "Enable writing <romname>.sym with the labels of every sprite, routine and patch, in format wla or nocash",
                     cfg.SymbolsType)
         .add_option("-l", "list path", "Specify a custom list file", cfg[PathType::List])
         .add_option("-pl", "Per level sprites - will insert perlevel sprite code", cfg.PerLevel)
@@ -1732,7 +1942,38 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
         .add_option("-meimei-a", "Enables always remap sprite data", meimei.AlwaysRemap())
         .add_option("-meimei-k", "Enables keep temp patches files", meimei.KeepTemp())
         .add_option("-meimei-d", "Enables debug for MeiMei patches", meimei.Debug())
-        .add_option("--onepatch", "Applies all sprites into a single big patch", cfg.AllSpritesOnePatch)
+        .add_option("--onepatch", "Applies the sprites with as few big patches as possible, splitting up sprites that define the same macros", cfg.AllSpritesOnePatch)
+        .add_option("--jobs", "N", "Assemble sprites in N worker processes (not available on Windows)", cfg.Jobs)
+        .add_option("--incremental",
+                    "Only reinsert sprites whose sources changed since the last run, keeping the others in place",
+                    cfg.Incremental)
+        .add_option("--no-cache",
+                    "Don't load or save <listname>.pixicache, the already parsed contents of every CFG/JSON file",
+                    cfg.NoMetadataCache)
+        .add_option("--deps",
+                    "Print which files each sprite depends on and save them to <romname>.pixideps, without inserting "
+                    "anything",
+                    cfg.DumpDeps)
+        .add_option("--trace", "FILE",
+                    "Write how long each step of the insertion took to FILE, in Chrome's trace event format",
+                    cfg.TracePath)
+        .add_option("--emit-patch", "FILE",
+                    "Also write what the insertion changed in the ROM as a patch, IPS or BPS depending on the "
+                    "extension of FILE",
+                    cfg.EmitPatchPath)
+        .add_option("--emit-patch-only",
+                    "Only write the --emit-patch patch, the ROM file and the .extmod file are left untouched",
+                    cfg.EmitPatchOnly)
+        .add_option("--freespace-report", "FILE",
+                    "Write a bank by bank map of the ROM's freespace after the insertion to FILE, with what every "
+                    "RATS block belongs to, as JSON if FILE ends in .json and as text otherwise",
+                    cfg.FreespaceReportPath)
+        .add_option("--track-changes", "Record which ranges of the ROM the insertion changed, for the C API",
+                    cfg.TrackChanges)
+        .add_option("--serve", "SOCKET",
+                    "Stay resident and insert on requests sent to a unix socket at this path (not available on "
+                    "Windows)",
+                    cfg.ServeSocket)
         .add_option("--stdincludes", "INCLUDEPATH", "Specify a text file with a list of search paths for asar",
                     cfg.AsarStdIncludes)
         .add_option("--stddefines", "DEFINEPATH", "Specify a text file with a list of defines for asar",
@@ -1748,12 +1989,21 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
     // handle arguments passed to tool
     //------------------------------------------------------------------------------------------
     bool parsed_correctly = optparser.parse();
+    const auto arguments_parsed = Tracer::clock::now();
     if (optparser.help_requested()) {
         optparser.print_help();
         return EXIT_SUCCESS;
     }
     if (!parsed_correctly)
         return EXIT_FAILURE;
+    if (g_server.active()) {
+        if (!cfg.ServeSocket.empty()) {
+            io.error("--serve can't be used in a request sent to a server\n");
+            return EXIT_FAILURE;
+        }
+        // there's nobody to answer prompts
+        cfg.ScriptMode = true;
+    }
     if (cfg.Disable255Sprites) {
         io.error("Disabling the 255 sprites per level patch is not supported since 1.41 because the RAM recovered by "
                  "moving the table from 1938 is used by misc tables for minor sprite types");
@@ -1771,10 +2021,26 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
                  cfg.Routines);
         return EXIT_FAILURE;
     }
+    if (!cfg.EmitPatchPath.empty() && !ChangeTracker::supported_patch_format(cfg.EmitPatchPath)) {
+        io.error("Invalid --emit-patch file %s, the supported formats are .ips and .bps\n", cfg.EmitPatchPath.c_str());
+        return EXIT_FAILURE;
+    }
+    if (cfg.EmitPatchOnly && cfg.EmitPatchPath.empty()) {
+        io.error("--emit-patch-only requires --emit-patch\n");
+        return EXIT_FAILURE;
+    }
+    if (cfg.EmitPatchOnly && cfg.Incremental) {
+        io.error("--emit-patch-only can't be used with --incremental, the saved state would describe the patched ROM\n");
+        return EXIT_FAILURE;
+    }
     if (cfg.SymbolsType != "" && cfg.SymbolsType != "wla" && cfg.SymbolsType != "nocash") {
         io.error("Invalid --symbols format. Supported formats are wla or nocash");
         return EXIT_FAILURE;
     }
+    if (!cfg.SymbolsType.empty())
+        g_symbols.enable();
+    if (!cfg.FreespaceReportPath.empty())
+        g_freespace.enable();
 
     // DEV_BUILD means either debug build or CI build.
     if constexpr (PIXI_DEV_BUILD) {
@@ -1788,14 +2054,44 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
         return EXIT_SUCCESS;
     }
 #ifdef ASAR_USE_DLL
-    AsarHandler asar_handler{};
-    if (!asar_handler.ok()) {
-        io.error(
-            "Error: Asar library is missing or couldn't be initialized, please redownload the tool or add the dll.\n");
-        return EXIT_FAILURE;
+    // a resident server keeps asar loaded between requests
+    std::optional<AsarHandler> asar_handler{};
+    if (!g_server.active()) {
+        asar_handler.emplace();
+        if (!asar_handler->ok()) {
+            io.error("Error: Asar library is missing or couldn't be initialized, please redownload the tool or add "
+                     "the dll.\n");
+            return EXIT_FAILURE;
+        }
     }
 #endif
 
+    if (!cfg.ServeSocket.empty()) {
+        if (!PixiServer::supported()) {
+            io.error("--serve is not supported on this platform\n");
+            return EXIT_FAILURE;
+        }
+        return g_server.run(cfg.ServeSocket, argv[0], plugin_list,
+                            [](int request_argc, const char** request_argv) {
+                                return pixi_run(request_argc, request_argv, true);
+                            });
+    }
+
+    // written on every way out of the run, failed runs included
+    struct trace_writer {
+        std::string path;
+        ~trace_writer() {
+            if (!path.empty())
+                (void)g_trace.write(path);
+        }
+    } trace_guard{cfg.TracePath};
+    if (!cfg.TracePath.empty()) {
+        g_trace.enable();
+        g_trace.complete("load plugins", "plugin", g_trace.origin(), plugins_loaded);
+        g_trace.complete("settings and arguments", "setup", plugins_loaded, arguments_parsed);
+        g_trace.complete("init asar", "setup", arguments_parsed, Tracer::clock::now());
+    }
+
 #ifdef ON_WINDOWS
     if (!lm_handle.empty()) {
         window_handle = (HWND)std::stoull(lm_handle, nullptr, 16);
@@ -1806,7 +2102,8 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
     patchfile::set_keep(cfg.KeepFiles, meimei.KeepTemp());
     versionflag[1] = (cfg.PerLevel ? 1 : 0);
 
-    if (plugins::for_each_plugin(plugin_list, &plugins::plugin::before_patching) != EXIT_SUCCESS) {
+    if (auto span = g_trace.scope("before_patching", "plugin");
+        plugins::for_each_plugin(plugin_list, &plugins::plugin::before_patching) != EXIT_SUCCESS) {
         return EXIT_FAILURE;
     };
 
@@ -1905,9 +2202,12 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
         return EXIT_FAILURE;
     }
 
+    if (cfg.TrackChanges || !cfg.EmitPatchPath.empty())
+        g_changes.begin(rom);
+
     // Initialize MeiMei
     if (!cfg.DisableMeiMei) {
-        if (!meimei.initialize(rom.name.data()))
+        if (!meimei.initialize(rom))
             return EXIT_FAILURE;
     }
 
@@ -1952,46 +2252,125 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
     std::vector<std::string> extraDefines = listExtraAsm(cfg.AsmDirPath + "/ExtraDefines", failed);
     if (failed)
         return EXIT_FAILURE;
-    if (!populate_sprite_list(cfg.GetPaths(), sprites_list_list, cfg[PathType::List], &rom))
+    {
+        // the asm files asar is going to read are loaded while the list is being parsed
+        std::vector<std::string> source_folders{};
+        for (size_t i = 0; i < FromEnum(PathType::__SIZE__); i++) {
+            if (ToEnum<PathType>(i) != PathType::List)
+                source_folders.push_back(cfg[ToEnum<PathType>(i)]);
+        }
+        g_memory_files.prefetch(std::move(source_folders));
+    }
+    if (!cfg.NoMetadataCache)
+        g_metadata_cache.begin(cfg[PathType::List]);
+    if (auto span = g_trace.scope("populate_sprite_list", "list");
+        !populate_sprite_list(cfg.GetPaths(), registry, cfg[PathType::List], &rom))
         return EXIT_FAILURE;
+    g_metadata_cache.save();
+
+    {
+        auto span = g_trace.scope("dependency graph", "list");
+        std::vector<std::string> routine_files{};
+        if (fs::exists(cleanPathTrail(cfg[PathType::Routines])) &&
+            !list_routines(cfg[PathType::Routines], routine_files))
+            return EXIT_FAILURE;
+        g_deps.set_routines(cfg[PathType::Routines], routine_files);
+        for (const auto& file : extraDefines) {
+            g_deps.add_shared_file(file);
+        }
+        for (size_t t = 0; t < FromEnum(ListType::__SIZE__); t++) {
+            for (const sprite* spr : registry.sprites(ToEnum<ListType>(static_cast<uint8_t>(t)))) {
+                g_deps.add_sprite(*spr);
+            }
+        }
+    }
+    const std::string deps_path = fs::path{rom.name}.replace_extension(".pixideps").generic_string();
+    if (cfg.DumpDeps) {
+        g_deps.dump();
+        return g_deps.save(deps_path) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    if (!clean_hack(rom, cfg[PathType::Asm]))
+    if (cfg.Jobs > 1) {
+        if (!AsarJobPool::supported()) {
+            io.print("--jobs is not supported on this platform, sprites will be assembled serially\n");
+        } else if (cfg.AllSpritesOnePatch || !cfg.SymbolsType.empty()) {
+            io.print("--jobs has no effect together with --onepatch or --symbols, sprites will be assembled serially\n");
+        } else {
+            g_jobs.set_jobs(cfg.Jobs);
+        }
+    }
+
+    if (cfg.Incremental) {
+        if (cfg.AllSpritesOnePatch) {
+            io.print("--incremental has no effect together with --onepatch, all sprites will be inserted\n");
+        } else {
+            g_incremental.begin(rom, hash_global_inputs(cfg, extraDefines, g_config_defines, VERSION_FULL));
+            g_incremental.plan(registry, rom);
+            g_incremental.plan_routines(g_deps, registry);
+            io.print("%zu sprites unchanged since the last insertion, keeping them in place\n",
+                     g_incremental.kept_count());
+        }
+    }
+
+    {
+        auto span = g_trace.scope("finish_prefetch", "patch");
+        g_memory_files.finish_prefetch();
+        span.arg("files", static_cast<long long>(g_memory_files.size()));
+    }
+
+    {
+        auto span = g_trace.scope("rats_index", "patch");
+        g_rats.build(rom);
+        span.arg("tags", static_cast<long long>(g_rats.tags().size()));
+    }
+
+    if (auto span = g_trace.scope("clean_hack", "patch"); !clean_hack(rom, cfg[PathType::Asm]))
         return EXIT_FAILURE;
 
-    if (!create_shared_patch(cfg[PathType::Routines], cfg))
+    if (auto span = g_trace.scope("create_shared_patch", "patch");
+        !create_shared_patch(cfg[PathType::Routines], cfg))
         return EXIT_FAILURE;
 
-    int normal_sprites_size = cfg.PerLevel ? MAX_SPRITE_COUNT : 0x100;
+    {
+        auto span = g_trace.scope("define_preludes", "patch");
+        std::vector<std::string> prelude_files{cfg.AsmDir + "sa1def.asm"};
+        prelude_files.insert(prelude_files.end(), extraDefines.begin(), extraDefines.end());
+        g_define_preludes.begin(g_config_defines, prelude_files);
+    }
 
     if (cfg.AllSpritesOnePatch) {
         {
-            PatchTimer sprites{cfg[PathType::Sprites]};
-            if (!patch_sprites_all_in_one(extraDefines, sprite_list, normal_sprites_size, rom, cfg[PathType::Sprites]))
+            auto span = g_trace.scope(cfg[PathType::Sprites], "sprites");
+            if (!patch_sprites_all_in_one(registry.sprites(ListType::Sprite), rom, cfg[PathType::Sprites]))
                 return EXIT_FAILURE;
         }
         for (const auto& [type, size] : sprite_sizes) {
             {
-                PatchTimer other{cfg[map_list_to_path[FromEnum(type)]]};
-                if (!patch_sprites_all_in_one(extraDefines, sprites_list_list[FromEnum(type)], static_cast<int>(size),
-                                              rom, cfg[map_list_to_path[FromEnum(type)]]))
+                auto span = g_trace.scope(cfg[map_list_to_path[FromEnum(type)]], "sprites");
+                if (!patch_sprites_all_in_one(registry.sprites(type), rom, cfg[map_list_to_path[FromEnum(type)]]))
                     return EXIT_FAILURE;
             }
         }
     } else {
         {
-            PatchTimer sprites{cfg[PathType::Sprites]};
-            if (!patch_sprites(extraDefines, sprite_list, normal_sprites_size, rom))
+            auto span = g_trace.scope(cfg[PathType::Sprites], "sprites");
+            if (!patch_sprites(registry.sprites(ListType::Sprite), rom))
                 return EXIT_FAILURE;
         }
         for (const auto& [type, size] : sprite_sizes) {
             {
-                PatchTimer other{cfg[map_list_to_path[FromEnum(type)]]};
-                if (!patch_sprites(extraDefines, sprites_list_list[FromEnum(type)], static_cast<int>(size), rom))
+                auto span = g_trace.scope(cfg[map_list_to_path[FromEnum(type)]], "sprites");
+                if (!patch_sprites(registry.sprites(type), rom))
                     return EXIT_FAILURE;
             }
         }
     }
 
+    if (g_jobs.enabled()) {
+        io.debug("%zu sprites committed from the workers, %zu had to be reassembled serially\n", g_jobs.committed(),
+                 g_jobs.rejected());
+    }
+
     if (!check_warnings())
         return EXIT_FAILURE;
 
@@ -2006,6 +2385,7 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
 #ifdef DEBUGMSG
     debug_print("Try create binary tables.\n");
 #endif
+    auto binfiles_span = g_trace.scope("binfiles", "lmdata");
     const auto& asm_path = cfg[PathType::Asm];
     std::vector<patchfile> binfiles{};
     binfiles.push_back(write_all(versionflag, asm_path, "_versionflag.bin", 4));
@@ -2025,28 +2405,27 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
                         PLS_DATA_ADDR, 0x400 + PLS_SPRITE_PTRS_ADDR + 2 * PLS_DATA_ADDR);
 #endif
         }
-        binfiles.push_back(write_long_table(sprite_list + 0x2000, asm_path, "_defaulttables.bin", 0x100));
-    } else {
-        binfiles.push_back(write_long_table(sprite_list, asm_path, "_defaulttables.bin", 0x100));
     }
-    unsigned char customstatusptrs[0x100 * 15]{};
-    for (int i = 0, j = cfg.PerLevel ? 0x2000 : 0; i < 0x100 * 5; i += 5, j++) {
-        memcpy(customstatusptrs + (i * 3), &sprite_list[j].ptrs, 15);
-    }
-    binfiles.push_back(write_all(customstatusptrs, asm_path, "_customstatusptr.bin", 0x100 * 15));
+    registry.publish_tables();
+    // the global sprites come after the per-level ones
+    const size_t global_slots = cfg.PerLevel ? 0x2000 : 0;
+    binfiles.push_back(write_long_table(registry.tables(ListType::Sprite).subspan(global_slots, 0x100), asm_path,
+                                        "_defaulttables.bin"));
+    binfiles.push_back(write_all(
+        reinterpret_cast<const unsigned char*>(registry.status_pointer_tables(ListType::Sprite).data() + global_slots),
+        asm_path, "_customstatusptr.bin", 0x100 * sizeof(status_pointers)));
 
-    binfiles.push_back(write_sprite_generic(cluster_list, "_clusterptr.bin"));
-    binfiles.push_back(write_sprite_generic(extended_list, "_extendedptr.bin"));
-    binfiles.push_back(write_sprite_generic(minor_extended_list, "_minorextendedptr.bin"));
-    binfiles.push_back(write_sprite_generic(smoke_list, "_smokeptr.bin"));
-    binfiles.push_back(write_sprite_generic(bounce_list, "_bounceptr.bin"));
-    binfiles.push_back(write_sprite_generic(spinningcoin_list, "_spinningcoinptr.bin"));
-    binfiles.push_back(write_sprite_generic(score_list, "_scoreptr.bin"));
+    binfiles.push_back(write_sprite_generic(registry.tables(ListType::Cluster), "_clusterptr.bin"));
+    binfiles.push_back(write_sprite_generic(registry.tables(ListType::Extended), "_extendedptr.bin"));
+    binfiles.push_back(write_sprite_generic(registry.tables(ListType::MinorExtended), "_minorextendedptr.bin"));
+    binfiles.push_back(write_sprite_generic(registry.tables(ListType::Smoke), "_smokeptr.bin"));
+    binfiles.push_back(write_sprite_generic(registry.tables(ListType::Bounce), "_bounceptr.bin"));
+    binfiles.push_back(write_sprite_generic(registry.tables(ListType::SpinningCoin), "_spinningcoinptr.bin"));
+    binfiles.push_back(write_sprite_generic(registry.tables(ListType::Score), "_scoreptr.bin"));
 
-    uint8_t file[SPRITE_COUNT * 3]{};
-    for (size_t i = 0; i < SPRITE_COUNT; i++)
-        memcpy(file + (i * 3), &extended_list[i].extended_cape_ptr, 3);
-    binfiles.push_back(write_all(file, asm_path, "_extendedcapeptr.bin", SPRITE_COUNT * 3));
+    const auto capes = registry.cape_pointers(ListType::Extended);
+    binfiles.push_back(write_all(reinterpret_cast<const unsigned char*>(capes.data()), asm_path,
+                                 "_extendedcapeptr.bin", static_cast<unsigned int>(capes.size_bytes())));
 
     // more?
 #ifdef DEBUGMSG
@@ -2114,7 +2493,8 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
         if (!cfg[ExtType::S16].empty())
             read_map16(map, cfg[ExtType::S16].c_str());
 
-        if (!generate_lm_data(sprite_list, map, extra_bytes, ssc, mwt, mw2, s16, cfg.PerLevel))
+        if (auto span = g_trace.scope("generate_lm_data", "lmdata");
+            !generate_lm_data(registry, map, extra_bytes, ssc, mwt, mw2, s16, cfg.PerLevel))
             return EXIT_FAILURE;
 
         binfiles.push_back(write_all(extra_bytes, asm_path, "_customsize.bin"));
@@ -2124,7 +2504,7 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
         fclose(mwt);
         fclose(mw2);
     } else {
-        if (!generate_lm_data_ex_bytes_only(sprite_list, extra_bytes, cfg.PerLevel))
+        if (!generate_lm_data_ex_bytes_only(registry, extra_bytes, cfg.PerLevel))
             return EXIT_FAILURE;
 
         binfiles.push_back(write_all(extra_bytes, asm_path, "_customsize.bin"));
@@ -2135,9 +2515,11 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
     std::array patch_names{"main.asm"sv,   "cluster.asm"sv, "extended.asm"sv,     "minorextended.asm"sv,
                            "bounce.asm"sv, "smoke.asm"sv,   "spinningcoin.asm"sv, "score.asm"sv};
     for (const auto& binfile : binfiles) {
-        g_memory_files.push_back(binfile.vfile());
+        g_memory_files.add(binfile.vfile());
     }
+    binfiles_span.end();
     for (auto& patch_name : patch_names) {
+        auto span = g_trace.scope(std::string{patch_name}, "core");
         if (!patch(asm_path, patch_name.data(), rom)) {
             return EXIT_FAILURE;
         }
@@ -2151,6 +2533,7 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
         io.debug("-------- ExtraHijacks prints --------\n", "");
     }
     for (std::string patchUri : extraHijacks) {
+        auto span = g_trace.scope(patchUri, "ExtraHijacks");
         if (!patch(patchUri.c_str(), rom))
             return EXIT_FAILURE;
         int count_extra_prints = 0;
@@ -2171,20 +2554,53 @@ PIXI_EXPORT int pixi_run(int argc, const char** argv, bool skip_first) {
 
     io.print("\nAll sprites applied successfully!\n");
 
-    if (!cfg.ExtModDisabled)
+    // with --emit-patch-only the ROM file isn't written, there's nothing for Lunar Magic to restore
+    if (!cfg.ExtModDisabled && !cfg.EmitPatchOnly)
         if (!create_lm_restore(rom.name.data()))
             return EXIT_FAILURE;
-    rom.close();
     int retval = 0;
     if (!cfg.DisableMeiMei) {
+        auto span = g_trace.scope("MeiMei", "meimei");
         meimei.configureSa1Def(cfg.AsmDirPath + "/sa1def.asm");
-        retval = meimei.run();
+        retval = meimei.run(rom);
+    }
+    if (retval == EXIT_SUCCESS && g_freespace.enabled()) {
+        auto span = g_trace.scope("map_freespace", "patch");
+        map_freespace(registry, rom, meimei.Written());
+    }
+    // if MeiMei failed the file is left as it was before the insertion, with --emit-patch-only it's never written
+    if (retval == EXIT_SUCCESS && !cfg.EmitPatchOnly)
+        rom.close();
+
+    if (retval == EXIT_SUCCESS && g_changes.enabled()) {
+        auto span = g_trace.scope("emit changes", "patch");
+        g_changes.record("MeiMei", meimei.Written());
+        g_changes.finish(rom);
+        if (!cfg.EmitPatchPath.empty()) {
+            if (!g_changes.write_patch(cfg.EmitPatchPath))
+                return EXIT_FAILURE;
+            io.print("Wrote %zu changed ranges to %s\n", g_changes.changes().size(), cfg.EmitPatchPath.c_str());
+        }
     }
 
+    if (retval == EXIT_SUCCESS && g_symbols.enabled() && !g_symbols.save(rom.name, cfg.SymbolsType))
+        return EXIT_FAILURE;
+    if (retval == EXIT_SUCCESS && g_freespace.enabled()) {
+        if (!g_freespace.write(cfg.FreespaceReportPath))
+            return EXIT_FAILURE;
+        io.print("Freespace: %s, map written to %s\n", g_freespace.summary().c_str(),
+                 cfg.FreespaceReportPath.c_str());
+    }
+    if (retval == EXIT_SUCCESS && !g_incremental.save())
+        return EXIT_FAILURE;
+    if (retval == EXIT_SUCCESS && g_incremental.enabled() && !g_deps.save(deps_path))
+        return EXIT_FAILURE;
+
     if (!check_warnings())
         return EXIT_FAILURE;
 
-    if (plugins::for_each_plugin(plugin_list, &plugins::plugin::after_patching) != EXIT_SUCCESS) {
+    if (auto span = g_trace.scope("after_patching", "plugin");
+        plugins::for_each_plugin(plugin_list, &plugins::plugin::after_patching) != EXIT_SUCCESS) {
         return EXIT_FAILURE;
     };
 
@@ -6,14 +6,55 @@
 #endif
 #include "file_io.h"
 #include "iohandler.h"
+#include <algorithm>
 #include <cctype>
+#include <cstdarg>
+#include <cstdio>
 #include <cstring>
 #include <filesystem>
 #include <iomanip>
 #include <sstream>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
 
 namespace fs = std::filesystem;
 
+namespace {
+
+constexpr size_t ROM_BANK_SIZE = 0x8000;
+
+// reserves the whole buffer asar may grow the ROM into, pages only get backed by memory once they're written to.
+// On Windows the whole range is committed up front, which only counts against the commit limit: committed pages
+// are zero-filled on first touch just like the ones mmap hands out, and asar can write anywhere in it.
+unsigned char* reserve_rom_buffer(size_t size) {
+#ifdef _WIN32
+    return static_cast<unsigned char*>(VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return mem == MAP_FAILED ? nullptr : static_cast<unsigned char*>(mem);
+#endif
+}
+
+void release_rom_buffer(unsigned char* data, size_t size) {
+    if (data == nullptr)
+        return;
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(data, 0, MEM_RELEASE);
+#else
+    munmap(data, size);
+#endif
+}
+
+} // namespace
+
 const char* BOOL_STR(bool b) {
     return b ? "true" : "false";
 }
@@ -22,21 +63,18 @@ bool patchfile::s_meimei_keep = false;
 bool patchfile::s_pixi_keep = false;
 
 patchfile::patchfile(const std::string& path, patchfile::openflags mode, origin origin)
-    : m_fs_path{path}, m_data_stream{static_cast<std::ios::openmode>(mode)}, m_from_meimei{origin == origin::meimei} {
-    m_vfile = std::make_unique<memoryfile>();
+    : m_fs_path{path}, m_from_meimei{origin == origin::meimei} {
     m_binary = (static_cast<std::ios::openmode>(mode) & std::ios::binary) != 0;
     std::transform(path.begin(), path.end(), std::back_inserter(m_path),
                    [](char c) { return static_cast<char>(std::tolower(c)); });
 }
 
 patchfile::patchfile(patchfile&& other) noexcept
-    : m_fs_path{std::move(other.m_fs_path)}, m_path{std::move(other.m_path)},
-      m_data_stream{std::move(other.m_data_stream)}, m_data{std::move(other.m_data)},
+    : m_fs_path{std::move(other.m_fs_path)}, m_path{std::move(other.m_path)}, m_buffer{std::move(other.m_buffer)},
+      m_size{std::exchange(other.m_size, 0)}, m_capacity{std::exchange(other.m_capacity, 0)},
       m_from_meimei{other.m_from_meimei}, m_binary{other.m_binary} {
-    m_vfile = std::move(other.m_vfile);
-    m_vfile->buffer = m_data.c_str();
-    m_vfile->length = m_data.size();
-    m_vfile->path = m_path.c_str();
+    // the moved from file must not write or remove anything when it's destroyed
+    other.m_path.clear();
 }
 
 void patchfile::set_keep(bool pixi, bool meimei) {
@@ -44,33 +82,45 @@ void patchfile::set_keep(bool pixi, bool meimei) {
     s_pixi_keep = pixi;
 }
 
+void patchfile::reserve(size_t extra) {
+    const size_t needed = m_size + extra + 1;
+    if (needed <= m_capacity)
+        return;
+    const size_t capacity = std::max({needed, m_capacity * 2, size_t{1024}});
+    auto buffer = std::make_unique<char[]>(capacity);
+    if (m_size != 0)
+        memcpy(buffer.get(), m_buffer.get(), m_size);
+    m_buffer = std::move(buffer);
+    m_capacity = capacity;
+}
+
 void patchfile::fprintf(_In_z_ _Printf_format_string_ const char* const format, ...) {
     va_list list{};
     va_list copy{};
     va_start(list, format);
     va_copy(copy, list);
-    size_t needed_space = std::vsnprintf(nullptr, 0, format, list);
-    std::string buf{};
-    buf.resize(needed_space);
-    std::vsnprintf(buf.data(), buf.size() + 1, format, copy);
+    // most writes fit in what's left of the buffer, only the ones that don't have to be formatted twice
+    const size_t available = m_capacity - m_size;
+    const int written = std::vsnprintf(m_buffer ? m_buffer.get() + m_size : nullptr, available, format, list);
+    if (written > 0) {
+        if (static_cast<size_t>(written) >= available) {
+            reserve(static_cast<size_t>(written));
+            std::vsnprintf(m_buffer.get() + m_size, static_cast<size_t>(written) + 1, format, copy);
+        }
+        m_size += static_cast<size_t>(written);
+    }
     va_end(list);
     va_end(copy);
-    m_data_stream << buf;
 }
 
 void patchfile::fwrite(const char* bindata, size_t size) {
-    m_data_stream.write(bindata, size);
+    reserve(size);
+    memcpy(m_buffer.get() + m_size, bindata, size);
+    m_size += size;
 }
 
 void patchfile::fwrite(const unsigned char* bindata, size_t size) {
-    m_data_stream.write(reinterpret_cast<const char*>(bindata), size);
-}
-
-void patchfile::close() {
-    m_data = m_data_stream.str();
-    m_vfile->buffer = m_data.c_str();
-    m_vfile->length = m_data.size();
-    m_vfile->path = m_path.c_str();
+    fwrite(reinterpret_cast<const char*>(bindata), size);
 }
 
 patchfile::~patchfile() {
@@ -80,7 +130,7 @@ patchfile::~patchfile() {
         FILE* fp = open(m_fs_path.c_str(), m_binary ? "wb" : "w");
         if (fp == nullptr)
             return;
-        ::fwrite(m_vfile->buffer, sizeof(char), m_vfile->length, fp);
+        ::fwrite(m_buffer.get(), sizeof(char), m_size, fp);
         fclose(fp);
     } else {
         fs::path filepath{m_fs_path};
@@ -91,9 +141,7 @@ patchfile::~patchfile() {
 }
 
 void patchfile::clear() {
-    m_data_stream.str("");
-    m_data.clear();
-    m_vfile.reset(new memoryfile);
+    m_size = 0;
 }
 
 bool ROM::open(std::string n) {
@@ -102,29 +150,69 @@ bool ROM::open(std::string n) {
 }
 
 void ROM::close() {
-    FILE* romfile = fopen(name.c_str(), "wb");
-    if (romfile == nullptr)
+    if (m_data == nullptr)
         return;
-    fwrite(m_data, sizeof(char), size + header_size, romfile);
-    fclose(romfile);
-    delete[] m_data;
-    m_data = nullptr; // assign to nullptr so that when the dtor is called and these already got freed the delete[] is a
-                      // no-op
+    const size_t total = static_cast<size_t>(size + header_size);
+    FILE* romfile = nullptr;
+    // a shrunk ROM needs the file truncated, so it can't be patched in place
+    if (total >= m_file_size)
+        romfile = fopen(name.c_str(), "r+b");
+    if (romfile != nullptr) {
+        write_changed_banks(romfile);
+        fclose(romfile);
+    } else if ((romfile = fopen(name.c_str(), "wb")) != nullptr) {
+        fwrite(m_data, sizeof(char), total, romfile);
+        fclose(romfile);
+    }
+    free_data();
+}
+
+void ROM::write_changed_banks(FILE* romfile) const {
+    // the file still holds the ROM as it was opened, each bank is compared against it instead of keeping a copy
+    std::vector<unsigned char> on_disk(ROM_BANK_SIZE);
+    const size_t total = static_cast<size_t>(size + header_size);
+    const size_t header = static_cast<size_t>(header_size);
+    for (size_t pc = 0; pc < total;) {
+        // the header, then 32KB banks
+        const size_t len = std::min(pc < header ? header - pc : ROM_BANK_SIZE, total - pc);
+        // everything past the original end of the file is new
+        bool changed = pc + len > m_file_size;
+        if (!changed) {
+            fseek(romfile, static_cast<long>(pc), SEEK_SET);
+            changed = fread(on_disk.data(), 1, len, romfile) != len || memcmp(on_disk.data(), m_data + pc, len) != 0;
+        }
+        if (changed) {
+            fseek(romfile, static_cast<long>(pc), SEEK_SET);
+            fwrite(m_data + pc, sizeof(char), len, romfile);
+        }
+        pc += len;
+    }
 }
 
 bool ROM::open() {
+    free_data();
     FILE* file = ::open(name.data(), "r+b"); // call global open
-    if (file == nullptr) {
-        m_data = nullptr;
+    if (file == nullptr)
         return false;
-    }
     size = static_cast<int>(file_size(file));
     header_size = size & 0x7FFF;
     size -= header_size;
-    m_data = read_all(name.data(), false, MAX_ROM_SIZE + header_size);
-    if (m_data == nullptr)
+    m_file_size = static_cast<size_t>(size + header_size);
+    m_capacity = MAX_ROM_SIZE + header_size;
+    m_data = reserve_rom_buffer(m_capacity);
+    if (m_data == nullptr) {
+        fclose(file);
+        free_data();
+        iohandler::get_global().error("Couldn't allocate memory for %s\n", name.c_str());
         return false;
+    }
+    const bool read = fread(m_data, 1, m_file_size, file) == m_file_size;
     fclose(file);
+    if (!read) {
+        iohandler::get_global().error("%s could not be fully read.  Please check file permissions.", name.c_str());
+        free_data();
+        return false;
+    }
     if (m_data[header_size + 0x7fd5] == 0x23) {
         if (m_data[header_size + 0x7fd7] == 0x0D) {
             mapper = MapperType::fullsa1rom;
@@ -233,30 +321,36 @@ bool ROM::is_exlevel() const {
     return get_lm_version() > LM_version_exlevel;
 }
 
-std::optional<uint16_t> ROM::get_rats_size(pcaddress pcaddr) const {
-    int addr = pcaddr.value;
-    constexpr std::string_view rats_tag = "STAR";
-    constexpr size_t rats_header_offset = rats_tag.size() + sizeof(uint16_t) + sizeof(uint16_t);
-    addr -= rats_header_offset;
-    if (memcmp(m_data + addr, rats_tag.data(), rats_tag.size()) != 0) // verify rats tag.
-        return std::nullopt;
-    addr += static_cast<int>(rats_tag.size());
-    // read a uint16_t in little endian from addr
-    uint16_t tag_size = m_data[addr] | (m_data[addr + 1] << 8);
-    uint16_t chksum = m_data[addr + 2] | (m_data[addr + 3] << 8);
-    if ((tag_size ^ 0xFFFF) != chksum) // verify checksum
-        return std::nullopt;
-    tag_size += 1;
-    return tag_size;
+void ROM::free_data() {
+    release_rom_buffer(m_data, m_capacity);
+    m_data = nullptr;
+    m_capacity = 0;
+    m_file_size = 0;
 }
 
 ROM::~ROM() {
-    delete[] m_data;
+    free_data();
+}
+
+std::vector<rom_range> asar_written_ranges(const ROM& rom) {
+    int block_count = 0;
+    const writtenblockdata* blocks = asar_getwrittenblocks(&block_count);
+    std::vector<rom_range> ranges{};
+    ranges.reserve(block_count);
+    for (int i = 0; i < block_count; i++) {
+        ranges.push_back({blocks[i].pcoffset + rom.header_size, blocks[i].numbytes});
+    }
+    return ranges;
 }
 
-bool is_empty_table(std::span<sprite> sprites) {
-    for (const auto& sprite : sprites) {
-        if (sprite.has_empty_table())
+bool is_header_checksum(const rom_range& range, const ROM& rom) {
+    const int checksum = rom.snes_to_pc(0x00FFDC).raw_value();
+    return range.pc >= checksum && range.pc + range.size <= checksum + 4;
+}
+
+bool is_empty_table(std::span<const sprite_table> tables) {
+    for (const auto& table : tables) {
+        if (table.init.is_empty() && table.main.is_empty())
             return false;
     }
     return true;
@@ -321,6 +415,17 @@ void sprite::print() {
     }
 }
 constexpr pointer DEFAULT_PTR = pointer{(RTL_BANK << 16) | (RTL_HIGH << 8) | (RTL_LOW)};
+void sprite::copy_parsed(const sprite& parsed) {
+    table = parsed.table;
+    byte_count = parsed.byte_count;
+    extra_byte_count = parsed.extra_byte_count;
+    asm_file = parsed.asm_file;
+    map_data = parsed.map_data;
+    disp_type = parsed.disp_type;
+    displays = parsed.displays;
+    collections = parsed.collections;
+}
+
 void sprite::clear() {
     line = 0;
     number = 0;
@@ -354,6 +459,8 @@ void sprite::clear() {
 
     collections.clear();
 
+    displays_in_lm = false;
+
     sprite_type = ListType::Sprite;
 }
 
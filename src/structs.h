@@ -7,6 +7,8 @@
 #include "asar/asar.h"
 #endif
 #include "config.h"
+#include "intern.h"
+#include <cstdio>
 #include <cstring>
 #include <memory>
 #include <optional>
@@ -36,15 +38,20 @@ constexpr size_t MINOR_SPRITE_COUNT = 0x1F;
 class patchfile {
     std::string m_fs_path{};
     std::string m_path{};
-    std::stringstream m_data_stream{};
-    std::string m_data{};
-    std::unique_ptr<memoryfile> m_vfile;
+    // everything written so far, formatted straight into the buffer. It only moves when it has to grow, so the views
+    // vfile() hands out stay valid while the patchfile itself gets moved around, until it's written to again.
+    std::unique_ptr<char[]> m_buffer{};
+    size_t m_size = 0;
+    size_t m_capacity = 0;
     bool m_from_meimei = false;
     bool m_binary = false;
 
     static bool s_meimei_keep;
     static bool s_pixi_keep;
 
+    // makes room for at least `extra` more bytes (and a terminator), doubling the buffer
+    void reserve(size_t extra);
+
     enum class placeholder {};
 
     constexpr static bool om_en = std::is_enum_v<std::ios::openmode>;
@@ -68,13 +75,16 @@ class patchfile {
     const auto& path() const {
         return m_path;
     }
-    const memoryfile& vfile() const {
-        return *m_vfile;
+    memoryfile vfile() const {
+        return memoryfile{.path = m_path.c_str(), .buffer = m_buffer ? m_buffer.get() : "", .length = m_size};
     }
     void fprintf(_In_z_ _Printf_format_string_ const char* const format, ...);
     void fwrite(const char* bindata, size_t size);
     void fwrite(const unsigned char* bindata, size_t size);
-    void close();
+    // the contents are visible through vfile() as soon as they're written, closing just marks the end of the file
+    void close() {
+    }
+    // keeps the buffer around for the next contents
     void clear();
     ~patchfile();
 };
@@ -288,9 +298,9 @@ struct sprite {
     uint8_t byte_count = 0;
     uint8_t extra_byte_count = 0;
 
-    std::string directory{};
-    std::string asm_file{};
-    std::string cfg_file{};
+    interned_string directory{};
+    interned_string asm_file{};
+    interned_string cfg_file{};
     std::vector<map16> map_data{};
 
     display_type disp_type = display_type::XYPosition;
@@ -302,6 +312,8 @@ struct sprite {
 
     ListType sprite_type = ListType::Sprite;
     bool has_empty_table() const;
+    // copies everything read_cfg_file/read_json_file fill in from a sprite that was parsed from the same file
+    void copy_parsed(const sprite& parsed);
     void clear();
     void print();
 };
@@ -323,12 +335,28 @@ class romdata {
     const unsigned char* operator+(snesaddress index) const;
 };
 
+// a range of bytes in the ROM, pc is headered (the same as pcaddress)
+struct rom_range {
+    int pc = 0;
+    int size = 0;
+    constexpr bool overlaps(const rom_range& other) const {
+        return pc < other.pc + other.size && other.pc < pc + size;
+    }
+};
+
 struct ROM {
     friend romdata;
     inline static const int sa1banks[8] = {0 << 20, 1 << 20, -1, -1, 2 << 20, 3 << 20, -1, -1};
 
   private:
+    // MAX_ROM_SIZE + header_size bytes, the pages past the end of the file only get backed once asar writes there
     unsigned char* m_data = nullptr;
+    size_t m_capacity = 0;
+    // size of the file when it was opened, headered
+    size_t m_file_size = 0;
+    void free_data();
+    // writes the banks that differ from what's in the file
+    void write_changed_banks(FILE* romfile) const;
 
   public:
     romdata data{*this};
@@ -342,6 +370,7 @@ struct ROM {
 
     [[nodiscard]] bool open(std::string n);
     [[nodiscard]] bool open();
+    // writes the 32KB banks that changed since the file was opened back to it
     void close();
 
     snesaddress pc_to_snes(pcaddress address) const;
@@ -354,7 +383,6 @@ struct ROM {
     void read_data(unsigned char* dst, size_t size, pcaddress addr) const;
     int get_lm_version() const;
     bool is_exlevel() const;
-    std::optional<uint16_t> get_rats_size(pcaddress addr) const;
     template <typename T> T read_struct(pcaddress addr = 0) const {
         T t{};
         memcpy(&t, data + addr, sizeof(T));
@@ -363,8 +391,10 @@ struct ROM {
     ~ROM();
 };
 
-bool is_empty_table(std::span<sprite> sprites);
-[[nodiscard]] bool populate_sprite_list(const Paths& paths,
-                                        const std::array<sprite*, FromEnum(ListType::__SIZE__)>& sprite_lists,
-                                        std::string_view listPath, const ROM* rom);
+// ranges written by the last asar call that was made on this ROM
+std::vector<rom_range> asar_written_ranges(const ROM& rom);
+// asar rewrites the internal header checksum on every patch, so a range within it doesn't belong to any insertion
+bool is_header_checksum(const rom_range& range, const ROM& rom);
+
+bool is_empty_table(std::span<const sprite_table> tables);
 #endif
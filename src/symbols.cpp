@@ -0,0 +1,150 @@
+#include "symbols.h"
+#include "iohandler.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+constexpr char SYMBOL_INDEX_MAGIC[4]{'P', 'X', 'S', 'Y'};
+constexpr uint32_t SYMBOL_INDEX_VERSION = 1;
+
+std::string symbol_namespace(std::string_view asm_file) {
+    const fs::path path{asm_file};
+    std::string name = path.parent_path().filename().generic_string();
+    if (!name.empty())
+        name += '_';
+    name += path.stem().generic_string();
+    std::replace_if(
+        name.begin(), name.end(), [](char c) { return !std::isalnum(static_cast<unsigned char>(c)) && c != '_'; },
+        '_');
+    return name;
+}
+
+void SymbolDatabase::reset() {
+    m_enabled = false;
+    m_symbols.clear();
+    m_index.clear();
+    m_routines.clear();
+    m_conflicts = 0;
+}
+
+void SymbolDatabase::set_routines(std::span<const std::string> routines) {
+    m_routines.clear();
+    m_routines.insert(routines.begin(), routines.end());
+}
+
+// a routine's labels are its own name and the ones in its namespace, e.g. GetDrawInfo and GetDrawInfo_loop
+bool SymbolDatabase::is_routine_label(std::string_view label) const {
+    if (m_routines.empty())
+        return false;
+    for (size_t end = label.find('_'); end != std::string_view::npos; end = label.find('_', end + 1)) {
+        if (m_routines.contains(std::string{label.substr(0, end)}))
+            return true;
+    }
+    return m_routines.contains(std::string{label});
+}
+
+void SymbolDatabase::add(std::span<const labeldata> labels, std::string_view ns,
+                         std::span<const sprite_namespace> sprites) {
+    using namespace std::string_view_literals;
+    constexpr auto entry_prefix = "SPRITE_ENTRY_"sv;
+    for (const labeldata& label : labels) {
+        std::string_view name{label.name};
+        // +/- labels only have a meaning inside the file that defines them
+        if (name.empty() || name.front() == ':')
+            continue;
+        std::string full_name{};
+        if (name.starts_with(entry_prefix)) {
+            int number = -1;
+            const char* begin = name.data() + entry_prefix.size();
+            auto [end, ec] = std::from_chars(begin, name.data() + name.size(), number);
+            auto spr = std::find_if(sprites.begin(), sprites.end(),
+                                    [&](const sprite_namespace& s) { return s.number == number; });
+            if (ec == std::errc{} && spr != sprites.end() && (end == name.data() + name.size() || *end == '_'))
+                full_name = spr->name + std::string{end, name.data() + name.size()};
+        }
+        if (full_name.empty()) {
+            if (ns.empty() || is_routine_label(name))
+                full_name = name;
+            else
+                full_name = std::string{ns} + '_' + std::string{name};
+        }
+        const auto address = static_cast<uint32_t>(label.location);
+        auto [it, added] = m_index.try_emplace(full_name, m_symbols.size());
+        if (added)
+            m_symbols.push_back({std::move(full_name), address});
+        else if (m_symbols[it->second].address != address)
+            m_conflicts++;
+    }
+}
+
+std::vector<SymbolDatabase::symbol> SymbolDatabase::sorted() const {
+    std::vector<symbol> symbols = m_symbols;
+    std::sort(symbols.begin(), symbols.end(), [](const symbol& a, const symbol& b) {
+        return a.address != b.address ? a.address < b.address : a.name < b.name;
+    });
+    return symbols;
+}
+
+static void put_u32(std::vector<unsigned char>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        out.push_back(static_cast<unsigned char>(value >> (i * 8)));
+}
+
+bool SymbolDatabase::save(const std::string& rom_path, const std::string& type) const {
+    iohandler& io = iohandler::get_global();
+    if (m_conflicts != 0)
+        io.debug("%zu labels were defined with different addresses by different patches, only the first one was "
+                 "kept\n",
+                 m_conflicts);
+    const std::vector<symbol> symbols = sorted();
+
+    std::string text{};
+    if (type == "wla") {
+        text += "; wla symbolic information file\n; generated by pixi\n\n[labels]\n";
+        for (const symbol& sym : symbols) {
+            char line[16];
+            std::snprintf(line, sizeof(line), "%02X:%04X ", (sym.address >> 16) & 0xFF, sym.address & 0xFFFF);
+            text.append(line).append(sym.name).push_back('\n');
+        }
+    } else {
+        text += ";no$sns symbolic information file\n;generated by pixi\n\n";
+        for (const symbol& sym : symbols) {
+            char line[16];
+            std::snprintf(line, sizeof(line), "%08X ", sym.address);
+            text.append(line).append(sym.name).push_back('\n');
+        }
+    }
+
+    std::vector<unsigned char> index{};
+    std::string strings{};
+    index.insert(index.end(), std::begin(SYMBOL_INDEX_MAGIC), std::end(SYMBOL_INDEX_MAGIC));
+    put_u32(index, SYMBOL_INDEX_VERSION);
+    put_u32(index, static_cast<uint32_t>(symbols.size()));
+    size_t strings_size = 0;
+    for (const symbol& sym : symbols)
+        strings_size += sym.name.size() + 1;
+    put_u32(index, static_cast<uint32_t>(strings_size));
+    for (const symbol& sym : symbols) {
+        put_u32(index, sym.address);
+        put_u32(index, static_cast<uint32_t>(strings.size()));
+        strings.append(sym.name).push_back('\0');
+    }
+    index.insert(index.end(), strings.begin(), strings.end());
+
+    auto write = [&](const std::string& path, const void* data, size_t size, const char* mode) {
+        FILE* file = fopen(path.c_str(), mode);
+        const bool ok = file != nullptr && fwrite(data, 1, size, file) == size;
+        if (file != nullptr)
+            fclose(file);
+        if (!ok)
+            io.error("Couldn't write symbols file %s\n", path.c_str());
+        return ok;
+    };
+    const std::string sym_path = fs::path{rom_path}.replace_extension(".sym").generic_string();
+    const std::string index_path = fs::path{rom_path}.replace_extension(".pixisym").generic_string();
+    return write(sym_path, text.data(), text.size(), "w") && write(index_path, index.data(), index.size(), "wb");
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "structs.h"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+    The labels of every asar call of a run (--symbols), merged into a single symbols file written once at the end.
+
+    Every sprite's labels go into a namespace named after its folder and asm file, e.g. sprites_shell_main, no
+    matter whether it was assembled alone or with --onepatch. The labels of the shared routines are kept as they
+    are since every sprite using them sees the same ones, and the core patches get a namespace each like sprites.
+
+    Next to <romname>.sym (wla or nocash) a binary index sorted by address is written as <romname>.pixisym,
+    for tools that need to look up the label of an address:
+        "PXSY", u32 version, u32 symbol count, u32 string table size
+        symbol count * { u32 snes address, u32 offset of the name in the string table }
+        string table, every name null terminated
+    all little endian, symbols with the same address are sorted by name.
+*/
+class SymbolDatabase {
+  public:
+    struct symbol {
+        std::string name{};
+        uint32_t address = 0;
+    };
+    // a sprite assembled by the asar call and the namespace its labels go into
+    struct sprite_namespace {
+        int number = 0;
+        std::string name{};
+    };
+
+  private:
+    bool m_enabled = false;
+    std::vector<symbol> m_symbols{};
+    std::unordered_map<std::string, size_t> m_index{};
+    std::unordered_set<std::string> m_routines{};
+    size_t m_conflicts = 0;
+
+    bool is_routine_label(std::string_view label) const;
+
+  public:
+    void reset();
+    void enable() {
+        m_enabled = true;
+    }
+    bool enabled() const {
+        return m_enabled;
+    }
+    void set_routines(std::span<const std::string> routines);
+    // Adds the labels of one asar call. Labels in a sprite's SPRITE_ENTRY_<number> namespace go into that sprite's
+    // namespace, the shared routines' labels are kept as they are and everything else goes into `ns`.
+    // A label that already exists with another address is dropped.
+    void add(std::span<const labeldata> labels, std::string_view ns, std::span<const sprite_namespace> sprites = {});
+    // sorted by address, then name
+    std::vector<symbol> sorted() const;
+    [[nodiscard]] bool save(const std::string& rom_path, const std::string& type) const;
+};
+
+// namespace for the labels of an asm file, its folder's and its own name, e.g. sprites/shell.asm -> sprites_shell
+std::string symbol_namespace(std::string_view asm_file);
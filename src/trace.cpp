@@ -0,0 +1,78 @@
+#include "trace.h"
+#include "iohandler.h"
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+Tracer::span::span(Tracer* tracer, std::string name, const char* category) : m_tracer{tracer} {
+    if (m_tracer == nullptr)
+        return;
+    m_event.name = std::move(name);
+    m_event.category = category;
+    m_event.start = clock::now();
+}
+
+Tracer::span::span(span&& other) noexcept : m_tracer{std::exchange(other.m_tracer, nullptr)} {
+    m_event = std::move(other.m_event);
+}
+
+Tracer::span& Tracer::span::arg(const char* key, arg_value value) {
+    if (m_tracer != nullptr)
+        m_event.args.emplace_back(key, std::move(value));
+    return *this;
+}
+
+void Tracer::span::end() {
+    if (m_tracer == nullptr)
+        return;
+    m_event.duration = clock::now() - m_event.start;
+    m_tracer->m_events.push_back(std::move(m_event));
+    m_tracer = nullptr;
+}
+
+void Tracer::reset() {
+    m_enabled = false;
+    m_origin = clock::now();
+    m_events.clear();
+}
+
+void Tracer::complete(std::string name, const char* category, clock::time_point start, clock::time_point end,
+                      std::vector<std::pair<const char*, arg_value>> args, int thread) {
+    if (!m_enabled)
+        return;
+    m_events.push_back(event{.name = std::move(name),
+                             .category = category,
+                             .start = start,
+                             .duration = end - start,
+                             .args = std::move(args),
+                             .thread = thread});
+}
+
+bool Tracer::write(const std::string& path) const {
+    using us = std::chrono::duration<double, std::micro>;
+    json events = json::array();
+    for (const event& e : m_events) {
+        json args = json::object();
+        for (const auto& [key, value] : e.args) {
+            std::visit([&](const auto& v) { args[key] = v; }, value);
+        }
+        events.push_back({{"name", e.name},
+                          {"cat", e.category},
+                          {"ph", "X"},
+                          {"ts", us{e.start - m_origin}.count()},
+                          {"dur", us{e.duration}.count()},
+                          {"pid", 1},
+                          {"tid", e.thread},
+                          {"args", std::move(args)}});
+    }
+    std::ofstream file{path, std::ios::trunc};
+    if (!file) {
+        iohandler::get_global().error("Couldn't write trace file %s\n", path.c_str());
+        return false;
+    }
+    json j{{"traceEvents", std::move(events)}, {"displayTimeUnit", "ms"}};
+    // file names aren't guaranteed to be valid UTF-8
+    file << j.dump(-1, ' ', false, json::error_handler_t::replace);
+    return true;
+}
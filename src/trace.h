@@ -0,0 +1,74 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+/**
+    Collects timed spans of a run and writes them out in Chrome's trace event format (--trace <file>),
+    the result can be opened in chrome://tracing or https://ui.perfetto.dev.
+
+    Spans are only recorded once tracing is enabled, the rest of the time they cost a clock read at most.
+*/
+class Tracer {
+  public:
+    using clock = std::chrono::steady_clock;
+    using arg_value = std::variant<long long, std::string>;
+
+    struct event {
+        std::string name{};
+        const char* category = "";
+        clock::time_point start{};
+        clock::duration duration{};
+        std::vector<std::pair<const char*, arg_value>> args{};
+        // spans from worker threads get their own lane, 1 is the main thread
+        int thread = 1;
+    };
+
+    // records an event covering its own lifetime, or until end() is called
+    class span {
+        Tracer* m_tracer = nullptr;
+        event m_event{};
+
+      public:
+        span(Tracer* tracer, std::string name, const char* category);
+        span(const span&) = delete;
+        span& operator=(const span&) = delete;
+        span(span&& other) noexcept;
+        span& operator=(span&& other) = delete;
+        ~span() {
+            end();
+        }
+        bool active() const {
+            return m_tracer != nullptr;
+        }
+        span& arg(const char* key, arg_value value);
+        void end();
+    };
+
+  private:
+    bool m_enabled = false;
+    clock::time_point m_origin{};
+    std::vector<event> m_events{};
+
+  public:
+    // starts a new trace, disabled until enable() is called
+    void reset();
+    void enable() {
+        m_enabled = true;
+    }
+    bool enabled() const {
+        return m_enabled;
+    }
+    clock::time_point origin() const {
+        return m_origin;
+    }
+    [[nodiscard]] span scope(std::string name, const char* category) {
+        return span{m_enabled ? this : nullptr, std::move(name), category};
+    }
+    // records a span that happened before tracing was enabled, or on another thread
+    void complete(std::string name, const char* category, clock::time_point start, clock::time_point end,
+                  std::vector<std::pair<const char*, arg_value>> args = {}, int thread = 1);
+    [[nodiscard]] bool write(const std::string& path) const;
+};
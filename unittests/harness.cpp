@@ -1,5 +1,14 @@
+#include "defines.h"
+#include "deps.h"
+#include "freespace.h"
+#include "json/base64.h"
+#include "metacache.h"
 #include "pixi_api.h"
+#include "rats.h"
+#include "registry.h"
+#include "symbols.h"
 #include <array>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <gtest/gtest.h>
@@ -28,6 +37,15 @@ namespace fs = std::filesystem;
 
 #define MAKE_LIB_NAME(x) DYLIB_PRE #x DYLIB_EXT
 
+#ifndef _WIN32
+#include <cstring>
+#include <future>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#endif
+
 #if defined(_WIN32) && defined(_MSC_VER)
 // clang-format off
 #define _CRTDBG_MAP_ALLOC
@@ -126,6 +144,431 @@ TEST(PixiUnitTests, ListParsing) {
     pixi_list_result_free(sprites);
 }
 
+TEST(PixiUnitTests, ListParsingReportsEveryError) {
+    WinCheckMemLeak leakchecker{};
+    // lines 2 and 4 are malformed, line 5 is fine, line 6 has an unknown extension
+    std::string_view list_contents{"00 test.json\nzz test.cfg ; comment\n\n01\n02 test.cfg\n03 test.txt\n"};
+    {
+        std::ofstream list_file{"list_errors.txt", std::ios::trunc};
+        list_file << list_contents;
+    }
+    pixi_list_result_t sprites = pixi_parse_list_file("list_errors.txt", false);
+    EXPECT_NE(sprites, nullptr);
+    EXPECT_FALSE(pixi_list_result_success(sprites));
+    int size = 0;
+    std::string_view error{pixi_last_error(&size)};
+    EXPECT_NE(error.find("List line 2 was malformed"), std::string_view::npos);
+    EXPECT_NE(error.find("line 4: missing extension"), std::string_view::npos);
+    EXPECT_NE(error.find("line 6: Unknown filetype txt"), std::string_view::npos);
+    EXPECT_EQ(error.find("line 5"), std::string_view::npos);
+    pixi_list_result_free(sprites);
+}
+
+TEST(PixiUnitTests, ListParsingSharesParsedFiles) {
+    WinCheckMemLeak leakchecker{};
+    try {
+        copy_file_wrap("test.json", "sprites/test.json");
+        copy_file_wrap("test.asm", "sprites/test.asm");
+        copy_file_wrap("test.cfg", "sprites/test.cfg");
+    } catch (const fs::filesystem_error& error) {
+        std::cout << "Error happened while copying the files: " << error.what() << '\n';
+        EXPECT_FALSE(true);
+        return;
+    }
+    {
+        std::ofstream list_file{"list_shared.txt", std::ios::trunc};
+        list_file << "00 test.cfg\n01 test.json\n02 test.cfg\n03 test.json\n";
+    }
+    pixi_list_result_t sprites = pixi_parse_list_file("list_shared.txt", false);
+    EXPECT_NE(sprites, nullptr);
+    EXPECT_TRUE(pixi_list_result_success(sprites));
+    int count = 0;
+    pixi_sprite_array arr = pixi_list_result_sprite_array(sprites, pixi_sprite_normal, &count);
+    EXPECT_EQ(count, 4);
+    for (int i = 2; i < count; i++) {
+        pixi_sprite_t first = arr[i - 2];
+        pixi_sprite_t again = arr[i];
+        EXPECT_EQ(pixi_sprite_line(again), i + 1);
+        EXPECT_EQ(pixi_sprite_number(again), i);
+        int size = 0;
+        EXPECT_STREQ(pixi_sprite_asm_file(again, &size), pixi_sprite_asm_file(first, &size));
+        EXPECT_EQ(pixi_sprite_byte_count(again), pixi_sprite_byte_count(first));
+        EXPECT_EQ(pixi_sprite_extra_byte_count(again), pixi_sprite_extra_byte_count(first));
+        int displays_first = 0;
+        int displays_again = 0;
+        pixi_display_array first_displays = pixi_sprite_displays(first, &displays_first);
+        pixi_display_array again_displays = pixi_sprite_displays(again, &displays_again);
+        EXPECT_EQ(displays_again, displays_first);
+        pixi_free_display_array(first_displays);
+        pixi_free_display_array(again_displays);
+    }
+    pixi_list_result_free(sprites);
+
+    // every file that can't be parsed is reported, in list order
+    {
+        std::ofstream list_file{"list_shared.txt", std::ios::trunc};
+        list_file << "00 test.cfg\n01 missing.cfg\n02 missing.json\n03 missing.cfg\n";
+    }
+    // the last error accumulates until the next run, only what this parse added is checked
+    int size = 0;
+    pixi_last_error(&size);
+    const size_t error_before = static_cast<size_t>(size);
+    sprites = pixi_parse_list_file("list_shared.txt", false);
+    EXPECT_NE(sprites, nullptr);
+    EXPECT_FALSE(pixi_list_result_success(sprites));
+    std::string_view error{pixi_last_error(&size)};
+    error.remove_prefix(std::min(error_before, error.size()));
+    const size_t cfg_error = error.find("line 2: Cannot parse CFG file sprites/missing.cfg");
+    const size_t json_error = error.find("line 3: Cannot parse JSON file sprites/missing.json");
+    EXPECT_NE(cfg_error, std::string_view::npos);
+    EXPECT_NE(json_error, std::string_view::npos);
+    EXPECT_LT(cfg_error, json_error);
+    EXPECT_EQ(error.find("line 4"), std::string_view::npos);
+    pixi_list_result_free(sprites);
+}
+
+TEST(PixiUnitTests, ListParsingSlots) {
+    WinCheckMemLeak leakchecker{};
+    try {
+        copy_file_wrap("test.json", "sprites/test.json");
+        copy_file_wrap("test.asm", "sprites/test.asm");
+        copy_file_wrap("test.cfg", "sprites/test.cfg");
+    } catch (const fs::filesystem_error& error) {
+        std::cout << "Error happened while copying the files: " << error.what() << '\n';
+        EXPECT_FALSE(true);
+        return;
+    }
+    {
+        std::ofstream list_file{"list_slots.txt", std::ios::trunc};
+        list_file << "01 test.cfg\n1FF:B0 test.json\n00 test.json\nCLUSTER:\n05 test.asm\n";
+    }
+    pixi_list_result_t sprites = pixi_parse_list_file("list_slots.txt", true);
+    EXPECT_NE(sprites, nullptr);
+    EXPECT_TRUE(pixi_list_result_success(sprites));
+    // sprites come back in slot order, the per-level ones before the global ones
+    int count = 0;
+    pixi_sprite_array arr = pixi_list_result_sprite_array(sprites, pixi_sprite_normal, &count);
+    ASSERT_EQ(count, 3);
+    EXPECT_EQ(pixi_sprite_level(arr[0]), 0x1FF);
+    EXPECT_EQ(pixi_sprite_number(arr[0]), 0xB0);
+    EXPECT_EQ(pixi_sprite_number(arr[1]), 0);
+    EXPECT_EQ(pixi_sprite_number(arr[2]), 1);
+    int size = 0;
+    EXPECT_STREQ(pixi_sprite_directory(arr[2], &size), "sprites/");
+    arr = pixi_list_result_sprite_array(sprites, pixi_sprite_cluster, &count);
+    ASSERT_EQ(count, 1);
+    EXPECT_EQ(pixi_sprite_number(arr[0]), 5);
+    EXPECT_STREQ(pixi_sprite_asm_file(arr[0], &size), "cluster/test.asm");
+    pixi_list_result_sprite_array(sprites, pixi_sprite_extended, &count);
+    EXPECT_EQ(count, 0);
+    pixi_list_result_free(sprites);
+
+    {
+        std::ofstream list_file{"list_slots.txt", std::ios::trunc};
+        list_file << "00 test.cfg\n00 test.json\n";
+    }
+    sprites = pixi_parse_list_file("list_slots.txt", false);
+    EXPECT_FALSE(pixi_list_result_success(sprites));
+    EXPECT_NE(std::string_view{pixi_last_error(&size)}.find("line 2: Sprite number 0 already used"),
+              std::string_view::npos);
+    pixi_list_result_free(sprites);
+
+    // cluster sprites go from 00 to 7F
+    {
+        std::ofstream list_file{"list_slots.txt", std::ios::trunc};
+        list_file << "CLUSTER:\n80 test.asm\n";
+    }
+    sprites = pixi_parse_list_file("list_slots.txt", false);
+    EXPECT_FALSE(pixi_list_result_success(sprites));
+    EXPECT_NE(std::string_view{pixi_last_error(&size)}.find("line 2: Sprite number must be less than 80"),
+              std::string_view::npos);
+    pixi_list_result_free(sprites);
+}
+
+TEST(PixiUnitTests, AsmFileIndexSpellings) {
+    // sprites using the same asm file through different spellings of its path are only assembled once
+    sprite plain{};
+    sprite dotted{};
+    sprite other{};
+    plain.asm_file = "a.asm";
+    dotted.asm_file = "./a.asm";
+    other.asm_file = "b.asm";
+    asm_file_index index{};
+    EXPECT_EQ(index.find_or_add(&plain), nullptr);
+    EXPECT_EQ(index.find_or_add(&dotted), &plain);
+    EXPECT_EQ(index.find_or_add(&other), nullptr);
+    EXPECT_EQ(index.canonical(dotted.asm_file).str(), index.canonical(plain.asm_file).str());
+}
+
+TEST(PixiUnitTests, InternPoolCollect) {
+    // strings stay in the pool while a handle refers to them, collect() drops the rest
+    interned_string::collect();
+    const size_t before = interned_string::pool_size();
+    interned_string kept{"InternPoolCollect/kept.asm"};
+    const char* kept_str = kept.c_str();
+    {
+        interned_string dropped{"InternPoolCollect/dropped.asm"};
+        interned_string copy = dropped;
+        EXPECT_EQ(copy, dropped);
+        EXPECT_EQ(interned_string::pool_size(), before + 2);
+    }
+    EXPECT_EQ(interned_string::collect(), 1u);
+    EXPECT_EQ(interned_string::pool_size(), before + 1);
+    EXPECT_EQ(interned_string{"InternPoolCollect/kept.asm"}.c_str(), kept_str);
+    kept.clear();
+    EXPECT_EQ(interned_string::collect(), 1u);
+    EXPECT_EQ(interned_string::pool_size(), before);
+}
+
+TEST(PixiUnitTests, MetadataCacheReuse) {
+    const fs::path dir = fs::temp_directory_path() / "pixi_metacache_test";
+    fs::create_directories(dir);
+    const std::string cfg_path = (dir / "cached.cfg").generic_string();
+    const std::string list_path = (dir / "list.txt").generic_string();
+    const fs::path cache_path = dir / "list.pixicache";
+    fs::remove(cache_path);
+    auto write_cfg = [&](std::string_view contents, int hours_later) {
+        {
+            std::ofstream cfg{cfg_path, std::ios::binary | std::ios::trunc};
+            cfg << contents;
+        }
+        fs::last_write_time(cfg_path, fs::file_time_type::clock::now() + std::chrono::hours{hours_later});
+    };
+    // a fresh cache for every "run", like pixi_reset does
+    auto run = [&](sprite& spr, std::vector<std::string>& warnings) {
+        MetadataCache cache{};
+        cache.begin(list_path);
+        const bool hit = cache.restore(&spr, warnings);
+        if (!hit) {
+            spr.asm_file = "cached.asm";
+            spr.byte_count = 3;
+            cache.store(&spr, std::array{std::string{"a warning"}});
+        }
+        cache.save();
+        return hit;
+    };
+
+    write_cfg("first contents\n", 0);
+    {
+        sprite spr{};
+        spr.cfg_file = cfg_path;
+        std::vector<std::string> warnings{};
+        EXPECT_FALSE(run(spr, warnings));
+        EXPECT_TRUE(fs::exists(cache_path));
+    }
+    // nothing changed
+    {
+        sprite spr{};
+        spr.cfg_file = cfg_path;
+        std::vector<std::string> warnings{};
+        EXPECT_TRUE(run(spr, warnings));
+        EXPECT_EQ(spr.asm_file, "cached.asm"sv);
+        EXPECT_EQ(spr.byte_count, 3);
+        EXPECT_EQ(warnings, std::vector<std::string>{"a warning"});
+    }
+    // touched but the contents are the same, served after comparing the hash
+    write_cfg("first contents\n", 1);
+    {
+        sprite spr{};
+        spr.cfg_file = cfg_path;
+        std::vector<std::string> warnings{};
+        EXPECT_TRUE(run(spr, warnings));
+        EXPECT_EQ(spr.asm_file, "cached.asm"sv);
+    }
+    // same size, different contents
+    write_cfg("other contents\n", 2);
+    {
+        sprite spr{};
+        spr.cfg_file = cfg_path;
+        std::vector<std::string> warnings{};
+        EXPECT_FALSE(run(spr, warnings));
+        EXPECT_TRUE(warnings.empty());
+    }
+    // a truncated cache and one with a bogus entry count are ignored
+    const auto cache_size = fs::file_size(cache_path);
+    fs::resize_file(cache_path, cache_size / 2);
+    {
+        sprite spr{};
+        spr.cfg_file = cfg_path;
+        std::vector<std::string> warnings{};
+        EXPECT_FALSE(run(spr, warnings));
+    }
+    EXPECT_EQ(fs::file_size(cache_path), cache_size);
+    {
+        std::fstream cache{cache_path, std::ios::binary | std::ios::in | std::ios::out};
+        // right after the magic and the version
+        cache.seekp(12);
+        cache.write("\xFF\xFF\xFF\xFF", 4);
+    }
+    {
+        sprite spr{};
+        spr.cfg_file = cfg_path;
+        std::vector<std::string> warnings{};
+        EXPECT_FALSE(run(spr, warnings));
+    }
+    fs::remove_all(dir);
+}
+
+TEST(PixiUnitTests, AsmScanMacroDefinitions) {
+    {
+        std::ofstream asm_file{"scan_macros.asm", std::ios::trunc};
+        asm_file << "macro first(a)\n    lda #<a>\nendmacro\n"
+                    "  MACRO second()\nendmacro ; macro commented()\n"
+                    "%first(1)\nincsrc \"scan_macros_guarded.asm\"\n";
+        std::ofstream guarded_file{"scan_macros_guarded.asm", std::ios::trunc};
+        guarded_file << "includeonce\nmacro guarded()\nendmacro\n";
+    }
+    asm_references refs = scan_asm_file("scan_macros.asm");
+    EXPECT_EQ(refs.macro_definitions, (std::vector<std::string>{"first", "second"}));
+    EXPECT_EQ(refs.macro_calls, std::vector<std::string>{"first"});
+    EXPECT_FALSE(refs.include_once);
+    ASSERT_EQ(refs.includes.size(), 1u);
+    refs = scan_asm_file(refs.includes[0].file);
+    EXPECT_EQ(refs.macro_definitions, std::vector<std::string>{"guarded"});
+    EXPECT_TRUE(refs.include_once);
+}
+
+TEST(PixiUnitTests, PlainDefineFiles) {
+    {
+        std::ofstream plain_file{"plain_defines.asm", std::ios::trunc};
+        plain_file << "include\n; just defines\n!ram = $7FAB10 ; comment\n!flag ?= 1\n!text = \"a b\"\n";
+        std::ofstream code_file{"code_defines.asm", std::ios::trunc};
+        code_file << "macro unused()\n    lda !inside\nendmacro\nif !sa1\n!ram = $7FAB20\nendif\n";
+    }
+    define_file plain = read_define_file("plain_defines.asm");
+    EXPECT_TRUE(plain.plain);
+    ASSERT_EQ(plain.assignments.size(), 3u);
+    EXPECT_EQ(plain.assignments[0].name, "ram");
+    EXPECT_EQ(plain.assignments[0].value, "$7FAB10");
+    EXPECT_TRUE(plain.assignments[1].conditional);
+    EXPECT_EQ(plain.assignments[2].value, "a b");
+    define_file code = read_define_file("code_defines.asm");
+    EXPECT_FALSE(code.plain);
+    EXPECT_TRUE(code.mentions.contains("sa1"));
+    EXPECT_FALSE(code.mentions.contains("inside"));
+
+    // plain_defines.asm can't be evaluated ahead of code_defines.asm, which assigns !ram itself
+    const definedata config_defines[]{{.name = "flag", .contents = "0"}};
+    const std::vector<std::string> files{"code_defines.asm", "plain_defines.asm"};
+    DefinePreludes preludes{};
+    preludes.begin(config_defines, files);
+    const auto& late = preludes.folder("missing/_header.asm");
+    EXPECT_EQ(late.includes, (std::vector<std::string>{"code_defines.asm", "plain_defines.asm", "shared.asm",
+                                                        "missing/_header.asm"}));
+    ASSERT_EQ(late.defines.size(), 1u);
+    preludes.begin(config_defines, std::vector<std::string>{"plain_defines.asm", "code_defines.asm"});
+    const auto& early = preludes.folder("missing/_header.asm");
+    EXPECT_EQ(early.includes.front(), "code_defines.asm");
+    ASSERT_EQ(early.defines.size(), 3u);
+    EXPECT_STREQ(early.defines[0].contents, "0");
+    EXPECT_STREQ(early.defines[1].name, "ram");
+    EXPECT_STREQ(early.defines[2].contents, "a b");
+}
+
+TEST(PixiUnitTests, SymbolNamespaces) {
+    SymbolDatabase symbols{};
+    symbols.enable();
+    const std::vector<std::string> routines{"GetDrawInfo"};
+    symbols.set_routines(routines);
+    const labeldata single[]{{"SPRITE_ENTRY_1", 0x108000}, {"main", 0x108010}, {"GetDrawInfo_loop", 0x109004}};
+    const SymbolDatabase::sprite_namespace entry{.number = 1, .name = symbol_namespace("sprites/shell.asm")};
+    symbols.add(single, entry.name, std::span{&entry, 1});
+    // what --onepatch gives back for two sprites, the routine was already inserted by the first patch
+    const labeldata batch[]{{"SPRITE_ENTRY_2_main", 0x10A000}, {"SPRITE_ENTRY_3", 0x10B000},
+                            {"GetDrawInfo_loop", 0x109004}};
+    const std::vector<SymbolDatabase::sprite_namespace> namespaces{{.number = 2, .name = "cluster_a"},
+                                                                   {.number = 3, .name = "cluster_b"}};
+    symbols.add(batch, {}, namespaces);
+    const auto sorted = symbols.sorted();
+    std::vector<std::string> names{};
+    for (const auto& sym : sorted)
+        names.push_back(sym.name);
+    EXPECT_EQ(names, (std::vector<std::string>{"sprites_shell", "sprites_shell_main", "GetDrawInfo_loop",
+                                               "cluster_a_main", "cluster_b"}));
+}
+
+TEST(PixiUnitTests, RatsIndexScan) {
+    std::vector<unsigned char> rom(0x10000, 0x00);
+    auto put_tag = [&](size_t at, uint16_t size, uint16_t check) {
+        memcpy(rom.data() + at, "STAR", 4);
+        rom[at + 4] = size & 0xFF;
+        rom[at + 5] = size >> 8;
+        rom[at + 6] = check & 0xFF;
+        rom[at + 7] = check >> 8;
+    };
+    put_tag(0x1003, 0x00FF, 0xFF00);
+    // protected by the tag before it, not a tag
+    put_tag(0x1010, 0x0010, 0xFFEF);
+    put_tag(0x8000, 0x0020, 0x10000 - 0x0020);
+    put_tag(0x9000, 0x1234, 0x1234);
+    put_tag(0xFFF0, 0x0100, 0xFEFF);
+    RatsIndex index{};
+    index.build(rom, 0x200);
+    ASSERT_EQ(index.tags().size(), 4u);
+    ASSERT_EQ(index.blocks().size(), 2u);
+    EXPECT_EQ(index.tags()[0].pc, 0x1203);
+    EXPECT_EQ(index.tags()[0].size, 0x100);
+    EXPECT_EQ(index.tags()[1].type, RatsIndex::kind::sprite_tool);
+    EXPECT_EQ(index.tags()[2].type, RatsIndex::kind::bad);
+    // runs past the end of the ROM
+    EXPECT_EQ(index.tags()[3].type, RatsIndex::kind::bad);
+    EXPECT_EQ(index.containing(0x1203), &index.blocks()[0]);
+    EXPECT_EQ(index.containing(0x1302), &index.blocks()[0]);
+    EXPECT_EQ(index.containing(0x130B), nullptr);
+    EXPECT_EQ(index.containing(0x1202), nullptr);
+    EXPECT_EQ(index.protecting(0x120B), &index.blocks()[0]);
+    EXPECT_EQ(index.protecting(0x1210), nullptr);
+    // only valid tags protect data that pixi put there
+    EXPECT_EQ(index.protecting(0x8208), nullptr);
+    EXPECT_EQ(find_rats_tag(rom, 0x1004), 0x1010u);
+}
+
+TEST(PixiUnitTests, FreespaceMapOwners) {
+    // 1MB headerless ROM, everything from bank $10 on is free except for the tagged blocks
+    std::vector<unsigned char> data(0x100000, 0xAA);
+    std::fill(data.begin() + 0x80000, data.end(), 0x00);
+    auto put_block = [&](size_t at, uint16_t size) {
+        memcpy(data.data() + at, "STAR", 4);
+        const uint16_t tag_size = size - 1;
+        data[at + 4] = tag_size & 0xFF;
+        data[at + 5] = tag_size >> 8;
+        data[at + 6] = (tag_size ^ 0xFFFF) & 0xFF;
+        data[at + 7] = (tag_size ^ 0xFFFF) >> 8;
+        std::fill_n(data.begin() + at + 8, size, 0x55);
+    };
+    put_block(0x80000, 0x100);
+    // the sprite's code protects its data at $108408
+    memcpy(data.data() + 0x80008, "PROT\x08\x84\x10STOP", 11);
+    put_block(0x80400, 0x40);
+    put_block(0x81000, 0x20);
+    const fs::path rom_path = fs::temp_directory_path() / "pixi_freespace_test.smc";
+    {
+        std::ofstream rom_file{rom_path, std::ios::binary};
+        rom_file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    }
+    ROM rom{};
+    ASSERT_TRUE(rom.open(rom_path.generic_string()));
+    RatsIndex rats{};
+    rats.build(rom);
+    FreespaceMap map{};
+    map.enable();
+    map.claim(0x80010, FreespaceMap::owner::sprite, "sprites/shell.asm");
+    map.build(rats, rom);
+    ASSERT_EQ(map.banks().size(), 0x10u);
+    const auto& bank = map.banks()[0];
+    ASSERT_EQ(bank.blocks.size(), 3u);
+    EXPECT_EQ(bank.blocks[0].type, FreespaceMap::owner::sprite);
+    EXPECT_EQ(bank.blocks[1].type, FreespaceMap::owner::sprite);
+    EXPECT_EQ(bank.blocks[1].name, "sprites/shell.asm");
+    EXPECT_EQ(bank.blocks[2].type, FreespaceMap::owner::foreign);
+    EXPECT_EQ(bank.used, 0x108 + 0x48 + 0x28);
+    EXPECT_EQ(bank.free, 0x8000 - bank.used);
+    EXPECT_EQ(bank.largest_free, 0x8000 - 0x1028);
+    EXPECT_EQ(map.free_bytes(), 0x80000 - bank.used);
+    rom.close();
+    fs::remove(rom_path);
+}
+
 TEST(PixiUnitTests, JsonParsing) {
     WinCheckMemLeak leakchecker{};
     pixi_sprite_t json_spr = pixi_parse_json_sprite("test.json");
@@ -149,6 +592,111 @@ TEST(PixiUnitTests, JsonParsing) {
     pixi_sprite_free(json_spr);
 }
 
+TEST(PixiUnitTests, JsonParsingEscapesAndMissingProperties) {
+    WinCheckMemLeak leakchecker{};
+    std::string contents{};
+    {
+        std::ifstream original{"test.json"};
+        contents.assign(std::istreambuf_iterator<char>{original}, std::istreambuf_iterator<char>{});
+    }
+    auto replace = [&](std::string_view from, std::string_view to) {
+        const size_t pos = contents.find(from);
+        ASSERT_NE(pos, std::string::npos);
+        contents.replace(pos, from.size(), to);
+    };
+    replace("\"Additional Byte Count (extra bit clear)\": 0", "\"Additional Byte Count (extra bit clear)\": 3");
+    replace("\"Extra Property Byte 3\": 0,", "");
+    replace("\"Sumo Brother Disassembly\"", "\"Sumo \\\"Brother\\\"\\tDisassembly\\u0021\"");
+    {
+        std::ofstream modified{"JsonParsingEscapes.json"};
+        modified << contents;
+    }
+    // a missing extra property byte is only a warning
+    pixi_sprite_t json_spr = pixi_parse_json_sprite("JsonParsingEscapes.json");
+    ASSERT_NE(json_spr, nullptr);
+    EXPECT_EQ(pixi_sprite_byte_count(json_spr), 3);
+    int size = 0;
+    pixi_collection_array collections = pixi_sprite_collections(json_spr, &size);
+    EXPECT_EQ(size, 1);
+    EXPECT_STREQ(pixi_collection_name(collections[0], &size), "Sumo \"Brother\"\tDisassembly!");
+    pixi_free_collection_array(collections);
+    pixi_sprite_free(json_spr);
+}
+
+TEST(PixiUnitTests, TweakJsonRoundTrip) {
+    WinCheckMemLeak leakchecker{};
+    pixi_sprite_t cfg_spr = pixi_parse_cfg_sprite("test.cfg");
+    ASSERT_NE(cfg_spr, nullptr);
+    int size = 0;
+    pixi_byte_array cfg_tweak = pixi_sprite_table_tweak(pixi_sprites_sprite_table(cfg_spr), &size);
+    const std::vector<unsigned char> expected(cfg_tweak, cfg_tweak + size);
+    pixi_string tweaks = pixi_generate_tweak_json(cfg_spr);
+    const std::string tweak_json{tweaks};
+    pixi_free_string(tweaks);
+    pixi_sprite_free(cfg_spr);
+    EXPECT_NE(tweak_json.find("\"Palette\": 1"), std::string::npos);
+
+    // later keys win, so appending the generated objects to test.json replaces its own
+    std::string contents{};
+    {
+        std::ifstream original{"test.json"};
+        contents.assign(std::istreambuf_iterator<char>{original}, std::istreambuf_iterator<char>{});
+    }
+    ASSERT_EQ(tweak_json.front(), '{');
+    contents.erase(contents.find_last_of('}'));
+    contents += ",\n" + tweak_json.substr(1);
+    {
+        std::ofstream converted{"TweakJsonRoundTrip.json"};
+        converted << contents;
+    }
+    pixi_sprite_t json_spr = pixi_parse_json_sprite("TweakJsonRoundTrip.json");
+    ASSERT_NE(json_spr, nullptr);
+    pixi_byte_array json_tweak = pixi_sprite_table_tweak(pixi_sprites_sprite_table(json_spr), &size);
+    EXPECT_EQ(std::vector<unsigned char>(json_tweak, json_tweak + size), expected);
+    pixi_sprite_free(json_spr);
+}
+
+TEST(PixiUnitTests, Base64) {
+    // RFC 4648 test vectors
+    const std::pair<std::string_view, std::string_view> vectors[]{
+        {"", ""}, {"f", "Zg=="}, {"fo", "Zm8="}, {"foo", "Zm9v"}, {"foob", "Zm9vYg=="}, {"fooba", "Zm9vYmE="},
+        {"foobar", "Zm9vYmFy"}};
+    for (const auto& [text, encoded] : vectors) {
+        const std::span<const unsigned char> bytes{reinterpret_cast<const unsigned char*>(text.data()), text.size()};
+        EXPECT_EQ(base64_encode(bytes), encoded);
+        std::string decoded(text.size(), '\0');
+        EXPECT_EQ(base64_decoded_size(encoded), text.size());
+        std::span out{reinterpret_cast<unsigned char*>(decoded.data()), decoded.size()};
+        EXPECT_TRUE(base64_decode(encoded, out));
+        EXPECT_EQ(decoded, text);
+    }
+
+    // long enough for the vectorized paths, with a partial tile at the end that has to be dropped
+    std::vector<unsigned char> bytes(8 * 100 + 5);
+    for (size_t i = 0; i < bytes.size(); i++)
+        bytes[i] = static_cast<unsigned char>(i * 7 + i / 3);
+    const std::string encoded = base64_encode(bytes);
+    std::vector<unsigned char> decoded(bytes.size());
+    ASSERT_TRUE(base64_decode(encoded, std::span{decoded}));
+    EXPECT_EQ(decoded, bytes);
+    std::vector<std::array<unsigned char, 8>> tiles(bytes.size() / 8);
+    ASSERT_TRUE(base64_decode(encoded, std::span{tiles}));
+    EXPECT_TRUE(std::equal(bytes.begin(), bytes.begin() + 8 * 100, tiles.front().begin()));
+
+    // anything outside of the alphabet is rejected wherever it is, even past what's being decoded
+    for (size_t i = 0; i < encoded.size(); i += 13) {
+        std::string broken = encoded;
+        broken[i] = '\n';
+        EXPECT_FALSE(base64_decode(broken, std::span{tiles})) << "at " << i;
+    }
+    for (std::string_view broken : {"A"sv, "AA="sv, "AAAA="sv, "A==="sv, "AA==AA=="sv}) {
+        std::vector<unsigned char> out{};
+        EXPECT_FALSE(base64_decoded_size(broken) && base64_decode(broken, std::span{out})) << broken;
+    }
+    std::vector<unsigned char> too_long(4);
+    EXPECT_FALSE(base64_decode("Zm9v", std::span{too_long}));
+}
+
 TEST(PixiUnitTests, PixiFullRun) {
     std::string_view list_contents{"00 test.json\n01 test.cfg"};
     try {
@@ -226,6 +774,408 @@ TEST(PixiUnitTests, PixiFullRunPerLevel) {
     EXPECT_EQ(pixi_run(sizeof(argv) / sizeof(argv[0]), argv, false), EXIT_SUCCESS);
 }
 
+TEST(PixiUnitTests, PixiIncrementalRun) {
+    // dotted.cfg uses test.asm through ./test.asm, it has to be kept as the same file
+    std::string_view list_contents{"00 test.json\n01 test.cfg\n02 dotted.cfg"};
+    try {
+        copy_file_wrap("base.smc", "PixiIncrementalRun.smc");
+        copy_file_wrap("test.json", "sprites/test.json");
+        copy_file_wrap("test.asm", "sprites/test.asm");
+        copy_file_wrap("test.cfg", "sprites/test.cfg");
+        fs::remove("PixiIncrementalRun.pixiinc");
+        std::ofstream cfg{"sprites/dotted.cfg", std::ios::trunc};
+        cfg << "01\n36\n00 0D 93 01 11 40\n00 00\n./test.asm\n02:03\n";
+    } catch (const fs::filesystem_error& error) {
+        std::cout << "Error happened while copying the files: " << error.what() << '\n';
+        EXPECT_FALSE(true);
+        return;
+    }
+    {
+        std::ofstream list_file{"list.txt", std::ios::trunc};
+        list_file << list_contents;
+    }
+    const char* argv[] = {"--incremental", "PixiIncrementalRun.smc"};
+    ASSERT_EQ(pixi_run(sizeof(argv) / sizeof(argv[0]), argv, false), EXIT_SUCCESS);
+    EXPECT_TRUE(fs::exists("PixiIncrementalRun.pixiinc"));
+    // second run, nothing changed so the (only) asm file should be kept in place
+    ASSERT_EQ(pixi_run(sizeof(argv) / sizeof(argv[0]), argv, false), EXIT_SUCCESS);
+    int size = 0;
+    pixi_string_array output = pixi_output(&size);
+    EXPECT_TRUE(std::any_of(output, output + size, [](const char* str) {
+        return std::string_view{str}.starts_with("1 sprites unchanged since the last insertion");
+    }));
+}
+
+TEST(PixiUnitTests, PixiIncrementalCleansUnusedRoutines) {
+    // inc_a calls SubHorzPos, once it's gone from the list the routine isn't reached anymore and gets cleaned
+    for (std::string_view name : {"inc_a"sv, "inc_b"sv}) {
+        std::ofstream cfg{"sprites/" + std::string{name} + ".cfg", std::ios::trunc};
+        cfg << "01\n36\n00 0D 93 01 11 40\n00 00\n" << name << ".asm\n00:00\n";
+        std::ofstream sprite{"sprites/" + std::string{name} + ".asm", std::ios::trunc};
+        sprite << "print \"INIT \",pc\nprint \"MAIN \",pc\n";
+        if (name == "inc_a")
+            sprite << "%SubHorzPos()\n";
+        sprite << "RTL\n";
+    }
+    try {
+        copy_file_wrap("base.smc", "PixiIncrementalRoutines.smc");
+        fs::remove("PixiIncrementalRoutines.pixiinc");
+    } catch (const fs::filesystem_error& error) {
+        std::cout << "Error happened while copying the files: " << error.what() << '\n';
+        EXPECT_FALSE(true);
+        return;
+    }
+    // the pointers in the routine table at $03E05C
+    auto routine_table = [] {
+        std::ifstream rom_file{"PixiIncrementalRoutines.smc", std::ios::binary};
+        const auto header = static_cast<std::streamoff>(fs::file_size("PixiIncrementalRoutines.smc") & 0x7FFF);
+        std::string table(310 * 3, '\0');
+        rom_file.seekg(header + 0x1E05C);
+        rom_file.read(table.data(), static_cast<std::streamsize>(table.size()));
+        return table;
+    };
+    auto contains_pointer = [](const std::string& table, int pointer) {
+        for (size_t i = 0; i + 3 <= table.size(); i += 3) {
+            const int entry = static_cast<unsigned char>(table[i]) | (static_cast<unsigned char>(table[i + 1]) << 8) |
+                              (static_cast<unsigned char>(table[i + 2]) << 16);
+            if (entry == pointer)
+                return true;
+        }
+        return false;
+    };
+    const char* argv[] = {"-d", "--incremental", "PixiIncrementalRoutines.smc"};
+    {
+        std::ofstream list_file{"list.txt", std::ios::trunc};
+        list_file << "00 inc_a.cfg\n01 inc_b.cfg\n";
+    }
+    ASSERT_EQ(pixi_run(sizeof(argv) / sizeof(argv[0]), argv, false), EXIT_SUCCESS);
+    int size = 0;
+    pixi_string_array output = pixi_output(&size);
+    int routine = -1;
+    for (int i = 0; i < size; i++) {
+        if (const char* at = strstr(output[i], "Routine: SubHorzPos inserted at $"))
+            routine = static_cast<int>(strtol(at + strlen("Routine: SubHorzPos inserted at $"), nullptr, 16));
+    }
+    ASSERT_NE(routine, -1);
+    EXPECT_TRUE(contains_pointer(routine_table(), routine));
+
+    {
+        std::ofstream list_file{"list.txt", std::ios::trunc};
+        list_file << "01 inc_b.cfg\n";
+    }
+    ASSERT_EQ(pixi_run(sizeof(argv) / sizeof(argv[0]), argv, false), EXIT_SUCCESS);
+    output = pixi_output(&size);
+    EXPECT_TRUE(std::any_of(output, output + size, [](const char* str) {
+        return std::string_view{str}.starts_with("1 sprites unchanged since the last insertion");
+    }));
+    EXPECT_FALSE(contains_pointer(routine_table(), routine));
+}
+
+TEST(PixiUnitTests, PixiDependencyGraph) {
+    std::string_view list_contents{"00 test.json\n01 test.cfg"};
+    try {
+        copy_file_wrap("base.smc", "PixiDependencyGraph.smc");
+        copy_file_wrap("test.json", "sprites/test.json");
+        copy_file_wrap("test.asm", "sprites/test.asm");
+        copy_file_wrap("test.cfg", "sprites/test.cfg");
+    } catch (const fs::filesystem_error& error) {
+        std::cout << "Error happened while copying the files: " << error.what() << '\n';
+        EXPECT_FALSE(true);
+        return;
+    }
+    {
+        std::ofstream list_file{"list.txt", std::ios::trunc};
+        list_file << list_contents;
+    }
+    const char* argv[] = {"--deps", "PixiDependencyGraph.smc"};
+    ASSERT_EQ(pixi_run(sizeof(argv) / sizeof(argv[0]), argv, false), EXIT_SUCCESS);
+    EXPECT_TRUE(fs::exists("PixiDependencyGraph.pixideps"));
+    // every sprite gets its folder's _header.asm
+    int size = 0;
+    pixi_string_array dependents = pixi_dependents("sprites/_header.asm", &size);
+    ASSERT_EQ(size, 1);
+    EXPECT_EQ(std::string_view{dependents[0]}, "sprites/test.asm"sv);
+    pixi_string_array dependencies = pixi_dependencies("sprites/test.asm", &size);
+    EXPECT_TRUE(std::any_of(dependencies, dependencies + size,
+                            [](const char* str) { return std::string_view{str} == "sprites/_header.asm"sv; }));
+    ASSERT_EQ(pixi_load_dependency_graph("PixiDependencyGraph.pixideps"), 1);
+    pixi_dependents("sprites/_header.asm", &size);
+    EXPECT_EQ(size, 1);
+}
+
+TEST(PixiUnitTests, PixiTraceRun) {
+    std::string_view list_contents{"00 test.json\n01 test.cfg"};
+    try {
+        copy_file_wrap("base.smc", "PixiTraceRun.smc");
+        copy_file_wrap("test.json", "sprites/test.json");
+        copy_file_wrap("test.asm", "sprites/test.asm");
+        copy_file_wrap("test.cfg", "sprites/test.cfg");
+    } catch (const fs::filesystem_error& error) {
+        std::cout << "Error happened while copying the files: " << error.what() << '\n';
+        EXPECT_FALSE(true);
+        return;
+    }
+    {
+        std::ofstream list_file{"list.txt", std::ios::trunc};
+        list_file << list_contents;
+    }
+    const char* argv[] = {"--trace", "PixiTraceRun.json", "PixiTraceRun.smc"};
+    ASSERT_EQ(pixi_run(sizeof(argv) / sizeof(argv[0]), argv, false), EXIT_SUCCESS);
+    std::ifstream trace_file{"PixiTraceRun.json"};
+    ASSERT_TRUE(trace_file.is_open());
+    std::string trace{std::istreambuf_iterator<char>{trace_file}, std::istreambuf_iterator<char>{}};
+    EXPECT_NE(trace.find(R"("traceEvents")"), std::string::npos);
+    EXPECT_NE(trace.find(R"("name":"populate_sprite_list")"), std::string::npos);
+    EXPECT_NE(trace.find(R"("name":"main.asm")"), std::string::npos);
+    // every sprite gets its own asar_patch_ex span
+    EXPECT_NE(trace.find(R"("sprite":1)"), std::string::npos);
+}
+
+TEST(PixiUnitTests, PixiEmitPatchRun) {
+    std::string_view list_contents{"00 test.json\n01 test.cfg"};
+    try {
+        copy_file_wrap("base.smc", "PixiEmitPatchRun.smc");
+        fs::remove("PixiEmitPatchRun.extmod");
+        copy_file_wrap("test.json", "sprites/test.json");
+        copy_file_wrap("test.asm", "sprites/test.asm");
+        copy_file_wrap("test.cfg", "sprites/test.cfg");
+    } catch (const fs::filesystem_error& error) {
+        std::cout << "Error happened while copying the files: " << error.what() << '\n';
+        EXPECT_FALSE(true);
+        return;
+    }
+    {
+        std::ofstream list_file{"list.txt", std::ios::trunc};
+        list_file << list_contents;
+    }
+    const auto original_write_time = fs::last_write_time("PixiEmitPatchRun.smc");
+    const char* argv[] = {"--emit-patch", "PixiEmitPatchRun.bps", "--emit-patch-only", "PixiEmitPatchRun.smc"};
+    ASSERT_EQ(pixi_run(sizeof(argv) / sizeof(argv[0]), argv, false), EXIT_SUCCESS);
+    int size = 0;
+    pixi_rom_change_array changes = pixi_rom_changes(&size);
+    ASSERT_GT(size, 0);
+    bool sprite_attributed = false;
+    for (int i = 0; i < size; i++) {
+        EXPECT_GT(pixi_rom_change_size(changes[i]), 0);
+        if (i > 0) {
+            EXPECT_GT(pixi_rom_change_offset(changes[i]), pixi_rom_change_offset(changes[i - 1]));
+        }
+        int source_size = 0;
+        std::string_view source{pixi_rom_change_source(changes[i], &source_size)};
+        sprite_attributed |= source.find("test.asm") != std::string_view::npos;
+    }
+    EXPECT_TRUE(sprite_attributed);
+    std::ifstream patch_file{"PixiEmitPatchRun.bps", std::ios::binary};
+    ASSERT_TRUE(patch_file.is_open());
+    char magic[4]{};
+    patch_file.read(magic, 4);
+    EXPECT_EQ(std::string_view(magic, 4), "BPS1");
+    // the ROM file was never written, and there's no restore point for Lunar Magic
+    auto read_all = [](const char* path) {
+        std::ifstream file{path, std::ios::binary};
+        return std::string{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    };
+    EXPECT_EQ(fs::last_write_time("PixiEmitPatchRun.smc"), original_write_time);
+    EXPECT_TRUE(read_all("PixiEmitPatchRun.smc") == read_all("base.smc"));
+    EXPECT_FALSE(fs::exists("PixiEmitPatchRun.extmod"));
+}
+
+#ifndef _WIN32
+TEST(PixiUnitTests, PixiServeRun) {
+    std::string_view list_contents{"00 test.json\n01 test.cfg"};
+    try {
+        copy_file_wrap("base.smc", "PixiServeRun.smc");
+        copy_file_wrap("test.json", "sprites/test.json");
+        copy_file_wrap("test.asm", "sprites/test.asm");
+        copy_file_wrap("test.cfg", "sprites/test.cfg");
+    } catch (const fs::filesystem_error& error) {
+        std::cout << "Error happened while copying the files: " << error.what() << '\n';
+        EXPECT_FALSE(true);
+        return;
+    }
+    {
+        std::ofstream list_file{"list.txt", std::ios::trunc};
+        list_file << list_contents;
+    }
+    const char* argv[] = {"--serve", "PixiServeRun.sock"};
+    std::future<int> server = std::async(std::launch::async, [&] { return pixi_run(2, argv, false); });
+
+    auto send_request = [](std::string_view request) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, "PixiServeRun.sock");
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        // the server might still be starting up
+        for (int attempt = 0; attempt < 100; attempt++) {
+            if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds{50});
+        }
+        std::string reply{};
+        if (send(fd, request.data(), request.size(), 0) == static_cast<ssize_t>(request.size())) {
+            char buffer[4096];
+            for (ssize_t len; (len = recv(fd, buffer, sizeof(buffer), 0)) > 0;) {
+                reply.append(buffer, static_cast<size_t>(len));
+            }
+        }
+        close(fd);
+        return reply;
+    };
+    // a client that connects and sends nothing is answered with an error once it times out
+    EXPECT_NE(send_request("").find("Timed out waiting for the request"), std::string::npos);
+    // the second insertion reuses what the first one parsed
+    for (int i = 0; i < 2; i++) {
+        std::string reply = send_request(R"({"args": ["PixiServeRun.smc"]})" "\n");
+        EXPECT_TRUE(reply.starts_with(R"({"error":"","exit_code":0,)")) << reply;
+    }
+    send_request(R"({"command": "shutdown"})" "\n");
+    ASSERT_EQ(server.wait_for(std::chrono::seconds{30}), std::future_status::ready);
+    EXPECT_EQ(server.get(), EXIT_SUCCESS);
+    EXPECT_FALSE(fs::exists("PixiServeRun.sock"));
+}
+
+TEST(PixiUnitTests, PixiJobsRejectedResult) {
+    // with 2 workers, 00 and 02 are assembled by the first one and 01 and 03 by the second one.
+    // 02 includes a file through a define, so which routines the list calls can't be told before assembling it and
+    // the workers insert SubHorzPos themselves. 01 inserts it again in its worker so it collides with the table
+    // entry 00 wrote and gets rejected, 03 calls the copy 01 inserted in that worker and has to be reassembled too.
+    constexpr std::array<std::string_view, 4> names{"jobs_a", "jobs_b", "jobs_c", "jobs_d"};
+    std::string list_contents{};
+    for (size_t i = 0; i < names.size(); i++) {
+        const std::string name{names[i]};
+        std::ofstream cfg{"sprites/" + name + ".cfg", std::ios::trunc};
+        cfg << "01\n36\n00 0D 93 01 11 40\n00 00\n" << name << ".asm\n00:00\n";
+        std::ofstream sprite{"sprites/" + name + ".asm", std::ios::trunc};
+        sprite << "print \"INIT \",pc\nprint \"MAIN \",pc\n";
+        if (i != 2)
+            sprite << "%SubHorzPos()\nprint \"ROUTINE \",hex(SubHorzPos, 6)\n";
+        else
+            sprite << "!jobs_include = \"jobs_include.asm\"\nincsrc !jobs_include\n";
+        sprite << "RTL\n";
+        list_contents += "0" + std::to_string(i) + " " + name + ".cfg\n";
+    }
+    {
+        std::ofstream include{"sprites/jobs_include.asm", std::ios::trunc};
+        std::ofstream list_file{"list.txt", std::ios::trunc};
+        list_file << list_contents;
+    }
+    try {
+        copy_file_wrap("base.smc", "PixiJobsRejectedResult.smc");
+    } catch (const fs::filesystem_error& error) {
+        std::cout << "Error happened while copying the files: " << error.what() << '\n';
+        EXPECT_FALSE(true);
+        return;
+    }
+    const char* argv[] = {"-d", "--jobs", "2", "PixiJobsRejectedResult.smc"};
+    ASSERT_EQ(pixi_run(sizeof(argv) / sizeof(argv[0]), argv, false), EXIT_SUCCESS);
+    int size = 0;
+    pixi_string_array output = pixi_output(&size);
+    std::vector<std::string_view> inserted{};
+    std::vector<std::string_view> called{};
+    for (int i = 0; i < size; i++) {
+        std::string_view line{output[i]};
+        if (size_t at = line.find("Routine: SubHorzPos inserted at $"); at != std::string_view::npos)
+            inserted.push_back(line.substr(at + "Routine: SubHorzPos inserted at $"sv.size(), 6));
+        if (size_t at = line.find("ROUTINE "); at != std::string_view::npos)
+            called.push_back(line.substr(at + "ROUTINE "sv.size(), 6));
+    }
+    ASSERT_EQ(inserted.size(), 1u);
+    ASSERT_EQ(called.size(), 3u);
+    for (std::string_view address : called)
+        EXPECT_EQ(address, inserted[0]);
+    EXPECT_TRUE(std::any_of(output, output + size, [](const char* str) {
+        return std::string_view{str}.find("2 sprites committed from the workers, 2 had to be reassembled serially") !=
+               std::string_view::npos;
+    }));
+}
+TEST(PixiUnitTests, PixiJobsSharedRoutines) {
+    // the routines the list calls are inserted before the workers start, so none of them collide on the routine table
+    constexpr std::array<std::string_view, 4> names{"shared_a", "shared_b", "shared_c", "shared_d"};
+    std::string list_contents{};
+    for (size_t i = 0; i < names.size(); i++) {
+        const std::string name{names[i]};
+        std::ofstream cfg{"sprites/" + name + ".cfg", std::ios::trunc};
+        cfg << "01\n36\n00 0D 93 01 11 40\n00 00\n" << name << ".asm\n00:00\n";
+        std::ofstream sprite{"sprites/" + name + ".asm", std::ios::trunc};
+        sprite << "print \"INIT \",pc\nprint \"MAIN \",pc\n%SubHorzPos()\nprint \"ROUTINE \",hex(SubHorzPos, 6)\nRTL\n";
+        list_contents += "0" + std::to_string(i) + " " + name + ".cfg\n";
+    }
+    {
+        std::ofstream list_file{"list.txt", std::ios::trunc};
+        list_file << list_contents;
+    }
+    try {
+        copy_file_wrap("base.smc", "PixiJobsSharedRoutines.smc");
+    } catch (const fs::filesystem_error& error) {
+        std::cout << "Error happened while copying the files: " << error.what() << '\n';
+        EXPECT_FALSE(true);
+        return;
+    }
+    const char* argv[] = {"-d", "--jobs", "2", "PixiJobsSharedRoutines.smc"};
+    ASSERT_EQ(pixi_run(sizeof(argv) / sizeof(argv[0]), argv, false), EXIT_SUCCESS);
+    int size = 0;
+    pixi_string_array output = pixi_output(&size);
+    std::vector<std::string_view> inserted{};
+    std::vector<std::string_view> called{};
+    for (int i = 0; i < size; i++) {
+        std::string_view line{output[i]};
+        if (size_t at = line.find("Routine: SubHorzPos inserted at $"); at != std::string_view::npos)
+            inserted.push_back(line.substr(at + "Routine: SubHorzPos inserted at $"sv.size(), 6));
+        if (size_t at = line.find("ROUTINE "); at != std::string_view::npos)
+            called.push_back(line.substr(at + "ROUTINE "sv.size(), 6));
+    }
+    ASSERT_EQ(inserted.size(), 1u);
+    ASSERT_EQ(called.size(), 4u);
+    for (std::string_view address : called)
+        EXPECT_EQ(address, inserted[0]);
+    EXPECT_TRUE(std::any_of(output, output + size, [](const char* str) {
+        return std::string_view{str}.find("4 sprites committed from the workers, 0 had to be reassembled serially") !=
+               std::string_view::npos;
+    }));
+}
+#endif
+
+
+TEST(PixiUnitTests, PrefetchedSourcesServedFromMemory) {
+    // the sprite and the file it incsrc's are read while the list is parsed, asar has to find both of them in the
+    // memory files instead of reading them again, which it only does if their paths match pixi's exactly
+    {
+        std::ofstream cfg{"sprites/memread.cfg", std::ios::trunc};
+        cfg << "01\n36\n00 0D 93 01 11 40\n00 00\nmemread.asm\n00:00\n";
+        std::ofstream sprite{"sprites/memread.asm", std::ios::trunc};
+        sprite << "incsrc \"memread_helper.asm\"\nprint \"INIT \",pc\nprint \"MAIN \",pc\n%memread_rtl()\n";
+        std::ofstream helper{"sprites/memread_helper.asm", std::ios::trunc};
+        helper << "macro memread_rtl()\n\tRTL\nendmacro\n";
+        std::ofstream list_file{"list.txt", std::ios::trunc};
+        list_file << "00 memread.cfg\n";
+    }
+    try {
+        copy_file_wrap("base.smc", "PrefetchedSourcesServedFromMemory.smc");
+    } catch (const fs::filesystem_error& error) {
+        std::cout << "Error happened while copying the files: " << error.what() << '\n';
+        EXPECT_FALSE(true);
+        return;
+    }
+    const char* argv[] = {"-d", "PrefetchedSourcesServedFromMemory.smc"};
+    ASSERT_EQ(pixi_run(sizeof(argv) / sizeof(argv[0]), argv, false), EXIT_SUCCESS);
+    int size = 0;
+    pixi_string_array output = pixi_output(&size);
+    // the patch inserting the sprite reads at least the sprite and its helper
+    bool sprite_patch_read = false;
+    for (int i = 0; i < size; i++) {
+        std::string_view line{output[i]};
+        if (size_t at = line.find("Asar read "); at != std::string_view::npos) {
+            long long files = -1;
+            long long from_memory = -1;
+            const char* format = "Asar read %lld files for %*s %lld of them from memory";
+            ASSERT_EQ(sscanf(output[i] + at, format, &files, &from_memory), 2);
+            sprite_patch_read = sprite_patch_read || files >= 2;
+        }
+        EXPECT_EQ(line.find("from disk: sprites/memread"), std::string_view::npos) << line;
+    }
+    EXPECT_TRUE(sprite_patch_read);
+}
+
 TEST(PixiUnitTests, PixiFullRunPerLevelFail) {
     std::string_view list_contents{"BA test.json\nBA:012 test.json"};
     try {